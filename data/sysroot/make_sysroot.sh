@@ -0,0 +1,125 @@
+#!/bin/bash
+# This script writes a fake root directory for --sysroot (CPUX_SYSROOT), with the files read by CPU-X collectors
+# Usage: make_sysroot.sh DIR SOCKETS CORES THREADS [coretemp|k10temp] [BOARD_VENDOR] [BOARD_NAME]
+#   CORES is the number of cores by socket, THREADS the number of threads by core
+# E.g.: make_sysroot.sh /tmp/server-2s-512t 2 128 2 coretemp
+
+if [[ $# -lt 4 ]]; then
+	sed -n 3,5p "$0" | sed 's/^# //'
+	exit 1
+fi
+
+DIR=$1
+SOCKETS=$2
+CORES=$3
+THREADS=$4
+CHIP=${5:-coretemp}
+BOARD_VENDOR=${6:-CPU-X}
+BOARD_NAME=${7:-Fixture board}
+CPUS=$((SOCKETS * CORES * THREADS))
+
+
+#########################################################
+#			FUNCTIONS			#
+#########################################################
+
+# Write a file, and create its directory
+put() {
+	mkdir -p "$(dirname "$DIR/$1")"
+	echo "$2" > "$DIR/$1"
+}
+
+# Logical CPUs are numbered like Linux does: first thread of all cores, then second thread...
+make_cpus() {
+	local cpu socket core thread
+
+	put sys/devices/system/cpu/possible "0-$((CPUS - 1))"
+	put sys/devices/system/cpu/present  "0-$((CPUS - 1))"
+	for ((cpu = 0; cpu < CPUS; cpu++)); do
+		thread=$((cpu / (SOCKETS * CORES)))
+		socket=$(((cpu % (SOCKETS * CORES)) / CORES))
+		core=$((cpu % CORES))
+		put sys/devices/system/cpu/cpu$cpu/topology/physical_package_id $socket
+		put sys/devices/system/cpu/cpu$cpu/topology/die_id              0
+		put sys/devices/system/cpu/cpu$cpu/topology/core_id             $core
+		put sys/devices/system/cpu/cpu$cpu/cpufreq/cpuinfo_min_freq     800000
+		put sys/devices/system/cpu/cpu$cpu/cpufreq/cpuinfo_max_freq     3600000
+	done
+}
+
+# Ticks grow with CPU number, so each CPU has its own usage
+make_proc_stat() {
+	local cpu
+
+	{
+		echo "cpu  $((CPUS * 1000)) 0 $((CPUS * 500)) $((CPUS * 8000)) 0 0 0 0 0 0"
+		for ((cpu = 0; cpu < CPUS; cpu++)); do
+			echo "cpu$cpu $((1000 + cpu)) 0 500 $((8000 - cpu)) 0 0 0 0 0 0"
+		done
+		echo "intr 0"
+		echo "ctxt 0"
+		echo "btime 1500000000"
+		echo "processes 1"
+		echo "procs_running 1"
+		echo "procs_blocked 0"
+	} > "$DIR/proc/stat"
+}
+
+# One hwmon chip by socket (coretemp) or a single one (k10temp), and a thermal zone
+make_sensors() {
+	local socket core n
+
+	if [[ $CHIP == coretemp ]]; then
+		for ((socket = 0; socket < SOCKETS; socket++)); do
+			put sys/class/hwmon/hwmon$socket/name        coretemp
+			put sys/class/hwmon/hwmon$socket/temp1_label "Package id $socket"
+			put sys/class/hwmon/hwmon$socket/temp1_input $((50000 + socket * 1000))
+			for ((core = 0; core < CORES; core++)); do
+				n=$((core + 2))
+				put sys/class/hwmon/hwmon$socket/temp${n}_label "Core $core"
+				put sys/class/hwmon/hwmon$socket/temp${n}_input $((40000 + core * 100))
+			done
+		done
+	else
+		put sys/class/hwmon/hwmon0/name        k10temp
+		put sys/class/hwmon/hwmon0/temp1_label Tctl
+		put sys/class/hwmon/hwmon0/temp1_input 45000
+	fi
+	put sys/class/hwmon/hwmon$SOCKETS/name        nct6775
+	put sys/class/hwmon/hwmon$SOCKETS/in0_label   Vcore
+	put sys/class/hwmon/hwmon$SOCKETS/in0_input   1100
+	put sys/class/thermal/thermal_zone0/type x86_pkg_temp
+	put sys/class/thermal/thermal_zone0/temp 50000
+}
+
+make_system() {
+	put sys/devices/virtual/dmi/id/board_vendor  "$BOARD_VENDOR"
+	put sys/devices/virtual/dmi/id/board_name    "$BOARD_NAME"
+	put sys/devices/virtual/dmi/id/board_version "1.0"
+	put sys/devices/virtual/dmi/id/bios_vendor   "CPU-X"
+	put sys/devices/virtual/dmi/id/bios_version  "1.00"
+	put sys/devices/virtual/dmi/id/bios_date     "01/01/2020"
+	put proc/sys/kernel/ostype    Linux
+	put proc/sys/kernel/osrelease 5.15.0-fixture
+	put proc/sys/kernel/hostname  "$(basename "$DIR")"
+	put etc/os-release "NAME=\"CPU-X fixture\"
+PRETTY_NAME=\"CPU-X fixture ($SOCKETS sockets, $CPUS threads)\"
+ID=cpux"
+}
+
+
+#########################################################
+#			MAIN				#
+#########################################################
+
+if [[ -e $DIR && ! -e $DIR/sys/devices/system/cpu/possible ]]; then
+	echo "$DIR already exists, and it is not a fake root directory"
+	exit 1
+fi
+rm -rf "$DIR"
+mkdir -p "$DIR/proc"
+make_cpus
+make_proc_stat
+make_sensors
+make_system
+echo "$DIR: $SOCKETS socket(s), $((SOCKETS * CORES)) cores, $CPUS threads"
@@ -74,26 +74,26 @@ enum {
 	LODSB
 };
 
-static BMPGraph *graph = NULL;
-
-static bool use_sse2 = true;
-static bool use_sse4 = true;
-static bool is_intel = false;
-static bool is_amd = false;
-
-static uint32_t cpu_has_mmx = 0;
-static uint32_t cpu_has_sse = 0;
-static uint32_t cpu_has_sse2 = 0;
-static uint32_t cpu_has_sse3 = 0;
-static uint32_t cpu_has_ssse3 = 0;
-static uint32_t cpu_has_sse4a = 0;
-static uint32_t cpu_has_sse41 = 0;
-static uint32_t cpu_has_sse42 = 0;
-static uint32_t cpu_has_aes = 0;
-static uint32_t cpu_has_avx = 0;
-static uint32_t cpu_has_avx2 = 0;
-static uint32_t cpu_has_64bit = 0;
-static uint32_t cpu_has_xd = 0;
+static __thread BMPGraph *graph = NULL;
+
+static __thread bool use_sse2 = true;
+static __thread bool use_sse4 = true;
+static __thread bool is_intel = false;
+static __thread bool is_amd = false;
+
+static __thread uint32_t cpu_has_mmx = 0;
+static __thread uint32_t cpu_has_sse = 0;
+static __thread uint32_t cpu_has_sse2 = 0;
+static __thread uint32_t cpu_has_sse3 = 0;
+static __thread uint32_t cpu_has_ssse3 = 0;
+static __thread uint32_t cpu_has_sse4a = 0;
+static __thread uint32_t cpu_has_sse41 = 0;
+static __thread uint32_t cpu_has_sse42 = 0;
+static __thread uint32_t cpu_has_aes = 0;
+static __thread uint32_t cpu_has_avx = 0;
+static __thread uint32_t cpu_has_avx2 = 0;
+static __thread uint32_t cpu_has_64bit = 0;
+static __thread uint32_t cpu_has_xd = 0;
 
 //----------------------------------------
 // Parameters for the tests.
@@ -167,7 +167,7 @@ static int chunk_sizes[] = {
 	0
 };
 
-static double chunk_sizes_log2 [sizeof(chunk_sizes)/sizeof(int)];
+static __thread double chunk_sizes_log2 [sizeof(chunk_sizes)/sizeof(int)];
 
 //----------------------------------------------------------------------------
 // Name:	error
@@ -195,7 +195,7 @@ void error (char *s)
 //============================================================================
 
 #define MSGLEN 10000
-static wchar_t msg [MSGLEN];
+static __thread wchar_t msg [MSGLEN];
 
 void print (wchar_t *s)
 {
@@ -1833,6 +1833,7 @@ int bandwidth(void *p_data)
 	uint32_t cache_size = 0;
 	double total_amount = 0;
 	Labels *data        = p_data;
+	const unsigned bw_test = (data != NULL) ? data->opts->bw_test : opts->bw_test;
 
 	msg[0] = 0;
 
@@ -1840,7 +1841,7 @@ int bandwidth(void *p_data)
 		chunk_sizes_log2[i] = log2 (chunk_sizes[i]);
 	}
 
-	if(opts->verbose && first)
+	if(opts->verbose && __atomic_exchange_n(&first, false, __ATOMIC_RELAXED))
 	{
 		printf ("This is bandwidth (built-in with CPU-X) version %s.\n", RELEASE);
 		printf ("Copyright (C) 2005-2014 by Zack T Smith.\n\n");
@@ -1848,7 +1849,6 @@ int bandwidth(void *p_data)
 		printf ("It is provided AS-IS, use at your own risk.\n");
 		printf ("See the file COPYING for more information.\n\n");
 		fflush (stdout);
-		first = false;
 	}
 
 	uint32_t ecx = get_cpuid1_ecx ();
@@ -2022,7 +2022,7 @@ end_initialization:
 	//------------------------------------------------------------
 	// SSE2 sequential reads.
 	//
-	if (use_sse2 && (opts->bw_test == SEQ_128_R || BANDWIDTH_MODE)) {
+	if (use_sse2 && (bw_test == SEQ_128_R || BANDWIDTH_MODE)) {
 		BMPGraphing_new_line (graph, "Sequential 128-bit reads", RGB_RED);
 
 		newline ();
@@ -2039,7 +2039,7 @@ end_initialization:
 	//------------------------------------------------------------
 	// AVX sequential reads.
 	//
-	if (cpu_has_avx && (opts->bw_test == SEQ_256_R || BANDWIDTH_MODE)) {
+	if (cpu_has_avx && (bw_test == SEQ_256_R || BANDWIDTH_MODE)) {
 		BMPGraphing_new_line (graph, "Sequential 256-bit reads", RGB_TURQUOISE);
 
 		newline ();
@@ -2058,7 +2058,7 @@ end_initialization:
 	//------------------------------------------------------------
 	// SSE2 random reads.
 	//
-	if (use_sse2 && (opts->bw_test == RAND_128_R || BANDWIDTH_MODE)) {
+	if (use_sse2 && (bw_test == RAND_128_R || BANDWIDTH_MODE)) {
 		BMPGraphing_new_line (graph, "Random 128-bit reads", RGB_MAROON);
 
 		newline ();
@@ -2078,7 +2078,7 @@ end_initialization:
 	//------------------------------------------------------------
 	// SSE2 sequential writes that do not bypass the caches.
 	//
-	if (use_sse2 && (opts->bw_test == SEQ_128_CACHE_W || BANDWIDTH_MODE)) {
+	if (use_sse2 && (bw_test == SEQ_128_CACHE_W || BANDWIDTH_MODE)) {
 		BMPGraphing_new_line (graph, "Sequential 128-bit cache writes", RGB_PURPLE);
 
 		newline ();
@@ -2095,7 +2095,7 @@ end_initialization:
 	//------------------------------------------------------------
 	// AVX sequential writes that do not bypass the caches.
 	//
-	if (cpu_has_avx && (opts->bw_test == SEQ_256_CACHE_W || BANDWIDTH_MODE)) {
+	if (cpu_has_avx && (bw_test == SEQ_256_CACHE_W || BANDWIDTH_MODE)) {
 		BMPGraphing_new_line (graph, "Sequential 256-bit cache writes", RGB_PINK);
 
 		newline ();
@@ -2114,7 +2114,7 @@ end_initialization:
 	//------------------------------------------------------------
 	// SSE2 random writes that do not bypass the caches.
 	//
-	if (use_sse2 && (opts->bw_test == RAND_128_CACHE_W || BANDWIDTH_MODE)) {
+	if (use_sse2 && (bw_test == RAND_128_CACHE_W || BANDWIDTH_MODE)) {
 		BMPGraphing_new_line (graph, "Random 128-bit cache writes", RGB_NAVYBLUE);
 
 		newline ();
@@ -2134,7 +2134,7 @@ end_initialization:
 	//------------------------------------------------------------
 	// SSE4 sequential reads that do bypass the caches.
 	//
-	if (use_sse4 && (opts->bw_test == SEQ_128_BYPASS_R || BANDWIDTH_MODE)) {
+	if (use_sse4 && (bw_test == SEQ_128_BYPASS_R || BANDWIDTH_MODE)) {
 		BMPGraphing_new_line (graph, "Sequential 128-bit bypassing reads", RGB_BLACK);
 
 		newline ();
@@ -2151,7 +2151,7 @@ end_initialization:
 	//------------------------------------------------------------
 	// SSE4 random reads that do bypass the caches.
 	//
-	if (use_sse4 && (opts->bw_test == RAND_128_BYPASS_R || BANDWIDTH_MODE)) {
+	if (use_sse4 && (bw_test == RAND_128_BYPASS_R || BANDWIDTH_MODE)) {
 		BMPGraphing_new_line (graph, "Random 128-bit bypassing reads", 0xdeadbeef);
 
 		newline ();
@@ -2170,7 +2170,7 @@ end_initialization:
 	//------------------------------------------------------------
 	// SSE4 sequential writes that do bypass the caches.
 	//
-	if (use_sse4 && (opts->bw_test == SEQ_128_BYPASS_W || BANDWIDTH_MODE)) {
+	if (use_sse4 && (bw_test == SEQ_128_BYPASS_W || BANDWIDTH_MODE)) {
 		BMPGraphing_new_line (graph, "Sequential 128-bit bypassing writes", RGB_DARKORANGE);
 
 		newline ();
@@ -2190,7 +2190,7 @@ end_initialization:
 	// microcode bug that leads to a severe drop in performance
 	// in this part of the test.
 	//
-	if (cpu_has_avx && (opts->bw_test == SEQ_256_BYPASS_W || BANDWIDTH_MODE)) {
+	if (cpu_has_avx && (bw_test == SEQ_256_BYPASS_W || BANDWIDTH_MODE)) {
 		BMPGraphing_new_line (graph, "Sequential 256-bit bypassing writes", RGB_DARKOLIVEGREEN);
 
 		newline ();
@@ -2209,7 +2209,7 @@ end_initialization:
 	//------------------------------------------------------------
 	// SSE4 random writes that bypass the caches.
 	//
-	if (use_sse4 && (opts->bw_test == RAND_128_BYPASS_W || BANDWIDTH_MODE)) {
+	if (use_sse4 && (bw_test == RAND_128_BYPASS_W || BANDWIDTH_MODE)) {
 		BMPGraphing_new_line (graph, "Random 128-bit bypassing writes", RGB_LEMONYELLOW);
 
 		newline ();
@@ -2230,11 +2230,11 @@ end_initialization:
 	// Sequential non-SSE2 reads.
 	//
 #ifdef __x86_64__
-	if(opts->bw_test == SEQ_64_R || BANDWIDTH_MODE)
+	if(bw_test == SEQ_64_R || BANDWIDTH_MODE)
 	{
 		BMPGraphing_new_line (graph, "Sequential 64-bit reads", RGB_BLUE);
 #else
-	if(opts->bw_test == SEQ_32_R || BANDWIDTH_MODE)
+	if(bw_test == SEQ_32_R || BANDWIDTH_MODE)
 	{
 		BMPGraphing_new_line (graph, "Sequential 32-bit reads", RGB_BLUE);
 #endif
@@ -2253,11 +2253,11 @@ end_initialization:
 	// Random non-SSE2 reads.
 	//
 #ifdef __x86_64__
-	if(opts->bw_test == RAND_64_R || BANDWIDTH_MODE)
+	if(bw_test == RAND_64_R || BANDWIDTH_MODE)
 	{
 		BMPGraphing_new_line (graph, "Random 64-bit reads", RGB_CYAN);
 #else
-	if(opts->bw_test == RAND_32_R || BANDWIDTH_MODE)
+	if(bw_test == RAND_32_R || BANDWIDTH_MODE)
 	{
 		BMPGraphing_new_line (graph, "Random 32-bit reads", RGB_CYAN);
 #endif
@@ -2279,11 +2279,11 @@ end_initialization:
 	// Sequential non-SSE2 writes.
 	//
 #ifdef __x86_64__
-	if(opts->bw_test == SEQ_64_W || BANDWIDTH_MODE)
+	if(bw_test == SEQ_64_W || BANDWIDTH_MODE)
 	{
 		BMPGraphing_new_line (graph, "Sequential 64-bit writes", RGB_DARKGREEN);
 #else
-	if(opts->bw_test == SEQ_32_W || BANDWIDTH_MODE)
+	if(bw_test == SEQ_32_W || BANDWIDTH_MODE)
 	{
 		BMPGraphing_new_line (graph, "Sequential 32-bit writes", RGB_DARKGREEN);
 #endif
@@ -2303,11 +2303,11 @@ end_initialization:
 	// Random non-SSE2 writes.
 	//
 #ifdef __x86_64__
-	if(opts->bw_test == RAND_64_W || BANDWIDTH_MODE)
+	if(bw_test == RAND_64_W || BANDWIDTH_MODE)
 	{
 		BMPGraphing_new_line (graph, "Random 64-bit writes", RGB_GREEN);
 #else
-	if(opts->bw_test == RAND_32_W || BANDWIDTH_MODE)
+	if(bw_test == RAND_32_W || BANDWIDTH_MODE)
 	{
 		BMPGraphing_new_line (graph, "Random 32-bit writes", RGB_GREEN);
 #endif
@@ -2329,7 +2329,7 @@ end_initialization:
 	//------------------------------------------------------------
 	// SSE2 sequential copy.
 	//
-	if (use_sse2 && (opts->bw_test == SEQ_128_C || BANDWIDTH_MODE)) {
+	if (use_sse2 && (bw_test == SEQ_128_C || BANDWIDTH_MODE)) {
 		BMPGraphing_new_line (graph, "Sequential 128-bit copy", 0x8f8844);
 
 		newline ();
@@ -2346,7 +2346,7 @@ end_initialization:
 	//------------------------------------------------------------
 	// AVX sequential copy.
 	//
-	if (cpu_has_avx && (opts->bw_test == SEQ_256_C || BANDWIDTH_MODE)) {
+	if (cpu_has_avx && (bw_test == SEQ_256_C || BANDWIDTH_MODE)) {
 		BMPGraphing_new_line (graph, "Sequential 256-bit copy", RGB_CHARTREUSE);
 
 		newline ();
@@ -2367,7 +2367,7 @@ end_initialization:
 	//------------------------------------------------------------
 	// LODSQ 64-bit sequential reads.
 	//
-	if(opts->bw_test == SEQ_64_LR || BANDWIDTH_MODE)
+	if(bw_test == SEQ_64_LR || BANDWIDTH_MODE)
 	{
 		BMPGraphing_new_line (graph, "Sequential 64-bit LODSQ reads", RGB_GRAY6);
 
@@ -2386,7 +2386,7 @@ end_initialization:
 	//------------------------------------------------------------
 	// LODSD 32-bit sequential reads.
 	//
-	if(opts->bw_test == SEQ_32_LR || BANDWIDTH_MODE)
+	if(bw_test == SEQ_32_LR || BANDWIDTH_MODE)
 	{
 		BMPGraphing_new_line (graph, "Sequential 32-bit LODSD reads", RGB_GRAY8);
 
@@ -2404,7 +2404,7 @@ end_initialization:
 	//------------------------------------------------------------
 	// LODSW 16-bit sequential reads.
 	//
-	if(opts->bw_test == SEQ_16_LR || BANDWIDTH_MODE)
+	if(bw_test == SEQ_16_LR || BANDWIDTH_MODE)
 	{
 		BMPGraphing_new_line (graph, "Sequential 16-bit LODSW reads", RGB_GRAY10);
 
@@ -2422,7 +2422,7 @@ end_initialization:
 	//------------------------------------------------------------
 	// LODSB 64-bit sequential reads.
 	//
-	if(opts->bw_test == SEQ_8_LR || BANDWIDTH_MODE)
+	if(bw_test == SEQ_8_LR || BANDWIDTH_MODE)
 	{
 		BMPGraphing_new_line (graph, "Sequential 8-bit LODSB reads", RGB_GRAY12);
 
@@ -0,0 +1,388 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE cache.c
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <libintl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cache.h"
+#include "cpu-x.h"
+
+#ifndef __linux__
+# include <sys/types.h>
+# include <sys/time.h>
+# include <sys/sysctl.h>
+#endif
+
+
+/************************* Public functions *************************/
+
+/* Fill static labels from the on-disk cache */
+int cache_load(Labels *data)
+{
+	int err = 1;
+	char *path;
+
+	if(!data->opts->use_cache || data->opts->refresh_cache)
+		return 1;
+
+	/* Data collected by root is preferred, because it contains more informations */
+	if((path = cache_path(true)) != NULL)
+	{
+		err = cache_read(data, path, true);
+		free(path);
+	}
+
+	/* Root only trusts its own cache */
+	if(err && getuid() && (path = cache_path(false)) != NULL)
+	{
+		err = cache_read(data, path, false);
+		free(path);
+	}
+
+	return err;
+}
+
+/* Write static labels in the on-disk cache */
+int cache_save(Labels *data)
+{
+	int fd, err = 0;
+	size_t size;
+	char *path, *tmp, *dir, *buff;
+
+	if(!data->opts->use_cache)
+		return 0;
+
+	if((buff = cache_serialize(data, &size)) == NULL || (path = cache_path(!getuid())) == NULL)
+	{
+		free(buff);
+		return 1;
+	}
+
+	/* Write a temporary file, then replace the old cache atomically */
+	MSG_VERBOSE(_("Writing static data in cache %s"), path);
+	dir = strdup(path);
+	*strrchr(dir, '/') = '\0';
+	asprintf(&tmp, "%s.%i", path, getpid());
+	if(mkdir_p(dir) || (fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+		err = 3;
+	else
+	{
+		err  = write(fd, buff, size) != (ssize_t) size;
+		err += close(fd);
+		err += err ? unlink(tmp) : rename(tmp, path);
+	}
+
+	if(err)
+		MSG_ERROR(_("failed to write cache file %s"), path);
+
+	free(buff);
+	free(dir);
+	free(tmp);
+	free(path);
+	return err;
+}
+
+/* Serialize static labels (the caller frees the buffer) */
+char *cache_serialize(Labels *data, size_t *size)
+{
+	int i, t, last;
+	size_t pos;
+	char *buff, **values;
+	CacheHeader header = { .magic = CACHE_MAGIC, .version = CACHE_VERSION };
+	CacheRecord record;
+
+	if(cache_boot_id(header.boot_id, sizeof(header.boot_id)))
+		return NULL;
+
+	strncpy(header.prgver, PRGVER, sizeof(header.prgver) - 1);
+	header.flags          = getuid() ? 0 : CACHE_ROOT;
+	header.cpu_count      = data->cpu_count;
+	header.gpu_count      = data->gpu_count;
+	header.dimms_count    = data->dimms_count;
+	header.bus_freq       = metric_get(data, MT_BUSSPEED);
+	header.cpu_vendor_id  = data->l_data->cpu_vendor_id;
+	header.cpu_model      = data->l_data->cpu_model;
+	header.cpu_ext_model  = data->l_data->cpu_ext_model;
+	header.cpu_ext_family = data->l_data->cpu_ext_family;
+	header.l1_size        = data->w_data->l1_size;
+	header.l2_size        = data->w_data->l2_size;
+	header.l3_size        = data->w_data->l3_size;
+	header.l1d_size       = data->w_data->l1d_size;
+
+	/* Compute buffer size */
+	*size = sizeof(CacheHeader);
+	for(t = 0; t < LASTCACHETABLE; t++)
+	{
+		values = cache_table(data, t, &last);
+		for(i = 0; i < last; i++)
+		{
+			if(values[i] != NULL && values[i][0] != '\0' && !cache_is_dynamic(t, i))
+			{
+				*size += sizeof(CacheRecord) + strnlen(values[i], UINT16_MAX);
+				header.records++;
+			}
+		}
+	}
+	header.size = *size;
+
+	/* Serialize labels */
+	if((buff = malloc(*size)) == NULL)
+	{
+		MSG_ERROR(_("failed to allocate memory for cache"));
+		return NULL;
+	}
+	memcpy(buff, &header, sizeof(CacheHeader));
+	pos = sizeof(CacheHeader);
+	for(t = 0; t < LASTCACHETABLE; t++)
+	{
+		values = cache_table(data, t, &last);
+		for(i = 0; i < last; i++)
+		{
+			if(values[i] == NULL || values[i][0] == '\0' || cache_is_dynamic(t, i))
+				continue;
+			record = (CacheRecord) { .table = t, .index = i, .length = strnlen(values[i], UINT16_MAX) };
+			memcpy(buff + pos, &record, sizeof(CacheRecord));
+			memcpy(buff + pos + sizeof(CacheRecord), values[i], record.length);
+			pos += sizeof(CacheRecord) + record.length;
+		}
+	}
+
+	return buff;
+}
+
+/* Fill static labels from a buffer made by cache_serialize() */
+int cache_unserialize(Labels *data, const char *buff, size_t size)
+{
+	int i, last, pass;
+	size_t pos;
+	char **values;
+	CacheHeader header;
+	CacheRecord record;
+
+	if(size < sizeof(CacheHeader))
+		return 4;
+	memcpy(&header, buff, sizeof(CacheHeader));
+	if(memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) || header.version != CACHE_VERSION || header.size != size ||
+	   header.dimms_count > UINT16_MAX || header.gpu_count > UINT16_MAX)
+		return 4;
+
+	/* Tables of devices are sized before records fill them */
+	if(labels_resize(data, NO_MEMORY, header.dimms_count) || labels_resize(data, NO_GRAPHICS, header.gpu_count))
+		goto error;
+
+	/* First pass checks records, second pass fills labels */
+	for(pass = 0; pass < 2; pass++)
+	{
+		pos = sizeof(CacheHeader);
+		for(i = 0; i < (int) header.records; i++)
+		{
+			if(pos + sizeof(CacheRecord) > header.size)
+				goto error;
+			memcpy(&record, buff + pos, sizeof(CacheRecord));
+			pos += sizeof(CacheRecord);
+			values = cache_table(data, record.table, &last);
+			if(values == NULL || record.index >= (uint32_t) last || pos + record.length > header.size)
+				goto error;
+			else if(pass == 1)
+			{
+				free(values[record.index]);
+				values[record.index] = strndup(buff + pos, record.length);
+			}
+			pos += record.length;
+		}
+	}
+
+	data->cpu_count              = header.cpu_count;
+	data->l_data->cpu_vendor_id  = header.cpu_vendor_id;
+	data->l_data->cpu_model      = header.cpu_model;
+	data->l_data->cpu_ext_model  = header.cpu_ext_model;
+	data->l_data->cpu_ext_family = header.cpu_ext_family;
+	data->w_data->l1_size        = header.l1_size;
+	data->w_data->l2_size        = header.l2_size;
+	data->w_data->l3_size        = header.l3_size;
+	data->w_data->l1d_size       = header.l1d_size;
+	if(header.bus_freq > 0)
+		metric_set_double(data, MT_BUSSPEED, header.bus_freq);
+	if(data->opts->selected_core >= data->cpu_count)
+		data->opts->selected_core = 0;
+
+	return 0;
+
+error:
+	/* Collectors will add devices again */
+	labels_resize(data, NO_MEMORY,   0);
+	labels_resize(data, NO_GRAPHICS, 0);
+	return 4;
+}
+
+
+/************************* Private functions *************************/
+
+/* Get the array of values and its size for a cache table */
+static char **cache_table(Labels *data, enum EnCacheTables table, int *last)
+{
+	switch(table)
+	{
+		case CACHE_TABCPU:         *last = LASTCPU;                       return data->tab_cpu[VALUE];
+		case CACHE_TABCACHES:      *last = LASTCACHES;                    return data->tab_caches[VALUE];
+		case CACHE_TABMOTHERBOARD: *last = LASTMOTHERBOARD;               return data->tab_motherboard[VALUE];
+		case CACHE_TABMEMORY:      *last = data->dimms_count * RAMFIELDS; return data->tab_memory[VALUE];
+		case CACHE_TABSYSTEM:      *last = LASTSYSTEM;                    return data->tab_system[VALUE];
+		case CACHE_TABGRAPHICS:    *last = data->gpu_count * GPUFIELDS;   return data->tab_graphics[VALUE];
+		default:                   *last = 0;                             return NULL;
+	}
+}
+
+/* Labels refreshed at runtime are never cached */
+static bool cache_is_dynamic(enum EnCacheTables table, int index)
+{
+	switch(table)
+	{
+		case CACHE_TABCPU:
+			return index == VOLTAGE || index == TEMPERATURE || index == CORESPEED || index == MULTIPLIER || index == USAGE;
+		case CACHE_TABCACHES:
+			return index % CACHEFIELDS == L1SPEED;
+		case CACHE_TABSYSTEM:
+			return index == UPTIME || index >= USED;
+		case CACHE_TABGRAPHICS:
+			return index % GPUFIELDS == GPUTEMPERATURE;
+		default:
+			return false;
+	}
+}
+
+/* Identify current boot (the cache is invalid after a reboot) */
+static int cache_boot_id(char *buff, size_t size)
+{
+#ifdef __linux__
+	char *boot_id;
+
+	if(fopen_to_str(NULL, "/proc/sys/kernel/random/boot_id", &boot_id))
+		return 1;
+	snprintf(buff, size, "%s", boot_id);
+	free(boot_id);
+#else
+	struct timeval boottime;
+	size_t len = sizeof(boottime);
+
+	if(sysctlbyname("kern.boottime", &boottime, &len, NULL, 0))
+		return 1;
+	snprintf(buff, size, "%li.%li", (long) boottime.tv_sec, (long) boottime.tv_usec);
+#endif /* __linux__ */
+
+	return 0;
+}
+
+/* Build the path of the cache file */
+static char *cache_path(bool system)
+{
+	char *path = NULL;
+
+	if(system)
+		asprintf(&path, "%s/%s", CACHE_SYSTEM_DIR, CACHE_FILE);
+	else if(getenv("XDG_CACHE_HOME") != NULL && getenv("XDG_CACHE_HOME")[0] == '/')
+		asprintf(&path, "%s/%s/%s", getenv("XDG_CACHE_HOME"), GETTEXT_PACKAGE, CACHE_FILE);
+	else if(getenv("HOME") != NULL)
+		asprintf(&path, "%s/.cache/%s/%s", getenv("HOME"), GETTEXT_PACKAGE, CACHE_FILE);
+
+	return path;
+}
+
+/* Read a cache file and fill labels if it is valid */
+static int cache_read(Labels *data, const char *path, bool need_root)
+{
+	int fd, err = 0;
+	char boot_id[sizeof(((CacheHeader *) NULL)->boot_id)] = "";
+	const char *map;
+	struct stat st;
+	CacheHeader header;
+
+	if((fd = open(path, O_RDONLY)) < 0)
+	{
+		errno = 0;
+		return 1;
+	}
+
+	if(fstat(fd, &st) || st.st_size < (off_t) sizeof(CacheHeader) ||
+	   (need_root && st.st_uid != 0) ||
+	   (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+	{
+		close(fd);
+		return 2;
+	}
+	close(fd);
+
+	/* Check if cache matches with running system and CPU-X version */
+	memcpy(&header, map, sizeof(CacheHeader));
+	cache_boot_id(boot_id, sizeof(boot_id));
+	if(memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) || header.version != CACHE_VERSION ||
+	   header.size != st.st_size || strncmp(header.boot_id, boot_id, sizeof(boot_id)) ||
+	   strncmp(header.prgver, PRGVER, sizeof(header.prgver)) || (need_root && !(header.flags & CACHE_ROOT)))
+	{
+		MSG_VERBOSE(_("Ignoring outdated cache %s"), path);
+		munmap((void *) map, st.st_size);
+		return 3;
+	}
+
+	err = cache_unserialize(data, map, st.st_size);
+	munmap((void *) map, st.st_size);
+
+	if(err)
+	{
+		MSG_ERROR(_("cache file %s is corrupted"), path);
+		return err;
+	}
+
+	MSG_VERBOSE(_("Reading static data from cache %s"), path);
+	return 0;
+}
+
+/* Create a directory and its parents */
+static int mkdir_p(const char *path)
+{
+	char *tmp, *p;
+	int err = 0;
+
+	tmp = strdup(path);
+	for(p = tmp + 1; *p != '\0' && !err; p++)
+	{
+		if(*p != '/')
+			continue;
+		*p  = '\0';
+		err = mkdir(tmp, 0755) && errno != EEXIST;
+		*p  = '/';
+	}
+	if(!err)
+		err = mkdir(tmp, 0755) && errno != EEXIST;
+	errno = 0;
+	free(tmp);
+
+	return err;
+}
@@ -0,0 +1,84 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE cache.h
+*/
+
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include "cpu-x.h"
+
+#define CACHE_MAGIC           "CPUXSTAT"
+#define CACHE_VERSION         3
+#define CACHE_FILE            "static.cache"
+#define CACHE_SYSTEM_DIR      "/var/cache/cpu-x"
+#define CACHE_ROOT            (1 << 0) /* Data was collected with root privileges */
+
+enum EnCacheTables
+{
+	CACHE_TABCPU, CACHE_TABCACHES, CACHE_TABMOTHERBOARD, CACHE_TABMEMORY, CACHE_TABSYSTEM, CACHE_TABGRAPHICS,
+	LASTCACHETABLE
+};
+
+typedef struct
+{
+	char     magic[8];
+	uint32_t version;
+	uint32_t flags;
+	char     boot_id[48];
+	char     prgver[16];
+	uint32_t size;           /* Size of the whole file */
+	uint32_t records;        /* Number of CacheRecord following this header */
+
+	/* Scalars from Labels */
+	uint32_t cpu_count, gpu_count, dimms_count;
+	double   bus_freq;
+	int32_t  cpu_vendor_id, cpu_model, cpu_ext_model, cpu_ext_family;
+	uint32_t l1_size, l2_size, l3_size, l1d_size;
+} CacheHeader;
+
+typedef struct
+{
+	uint16_t table, length;        /* Followed by 'length' bytes (not null-terminated) */
+	uint32_t index;
+} CacheRecord;
+
+
+/* Get the array of values and its size for a cache table */
+static char **cache_table(Labels *data, enum EnCacheTables table, int *last);
+
+/* Labels refreshed at runtime are never cached */
+static bool cache_is_dynamic(enum EnCacheTables table, int index);
+
+/* Identify current boot (the cache is invalid after a reboot) */
+static int cache_boot_id(char *buff, size_t size);
+
+/* Build the path of the cache file */
+static char *cache_path(bool system);
+
+/* Read a cache file and fill labels if it is valid */
+static int cache_read(Labels *data, const char *path, bool need_root);
+
+/* Create a directory and its parents */
+static int mkdir_p(const char *path);
+
+
+#endif /* _CACHE_H_ */
@@ -0,0 +1,562 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE capture.c
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <libintl.h>
+#include "capture.h"
+#include "cpu-x.h"
+
+#if HAS_LIBCPUID
+# include <libcpuid/libcpuid.h>
+#endif
+
+static pthread_mutex_t capture_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int capture_fd       = -1;      /* Archive being written (--capture) */
+static char **capture_paths = NULL;    /* System files read by collectors */
+static size_t capture_count = 0;
+static char *capture_root   = NULL;    /* Extracted archive (--from-capture) */
+
+/* Files read by libraries or system calls, not through sysroot_*() functions */
+static const char *capture_extra[] =
+{
+	SYS_CPU_POSSIBLE,                               /* sysconf() */
+	"/sys/firmware/dmi/tables/smbios_entry_point",  /* dmidecode */
+	"/sys/firmware/dmi/tables/DMI",
+	NULL
+};
+
+
+/************************* Public functions *************************/
+
+/* Open an archive ("-" for standard output), and remember system files read by collectors from now */
+int capture_start(const char *path)
+{
+	if(!strcmp(path, "-"))
+	{
+		/* Keep stdout for archive; messages printed after this call go to stderr */
+		fflush(stdout);
+		if((capture_fd = dup(STDOUT_FILENO)) >= 0)
+			dup2(STDERR_FILENO, STDOUT_FILENO);
+	}
+	else
+		capture_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+	if(capture_fd < 0)
+	{
+		MSG_ERROR(_("failed to create capture %s"), path);
+		return 1;
+	}
+
+	MSG_VERBOSE(_("Capturing system files in %s"), path);
+	return 0;
+}
+
+/* Remember a system file or directory read by a collector */
+void capture_add(const char *path)
+{
+	char **tmp;
+
+	pthread_mutex_lock(&capture_mutex);
+	if(capture_fd >= 0 && (tmp = realloc(capture_paths, (capture_count + 1) * sizeof(char *))) != NULL)
+	{
+		capture_paths = tmp;
+		if((capture_paths[capture_count] = strdup(path)) != NULL)
+			capture_count++;
+	}
+	pthread_mutex_unlock(&capture_mutex);
+}
+
+/* Write remembered files in archive, with those read by libraries, and close it */
+int capture_write(void)
+{
+	int fd, err = 0;
+	size_t i, count;
+	char **paths;
+	const char end[2 * TAR_BLOCK] = { 0 };
+
+	for(i = 0; capture_extra[i] != NULL; i++)
+		capture_add(capture_extra[i]);
+
+	/* Files read while archive is written are not remembered */
+	pthread_mutex_lock(&capture_mutex);
+	fd            = capture_fd;
+	paths         = capture_paths;
+	count         = capture_count;
+	capture_fd    = -1;
+	capture_paths = NULL;
+	capture_count = 0;
+	pthread_mutex_unlock(&capture_mutex);
+	if(fd < 0)
+		return 1;
+
+	/* A file can be read by several collectors */
+	MSG_VERBOSE(_("Writing captured files"));
+	qsort(paths, count, sizeof(char *), cmp_path);
+	for(i = 0; i < count; i++)
+	{
+		if(i == 0 || strcmp(paths[i], paths[i - 1]))
+			err += capture_put_path(fd, paths[i]);
+	}
+	for(i = 0; i < count; i++)
+		free(paths[i]);
+	free(paths);
+
+	err += capture_put_pci(fd);
+	err += capture_put_cpuid(fd);
+	if(write_full(fd, end, sizeof(end)))
+		err++;
+	close(fd);
+
+	if(err)
+		MSG_ERROR(_("failed to write capture"));
+
+	return err;
+}
+
+/* Extract an archive made by --capture ("-" for standard input), and read system files in it */
+int capture_open(const char *path)
+{
+	int fd, out, err = 0;
+	unsigned i, sum, link_count = 0;
+	long long size, blocks;
+	char block[TAR_BLOCK], name[sizeof(((TarHeader *) 0)->prefix) + sizeof(((TarHeader *) 0)->name) + 2], *entry, *file;
+	const char *tmpdir = (getenv("TMPDIR") != NULL) ? getenv("TMPDIR") : "/tmp";
+	TarHeader *header = (TarHeader *) block;
+	TarLink *links = NULL, *tmp;
+
+	fd = strcmp(path, "-") ? open(path, O_RDONLY | O_CLOEXEC) : STDIN_FILENO;
+	asprintf(&capture_root, "%s/cpu-x-capture.XXXXXX", tmpdir);
+	if(fd < 0 || capture_root == NULL || mkdtemp(capture_root) == NULL)
+	{
+		MSG_ERROR(_("failed to open capture %s"), path);
+		free(capture_root);
+		capture_root = NULL;
+		if(fd > STDIN_FILENO)
+			close(fd);
+		return 1;
+	}
+
+	MSG_VERBOSE(_("Extracting capture %s in %s"), path, capture_root);
+	while(!err && !read_full(fd, block, TAR_BLOCK))
+	{
+		/* Archive ends with an empty block */
+		for(i = 0, sum = 0; i < TAR_BLOCK; i++)
+			sum += (i >= offsetof(TarHeader, chksum) && i < offsetof(TarHeader, chksum) + sizeof(header->chksum)) ? ' ' : (unsigned char) block[i];
+		if(sum == sizeof(header->chksum) * ' ')
+			break;
+		if(sum != tar_octal(header->chksum, sizeof(header->chksum)) || (size = tar_octal(header->size, sizeof(header->size))) < 0)
+		{
+			err = 2;
+			break;
+		}
+
+		/* Paths are relative to extraction directory */
+		if(header->prefix[0] != '\0')
+			snprintf(name, sizeof(name), "%.*s/%.*s", (int) sizeof(header->prefix), header->prefix, (int) sizeof(header->name), header->name);
+		else
+			snprintf(name, sizeof(name), "%.*s", (int) sizeof(header->name), header->name);
+		for(entry = name; entry[0] == '/' || (entry[0] == '.' && entry[1] == '/'); entry += (entry[0] == '/') ? 1 : 2);
+		blocks = (size + TAR_BLOCK - 1) / TAR_BLOCK;
+		if(!path_is_safe(entry))
+		{
+			MSG_WARNING(_("Skipping unsafe path '%s' in capture"), name);
+			header->typeflag = 'S';
+		}
+		asprintf(&file, "%s/%s", capture_root, entry);
+
+		switch(header->typeflag)
+		{
+			case TAR_FILE:
+			case '\0':
+				if(mkdir_parents(file) || (out = open(file, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0644)) < 0)
+				{
+					err = 3;
+					break;
+				}
+				for(; blocks > 0 && !err; blocks--, size -= TAR_BLOCK)
+				{
+					if(read_full(fd, block, TAR_BLOCK) || write_full(out, block, (size < TAR_BLOCK) ? size : TAR_BLOCK))
+						err = 4;
+				}
+				close(out);
+				break;
+			case TAR_DIR:
+				if(mkdir_parents(file) || (mkdir(file, 0755) < 0 && errno != EEXIST))
+					err = 3;
+				break;
+			case TAR_SYMLINK:
+				/* Links are created last: no file is written through them */
+				if((tmp = realloc(links, (link_count + 1) * sizeof(TarLink))) == NULL)
+				{
+					err = 5;
+					break;
+				}
+				links = tmp;
+				links[link_count].path   = strdup(file);
+				links[link_count].target = strndup(header->linkname, sizeof(header->linkname));
+				link_count++;
+				break;
+			default:
+				for(; blocks > 0 && !err; blocks--)
+					err = read_full(fd, block, TAR_BLOCK) ? 4 : 0;
+				break;
+		}
+		free(file);
+	}
+
+	for(i = 0; i < link_count; i++)
+	{
+		if(!err && links[i].path != NULL && links[i].target != NULL && !mkdir_parents(links[i].path))
+			symlink(links[i].target, links[i].path);
+		free(links[i].path);
+		free(links[i].target);
+	}
+	free(links);
+	if(fd > STDIN_FILENO)
+		close(fd);
+
+	if(err)
+	{
+		MSG_ERROR(_("failed to extract capture %s"), path);
+		capture_close();
+		return err;
+	}
+
+	opts->sysroot = capture_root;
+	return 0;
+}
+
+/* Remove extracted archive */
+void capture_close(void)
+{
+	if(capture_root == NULL)
+		return;
+
+	if(opts->sysroot == capture_root)
+		opts->sysroot = NULL;
+	nftw(capture_root, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+	free(capture_root);
+	capture_root = NULL;
+}
+
+
+/************************* Private functions *************************/
+
+/* Write a header for an entry, and the content of a regular file */
+static int tar_put(int fd, const char *path, char type, const char *content, size_t size)
+{
+	unsigned i, sum = 0;
+	size_t len, split;
+	TarHeader header;
+	const char pad[TAR_BLOCK] = { 0 };
+
+	/* Long paths are split in prefix and name */
+	while(*path == '/')
+		path++;
+	len = strlen(path);
+	memset(&header, 0, sizeof(TarHeader));
+	if(len <= sizeof(header.name))
+		memcpy(header.name, path, len);
+	else
+	{
+		for(split = len - 1; split > 0; split--)
+		{
+			if(path[split] == '/' && split <= sizeof(header.prefix) && len - split - 1 <= sizeof(header.name))
+				break;
+		}
+		if(split == 0)
+		{
+			MSG_WARNING(_("Skipping too long path '%s' in capture"), path);
+			return 0;
+		}
+		memcpy(header.prefix, path, split);
+		memcpy(header.name, path + split + 1, len - split - 1);
+	}
+
+	if(type != TAR_FILE)
+		size = 0;
+	snprintf(header.mode,  sizeof(header.mode),  "%07o", (type == TAR_FILE) ? 0644 : (type == TAR_DIR) ? 0755 : 0777);
+	snprintf(header.uid,   sizeof(header.uid),   "%07o", 0);
+	snprintf(header.gid,   sizeof(header.gid),   "%07o", 0);
+	snprintf(header.size,  sizeof(header.size),  "%011llo", (unsigned long long) size);
+	snprintf(header.mtime, sizeof(header.mtime), "%011llo", (unsigned long long) time(NULL));
+	header.typeflag = type;
+	if(type == TAR_SYMLINK)
+		strncpy(header.linkname, content, sizeof(header.linkname));
+	memcpy(header.magic,   "ustar", sizeof(header.magic));
+	memcpy(header.version, "00",    sizeof(header.version));
+
+	/* Checksum is computed with spaces in its own field */
+	memset(header.chksum, ' ', sizeof(header.chksum));
+	for(i = 0; i < sizeof(TarHeader); i++)
+		sum += ((unsigned char *) &header)[i];
+	snprintf(header.chksum, sizeof(header.chksum), "%06o", sum);
+
+	if(write_full(fd, &header, sizeof(TarHeader)) || (size > 0 && write_full(fd, content, size)) ||
+	   (size % TAR_BLOCK && write_full(fd, pad, TAR_BLOCK - size % TAR_BLOCK)))
+		return 1;
+
+	return 0;
+}
+
+/* Read a number in an octal field of a header */
+static long long tar_octal(const char *field, size_t size)
+{
+	size_t i;
+	long long value = 0;
+
+	for(i = 0; i < size && field[i] == ' '; i++);
+	for(; i < size && field[i] >= '0' && field[i] <= '7'; i++)
+		value = value * 8 + (field[i] - '0');
+
+	return (i < size && field[i] != '\0' && field[i] != ' ') ? -1 : value;
+}
+
+/* Read exactly 'size' bytes (archive can be a pipe) */
+static int read_full(int fd, void *buff, size_t size)
+{
+	ssize_t len;
+	size_t done = 0;
+
+	while(done < size)
+	{
+		if((len = read(fd, (char *) buff + done, size - done)) < 0 && errno == EINTR)
+			continue;
+		else if(len <= 0)
+			return 1;
+		done += len;
+	}
+
+	return 0;
+}
+
+/* Write exactly 'size' bytes (archive can be a pipe) */
+static int write_full(int fd, const void *buff, size_t size)
+{
+	ssize_t len;
+	size_t done = 0;
+
+	while(done < size)
+	{
+		if((len = write(fd, (const char *) buff + done, size - done)) < 0 && errno == EINTR)
+			continue;
+		else if(len <= 0)
+			return 1;
+		done += len;
+	}
+
+	return 0;
+}
+
+/* Read a whole file (sysfs and procfs files have no real size) */
+static char *read_all(int fd, size_t *size)
+{
+	ssize_t len;
+	size_t alloc = TAR_BLOCK * 8;
+	char *buff, *tmp;
+
+	*size = 0;
+	if((buff = malloc(alloc)) == NULL)
+		return NULL;
+
+	while((len = read(fd, buff + *size, alloc - *size)) > 0)
+	{
+		*size += len;
+		if(*size < alloc)
+			continue;
+		if(alloc >= CAPTURE_MAX_FILE || (tmp = realloc(buff, alloc * 2)) == NULL)
+		{
+			len = -1;
+			break;
+		}
+		buff   = tmp;
+		alloc *= 2;
+	}
+
+	if(len < 0)
+	{
+		free(buff);
+		return NULL;
+	}
+
+	return buff;
+}
+
+/* Add a system file or directory in archive (other types are skipped) */
+static int capture_put_path(int fd, const char *path)
+{
+	int src, ret = 0;
+	size_t size;
+	char *buff;
+	struct stat st;
+
+	/* Some sysfs files cannot be read (permission, I/O error): they are skipped */
+	if((src = sysroot_open(opts, path, O_RDONLY | O_NONBLOCK | O_CLOEXEC)) < 0)
+		return 0;
+
+	if(fstat(src, &st) < 0)
+		ret = 0;
+	else if(S_ISDIR(st.st_mode))
+		ret = tar_put(fd, path, TAR_DIR, NULL, 0);
+	else if(S_ISREG(st.st_mode) && (buff = read_all(src, &size)) != NULL)
+	{
+		ret = tar_put(fd, path, TAR_FILE, buff, size);
+		free(buff);
+	}
+	close(src);
+
+	return ret;
+}
+
+/* Add files of PCI devices read by libpci in archive */
+static int capture_put_pci(int fd)
+{
+	int i, err = 0;
+	ssize_t len;
+	char path[PATH_MAX], buff[PATH_MAX], target[PATH_MAX];
+	DIR *dp;
+	struct dirent *entry;
+	const char *files[] = { "vendor", "device", "class", "revision", "subsystem_vendor", "subsystem_device",
+	                        "irq", "resource", "config", "label", "numa_node", NULL };
+
+	if((dp = sysroot_opendir(opts, SYS_PCI)) == NULL)
+		return 0;
+
+	while((entry = readdir(dp)) != NULL)
+	{
+		if(entry->d_name[0] == '.')
+			continue;
+		for(i = 0; files[i] != NULL; i++)
+		{
+			snprintf(path, sizeof(path), "%s/%s/%s", SYS_PCI, entry->d_name, files[i]);
+			err += capture_put_path(fd, path);
+		}
+
+		/* Only name of driver is used, from target of this link */
+		snprintf(path, sizeof(path), "%s/%s/driver", SYS_PCI, entry->d_name);
+		if((len = readlink(sysroot_path(opts, path, buff, sizeof(buff)), target, sizeof(target) - 1)) > 0)
+		{
+			target[len] = '\0';
+			err += tar_put(fd, path, TAR_SYMLINK, target, 0);
+		}
+	}
+	closedir(dp);
+
+	return err;
+}
+
+/* Add raw CPUID leaves in archive (libcpuid format) */
+static int capture_put_cpuid(int fd)
+{
+	int ret = 0;
+#if HAS_LIBCPUID
+	int mfd;
+	size_t size;
+	char path[PATH_MAX], *buff;
+	struct cpu_raw_data_t raw;
+
+	/* libcpuid writes in a file: a memory file avoids temporary files */
+	if(cpuid_get_raw_data(&raw) || (mfd = memfd_create("cpuid", MFD_CLOEXEC)) < 0)
+	{
+		MSG_WARNING(_("Skipping CPUID leaves in capture"));
+		return 0;
+	}
+	snprintf(path, sizeof(path), "/proc/self/fd/%i", mfd);
+	if(!cpuid_serialize_raw_data(&raw, path) && lseek(mfd, 0, SEEK_SET) == 0 && (buff = read_all(mfd, &size)) != NULL)
+	{
+		ret = tar_put(fd, CAPTURE_CPUID, TAR_FILE, buff, size);
+		free(buff);
+	}
+	close(mfd);
+#else
+	(void) fd;
+#endif /* HAS_LIBCPUID */
+
+	return ret;
+}
+
+/* Order paths (qsort) */
+static int cmp_path(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* Check that a path from an archive stays in extraction directory */
+static bool path_is_safe(const char *path)
+{
+	const char *p;
+
+	if(path[0] == '\0')
+		return false;
+
+	for(p = path; p != NULL; p = strchr(p, '/'))
+	{
+		if(*p == '/')
+			p++;
+		if(p[0] == '.' && p[1] == '.' && (p[2] == '/' || p[2] == '\0'))
+			return false;
+	}
+
+	return true;
+}
+
+/* Create missing parent directories of a path */
+static int mkdir_parents(char *path)
+{
+	char *p;
+
+	/* Extraction directory already exists */
+	for(p = path + strlen(capture_root) + 1; (p = strchr(p, '/')) != NULL; p++)
+	{
+		*p = '\0';
+		if(mkdir(path, 0755) < 0 && errno != EEXIST)
+		{
+			*p = '/';
+			return 1;
+		}
+		*p = '/';
+	}
+
+	return 0;
+}
+
+/* Remove a file of extracted capture (nftw) */
+static int remove_entry(const char *path, const struct stat *sb, int flag, struct FTW *ftwbuf)
+{
+	(void) sb;
+	(void) flag;
+	(void) ftwbuf;
+
+	return remove(path);
+}
@@ -0,0 +1,105 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE capture.h
+*/
+
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+#include <stddef.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include "cpu-x.h"
+
+#define TAR_BLOCK             512            /* Archive is made of blocks of this size */
+#define TAR_FILE              '0'            /* Types of entries */
+#define TAR_SYMLINK           '2'
+#define TAR_DIR               '5'
+#define CAPTURE_MAX_FILE      (64 << 20)     /* Larger files are skipped */
+
+/* POSIX ustar header */
+typedef struct
+{
+	char name[100];
+	char mode[8];
+	char uid[8];
+	char gid[8];
+	char size[12];
+	char mtime[12];
+	char chksum[8];
+	char typeflag;
+	char linkname[100];
+	char magic[6];
+	char version[2];
+	char uname[32];
+	char gname[32];
+	char devmajor[8];
+	char devminor[8];
+	char prefix[155];
+	char pad[12];
+} TarHeader;
+
+/* Symbolic link found in an archive (created after all files) */
+typedef struct
+{
+	char *path;
+	char *target;
+} TarLink;
+
+
+/* Write a header for an entry, and the content of a regular file */
+static int tar_put(int fd, const char *path, char type, const char *content, size_t size);
+
+/* Read a number in an octal field of a header */
+static long long tar_octal(const char *field, size_t size);
+
+/* Read exactly 'size' bytes (archive can be a pipe) */
+static int read_full(int fd, void *buff, size_t size);
+
+/* Write exactly 'size' bytes (archive can be a pipe) */
+static int write_full(int fd, const void *buff, size_t size);
+
+/* Read a whole file (sysfs and procfs files have no real size) */
+static char *read_all(int fd, size_t *size);
+
+/* Add a system file or directory in archive (other types are skipped) */
+static int capture_put_path(int fd, const char *path);
+
+/* Add files of PCI devices read by libpci in archive */
+static int capture_put_pci(int fd);
+
+/* Add raw CPUID leaves in archive (libcpuid format) */
+static int capture_put_cpuid(int fd);
+
+/* Order paths (qsort) */
+static int cmp_path(const void *a, const void *b);
+
+/* Check that a path from an archive stays in extraction directory */
+static bool path_is_safe(const char *path);
+
+/* Create missing parent directories of a path */
+static int mkdir_parents(char *path);
+
+/* Remove a file of extracted capture (nftw) */
+static int remove_entry(const char *path, const struct stat *sb, int flag, struct FTW *ftwbuf);
+
+
+#endif /* _CAPTURE_H_ */
@@ -0,0 +1,241 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE command.c
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <libintl.h>
+#include "command.h"
+#include "cpu-x.h"
+
+extern char **environ;
+
+static CommandCache cache = { .path_env = NULL, .dirs = NULL, .dir_count = 0, .cmds = NULL, .cmd_count = 0 };
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/************************* Public functions *************************/
+
+/* Check if a command exists */
+bool command_exists(char *in)
+{
+	return (command_path(in) != NULL);
+}
+
+/* Open a pipe and put its content in buffer */
+int popen_to_str(char *command, char **buffer)
+{
+	int fd[2];
+	pid_t pid;
+	ssize_t n;
+	size_t len = 0, size = MAXSTR;
+	char *tmp;
+
+	if((*buffer = malloc(size * sizeof(char))) == NULL)
+		goto error;
+	(*buffer)[0] = '\0';
+
+	if(pipe2(fd, O_CLOEXEC))
+		goto error;
+
+	pid = command_spawn(command, fd[1], -1);
+	close(fd[1]);
+	if(pid < 0)
+	{
+		close(fd[0]);
+		if(pid == -1)
+			return -1;
+		goto error;
+	}
+
+	/* Read whole output, growing buffer if needed */
+	while((n = read(fd[0], *buffer + len, size - len - 1)) != 0)
+	{
+		if(n < 0 && errno == EINTR)
+			continue;
+		else if(n < 0)
+			break;
+
+		len += n;
+		if(len == size - 1)
+		{
+			if((tmp = realloc(*buffer, size * 2)) == NULL)
+				break;
+			*buffer = tmp;
+			size   *= 2;
+		}
+	}
+	close(fd[0]);
+	while(len > 0 && (*buffer)[len - 1] == '\n')
+		len--;
+	(*buffer)[len] = '\0';
+
+	if(len == 0)
+	{
+		command_wait(pid);
+		goto error;
+	}
+
+	return command_wait(pid);
+
+error:
+	MSG_ERROR(_("an error occurred while running command '%s'"), command);
+	return 2;
+}
+
+/* Run a command and wait for it; its output is discarded */
+int run_command(char *command)
+{
+	int null;
+	pid_t pid;
+
+	if((null = open("/dev/null", O_WRONLY | O_CLOEXEC)) < 0)
+		return 2;
+	pid = command_spawn(command, null, null);
+	close(null);
+
+	return (pid < 0) ? -pid : command_wait(pid);
+}
+
+
+/************************* Private functions *************************/
+
+/* Find full path of a command in $PATH (result is cached) */
+static const char *command_path(const char *name)
+{
+	unsigned i;
+	char *path = NULL, *dir, *saveptr;
+	const char *ret;
+	CommandPath *tmp;
+
+	if(strchr(name, '/') != NULL)
+		return access(name, X_OK) ? NULL : name;
+
+	pthread_mutex_lock(&cache_mutex);
+	for(i = 0; i < cache.cmd_count && strcmp(cache.cmds[i].name, name); i++);
+	if(i < cache.cmd_count)
+	{
+		ret = cache.cmds[i].path;
+		pthread_mutex_unlock(&cache_mutex);
+		return ret;
+	}
+
+	/* $PATH is split once */
+	if(cache.path_env == NULL)
+	{
+		cache.path_env = strdup((getenv("PATH") != NULL) ? getenv("PATH") : DEFAULT_PATH);
+		for(dir = strtok_r(cache.path_env, ":", &saveptr); dir != NULL; dir = strtok_r(NULL, ":", &saveptr))
+		{
+			if((cache.dirs = realloc(cache.dirs, (cache.dir_count + 1) * sizeof(char *))) == NULL)
+			{
+				cache.dir_count = 0;
+				break;
+			}
+			cache.dirs[cache.dir_count++] = dir;
+		}
+	}
+
+	for(i = 0; i < cache.dir_count; i++)
+	{
+		asprintf(&path, "%s/%s", cache.dirs[i], name);
+		if(!access(path, X_OK))
+			break;
+		free(path);
+		path = NULL;
+	}
+
+	/* Missing commands are cached too */
+	if((tmp = realloc(cache.cmds, (cache.cmd_count + 1) * sizeof(CommandPath))) != NULL)
+	{
+		cache.cmds = tmp;
+		cache.cmds[cache.cmd_count++] = (CommandPath) { .name = strdup(name), .path = path };
+	}
+	pthread_mutex_unlock(&cache_mutex);
+
+	return path;
+}
+
+/* Start a command, with its output in 'out' and its errors in 'err' (if not -1)
+   Return -1 if command does not exist, -2 on error */
+static pid_t command_spawn(const char *command, int out, int err)
+{
+	int i = 0, ret;
+	pid_t pid;
+	char *argv[SPAWN_ARGS], *copy, *saveptr;
+	const char *path;
+	posix_spawn_file_actions_t actions;
+
+	/* First word is the command, even if a shell is needed */
+	copy = strdup(command);
+	if(copy == NULL)
+		return -2;
+	for(argv[i] = strtok_r(copy, " ", &saveptr); argv[i] != NULL && i < SPAWN_ARGS - 1; argv[i] = strtok_r(NULL, " ", &saveptr))
+		i++;
+	argv[i] = NULL;
+
+	if(argv[0] == NULL || (path = command_path(argv[0])) == NULL)
+	{
+		free(copy);
+		return -1;
+	}
+
+	/* Simple commands are run without shell */
+	if(strpbrk(command, SHELL_CHARS) != NULL || i == SPAWN_ARGS - 1)
+	{
+		argv[0] = "sh";
+		argv[1] = "-c";
+		argv[2] = (char *) command;
+		argv[3] = NULL;
+		path    = SHELL;
+	}
+
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+	if(err >= 0)
+		posix_spawn_file_actions_adddup2(&actions, err, STDERR_FILENO);
+	ret = posix_spawn(&pid, path, &actions, NULL, argv, environ);
+	posix_spawn_file_actions_destroy(&actions);
+	free(copy);
+
+	return ret ? -2 : pid;
+}
+
+/* Wait end of a command, and return its exit status */
+static int command_wait(pid_t pid)
+{
+	int status;
+
+	while(waitpid(pid, &status, 0) < 0)
+	{
+		if(errno != EINTR)
+			return 2;
+	}
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 2;
+}
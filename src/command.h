@@ -0,0 +1,62 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE command.h
+*/
+
+#ifndef _COMMAND_H_
+#define _COMMAND_H_
+
+#include <sys/types.h>
+#include "cpu-x.h"
+
+#define SHELL                 "/bin/sh"
+#define DEFAULT_PATH          "/usr/local/bin:/usr/bin:/bin:/usr/local/sbin:/usr/sbin:/sbin"
+#define SHELL_CHARS           "|&;<>()$`\\\"'*?[]~=\n" /* Commands with these need a shell */
+#define SPAWN_ARGS            16       /* Max arguments of a command run without shell */
+
+typedef struct
+{
+	char *name;
+	char *path;          /* Full path, or NULL if command was not found */
+} CommandPath;
+
+typedef struct
+{
+	char        *path_env;   /* Copy of $PATH, split in 'dirs' */
+	char        **dirs;
+	unsigned    dir_count;
+	CommandPath *cmds;       /* Commands looked up so far */
+	unsigned    cmd_count;
+} CommandCache;
+
+
+/* Find full path of a command in $PATH (result is cached) */
+static const char *command_path(const char *name);
+
+/* Start a command, with its output in 'out' and its errors in 'err' (if not -1)
+   Return -1 if command does not exist, -2 on error */
+static pid_t command_spawn(const char *command, int out, int err);
+
+/* Wait end of a command, and return its exit status */
+static int command_wait(pid_t pid);
+
+
+#endif /* _COMMAND_H_ */
@@ -25,21 +25,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <ctype.h>
 #include <string.h>
 #include <time.h>
 #include <math.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <pthread.h>
-#include <dirent.h>
-#include <locale.h>
 #include <libintl.h>
 #include <sys/utsname.h>
+#include <sys/timerfd.h>
 #include "core.h"
 #include "cpu-x.h"
 
 #ifndef __linux__
 # include <sys/types.h>
 # include <sys/sysctl.h>
+# include <sys/resource.h>
 #endif
 
 #if HAS_LIBCPUID
@@ -67,29 +70,138 @@
 # include <statgrab.h>
 #endif
 
+/* Collectors used after startup; due collectors run in this order (fallbacks need values of others) */
+static const RefreshTask refresh_tasks[LASTREFRESH] =
+{
+	/*           Required       Function                err_func Period        Tolerance Cost    Metrics */
+	REFRESH_TASK(HAS_LIBCPUID,  call_libcpuid_cpuclock, true,    0,            20,       1.0,    METRIC_BIT(MT_CORESPEED)),
+	REFRESH_TASK(true,          call_msr,               true,    0,            20,       0.1,    METRIC_BIT(MT_CORESPEED) | METRIC_BIT(MT_MULTIPLIER) |
+	                                                                                             METRIC_BIT(MT_MULTMIN) | METRIC_BIT(MT_MULTMAX) |
+	                                                                                             METRIC_BIT(MT_BUSSPEED) | METRIC_BIT(MT_VOLTAGE) |
+	                                                                                             METRIC_BIT(MT_TEMPERATURE)),
+	REFRESH_TASK(true,          cpu_usage,              true,    0,            20,       0.1,    METRIC_BIT(MT_USAGE) | METRIC_BIT(MT_COREUSAGE)),
+	REFRESH_TASK(true,          fallback_mode_dynamic,  false,   0,            20,       0.2,    METRIC_BIT(MT_MULTIPLIER) | METRIC_BIT(MT_VOLTAGE) |
+	                                                                                             METRIC_BIT(MT_TEMPERATURE)),
+	REFRESH_TASK(HAS_BANDWIDTH, call_bandwidth,         true,    REFRESH_SLOW, 1000,     1000.0, METRIC_BIT(MT_L1SPEED) | METRIC_BIT(MT_L2SPEED) |
+	                                                                                             METRIC_BIT(MT_L3SPEED)),
+	REFRESH_TASK(HAS_LIBSYSTEM, system_dynamic,         true,    0,            200,      0.5,    METRIC_BIT(MT_UPTIME) | METRIC_BIT(MT_MEMUSED) |
+	                                                                                             METRIC_BIT(MT_MEMBUFFERS) | METRIC_BIT(MT_MEMCACHED) |
+	                                                                                             METRIC_BIT(MT_MEMFREE) | METRIC_BIT(MT_SWAPUSED) |
+	                                                                                             METRIC_BIT(MT_MEMTOTAL) | METRIC_BIT(MT_SWAPTOTAL)),
+	REFRESH_TASK(true,          gpu_temperature,        true,    0,            200,      1.0,    METRIC_BIT(MT_GPU1TEMPERATURE)),
+	REFRESH_TASK(true,          benchmark_status,       true,    0,            50,       0.01,   METRIC_BENCH),
+};
+
+/* Process-wide initializations (kernel module, libraries), done once for all contexts */
+static pthread_once_t msr_once = PTHREAD_ONCE_INIT;
+static bool msr_loaded = false;
+#if HAS_LIBSTATGRAB
+static pthread_once_t statgrab_once = PTHREAD_ONCE_INIT;
+static bool statgrab_init = false;
+#endif
+
 
 /************************* Public functions *************************/
 
 /* Fill labels by calling below functions */
 int fill_labels(Labels *data)
 {
-	int err = 0;
+	int i, nthreads, err = 0;
+	bool cached;
+	double total;
+	struct timespec start;
+	pthread_t tid[STARTUP_THREADS];
+	StartupTask t[LASTSTARTUP] =
+	{
+		/*           Required       Function                err_func Dependencies */
+		STARTUP_TASK(HAS_DMIDECODE, call_dmidecode,         false,   0),
+		STARTUP_TASK(HAS_LIBCPUID,  call_libcpuid_static,   false,   0),
+		STARTUP_TASK(HAS_LIBCPUID,  call_libcpuid_cpuclock, true,    0),
+		STARTUP_TASK(true,          call_msr,               true,    DEP(ST_DMIDECODE) | DEP(ST_LIBCPUID_STATIC) | DEP(ST_LIBCPUID_CPUCLOCK)),
+		STARTUP_TASK(HAS_LIBSYSTEM, system_dynamic,         true,    0),
+		STARTUP_TASK(HAS_BANDWIDTH, call_bandwidth,         true,    DEP(ST_LIBCPUID_STATIC)),
+		STARTUP_TASK(HAS_LIBPCI,    find_devices,           false,   0),
+		STARTUP_TASK(true,          cpu_topology,           false,   DEP(ST_LIBCPUID_STATIC)),
+		STARTUP_TASK(true,          cpu_usage,              true,    0),
+		STARTUP_TASK(true,          system_static,          false,   0),
+		STARTUP_TASK(true,          find_sensors,           false,   0),
+		STARTUP_TASK(true,          gpu_temperature,        true,    DEP(ST_DEVICES) | DEP(ST_SENSORS)),
+		STARTUP_TASK(true,          benchmark_status,       true,    0),
+		STARTUP_TASK(true,          fallback_mode_static,   false,   DEP(ST_DMIDECODE) | DEP(ST_LIBCPUID_STATIC)),
+		/* Fallbacks only fill values which other collectors did not find: run them last */
+		STARTUP_TASK(true,          fallback_mode_dynamic,  false,   DEP(ST_FALLBACK_DYNAMIC) - 1),
+	};
+	StartupPool pool = { .data = data, .tasks = t, .done = 0,
+	                     .mutex = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER };
+
+	/* With a recording, static values are read from it and collectors are not used */
+	if(data->r_data->reader != NULL)
+	{
+		replay_read(data);
+		metrics_format(data, -1);
+		return 0;
+	}
+
+	/* With a running daemon, only static values are needed (from its cache) */
+	if(data->snapshot->map != NULL)
+	{
+		if(!cache_load(data) && !snapshot_read(data))
+		{
+			metrics_format(data, -1);
+			return 0;
+		}
+		MSG_WARNING(_("Cannot use values published by daemon"));
+		snapshot_detach(data);
+	}
+
+	/* Static collectors are not needed if a valid cache exists */
+	cached = !cache_load(data);
+	if(cached)
+	{
+		t[ST_DMIDECODE].func        = NULL;
+		t[ST_LIBCPUID_STATIC].func  = NULL;
+		t[ST_DEVICES].func          = NULL;
+		t[ST_SYSTEM_STATIC].func    = NULL;
+		t[ST_FALLBACK_STATIC].func  = NULL;
+	}
 
-	if(HAS_DMIDECODE)   err +=          call_dmidecode         (data);
-	if(HAS_LIBCPUID)    err +=          call_libcpuid_static   (data);
-	if(HAS_LIBCPUID)    err += err_func(call_libcpuid_cpuclock, data);
-	if(HAS_LIBCPUID)    err += err_func(call_libcpuid_msr,      data);
-	if(HAS_LIBSYSTEM)   err += err_func(system_dynamic,         data);
-	if(HAS_BANDWIDTH)   err += err_func(call_bandwidth,         data);
-	if(HAS_LIBPCI)      err +=          find_devices           (data);
+	/* Unavailable collectors are considered as done */
+	for(i = 0; i < LASTSTARTUP; i++)
+	{
+		if(t[i].func == NULL)
+			pool.done |= DEP(i);
+	}
+
+	/* Collectors mostly wait for I/O and child processes, so the pool size
+	   does not depend on CPU count; the calling thread is a worker too */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i = 1; i < STARTUP_THREADS; i++)
+	{
+		if(pthread_create(&tid[i], NULL, startup_worker, &pool))
+			break;
+	}
+	nthreads = i;
+	startup_worker(&pool);
+	for(i = 1; i < nthreads; i++)
+		pthread_join(tid[i], NULL);
+	total = elapsed_ms(&start);
+
+	/* Report wall time spent by each collector */
+	for(i = 0; i < LASTSTARTUP; i++)
+	{
+		if(t[i].func == NULL)
+			continue;
+		err += t[i].err;
+		MSG_VERBOSE(_("Startup: %-24s %9.2f ms"), t[i].name, t[i].elapsed);
+	}
+	MSG_VERBOSE(_("Startup: %-24s %9.2f ms (%i threads)"), _("total"), total, nthreads);
 
-	err += err_func(cpu_usage,        data);
-	err +=          system_static    (data);
-	err += err_func(gpu_temperature,  data);
-	err += err_func(benchmark_status, data);
+	pthread_mutex_destroy(&pool.mutex);
+	pthread_cond_destroy(&pool.cond);
 
-	err += fallback_mode_static(data);
-	err += fallback_mode_dynamic(data);
+	metrics_format(data, -1);
+	if(!cached)
+		cache_save(data);
 
 	return err;
 }
@@ -99,58 +211,368 @@ int do_refresh(Labels *data, enum EnTabNumber page)
 {
 	int err = 0;
 
-	switch(page)
+	/* Values are read from a recording */
+	if(page != NO_BENCH && data->r_data->reader != NULL)
 	{
-		case NO_CPU:
-			if(HAS_LIBCPUID) err += err_func(call_libcpuid_cpuclock, data);
-			if(HAS_LIBCPUID) err += err_func(call_libcpuid_msr,      data);
-			err += err_func(cpu_usage, data);
-			err += fallback_mode_dynamic(data);
-			break;
-		case NO_CACHES:
-			if(HAS_BANDWIDTH) err += err_func(call_bandwidth, data);
-			break;
-		case NO_SYSTEM:
-			if(HAS_LIBSYSTEM) err += err_func(system_dynamic, data);
-			break;
-		case NO_GRAPHICS:
-			err += err_func(gpu_temperature, data);
-			break;
-		case NO_BENCH:
-			err += err_func(benchmark_status, data);
-			break;
-		default:
-			err = -1;
+		err = replay_read(data);
+		metrics_format(data, page);
+		return err;
+	}
+
+	/* Values are collected by a running daemon */
+	if(page != NO_BENCH && data->snapshot->map != NULL && !data->snapshot->writer && !snapshot_read(data))
+	{
+		metrics_format(data, page);
+		record_sample(data);
+		return 0;
+	}
+
+	err = refresh_metrics(data, (page == NO_BENCH) ? METRIC_BENCH : metrics_page_mask(page));
+	metrics_format(data, page);
+	record_sample(data);
+
+	return err;
+}
+
+/* Run collectors which update given metrics (METRIC_BIT() mask), without formatting labels */
+int refresh_metrics(Labels *data, uint64_t mask)
+{
+	int err = 0;
+	unsigned task;
+
+	/* Collectors are selected by the metrics they update */
+	for(task = 0; task < LASTREFRESH; task++)
+	{
+		if(refresh_tasks[task].func != NULL && (refresh_tasks[task].metrics & mask))
+			err += refresh_run(data, task);
 	}
 
 	return err;
 }
 
+/* Create the timer of the refresh scheduler; its file descriptor is readable when collectors are due */
+int refresh_start(Labels *data)
+{
+	RefreshData *r = data->refresh;
+
+	if(r->fd < 0 && (r->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+		MSG_ERROR(_("failed to create refresh timer"));
+
+	return r->fd;
+}
+
+/* Select metrics shown by interface: only collectors which update them are scheduled */
+void refresh_subscribe(Labels *data, uint64_t metrics)
+{
+	unsigned task;
+	const uint64_t now = refresh_now();
+	RefreshData *r = data->refresh;
+
+	r->heap_size = 0;
+	for(task = 0; task < LASTREFRESH; task++)
+	{
+		if(refresh_tasks[task].func == NULL || !(refresh_tasks[task].metrics & metrics))
+			continue;
+		/* Newly shown values are collected at once */
+		if(!(refresh_tasks[task].metrics & r->subscribed) || r->deadline[task] == 0)
+			r->deadline[task] = now;
+		refresh_heap_push(r, task);
+	}
+	r->subscribed = metrics;
+
+	refresh_arm(r, (r->heap_size > 0) ? r->deadline[r->heap[0]] : 0);
+}
+
+/* Run due collectors (call it when timer is readable); return updated metrics */
+uint64_t refresh_dispatch(Labels *data)
+{
+	unsigned task;
+	uint32_t due = 0;
+	uint64_t now, expirations, tolerance, updated = 0;
+	RefreshData *r = data->refresh;
+
+	if(r->fd >= 0 && read(r->fd, &expirations, sizeof(expirations)) < 0)
+		expirations = 0;
+	now = refresh_now();
+
+	/* Values of a recording or of a daemon are all read at once */
+	if(data->r_data->reader != NULL || (data->snapshot->map != NULL && !data->snapshot->writer))
+	{
+		do_refresh(data, -1);
+		if(r->subscribed & METRIC_BENCH)
+			do_refresh(data, NO_BENCH);
+		refresh_arm(r, now + (uint64_t) data->opts->refr_time * 1000000ULL);
+		return r->subscribed;
+	}
+
+	/* Collectors due soon run now, so they share this wakeup */
+	while(r->heap_size > 0)
+	{
+		task      = r->heap[0];
+		tolerance = refresh_tasks[task].tolerance * 1000000ULL;
+		if(tolerance > refresh_period(data, task) / 2)
+			tolerance = refresh_period(data, task) / 2;
+		if(r->deadline[task] > now + tolerance)
+			break;
+		due |= DEP(refresh_heap_pop(r));
+	}
+
+	for(task = 0; task < LASTREFRESH; task++)
+	{
+		if(!(due & DEP(task)))
+			continue;
+		refresh_run(data, task);
+		updated |= refresh_tasks[task].metrics;
+
+		/* Missed deadlines are skipped, instead of running a collector several times in a row */
+		r->deadline[task] += refresh_period(data, task);
+		if(r->deadline[task] <= now)
+			r->deadline[task] = now + refresh_period(data, task);
+		refresh_heap_push(r, task);
+	}
+
+	metrics_format(data, -1);
+	record_sample(data);
+	refresh_arm(r, (r->heap_size > 0) ? r->deadline[r->heap[0]] : 0);
+
+	return updated;
+}
+
+/* Name of a refresh collector, NULL if it is not available in this build or 'task' is out of range */
+const char *refresh_task_name(unsigned task)
+{
+	return (task < LASTREFRESH && refresh_tasks[task].func != NULL) ? refresh_tasks[task].name : NULL;
+}
+
+/* Run a single refresh collector (index from 0 to refresh_task_count() - 1) */
+int refresh_task_run(Labels *data, unsigned task)
+{
+	return (refresh_task_name(task) != NULL) ? refresh_run(data, task) : 1;
+}
+
+/* Number of refresh collectors */
+unsigned refresh_task_count(void)
+{
+	return LASTREFRESH;
+}
+
+/* Delete the timer of the refresh scheduler */
+void refresh_stop(Labels *data)
+{
+	if(data->refresh->fd >= 0)
+		close(data->refresh->fd);
+	data->refresh->fd        = -1;
+	data->refresh->heap_size = 0;
+}
+
+/* Close statistics file of CPU usage and free counters */
+void usage_close(UsageData *u_data)
+{
+	if(u_data->fd >= 0)
+		close(u_data->fd);
+	free(u_data->buff);
+	free(u_data->ticks[0]);
+	free(u_data->ticks[1]);
+	free(u_data->percent);
+	free(u_data->rate);
+	free(u_data->usage);
+	*u_data = (UsageData) { .fd = -1, .buff = NULL, .core_count = 0, .current = 0, .hz = 0, .stamp = { 0 },
+	                        .ticks = { NULL }, .percent = NULL, .rate = NULL, .usage = NULL };
+}
+
 
 /************************* Private functions *************************/
 
-/* Avoid to re-run a function if an error was occurred in previous call */
-static int err_func(int (*func)(Labels *), Labels *data)
+/* Milliseconds elapsed since 'start' (monotonic clock) */
+static double elapsed_ms(const struct timespec *start)
 {
-	int err = 0;
-	unsigned i = 0;
-	static unsigned last = 0;
-	static struct Functions { void *func; bool skip_func; } f[16];
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/* Current time of monotonic clock, in ns */
+static uint64_t refresh_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/* Effective period of a collector, in ns (slow collectors are delayed) */
+static uint64_t refresh_period(Labels *data, unsigned task)
+{
+	const double period = refresh_tasks[task].period ? refresh_tasks[task].period : data->opts->refr_time;
+	RefreshData *r = data->refresh;
+
+	return fmax(period, r->cost[task] * REFRESH_COST_RATIO) * 1000000ULL;
+}
+
+/* Run a collector, and update its cost estimate */
+static int refresh_run(Labels *data, unsigned task)
+{
+	int err;
+	double cost;
+	struct timespec start;
+	const RefreshTask *t = &refresh_tasks[task];
+	RefreshData *r = data->refresh;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	err  = t->use_err_func ? err_func(t->name, t->func, data) : t->func(data);
+	cost = elapsed_ms(&start);
+
+	/* Moving average: one slow run does not change the period */
+	r->cost[task] = (r->cost[task] > 0) ? 0.8 * r->cost[task] + 0.2 * cost : fmax(cost, t->cost);
+
+	return err;
+}
 
-	for(i = 0; (i < last) && (func != f[i].func); i++);
+/* Add a collector to the deadline heap */
+static void refresh_heap_push(RefreshData *r, unsigned task)
+{
+	unsigned i = r->heap_size++, parent;
+
+	for(; i > 0 && r->deadline[r->heap[parent = (i - 1) / 2]] > r->deadline[task]; i = parent)
+		r->heap[i] = r->heap[parent];
+	r->heap[i] = task;
+}
+
+/* Remove the collector with the nearest deadline from the heap */
+static unsigned refresh_heap_pop(RefreshData *r)
+{
+	unsigned i = 0, child;
+	const unsigned top = r->heap[0], last = r->heap[--r->heap_size];
 
-	if(i == last)
+	while((child = 2 * i + 1) < r->heap_size)
 	{
-		f[last].func = func;
-		f[last].skip_func = false;
-		last++;
+		if(child + 1 < r->heap_size && r->deadline[r->heap[child + 1]] < r->deadline[r->heap[child]])
+			child++;
+		if(r->deadline[r->heap[child]] >= r->deadline[last])
+			break;
+		r->heap[i] = r->heap[child];
+		i = child;
 	}
+	r->heap[i] = last;
 
-	if(!f[i].skip_func)
-		err = func(data);
+	return top;
+}
 
-	if(err)
-		f[i].skip_func = true;
+/* Set timer to given deadline (monotonic clock, in ns); 0 stops the timer */
+static void refresh_arm(RefreshData *r, uint64_t deadline)
+{
+	struct itimerspec its = { .it_interval = { 0, 0 } };
+
+	if(r->fd < 0)
+		return;
+
+	/* A past deadline fires at once, but a null value would stop the timer */
+	its.it_value.tv_sec  = deadline / 1000000000ULL;
+	its.it_value.tv_nsec = deadline % 1000000000ULL;
+	if(deadline > 0 && its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+		its.it_value.tv_nsec = 1;
+	timerfd_settime(r->fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/* Run startup collectors as soon as their dependencies are done */
+static void *startup_worker(void *p_pool)
+{
+	int i;
+	const uint32_t all = DEP(LASTSTARTUP) - 1;
+	struct timespec start;
+	StartupPool *pool = p_pool;
+	StartupTask *task;
+
+	pthread_mutex_lock(&pool->mutex);
+	while(pool->done != all)
+	{
+		/* Pick the first pending task whose dependencies are satisfied */
+		for(i = 0; i < LASTSTARTUP; i++)
+		{
+			task = &pool->tasks[i];
+			if(!task->started && !(pool->done & DEP(i)) && (task->deps & pool->done) == task->deps)
+				break;
+		}
+
+		if(i == LASTSTARTUP)
+		{
+			pthread_cond_wait(&pool->cond, &pool->mutex);
+			continue;
+		}
+
+		task->started = true;
+		pthread_mutex_unlock(&pool->mutex);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		task->err     = task->use_err_func ? err_func(task->name, task->func, pool->data) : task->func(pool->data);
+		task->elapsed = elapsed_ms(&start);
+
+		pthread_mutex_lock(&pool->mutex);
+		pool->done |= DEP(i);
+		pthread_cond_broadcast(&pool->cond);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	return NULL;
+}
+
+/* Call a collector unless it is waiting for a retry; update its health and count its cost */
+static int err_func(const char *name, int (*func)(Labels *), Labels *data)
+{
+	int err;
+	unsigned i;
+	bool skip;
+	uint64_t now = refresh_now();
+	enum EnHealth health;
+	struct timespec start;
+	Collector *c = NULL;
+	CoreData *c_data = data->c_data;
+
+	pthread_mutex_lock(&c_data->mutex);
+	if(c_data->collectors == NULL)
+		c_data->collectors = calloc(COLLECTORS_MAX, sizeof(Collector));
+	if(c_data->collectors != NULL)
+	{
+		for(i = 0; (i < c_data->collector_count) && (func != c_data->collectors[i].func); i++);
+		if(i == c_data->collector_count && c_data->collector_count < COLLECTORS_MAX)
+			c_data->collectors[c_data->collector_count++] = (Collector) { .func = func, .health = HEALTH_OK, .failures = 0, .errors = 0, .retry = 0 };
+		c = (i < COLLECTORS_MAX) ? &c_data->collectors[i] : NULL;
+	}
+	skip = (c != NULL) && now < c->retry;
+	pthread_mutex_unlock(&c_data->mutex);
+
+	if(skip)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	err = func(data);
+	if(c == NULL)
+		return err;
+
+	pthread_mutex_lock(&c_data->mutex);
+	if(!err)
+	{
+		if(c->health != HEALTH_OK)
+			MSG_VERBOSE(_("%s works again after %u failure(s)"), name, c->failures);
+		c->health   = HEALTH_OK;
+		c->failures = 0;
+		c->retry    = 0;
+	}
+	else
+	{
+		c->errors++;
+		/* Delay before next try doubles after each consecutive failure, up to its maximum (a device can come back) */
+		if(++c->failures == BACKOFF_RETRIES + 1)
+			MSG_VERBOSE(_("%s is disabled after %u consecutive failures, retrying every %u s"), name, c->failures,
+			            (BACKOFF_FIRST << (BACKOFF_RETRIES - 1)) / 1000);
+		c->health = (c->failures > BACKOFF_RETRIES) ? HEALTH_DISABLED : HEALTH_DEGRADED;
+		c->retry  = now + ((BACKOFF_FIRST * 1000000ULL) << (((c->failures < BACKOFF_RETRIES) ? c->failures : BACKOFF_RETRIES) - 1));
+	}
+	health = c->health;
+	pthread_mutex_unlock(&c_data->mutex);
+
+	selfstats_add(data, name, elapsed_ms(&start), err != 0, health);
 
 	return err;
 }
@@ -276,14 +698,19 @@ static void print_hex(char **string, int32_t value)
 /* Static elements provided by libcpuid */
 static int call_libcpuid_static(Labels *data)
 {
-	int i, j = 0;
+	int i, j = 0, err;
 	const char *fmt = { _("%2d-way set associative, %2d-byte line size") };
+	char path[PATH_MAX];
 	struct cpu_raw_data_t raw;
 	struct cpu_id_t datanr;
 
-	/* Call libcpuid */
+	/* Call libcpuid; raw CPUID leaves of a capture (--from-capture) replace those of this CPU */
 	MSG_VERBOSE(_("Calling libcpuid for retrieving static data"));
-	if(cpuid_get_raw_data(&raw) || cpu_identify(&raw, &datanr))
+	if(data->opts->sysroot != NULL && !sysroot_access(data->opts, CAPTURE_CPUID, R_OK))
+		err = cpuid_deserialize_raw_data(&raw, sysroot_path(data->opts, CAPTURE_CPUID, path, sizeof(path)));
+	else
+		err = cpuid_get_raw_data(&raw);
+	if(err || cpu_identify(&raw, &datanr))
 	{
 		MSG_ERROR(_("failed to call libcpuid"));
 		return 1;
@@ -294,8 +721,8 @@ static int call_libcpuid_static(Labels *data)
 	data->l_data->cpu_model      = datanr.model;
 	data->l_data->cpu_ext_model  = datanr.ext_model;
 	data->l_data->cpu_ext_family = datanr.ext_family;
-	if(opts->selected_core >= data->cpu_count)
-		opts->selected_core = 0;
+	if(data->opts->selected_core >= data->cpu_count)
+		data->opts->selected_core = 0;
 
 	/* Basically fill CPU tab */
 	iasprintf(&data->tab_cpu[VALUE][CODENAME],      datanr.cpu_codename);
@@ -340,6 +767,7 @@ static int call_libcpuid_static(Labels *data)
 	/* Cache level 1 (data) */
 	if(datanr.l1_data_cache > 0)
 	{
+		data->w_data->l1d_size = datanr.l1_data_cache;
 		iasprintf(&data->tab_cpu[VALUE][LEVEL1D], "%d x %4d KB", datanr.num_cores, datanr.l1_data_cache);
 		iasprintf(&data->tab_cpu[VALUE][LEVEL1D], "%s, %2d-way", data->tab_cpu[VALUE][LEVEL1D], datanr.l1_assoc);
 	}
@@ -428,230 +856,471 @@ static int call_libcpuid_static(Labels *data)
 /* CPU clock provided by libcpuid */
 static int call_libcpuid_cpuclock(Labels *data)
 {
+	int freq;
+
 	/* CPU frequency */
 	MSG_VERBOSE(_("Calling libcpuid for retrieving CPU clock"));
-	data->cpu_freq = cpu_clock();
-	iasprintf(&data->tab_cpu[VALUE][CORESPEED], "%d MHz", data->cpu_freq);
+	freq = cpu_clock();
+	if(freq > 0)
+		metric_set_int(data, MT_CORESPEED, freq);
 
-	return (data->cpu_freq <= 0);
+	return (freq <= 0);
 }
 
-/* Load CPU MSR kernel module */
-static bool load_msr_driver(void)
+#endif /* HAS_LIBCPUID */
+
+#if HAS_DMIDECODE
+/* Call Dmidecode through CPU-X but do nothing else */
+int run_dmidecode(void)
+{
+	opt.type   = NULL;
+	opt.flags  = (opts->verbose) ? 0 : FLAG_QUIET;
+	dmisysroot = opts->sysroot;
+	return dmidecode();
+}
+
+/* Elements provided by dmidecode (need root privileges) */
+static int call_dmidecode(Labels *data)
+{
+	int i, err = 0;
+
+	/* Dmidecode options */
+	opt.type   = NULL;
+	opt.flags  = (opts->verbose) ? FLAG_CPU_X : FLAG_CPU_X | FLAG_QUIET;
+	dmisysroot = data->opts->sysroot;
+
+	/* Tables in root directory given by --sysroot are readable by anybody */
+	if(getuid() && data->opts->sysroot == NULL)
+	{
+		MSG_WARNING(_("Skip call to dmidecode (need to be root)"));
+		return 1;
+	}
+
+	MSG_VERBOSE(_("Calling dmidecode"));
+	opt.type = calloc(256, sizeof(uint8_t));
+	if(opt.type == NULL)
+	{
+		MSG_ERROR(_("failed to allocate memory for dmidecode"));
+		return 2;
+	}
+
+	/* Tab CPU */
+	dmidata[PROC_PACKAGE] = &data->tab_cpu[VALUE][PACKAGE];
+	dmidata[PROC_BUS]     = &data->tab_cpu[VALUE][BUSSPEED];
+	opt.type[4]           = 1;
+	err                  += dmidecode();
+	if(data->tab_cpu[VALUE][BUSSPEED] != NULL && strtod(data->tab_cpu[VALUE][BUSSPEED], NULL) > 0)
+		metric_set_double(data, MT_BUSSPEED, strtod(data->tab_cpu[VALUE][BUSSPEED], NULL));
+
+	/* Tab Motherboard */
+	for(i = MANUFACTURER; i < LASTMOTHERBOARD; i++)
+		dmidata[i]    = &data->tab_motherboard[VALUE][i];
+	memset(opt.type, 0, 256 * sizeof(uint8_t));
+	opt.type[0]           = 1;
+	opt.type[2]           = 1;
+	err                  += dmidecode();
+
+	/* Tab RAM: each memory device adds a bank */
+	dmilabels             = data;
+	memset(opt.type, 0, 256 * sizeof(uint8_t));
+	opt.type[17]          = 1;
+	err                  += dmidecode();
+
+	if(err)
+		MSG_ERROR(_("failed to call dmidecode"));
+
+	free(opt.type);
+	return err;
+}
+#endif /* HAS_DMIDECODE */
+
+/* Load CPU MSR kernel module (called once by process) */
+static void load_msr_driver_once(void)
 {
-	static bool loaded = false;
 #ifdef __linux__
-	if(!loaded && !getuid())
+	if(!sysroot_access(NULL, "/dev/cpu/0/msr", F_OK))
+		msr_loaded = true;
+	else if(!getuid())
 	{
 		MSG_VERBOSE(_("Loading 'msr' kernel module"));
-		loaded = !system("modprobe msr 2> /dev/null");
-		if(!loaded)
+		msr_loaded = !run_command("modprobe msr");
+		if(!msr_loaded)
 			MSG_ERROR(_("failed to load 'msr' kernel module"));
 	}
 #endif /* __linux__ */
-	return loaded;
 }
 
-/* MSRs values provided by libcpuid */
-static int call_libcpuid_msr(Labels *data)
+/* Load CPU MSR kernel module */
+static bool load_msr_driver(void)
 {
-#ifdef HAVE_LIBCPUID_0_2_2
-	static bool load_module = true;
-	int voltage, temp, bclk;
-	struct msr_driver_t *msr = NULL;
+	pthread_once(&msr_once, load_msr_driver_once);
+	return msr_loaded;
+}
 
-	if(getuid())
-	{
-		MSG_WARNING(_("Skip CPU MSR opening (need to be root)"));
-		return 1;
-	}
+/* CPU MSR values, read from a pool of files kept open */
+static int call_msr(Labels *data)
+{
+	const unsigned core = data->opts->selected_core;
+	double mult;
+	char *path = getenv("CPUX_MSR_PATH");
+	MsrData *m_data = data->m_data;
+	CoreData *c_data = data->c_data;
 
-	/* MSR stuff */
-	MSG_VERBOSE(_("Calling libcpuid for retrieving CPU MSR values"));
-	if(load_module)
+	if(m_data->fd == NULL)
 	{
-		load_msr_driver();
-		load_module = false;
-	}
+		/* CPUX_MSR_PATH can point to other files (e.g. "/tmp/msr/%u"), which do not need root privileges;
+		 * so do MSR files in root directory given by --sysroot */
+		if(path == NULL && data->opts->sysroot != NULL)
+			path = DEV_MSR;
+		else if(path == NULL)
+		{
+			if(getuid())
+			{
+				MSG_WARNING(_("Skip CPU MSR opening (need to be root)"));
+				return 1;
+			}
+			load_msr_driver();
+			path = DEV_MSR;
+		}
 
-	msr = cpu_msr_driver_open_core(opts->selected_core);
-	if(msr == NULL)
-	{
-		MSG_ERROR(_("failed to open CPU MSR"));
-		return 2;
+		MSG_VERBOSE(_("Opening CPU MSR files"));
+		if(msr_open(m_data, path, data->opts))
+		{
+			MSG_ERROR(_("failed to open CPU MSR"));
+			return 2;
+		}
 	}
 
-	/* Get values from MSR */
-	voltage = cpu_msrinfo(msr, INFO_VOLTAGE);
-	temp    = cpu_msrinfo(msr, INFO_TEMPERATURE);
-	bclk    = cpu_msrinfo(msr, INFO_BCLK);
+	MSG_VERBOSE(_("Reading CPU MSR values"));
+	msr_sample(m_data);
+	if(core >= m_data->core_count || m_data->fd[core] < 0)
+		return 3;
 
 	/* CPU Voltage */
-	if(voltage != CPU_INVALID_VALUE)
-		iasprintf(&data->tab_cpu[VALUE][VOLTAGE],     "%.3f V", (double) voltage / 100);
+	if(m_data->voltage[core] > 0)
+		metric_set_double(data, MT_VOLTAGE,     m_data->voltage[core]);
 
 	/* CPU Temperature */
-	if(temp != CPU_INVALID_VALUE)
-		iasprintf(&data->tab_cpu[VALUE][TEMPERATURE], "%i°C", temp);
+	if(m_data->temperature[core] > 0)
+		metric_set_double(data, MT_TEMPERATURE, m_data->temperature[core]);
 
-	/* Base clock */
-	if(bclk != CPU_INVALID_VALUE)
+	/* Multipliers (min-max) */
+	if(m_data->min_mult > 0 && m_data->max_mult > 0)
 	{
-		data->bus_freq = (double) bclk / 100;
-		iasprintf(&data->tab_cpu[VALUE][BUSSPEED],    "%.2f MHz", data->bus_freq);
+		metric_set_double(data, MT_MULTMIN,    m_data->min_mult);
+		metric_set_double(data, MT_MULTMAX,    m_data->max_mult);
 	}
 
-#ifdef HAVE_LIBCPUID_0_3_0
-	int min_mult, max_mult;
-
-	min_mult = cpu_msrinfo(msr, INFO_MIN_MULTIPLIER);
-	max_mult = cpu_msrinfo(msr, INFO_MAX_MULTIPLIER);
-
-	/* Multipliers (min-max) */
-	if(min_mult != CPU_INVALID_VALUE && max_mult != CPU_INVALID_VALUE)
-		iasprintf(&data->tab_cpu[VALUE][MULTIPLIER], "x%.1f (%.0f-%.0f)",
-		         data->cpu_freq / data->bus_freq,
-			 (double) min_mult / 100, (double) max_mult / 100);
-#endif /* HAVE_LIBCPUID_0_3_0 */
-	cpu_msr_driver_close(msr);
-#endif /* HAVE_LIBCPUID_0_2_2 */
+	/* Average multiplier since last sample is more accurate than requested one */
+	mult = (m_data->eff_multiplier[core] > 0) ? m_data->eff_multiplier[core] : m_data->multiplier[core];
+	if(mult > 0)
+	{
+		metric_set_double(data, MT_MULTIPLIER, mult);
+		/* Base clock, only if it was not measured (e.g. by Dmidecode) */
+		if(metric_get(data, MT_CORESPEED) > 0 && (!metric_valid(data, MT_BUSSPEED) || c_data->bus_derived))
+		{
+			metric_set_double(data, MT_BUSSPEED, metric_get(data, MT_CORESPEED) / mult);
+			c_data->bus_derived = true;
+		}
+	}
 
 	return 0;
 }
-#endif /* HAS_LIBCPUID */
 
-#if HAS_DMIDECODE
-/* Call Dmidecode through CPU-X but do nothing else */
-int run_dmidecode(void)
+/* Read an identifier in topology directory of a logical CPU */
+static int topology_read_id(const Options *options, unsigned cpu, const char *file, int32_t *id)
 {
-	opt.type  = NULL;
-	opt.flags = (opts->verbose) ? 0 : FLAG_QUIET;
-	return dmidecode();
+	int ret;
+	char *path;
+	FILE *f;
+
+	asprintf(&path, "%s%u/topology/%s", SYS_CPU, cpu, file);
+	f = sysroot_fopen(options, path, "r");
+	free(path);
+	if(f == NULL)
+		return 1;
+	ret = (fscanf(f, "%" SCNd32, id) != 1);
+	fclose(f);
+
+	return ret;
 }
 
-/* Elements provided by dmidecode (need root privileges) */
-static int call_dmidecode(Labels *data)
+/* Order logical CPUs by socket, die and core */
+static int topology_compare(const void *a, const void *b)
 {
-	int i, err = 0;
+	const int32_t *x = a, *y = b;
+	int i;
 
-	/* Dmidecode options */
-	opt.type  = NULL;
-	opt.flags = (opts->verbose) ? FLAG_CPU_X : FLAG_CPU_X | FLAG_QUIET;
+	for(i = 0; i < TOPOLOGY_IDS; i++)
+	{
+		if(x[i] != y[i])
+			return (x[i] < y[i]) ? -1 : 1;
+	}
 
-	if(getuid())
+	return 0;
+}
+
+/* Build CPU topology (sockets -> dies -> cores -> threads) */
+static int cpu_topology(Labels *data)
+{
+	long count;
+	bool sysfs;
+	uint32_t i, online = 0;
+	int32_t (*ids)[TOPOLOGY_IDS + 1];  /* Socket, die and core id, then CPU number */
+	TopologyData *t = data->t_data;
+
+	MSG_VERBOSE(_("Building CPU topology"));
+	count = sysroot_cpu_count(data->opts);
+	if((ids = malloc(count * sizeof(*ids))) == NULL || (t->cpus = malloc(count * sizeof(CpuTopology))) == NULL)
 	{
-		MSG_WARNING(_("Skip call to dmidecode (need to be root)"));
+		MSG_ERROR(_("failed to allocate memory for CPU topology"));
+		free(ids);
 		return 1;
 	}
 
-	MSG_VERBOSE(_("Calling dmidecode"));
-	opt.type = calloc(256, sizeof(uint8_t));
-	if(opt.type == NULL)
+	/* Without sysfs, each logical CPU is a core; offline CPUs have no topology, and die_id only exists since Linux 5.2 */
+	sysfs = !sysroot_access(data->opts, SYS_CPU "0/topology", F_OK);
+	for(i = 0; i < (uint32_t) count; i++)
 	{
-		MSG_ERROR(_("failed to allocate memory for dmidecode"));
-		return 2;
+		t->cpus[i] = (CpuTopology) { .socket = -1, .die = -1, .core = -1 };
+		ids[online][0] = ids[online][1] = 0;
+		ids[online][2] = i;
+		ids[online][TOPOLOGY_IDS] = i;
+		if(sysfs)
+		{
+			if(topology_read_id(data->opts, i, "physical_package_id", &ids[online][0]) || topology_read_id(data->opts, i, "core_id", &ids[online][2]))
+				continue;
+			topology_read_id(data->opts, i, "die_id", &ids[online][1]);
+		}
+		online++;
 	}
 
-	/* Tab CPU */
-	dmidata[PROC_PACKAGE] = &data->tab_cpu[VALUE][PACKAGE];
-	dmidata[PROC_BUS]     = &data->tab_cpu[VALUE][BUSSPEED];
-	opt.type[4]           = 1;
-	err                  += dmidecode();
-	if(data->tab_cpu[VALUE][BUSSPEED] != NULL)
-		data->bus_freq = strtod(data->tab_cpu[VALUE][BUSSPEED], NULL);
+	/* Sockets, dies and cores are numbered in order, from 0 */
+	qsort(ids, online, sizeof(*ids), topology_compare);
+	t->socket_count = t->die_count = t->core_count = 0;
+	for(i = 0; i < online; i++)
+	{
+		const bool new_socket = (i == 0) || ids[i][0] != ids[i - 1][0];
+		const bool new_die    = new_socket || ids[i][1] != ids[i - 1][1];
+		const bool new_core   = new_die    || ids[i][2] != ids[i - 1][2];
+
+		t->socket_count += new_socket;
+		t->die_count    += new_die;
+		t->core_count   += new_core;
+		t->cpus[ids[i][TOPOLOGY_IDS]] = (CpuTopology) { .socket = t->socket_count - 1, .die = t->die_count - 1, .core = t->core_count - 1 };
+	}
+	t->thread_count = count;
+	free(ids);
+	if(online == 0)
+		return 1;
 
-	/* Tab Motherboard */
-	for(i = MANUFACTURER; i < LASTMOTHERBOARD; i++)
-		dmidata[i]    = &data->tab_motherboard[VALUE][i];
-	opt.type[0]           = 1;
-	opt.type[2]           = 1;
-	err                  += dmidecode();
+	/* All logical CPUs can be selected, not only those of first socket */
+	data->cpu_count = t->thread_count;
+	if(data->opts->selected_core >= data->cpu_count)
+		data->opts->selected_core = 0;
+	if(data->tab_cpu[VALUE][SOCKETS] == NULL)
+		iasprintf(&data->tab_cpu[VALUE][SOCKETS], "%u", t->socket_count);
+	if(data->tab_cpu[VALUE][CORES] == NULL)
+		iasprintf(&data->tab_cpu[VALUE][CORES],   "%u", t->core_count / t->socket_count);
+	if(data->tab_cpu[VALUE][THREADS] == NULL)
+		iasprintf(&data->tab_cpu[VALUE][THREADS], "%u", online / t->socket_count);
+
+	return 0;
+}
+
+/* Allocate counters and open statistics source for CPU usage */
+static int usage_init(UsageData *u_data, const Options *options)
+{
+	long count;
+
+	count = sysroot_cpu_count(options);
+
+#ifdef __linux__
+	u_data->fd = sysroot_open(options, "/proc/stat", O_RDONLY | O_CLOEXEC);
+	if(u_data->fd < 0)
+	{
+		MSG_ERROR(_("failed to open %s"), "/proc/stat");
+		return 1;
+	}
+	u_data->buff_size = (count + 1) * STAT_LINE_SIZE;
+	u_data->hz        = sysconf(_SC_CLK_TCK);
+#else
+	struct clockinfo clock;
+	size_t len = sizeof(clock);
+
+	u_data->buff_size = count * CPUSTATES * sizeof(long);
+	u_data->hz        = sysctlbyname("kern.clockrate", &clock, &len, NULL, 0) ? 0 : (clock.stathz ? clock.stathz : clock.hz);
+#endif /* __linux__ */
 
-	/* Tab RAM */
-	for(i = BANK0_0; i < LASTMEMORY; i++)
-		dmidata[i]    = &data->tab_memory[VALUE][i];
-	opt.type[17]          = 1;
-	err                  += dmidecode();
+	u_data->core_count = count;
+	u_data->buff       = malloc(u_data->buff_size);
+	u_data->ticks[0]   = calloc((count + 1) * LASTSTAT, sizeof(uint64_t));
+	u_data->ticks[1]   = calloc((count + 1) * LASTSTAT, sizeof(uint64_t));
+	u_data->percent    = calloc((count + 1) * LASTSTAT, sizeof(double));
+	u_data->rate       = calloc((count + 1) * LASTSTAT, sizeof(double));
+	u_data->usage      = calloc(count + 1, sizeof(double));
+	if(u_data->buff == NULL || u_data->ticks[0] == NULL || u_data->ticks[1] == NULL ||
+	   u_data->percent == NULL || u_data->rate == NULL || u_data->usage == NULL)
+	{
+		MSG_ERROR(_("failed to allocate memory for CPU usage calculation"));
+		return 2;
+	}
 
-	while(data->tab_memory[VALUE][data->dimms_count] != NULL)
-		data->dimms_count++;
+	return 0;
+}
 
-	if(err)
-		MSG_ERROR(_("failed to call dmidecode"));
+#ifdef __linux__
+/* Parse an unsigned integer, and move pointer after it */
+static inline uint64_t parse_u64(const char **p)
+{
+	uint64_t val = 0;
 
-	free(opt.type);
-	return err;
+	while(**p == ' ')
+		(*p)++;
+	while(**p >= '0' && **p <= '9')
+		val = val * 10 + (*(*p)++ - '0');
+
+	return val;
 }
-#endif /* HAS_DMIDECODE */
 
-static long **allocate_2d_array(int rows, int columns)
+/* Fill counters from "cpu" lines of /proc/stat; return false if buffer ends before last line */
+static bool parse_proc_stat(const char *p, const char *end, uint64_t *ticks, unsigned core_count)
 {
-	int i;
-	long **array = NULL;
+	unsigned i, row;
+	const char *eol;
 
-	array = calloc(rows, sizeof(long *));
-	if(array == NULL)
-		goto error;
-	for(i = 0; i < rows; i++)
+	while(end - p > 3 && !memcmp(p, "cpu", 3))
 	{
-		array[i] = calloc(columns, sizeof(long));
-		if(array[i] == NULL)
-			goto error;
+		if((eol = memchr(p, '\n', end - p)) == NULL)
+			return false;
+
+		/* "cpu" is the total, "cpuN" is logical CPU N */
+		p  += 3;
+		row = (*p == ' ') ? 0 : parse_u64(&p) + 1;
+		if(row <= core_count)
+		{
+			for(i = 0; i < LASTSTAT && p < eol; i++)
+				ticks[row * LASTSTAT + i] = parse_u64(&p);
+		}
+		p = eol + 1;
 	}
 
-	return array;
-error:
-	MSG_ERROR(_("failed to allocate memory for CPU usage calculation (rows)"));
-	return NULL;
+	return end - p > 3;
 }
+#endif /* __linux__ */
 
-/* Calculate total CPU usage */
-static int cpu_usage(Labels *data)
+/* Read CPU time counters in given buffer */
+static int usage_read(UsageData *u_data, uint64_t *ticks)
 {
-	enum StatType { USER, NICE, SYSTEM, INTR, IDLE, LASTSTAT };
-	int i, ind, core = -1;
-	static long **pre = NULL;
-	long **new;
-	double loadavg;
+	/* Offline CPUs are not reported */
+	memset(ticks, 0, (u_data->core_count + 1) * LASTSTAT * sizeof(uint64_t));
 
-	MSG_VERBOSE(_("Calculating CPU usage"));
-	if(pre == NULL)
-		pre = allocate_2d_array(data->cpu_count + 1, LASTSTAT);
-	new = allocate_2d_array(data->cpu_count + 1, LASTSTAT);
+#ifdef __linux__
+	char *buff;
+	ssize_t len;
+
+	while((len = pread(u_data->fd, u_data->buff, u_data->buff_size, 0)) > 0 &&
+	      !parse_proc_stat(u_data->buff, u_data->buff + len, ticks, u_data->core_count))
+	{
+		/* Buffer is too small: this only happens once */
+		if((size_t) len < u_data->buff_size || (buff = realloc(u_data->buff, u_data->buff_size * 2)) == NULL)
+			return 1;
+		u_data->buff       = buff;
+		u_data->buff_size *= 2;
+	}
 
-	if(new == NULL || pre == NULL)
+	return (len <= 0);
+#else
+	unsigned i, j;
+	size_t len = u_data->buff_size;
+	long *cp_times = (long *) u_data->buff;
+	const int stat[CPUSTATES] = { [CP_USER] = STAT_USER, [CP_NICE] = STAT_NICE, [CP_SYS] = STAT_SYSTEM,
+	                              [CP_INTR] = STAT_IRQ,  [CP_IDLE] = STAT_IDLE };
+
+	if(sysctlbyname("kern.cp_times", cp_times, &len, NULL, 0))
 		return 1;
 
-#ifdef __linux__
-	FILE *fp;
+	for(i = 0; i < len / (CPUSTATES * sizeof(long)) && i < u_data->core_count; i++)
+	{
+		for(j = 0; j < CPUSTATES; j++)
+		{
+			ticks[(i + 1) * LASTSTAT + stat[j]]  = cp_times[i * CPUSTATES + j];
+			ticks[stat[j]]                      += cp_times[i * CPUSTATES + j];
+		}
+	}
 
-	ind = (core < 0) ? 0 : core + 1;
-	fp = fopen("/proc/stat","r");
-	for(i = 0; i <= data->cpu_count; i++)
-		fscanf(fp,"%*s %li %li %li %li %*s %*s %*s %*s %*s %*s", &new[i][USER], &new[i][NICE], &new[i][SYSTEM], &new[i][IDLE]);
-	fclose(fp);
+	return 0;
+#endif /* __linux__ */
+}
+
+/* Time of a usage sample, in nanoseconds since boot */
+static uint64_t usage_clock(void)
+{
+	struct timespec now;
+
+#ifdef CLOCK_BOOTTIME
+	clock_gettime(CLOCK_BOOTTIME, &now);
 #else
-	long cp_time[LASTSTAT * 8];
-	size_t len = sizeof(cp_time);
-	const char *sysctlvarname = (core < 0) ? "kern.cp_time" : "kern.cp_times";
+	clock_gettime(CLOCK_MONOTONIC, &now);
+#endif /* CLOCK_BOOTTIME */
+	return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
 
-	ind = (core < 0) ? 0 : core;
-	if(sysctlbyname(sysctlvarname, &cp_time, &len, NULL, 0))
+/* Calculate CPU usage, for all logical CPUs */
+static int cpu_usage(Labels *data)
+{
+	unsigned i, j;
+	uint64_t *new, *pre, delta[LASTSTAT], total, all_ticks = 0, core_ticks = 0;
+	double elapsed;
+	UsageData *u_data = data->u_data;
+
+	MSG_VERBOSE(_("Calculating CPU usage"));
+	if(u_data->usage == NULL && usage_init(u_data, data->opts))
 		return 1;
-	for(i = 0; i <= data->cpu_count * LASTSTAT; i++)
-		new[i / LASTSTAT][i % LASTSTAT] = cp_time[i];
-#endif /* __linux__ */
-	loadavg = (double)((new[ind][USER] + new[ind][NICE] + new[ind][SYSTEM] + new[ind][INTR]) -
-	                   (pre[ind][USER] + pre[ind][NICE] + pre[ind][SYSTEM] + pre[ind][INTR])) /
-	                  ((new[ind][USER] + new[ind][NICE] + new[ind][SYSTEM] + new[ind][INTR] + new[ind][IDLE]) -
-	                   (pre[ind][USER] + pre[ind][NICE] + pre[ind][SYSTEM] + pre[ind][INTR] + pre[ind][IDLE]));
 
-	if(loadavg > 0.0 && ind == 0)
-		asprintf(&data->tab_cpu[VALUE][USAGE], "%6.2f %%", loadavg * 100);
+	/* Counters are double-buffered: no allocation after first call */
+	u_data->current = !u_data->current;
+	new = u_data->ticks[u_data->current];
+	pre = u_data->ticks[!u_data->current];
+	if(usage_read(u_data, new))
+	{
+		MSG_ERROR(_("failed to read CPU statistics"));
+		return 2;
+	}
+
+	/* First sample is compared to boot time */
+	u_data->stamp[u_data->current] = usage_clock();
+	elapsed = (double) (u_data->stamp[u_data->current] - u_data->stamp[!u_data->current]) / 1e9;
+
+	for(i = 0; i <= u_data->core_count; i++)
+	{
+		total = 0;
+		for(j = 0; j < LASTSTAT; j++)
+		{
+			/* Some counters (like iowait) can go backwards */
+			delta[j] = (new[i * LASTSTAT + j] > pre[i * LASTSTAT + j]) ? new[i * LASTSTAT + j] - pre[i * LASTSTAT + j] : 0;
+			/* Guest time is already counted in user time */
+			if(j != STAT_GUEST && j != STAT_GUESTNICE)
+				total += delta[j];
+		}
+		for(j = 0; j < LASTSTAT; j++)
+		{
+			u_data->percent[i * LASTSTAT + j] = total ? (double) delta[j] / total * 100 : 0.0;
+			u_data->rate[i * LASTSTAT + j]    = (elapsed > 0 && u_data->hz > 0) ? delta[j] / (elapsed * u_data->hz) : 0.0;
+		}
+		u_data->usage[i] = total ? 100.0 - u_data->percent[i * LASTSTAT + STAT_IDLE] - u_data->percent[i * LASTSTAT + STAT_IOWAIT] : 0.0;
+		if(i == 0)
+			all_ticks = total;
+		else if(i == data->opts->selected_core + 1)
+			core_ticks = total;
+	}
+
+	/* An idle machine has a usage of 0%, only an empty sample (no tick elapsed) is skipped */
+	if(all_ticks > 0)
+		metric_set_double(data, MT_USAGE, u_data->usage[0]);
+	if(data->opts->selected_core < u_data->core_count && core_ticks > 0)
+		metric_set_double(data, MT_COREUSAGE, u_data->usage[data->opts->selected_core + 1]);
 
-	for(i = 0; i <= data->cpu_count; i++)
-		memcpy(pre[i], new[i], LASTSTAT * sizeof(long));
-	free(new);
 	return 0;
 }
 
@@ -665,7 +1334,6 @@ int run_bandwidth(void)
 /* Compute CPU cache speed */
 static int call_bandwidth(Labels *data)
 {
-	static bool first = true;
 	int i, err;
 	pthread_t tid;
 
@@ -674,14 +1342,14 @@ static int call_bandwidth(Labels *data)
 
 	MSG_VERBOSE(_("Calling bandwidth"));
 	/* Check if selectionned test is valid */
-	if(opts->bw_test >= LASTTEST)
+	if(data->opts->bw_test >= LASTTEST)
 	{
 		MSG_WARNING(_("Invalid bandwidth test selectionned!"));
 		MSG_STDERR(_("List of available tests:"));
 		for(i = SEQ_128_R; i < LASTTEST; i++)
 			MSG_STDERR("\t%i: %s", i, tests[i].name);
-		opts->bw_test = 0;
-		MSG_STDERR(_("%s will use test #%i (%s)"), PRGNAME, opts->bw_test, tests[opts->bw_test].name);
+		data->opts->bw_test = 0;
+		MSG_STDERR(_("%s will use test #%i (%s)"), PRGNAME, data->opts->bw_test, tests[data->opts->bw_test].name);
 	}
 
 	/* Set test names */
@@ -695,15 +1363,18 @@ static int call_bandwidth(Labels *data)
 
 	/* Run bandwidth in a separated thread */
 	err = pthread_create(&tid, NULL, (void *)bandwidth, data);
-	if(first)
+	if(!data->c_data->bw_started)
 	{
 		err += pthread_join(tid, NULL);
-		first = false;
+		data->c_data->bw_started = true;
 	}
 
-	/* Speed labels */
-	for(i = L1SPEED; i < LASTCACHES; i += CACHEFIELDS)
-		iasprintf(&data->tab_caches[VALUE][i], "%.2f MB/s", (double) data->w_data->speed[(i - L1SPEED) / CACHEFIELDS] / 10);
+	/* Speed metrics */
+	for(i = 0; i < LASTCACHES / CACHEFIELDS; i++)
+	{
+		if(data->w_data->speed[i] > 0)
+			metric_set_double(data, MT_L1SPEED + i, (double) data->w_data->speed[i] / 10);
+	}
 
 	return err;
 }
@@ -715,7 +1386,7 @@ static char *find_driver(struct pci_dev *dev, char *buff)
 {
 	/* Taken from http://git.kernel.org/cgit/utils/pciutils/pciutils.git/tree/ls-kernel.c */
 	int n;
-	char name[MAXSTR], *drv, *base;
+	char name[PATH_MAX], *drv, *base;
 
 	MSG_VERBOSE(_("Finding graphic card driver"));
 	if(dev->access->method != PCI_ACCESS_SYS_BUS_PCI)
@@ -751,14 +1422,43 @@ static char *find_driver(struct pci_dev *dev, char *buff)
 		return buff;
 }
 
+/* Sort GPUs added from 'first' by PCI address, so they are in same order as GPU sensors */
+static void sort_gpus(Labels *data, uint64_t *order, uint32_t first)
+{
+	uint32_t i, j, f;
+	uint64_t key;
+	char *str, **row_a, **row_b;
+
+	for(i = first + 1; i < data->gpu_count; i++)
+	{
+		for(j = i; (j > first) && (order[j - first - 1] > order[j - first]); j--)
+		{
+			key                  = order[j - first - 1];
+			order[j - first - 1] = order[j - first];
+			order[j - first]     = key;
+			row_a                = &data->tab_graphics[VALUE][(j - 1) * GPUFIELDS];
+			row_b                = &data->tab_graphics[VALUE][j * GPUFIELDS];
+			for(f = 0; f < GPUFIELDS; f++)
+			{
+				str      = row_a[f];
+				row_a[f] = row_b[f];
+				row_b[f] = str;
+			}
+		}
+	}
+}
+
 /* Find some PCI devices, like chipset and GPU */
 static int find_devices(Labels *data)
 {
 	/* Adapted from http://git.kernel.org/cgit/utils/pciutils/pciutils.git/tree/example.c */
-	int i, nbgpu = 0, chipset = 0;
+	int i, gpu, chipset = 0;
+	bool sortable = true;
+	const uint32_t first = data->gpu_count;
+	uint64_t *order = NULL, *tmp;
 	struct pci_access *pacc;
 	struct pci_dev *dev;
-	char namebuf[MAXSTR], *vendor, *product, *drivername;
+	char namebuf[MAXSTR], sysfs[PATH_MAX], *vendor, *product, *drivername;
 	enum Vendors { CURRENT = 3, LASTVENDOR };
 	char *gpu_vendors[LASTVENDOR] = { "AMD", "Intel", "NVIDIA" };
 
@@ -772,6 +1472,13 @@ static int find_devices(Labels *data)
 		return 1;
 	}
 #endif /* __FreeBSD__ */
+	/* Devices of root directory given by --sysroot are only read in its sysfs */
+	if(data->opts->sysroot != NULL)
+	{
+		snprintf(sysfs, sizeof(sysfs), "%s/sys/bus/pci", data->opts->sysroot);
+		pacc->method = PCI_ACCESS_SYS_BUS_PCI;
+		pci_set_param(pacc, "sysfs.path", sysfs);
+	}
 	pci_init(pacc);	    /* Initialize the PCI library */
 	pci_scan_bus(pacc); /* We want to get the list of devices */
 
@@ -792,93 +1499,179 @@ static int find_devices(Labels *data)
 		}
 
 		/* Looking for GPU */
-		if(nbgpu < LASTGRAPHICS / GPUFIELDS &&
-		  (dev->device_class == PCI_BASE_CLASS_DISPLAY	||
+		if((dev->device_class == PCI_BASE_CLASS_DISPLAY	||
 		  dev->device_class == PCI_CLASS_DISPLAY_VGA	||
 		  dev->device_class == PCI_CLASS_DISPLAY_XGA	||
 		  dev->device_class == PCI_CLASS_DISPLAY_3D	||
-		  dev->device_class == PCI_CLASS_DISPLAY_OTHER))
+		  dev->device_class == PCI_CLASS_DISPLAY_OTHER) &&
+		  (gpu = labels_add_device(data, NO_GRAPHICS)) >= 0)
 		{
 			for(i = 0; (i < CURRENT) && (strstr(vendor, gpu_vendors[i]) == NULL); i++);
 
 			drivername = find_driver(dev, namebuf);
 			if(drivername != NULL)
-				iasprintf(&data->tab_graphics[VALUE][GPU1VENDOR	+ nbgpu * GPUFIELDS], _("%s (%s driver)"), gpu_vendors[i], drivername);
+				iasprintf(&data->tab_graphics[VALUE][GPUVENDOR	+ gpu * GPUFIELDS], _("%s (%s driver)"), gpu_vendors[i], drivername);
+			else
+				iasprintf(&data->tab_graphics[VALUE][GPUVENDOR	+ gpu * GPUFIELDS], "%s", gpu_vendors[i]);
+			iasprintf(&data->tab_graphics[VALUE][GPUMODEL	+ gpu * GPUFIELDS], "%s", product);
+
+			if(sortable && (tmp = realloc(order, (gpu - first + 1) * sizeof(uint64_t))) != NULL)
+			{
+				order = tmp;
+				order[gpu - first] = PCI_ORDER(dev->domain, dev->bus, dev->dev, dev->func);
+			}
 			else
-				iasprintf(&data->tab_graphics[VALUE][GPU1VENDOR	+ nbgpu * GPUFIELDS], "%s", gpu_vendors[i]);
-			iasprintf(&data->tab_graphics[VALUE][GPU1MODEL	+ nbgpu * GPUFIELDS], "%s", product);
-			nbgpu++;
+				sortable = false;
 		}
 	}
 
 	/* Close everything */
-	data->gpu_count = nbgpu;
+	if(sortable)
+		sort_gpus(data, order, first);
 	pci_cleanup(pacc);
 	free(vendor);
 	free(product);
+	free(order);
 
 	if(!chipset)
 		MSG_ERROR(_("failed to find chipset vendor and model"));
-	if(!nbgpu)
+	if(!data->gpu_count)
 		MSG_ERROR(_("failed to find graphic card vendor and model"));
 
-	return !chipset + !nbgpu;
+	return !chipset + !data->gpu_count;
 }
 #endif /* HAS_LIBPCI */
 
-/* Retrieve GPU temperature */
+/* Find hardware sensors (hwmon and thermal zones) */
+static int find_sensors(Labels *data)
+{
+	if(data->s_data->init)
+		return 0;
+
+	if(sensors_init(data->s_data, data->opts))
+	{
+		MSG_WARNING(_("No hardware sensor found"));
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Retrieve temperature of each GPU */
 static int gpu_temperature(Labels *data)
 {
-	double temp = 0.0;
-	char *buff, *drm_hwmon, *drm_temp = NULL;
-	DIR *dp = NULL;
-	struct dirent *dir;
+	uint32_t i, found = 0;
+	const uint32_t count = (data->gpu_count > 0) ? data->gpu_count : 1; /* Metric of first GPU, even if graphics tab is empty */
+	double temp;
+	char *buff, text[MAXSTR];
 
 	MSG_VERBOSE(_("Retrieving GPU temperature"));
-	if(!popen_to_str("nvidia-settings -q GPUCoreTemp", &buff) || /* NVIDIA closed source driver */
-	   !popen_to_str("aticonfig --odgt | grep Sensor | awk '{ print $5 }'", &buff)) /* AMD closed source driver */
-		temp = atof(buff);
-	else /* Open source drivers */
-	{
-		asprintf(&drm_hwmon, "%s%i/device/hwmon/", SYS_DRM, 0);
-		dp = opendir(drm_hwmon);
-		if(dp)
+	/* Sensors and graphics tab list GPUs in PCI address order */
+	for(i = 0; i < count; i++)
+	{
+		temp = 0.0;
+		if(sensors_read(data->s_data, SENSOR_GPUTEMP, i, &temp) && (i == 0)) /* Closed source drivers do not provide a hwmon chip */
 		{
-			while((dir = readdir(dp)) != NULL)
-			{
-				asprintf(&drm_temp, "%s%i/device/hwmon/%s/temp1_input", SYS_DRM, 0, dir->d_name);
-				if(!access(drm_temp, R_OK) && !fopen_to_str(drm_temp, &buff))
-				{
-					temp = atof(buff) / 1000.0;
-					break;
-				}
-			}
-			closedir(dp);
+			/* Only call tools of a loaded driver */
+			if((!sysroot_access(data->opts, "/proc/driver/nvidia", F_OK) && !popen_to_str("nvidia-settings -q GPUCoreTemp", &buff)) || /* NVIDIA closed source driver */
+			   (!sysroot_access(data->opts, "/proc/ati", F_OK) && !popen_to_str("aticonfig --odgt | grep Sensor | awk '{ print $5 }'", &buff))) /* AMD closed source driver */
+				temp = atof(buff);
 		}
-	}
+		if(temp <= 0.0)
+			continue;
 
-	if(temp)
-	{
-		iasprintf(&data->tab_graphics[VALUE][GPU1TEMPERATURE], "%.2f°C", temp);
-		return 0;
+		found++;
+		if(i == 0)
+			metric_set_double(data, MT_GPU1TEMPERATURE, temp);
+		if(i < data->gpu_count)
+		{
+			/* Label is only reallocated when its text changes */
+			data->gpu_temperature[i] = temp;
+			snprintf(text, sizeof(text), "%.2f°C", temp);
+			if(data->tab_graphics[VALUE][GPUTEMPERATURE + i * GPUFIELDS] == NULL ||
+			   strcmp(data->tab_graphics[VALUE][GPUTEMPERATURE + i * GPUFIELDS], text))
+				iasprintf(&data->tab_graphics[VALUE][GPUTEMPERATURE + i * GPUFIELDS], "%s", text);
+		}
 	}
-	else
+
+	if(!found)
 	{
 		MSG_ERROR(_("failed to retrieve GPU temperature"));
 		return 1;
 	}
+
+	return 0;
+}
+
+#ifdef __linux__
+/* Read a value in /proc/sys/kernel (unlike uname(), it is also found in a capture) */
+static int proc_kernel_str(const Options *options, const char *name, char *buff, size_t size)
+{
+	char path[PATH_MAX];
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "/proc/sys/kernel/%s", name);
+	if((fp = sysroot_fopen(options, path, "r")) == NULL)
+		return 1;
+	if(fgets(buff, size, fp) == NULL)
+		buff[0] = '\0';
+	fclose(fp);
+	buff[strcspn(buff, "\n")] = '\0';
+
+	return (buff[0] == '\0');
+}
+
+/* Get PRETTY_NAME value in os-release file */
+static int os_release_name(const Options *options, char *buff, size_t size)
+{
+	char line[MAXSTR * 4], *src, *dst, quote = '\0';
+	FILE *fp;
+
+	if((fp = sysroot_fopen(options, OS_RELEASE, "r")) == NULL && (fp = sysroot_fopen(options, OS_RELEASE_DEFAULT, "r")) == NULL)
+		return 1;
+
+	line[0] = '\0';
+	while(fgets(line, sizeof(line), fp) != NULL && strncmp(line, "PRETTY_NAME=", 12));
+	fclose(fp);
+	if(strncmp(line, "PRETTY_NAME=", 12))
+		return 2;
+
+	/* Value can be quoted, and can contain escaped characters */
+	src = dst = line + 12;
+	if(*src == '"' || *src == '\'')
+		quote = *src++;
+	for(; *src != '\0' && *src != '\n' && *src != quote; src++)
+	{
+		if(*src == '\\' && quote && src[1] != '\0')
+			src++;
+		*dst++ = *src;
+	}
+	*dst = '\0';
+	snprintf(buff, size, "%s", line + 12);
+
+	return (buff[0] == '\0');
 }
+#endif /* __linux__ */
 
 /* Satic elements for System tab, OS specific */
 static int system_static(Labels *data)
 {
 	int err = 0;
-	char *buff = NULL;
 	struct utsname name;
 
 	MSG_VERBOSE(_("Identifying running system"));
-	err = uname(&name);
-	if(err)
+#ifdef __linux__
+	char ostype[MAXSTR], release[MAXSTR * 2], hostname[MAXSTR * 2];
+
+	if(!proc_kernel_str(data->opts, "ostype", ostype, sizeof(ostype)) && !proc_kernel_str(data->opts, "osrelease", release, sizeof(release)) &&
+	   !proc_kernel_str(data->opts, "hostname", hostname, sizeof(hostname)))
+	{
+		iasprintf(&data->tab_system[VALUE][KERNEL],   "%s %s", ostype, release); /* Kernel label */
+		iasprintf(&data->tab_system[VALUE][HOSTNAME], "%s",    hostname); /* Hostname label */
+	}
+	else
+#endif /* __linux__ */
+	if((err = uname(&name)))
 		MSG_ERROR(_("failed to identify running system"));
 	else
 	{
@@ -886,14 +1679,20 @@ static int system_static(Labels *data)
 		iasprintf(&data->tab_system[VALUE][HOSTNAME], "%s",    name.nodename); /* Hostname label */
 	}
 
-	/* Compiler label */
-	err += popen_to_str("cc --version", &buff);
-	iasprintf(&data->tab_system[VALUE][COMPILER], buff);
+	/* Compiler label (the one used to build CPU-X) */
+	iasprintf(&data->tab_system[VALUE][COMPILER], "%s %s", CC, __VERSION__);
 
 #ifdef __linux__
+	char tmp[MAXSTR * 2];
+
 	/* Distribution label */
-	err += popen_to_str("grep PRETTY_NAME= /etc/os-release | awk -F '\"|\"' '{print $2}'", &buff);
-	iasprintf(&data->tab_system[VALUE][DISTRIBUTION], buff);
+	if(os_release_name(data->opts, tmp, sizeof(tmp)))
+	{
+		MSG_ERROR(_("failed to find distribution name"));
+		err++;
+	}
+	else
+		iasprintf(&data->tab_system[VALUE][DISTRIBUTION], "%s", tmp);
 #else
 	char tmp[MAXSTR];
 	size_t len = sizeof(tmp);
@@ -910,13 +1709,19 @@ static int system_static(Labels *data)
 	return err;
 }
 
+#if HAS_LIBSTATGRAB
+/* Initialize libstatgrab (called once by process) */
+static void statgrab_init_once(void)
+{
+	statgrab_init = (sg_init(0) == SG_ERROR_NONE);
+}
+#endif /* HAS_LIBSTATGRAB */
+
 /* Dynamic elements for System tab, provided by libprocps/libstatgrab */
 static int system_dynamic(Labels *data)
 {
-	int err = 0, i, j = 0;
+	int err = 0;
 	time_t uptime_s = 0;
-	struct tm *tm;
-	MemoryData *m_data = data->m_data;
 
 #if HAS_LIBPROCPS
 	const int div = 1e3;
@@ -927,17 +1732,16 @@ static int system_dynamic(Labels *data)
 
 	/* Memory variables */
 	meminfo();
-	m_data->mem_usage[BARUSED]    = kb_main_used    / div;
-	m_data->mem_usage[BARBUFFERS] = kb_main_buffers / div;
-	m_data->mem_usage[BARCACHED]  = kb_main_cached  / div;
-	m_data->mem_usage[BARFREE]    = kb_main_free    / div;
-	m_data->mem_usage[BARSWAP]    = kb_swap_used    / div;
-	m_data->mem_total             = kb_main_total   / div;
-	m_data->swap_total            = kb_swap_total   / div;
+	metric_set_int(data, MT_MEMTOTAL,   kb_main_total   / div);
+	metric_set_int(data, MT_SWAPTOTAL,  kb_swap_total   / div);
+	metric_set_int(data, MT_MEMUSED,    kb_main_used    / div);
+	metric_set_int(data, MT_MEMBUFFERS, kb_main_buffers / div);
+	metric_set_int(data, MT_MEMCACHED,  kb_main_cached  / div);
+	metric_set_int(data, MT_MEMFREE,    kb_main_free    / div);
+	metric_set_int(data, MT_SWAPUSED,   kb_swap_used    / div);
 #endif /* HAS_LIBPROCPS */
 
 #if HAS_LIBSTATGRAB
-	static bool called = false;
 	const int div = 1e6;
 	sg_mem_stats *mem; /* Memory labels */
 	sg_swap_stats *swap;
@@ -945,11 +1749,8 @@ static int system_dynamic(Labels *data)
 
 	MSG_VERBOSE(_("Calling libstatgrab"));
 	/* Libstatgrab initialization */
-	if(!called)
-	{
-		err += sg_init(0);
-		called = true;
-	}
+	pthread_once(&statgrab_once, statgrab_init_once);
+	err += !statgrab_init;
 	mem  = sg_get_mem_stats(NULL);
 	swap = sg_get_swap_stats(NULL);
 	info = sg_get_host_info(NULL);
@@ -958,64 +1759,257 @@ static int system_dynamic(Labels *data)
 	uptime_s = info->uptime;
 
 	/* Memory variables */
-	m_data->mem_usage[BARUSED]    = mem->used   / div;
-	m_data->mem_usage[BARBUFFERS] = 0;
-	m_data->mem_usage[BARCACHED]  = mem->cache  / div;
-	m_data->mem_usage[BARFREE]    = mem->free   / div;
-	m_data->mem_usage[BARSWAP]    = swap->used  / div;
-	m_data->mem_total             = mem->total  / div;
-	m_data->swap_total            = swap->total / div;
+	metric_set_int(data, MT_MEMTOTAL,   mem->total  / div);
+	metric_set_int(data, MT_SWAPTOTAL,  swap->total / div);
+	metric_set_int(data, MT_MEMUSED,    mem->used   / div);
+	metric_set_int(data, MT_MEMBUFFERS, 0);
+	metric_set_int(data, MT_MEMCACHED,  mem->cache  / div);
+	metric_set_int(data, MT_MEMFREE,    mem->free   / div);
+	metric_set_int(data, MT_SWAPUSED,   swap->used  / div);
 #endif /* HAS_LIBSTATGRAB */
-	/* Memory labels */
-	for(i = USED; i < SWAP; i++)
-		asprintf(&data->tab_system[VALUE][i], "%5u MB / %5u MB", m_data->mem_usage[j++], m_data->mem_total);
-	asprintf(&data->tab_system[VALUE][SWAP], "%5u MB / %5u MB", m_data->mem_usage[j], m_data->swap_total);
-
-	/* Uptime label */
-	tm = gmtime(&uptime_s);
-	asprintf(&data->tab_system[VALUE][UPTIME], _("%i days, %i hours, %i minutes, %i seconds"),
-	          tm->tm_yday, tm->tm_hour, tm->tm_min, tm->tm_sec);
+	metric_set_int(data, MT_UPTIME, uptime_s);
 
 	return err;
 }
 
-/* Compute all prime numbers in 'duration' seconds */
-static void *primes_bench(void *p_data)
+/* Current time of a clock, in ns */
+static uint64_t bench_clock(clockid_t clock)
 {
-	uint64_t  i, num, sup;
-	Labels    *data   = p_data;
-	BenchData *b_data = data->b_data;
+	struct timespec now;
 
-	while(b_data->elapsed < b_data->duration * 60 && b_data->run)
-	{
-		/* b_data->num is shared by all threads */
-		pthread_mutex_lock(&b_data->mutex_num);
-		b_data->num++;
-		num = b_data->num;
-		pthread_mutex_unlock(&b_data->mutex_num);
+	clock_gettime(clock, &now);
+	return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/* Test numbers from 'num' to 'end' by trial division */
+static uint64_t primes_block(BenchData *b_data, uint64_t num, uint64_t end, uint64_t *candidates)
+{
+	uint64_t i, sup, primes = 0;
+	const bool fast_mode = (b_data->mode == BENCH_PRIMEFAST);
 
+	for(; (num < end) && __atomic_load_n(&b_data->run, __ATOMIC_RELAXED); num++)
+	{
 		/* Slow mode: loop from i to num, prime if num == i
 		   Fast mode: loop from i to sqrt(num), prime if num mod i != 0 */
-		sup = b_data->fast_mode ? sqrt(num) : num;
+		sup = fast_mode ? sqrt(num) : num;
 		for(i = 2; (i < sup) && (num % i != 0); i++);
 
-		if((b_data->fast_mode && num % i) || (!b_data->fast_mode && num == i))
+		if((fast_mode && num % i) || (!fast_mode && num == i))
+			primes++;
+		(*candidates)++;
+	}
+
+	return primes;
+}
+
+/* Allocate segment and build pre-sieve patterns of a thread */
+static int sieve_init(SieveData *sieve, uint32_t segment)
+{
+	unsigned i, j, k, p;
+	uint64_t n;
+	const unsigned presieved[SIEVE_PATTERNS][SIEVE_PRESIEVED] = { { 3, 5, 7, 11, 13 }, { 17, 19, 23 } };
+
+	memset(sieve, 0, sizeof(SieveData));
+	if(posix_memalign((void **) &sieve->segment, CACHE_LINE_SIZE, segment))
+	{
+		sieve->segment = NULL;
+		return 1;
+	}
+
+	for(i = 0; i < SIEVE_PATTERNS; i++)
+	{
+		for(sieve->pattern_size[i] = 1, j = 0; presieved[i][j] != 0; j++)
+			sieve->pattern_size[i] *= presieved[i][j];
+		if((sieve->pattern[i] = malloc(sieve->pattern_size[i])) == NULL)
+			return 2;
+
+		/* Bit k of byte j is number 16j + 2k + 1 */
+		memset(sieve->pattern[i], 0xFF, sieve->pattern_size[i]);
+		for(j = 0; j < sieve->pattern_size[i]; j++)
 		{
-			pthread_mutex_lock(&b_data->mutex_primes);
-			b_data->primes++;
-			pthread_mutex_unlock(&b_data->mutex_primes);
+			for(k = 0; k < 8; k++)
+			{
+				n = 16ULL * j + 2 * k + 1;
+				for(p = 0; presieved[i][p] != 0; p++)
+				{
+					if(n % presieved[i][p] == 0)
+						sieve->pattern[i][j] &= ~(1 << k);
+				}
+			}
 		}
+	}
+
+	return 0;
+}
+
+/* Free sieve state of a thread */
+static void sieve_free(SieveData *sieve)
+{
+	unsigned i;
+
+	free(sieve->segment);
+	free(sieve->base);
+	for(i = 0; i < SIEVE_PATTERNS; i++)
+		free(sieve->pattern[i]);
+}
+
+/* Find sieving primes up to 'limit' (simple sieve of Eratosthenes) */
+static int sieve_base(SieveData *sieve, uint64_t limit)
+{
+	uint64_t i, j;
+	uint8_t *composite;
+	uint32_t *base;
+
+	if((composite = calloc(limit + 1, 1)) == NULL)
+		return 1;
+	/* Less than limit / 2 odd primes */
+	if((base = realloc(sieve->base, sizeof(uint32_t) * (limit / 2 + 1))) == NULL)
+	{
+		free(composite);
+		return 2;
+	}
+
+	sieve->base       = base;
+	sieve->base_count = 0;
+	for(i = 3; i <= limit; i += 2)
+	{
+		if(composite[i])
+			continue;
+		for(j = i * i; j <= limit; j += 2 * i)
+			composite[j] = 1;
+		/* Primes up to 23 are cleared by pre-sieve patterns */
+		if(i > 23)
+			sieve->base[sieve->base_count++] = i;
+	}
+	sieve->base_limit = limit;
+	free(composite);
+
+	return 0;
+}
+
+/* Pre-sieve kernel: AND two patterns into segment */
+static void sieve_presieve(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t size)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	for(; i + sizeof(__m128i) <= size; i += sizeof(__m128i))
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_and_si128(_mm_loadu_si128((const __m128i *) (a + i)),
+		                                                      _mm_loadu_si128((const __m128i *) (b + i))));
+#endif /* __SSE2__ */
+	for(; i < size; i++)
+		dst[i] = a[i] & b[i];
+}
 
-		/* Only the first thread compute elapsed time */
-		if(b_data->first_thread == pthread_self())
-			b_data->elapsed = (clock() - b_data->start) / CLOCKS_PER_SEC / b_data->threads;
+/* Count primes from 'lo' to 'lo + 16 * segment' ('lo' is a multiple of 16) */
+static uint64_t sieve_block(SieveData *sieve, uint32_t segment, uint64_t lo)
+{
+	uint32_t i, n, off[SIEVE_PATTERNS];
+	uint64_t j, p, m, bit, primes = 0;
+	const uint64_t hi   = lo + 16ULL * segment;
+	const uint64_t bits = 8ULL * segment;
+	const uint64_t sup  = (uint64_t) sqrt(hi) + 1;
+	uint64_t *words     = (uint64_t *) sieve->segment;
+
+	/* Sieving primes must reach sqrt(hi) */
+	if(sup > sieve->base_limit && sieve_base(sieve, (2 * sieve->base_limit > sup) ? 2 * sieve->base_limit : sup))
+		return 0;
+
+	/* Small primes: copy patterns at the offset of the segment (they wrap around) */
+	for(i = 0; i < SIEVE_PATTERNS; i++)
+		off[i] = (lo / 16) % sieve->pattern_size[i];
+	for(i = 0; i < segment; i += n)
+	{
+		n = segment - i;
+		n = (sieve->pattern_size[0] - off[0] < n) ? sieve->pattern_size[0] - off[0] : n;
+		n = (sieve->pattern_size[1] - off[1] < n) ? sieve->pattern_size[1] - off[1] : n;
+		sieve_presieve(sieve->segment + i, sieve->pattern[0] + off[0], sieve->pattern[1] + off[1], n);
+		off[0] = (off[0] + n) % sieve->pattern_size[0];
+		off[1] = (off[1] + n) % sieve->pattern_size[1];
+	}
+
+	/* Other primes: clear odd multiples, from p * p */
+	for(j = 0; j < sieve->base_count; j++)
+	{
+		p = sieve->base[j];
+		if(p * p >= hi)
+			break;
+		m = (p * p >= lo) ? p * p : (lo + p - 1) / p * p;
+		if(!(m & 1))
+			m += p;
+		for(bit = (m - lo) / 2; bit < bits; bit += p)
+			sieve->segment[bit >> 3] &= ~(1 << (bit & 7));
+	}
+
+	/* 1 is not a prime, pre-sieved primes are counted once */
+	if(lo == 0)
+	{
+		sieve->segment[0] &= ~1;
+		primes += SIEVE_PRESIEVED;
+	}
+
+	for(j = 0; j < segment / sizeof(uint64_t); j++)
+		primes += __builtin_popcountll(words[j]);
+
+	return primes;
+}
+
+/* Run a benchmark in a thread, until deadline or stop flag */
+static void *bench_thread(void *p_slot)
+{
+	uint64_t  num, now, wall, cpu, primes = 0, candidates = 0;
+	SieveData sieve     = { .segment = NULL };
+	BenchThread *slot   = p_slot;
+	BenchData   *b_data = slot->b_data;
+	const uint64_t block = (b_data->mode == BENCH_SIEVE)     ? 16ULL * b_data->segment :
+	                       (b_data->mode == BENCH_PRIMEFAST) ? BENCH_BLOCK_FAST : BENCH_BLOCK_SLOW;
+
+	if(b_data->mode == BENCH_SIEVE && sieve_init(&sieve, b_data->segment))
+	{
+		MSG_ERROR(_("an error occurred while starting benchmark"));
+		__atomic_store_n(&b_data->run, false, __ATOMIC_RELAXED);
+	}
+
+	/* Start barrier: wait until all threads are created */
+	pthread_mutex_lock(&b_data->gate_lock);
+	while(!b_data->started)
+		pthread_cond_wait(&b_data->gate, &b_data->gate_lock);
+	pthread_mutex_unlock(&b_data->gate_lock);
+	wall = bench_clock(CLOCK_MONOTONIC);
+	cpu  = bench_clock(CLOCK_THREAD_CPUTIME_ID);
+
+	while(__atomic_load_n(&b_data->run, __ATOMIC_RELAXED))
+	{
+		/* b_data->num is shared by all threads: claim a whole block of numbers at once */
+		num = __atomic_fetch_add(&b_data->num, block, __ATOMIC_RELAXED);
+		if(b_data->mode == BENCH_SIEVE)
+		{
+			primes     += sieve_block(&sieve, b_data->segment, num);
+			candidates += block;
+		}
+		else
+			primes += primes_block(b_data, num, num + block, &candidates);
+
+		/* Counters are only written by this thread, benchmark_status() reads them */
+		now = bench_clock(CLOCK_MONOTONIC);
+		__atomic_store_n(&slot->primes,     primes,                                    __ATOMIC_RELAXED);
+		__atomic_store_n(&slot->candidates, candidates,                                __ATOMIC_RELAXED);
+		__atomic_store_n(&slot->wall,       now - wall,                                __ATOMIC_RELAXED);
+		__atomic_store_n(&slot->cpu,        bench_clock(CLOCK_THREAD_CPUTIME_ID) - cpu, __ATOMIC_RELAXED);
+		if(now >= b_data->deadline)
+			break;
 	}
+	sieve_free(&sieve);
 
-	if(b_data->first_thread == pthread_self())
+	/* Last thread merges counters of all threads, then publishes them (slots can be freed after that) */
+	if(__atomic_sub_fetch(&b_data->active, 1, __ATOMIC_ACQ_REL) == 0)
 	{
-		b_data->run = false;
-		pthread_mutex_destroy(&b_data->mutex_num);
-		pthread_mutex_destroy(&b_data->mutex_primes);
+		for(num = 0, primes = 1; num < b_data->slot_count; num++)
+			primes += b_data->slots[num].primes;
+		b_data->primes = primes;
+		__atomic_store_n(&b_data->end,  bench_clock(CLOCK_MONOTONIC), __ATOMIC_RELAXED);
+		__atomic_store_n(&b_data->run,  false, __ATOMIC_RELAXED);
+		__atomic_store_n(&b_data->done, true,  __ATOMIC_RELEASE);
 	}
 
 	return NULL;
@@ -1025,28 +2019,56 @@ static void *primes_bench(void *p_data)
 static int benchmark_status(Labels *data)
 {
 	char *buff;
+	unsigned i;
+	uint64_t primes, candidates = 0, wall = 0, cpu = 0;
 	BenchData *b_data   = data->b_data;
-	enum EnTabBench ind = b_data->fast_mode ? PRIMEFASTSCORE : PRIMESLOWSCORE;
+	enum EnTabBench ind;
+	bool running;
 
 	MSG_VERBOSE(_("Updating benchmark status"));
 	asprintf(&data->tab_bench[VALUE][PARAMDURATION], _("%u mins"), data->b_data->duration);
 	asprintf(&data->tab_bench[VALUE][PARAMTHREADS],    "%u",       data->b_data->threads);
-	asprintf(&data->tab_bench[VALUE][PRIMESLOWRUN],  _("Inactive"));
-	asprintf(&data->tab_bench[VALUE][PRIMEFASTRUN],  _("Inactive"));
 
-	if(b_data->primes == 0)
+	/* Slots can be reallocated by start_benchmarks() in another thread */
+	pthread_mutex_lock(&b_data->slots_lock);
+	ind = PRIMESLOWSCORE + b_data->mode * BENCHFIELDS;
+	/* b_data->primes and b_data->end are only set when all threads are done */
+	running = (b_data->slots != NULL) && !__atomic_load_n(&b_data->done, __ATOMIC_ACQUIRE);
+	for(i = PRIMESLOWSCORE; i < PARAMDURATION; i += BENCHFIELDS)
 	{
-		asprintf(&data->tab_bench[VALUE][PRIMESLOWSCORE], _("Not started"));
-		asprintf(&data->tab_bench[VALUE][PRIMEFASTSCORE], _("Not started"));
+		asprintf(&data->tab_bench[VALUE][i + 1], _("Inactive"));
+		if(b_data->slots == NULL)
+			asprintf(&data->tab_bench[VALUE][i], _("Not started"));
+	}
+
+	if(b_data->slots == NULL)
+	{
+		pthread_mutex_unlock(&b_data->slots_lock);
 		return 0;
 	}
 
-	if(b_data->run)
+	/* Number 2 is not tested by threads */
+	primes = running ? 1 : b_data->primes;
+	b_data->elapsed = ((running ? bench_clock(CLOCK_MONOTONIC) : __atomic_load_n(&b_data->end, __ATOMIC_ACQUIRE)) -
+	                   b_data->start) / 1000000000ULL;
+	for(i = 0; i < b_data->slot_count; i++)
+	{
+		if(running)
+			primes += __atomic_load_n(&b_data->slots[i].primes, __ATOMIC_RELAXED);
+		candidates += __atomic_load_n(&b_data->slots[i].candidates, __ATOMIC_RELAXED);
+		wall       += __atomic_load_n(&b_data->slots[i].wall,       __ATOMIC_RELAXED);
+		cpu        += __atomic_load_n(&b_data->slots[i].cpu,        __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&b_data->slots_lock);
+
+	if(running)
 		asprintf(&data->tab_bench[VALUE][ind + 1], _("Active"));
 
-	if(b_data->run)
+	if(running)
 	{
-		if(b_data->duration * 60 - b_data->elapsed > 60 * 59)
+		if(b_data->elapsed > b_data->duration * 60)
+			asprintf(&buff, _("(stopping)"));
+		else if(b_data->duration * 60 - b_data->elapsed > 60 * 59)
 			asprintf(&buff, _("(%u hours left)"), (b_data->duration - b_data->elapsed / 60) / 60);
 		else if(b_data->duration * 60 - b_data->elapsed >= 60)
 			asprintf(&buff, _("(%u minutes left)"), b_data->duration - b_data->elapsed / 60);
@@ -1063,37 +2085,130 @@ static int benchmark_status(Labels *data)
 			asprintf(&buff, _("in %u seconds"), b_data->elapsed);
 	}
 
-	asprintf(&data->tab_bench[VALUE][ind], "%'u %s", b_data->primes, buff);
+	/* Throughput of a thread is measured on its CPU time (numbers tested by CPU second),
+	   so it does not depend on other processes; share of CPU time shows descheduling */
+	if(cpu > 0 && wall > 0)
+		asprintf(&data->tab_bench[VALUE][ind], _("%'" PRIu64 " %s, %'.0f/s by thread (%.0f%% CPU)"), primes, buff,
+			candidates * 1e9 / cpu, cpu * 100.0 / wall);
+	else
+		asprintf(&data->tab_bench[VALUE][ind], "%'" PRIu64 " %s", primes, buff);
+	free(buff);
 	return 0;
 }
 
-/* Perform a multithreaded benchmark (compute prime numbers) */
+/* Perform a multithreaded benchmark (compute prime numbers, by trial division or with a sieve) */
 void start_benchmarks(Labels *data)
 {
 	int err = 0;
+	bool stopped = false;
 	unsigned i;
-	pthread_t *t_id;
+	pthread_t t_id;
+	pthread_attr_t attr;
 	BenchData *b_data = data->b_data;
 
+	/* Threads of a stopped benchmark still use their counters until they finish their number */
+	pthread_mutex_lock(&b_data->slots_lock);
+	if(b_data->slots != NULL && !__atomic_load_n(&b_data->done, __ATOMIC_ACQUIRE))
+	{
+		pthread_mutex_unlock(&b_data->slots_lock);
+		MSG_WARNING(_("Previous benchmark is still stopping, try again later"));
+		return;
+	}
+
+	/* Bitmap of a sieve segment (16 numbers by byte) fills half of L2 cache,
+	   the other half keeps pre-sieve patterns and sieving primes */
+	if(data->w_data->l2_size > 0)
+		b_data->segment = data->w_data->l2_size * 1024 / 2;
+	else if(data->w_data->l1d_size > 0)
+		b_data->segment = data->w_data->l1d_size * 1024;
+	else
+		b_data->segment = SIEVE_SEGMENT_DEFAULT;
+	b_data->segment = (b_data->segment < SIEVE_SEGMENT_MIN) ? SIEVE_SEGMENT_MIN :
+	                  (b_data->segment > SIEVE_SEGMENT_MAX) ? SIEVE_SEGMENT_MAX : b_data->segment & ~15U;
+
 	MSG_VERBOSE(_("Starting benchmark"));
+	if(b_data->mode == BENCH_SIEVE)
+		MSG_VERBOSE(_("Sieve segments of %u KB"), b_data->segment / 1024);
+	if(b_data->slots != NULL)
+	{
+		pthread_mutex_destroy(&b_data->gate_lock);
+		pthread_cond_destroy(&b_data->gate);
+		free(b_data->slots);
+	}
+	b_data->slot_count = b_data->threads;
+	if(posix_memalign((void **) &b_data->slots, CACHE_LINE_SIZE, sizeof(BenchThread) * b_data->slot_count))
+	{
+		b_data->slots      = NULL;
+		b_data->slot_count = 0;
+		b_data->run        = false;
+		pthread_mutex_unlock(&b_data->slots_lock);
+		MSG_ERROR(_("an error occurred while starting benchmark"));
+		return;
+	}
+
 	b_data->run     = true;
+	b_data->done    = false;
+	b_data->started = false;
 	b_data->elapsed = 0;
-	b_data->num     = 2;
+	b_data->num     = (b_data->mode == BENCH_SIEVE) ? 0 : 3;
 	b_data->primes  = 1;
-	b_data->start   = clock();
-	t_id            = malloc(sizeof(pthread_t) * b_data->threads);
+	b_data->active  = b_data->slot_count;
+	memset(b_data->slots, 0, sizeof(BenchThread) * b_data->slot_count);
+	pthread_mutex_init(&b_data->gate_lock, NULL);
+	pthread_cond_init(&b_data->gate, NULL);
+
+	/* Threads are never joined */
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	for(i = 0; i < b_data->slot_count; i++)
+	{
+		b_data->slots[i].b_data = b_data;
+		if(pthread_create(&t_id, &attr, bench_thread, &b_data->slots[i]))
+		{
+			/* Thread was not started: it will not decrement b_data->active */
+			err++;
+			b_data->run = false;
+			stopped = (__atomic_sub_fetch(&b_data->active, b_data->slot_count - i, __ATOMIC_ACQ_REL) == 0);
+			break;
+		}
+	}
+	pthread_attr_destroy(&attr);
+
+	/* Open start barrier: all threads begin together, with the same deadline */
+	pthread_mutex_lock(&b_data->gate_lock);
+	b_data->start    = bench_clock(CLOCK_MONOTONIC);
+	b_data->end      = b_data->start;
+	b_data->deadline = b_data->start + b_data->duration * 60 * 1000000000ULL;
+	b_data->started  = true;
+	pthread_cond_broadcast(&b_data->gate);
+	pthread_mutex_unlock(&b_data->gate_lock);
+
+	/* No thread was started: nothing to merge, 'end' is 'start' */
+	if(stopped)
+		__atomic_store_n(&b_data->done, true, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&b_data->slots_lock);
+
+	if(err)
+		MSG_ERROR(_("an error occurred while starting benchmark"));
+}
 
-	err += pthread_mutex_init(&b_data->mutex_num,    NULL);
-	err += pthread_mutex_init(&b_data->mutex_primes, NULL);
+/* Ask threads of running benchmark to stop */
+void stop_benchmarks(Labels *data)
+{
+	MSG_VERBOSE(_("Stopping benchmark"));
+	__atomic_store_n(&data->b_data->run, false, __ATOMIC_RELEASE);
+}
 
-	for(i = 0; i < b_data->threads; i++)
-		err += pthread_create(&t_id[i], NULL, primes_bench, data);
+/* Check if all benchmark threads are finished (parameters can be changed) */
+bool benchmarks_idle(Labels *data)
+{
+	bool idle;
 
-	b_data->first_thread = t_id[0];
-	free(t_id);
+	pthread_mutex_lock(&data->b_data->slots_lock);
+	idle = (data->b_data->slots == NULL) || __atomic_load_n(&data->b_data->done, __ATOMIC_ACQUIRE);
+	pthread_mutex_unlock(&data->b_data->slots_lock);
 
-	if(err)
-		MSG_ERROR(_("an error occurred while starting benchmark"));
+	return idle;
 }
 
 
@@ -1134,18 +2249,11 @@ static int cpu_package_fallback(Labels *data)
 static int cputab_temp_fallback(Labels *data)
 {
 	double val = 0.0;
-	char *command, *buff;
 
 	MSG_VERBOSE(_("Retrieving CPU temperature in fallback mode"));
-	setlocale(LC_ALL, "C");
-	asprintf(&command, "sensors | grep -i 'Core[[:space:]]*%u' | awk -F '[+°]' '{ print $2 }'", opts->selected_core);
-	if(!popen_to_str(command, &buff))
-		val = atof(buff);
-	setlocale(LC_ALL, "");
-
-	if(val > 0)
+	if(!sensors_read(data->s_data, SENSOR_CPUTEMP, data->opts->selected_core, &val) && val > 0)
 	{
-		iasprintf(&data->tab_cpu[VALUE][TEMPERATURE], "%.2f°C", val);
+		metric_set_double(data, MT_TEMPERATURE, val);
 		return 0;
 	}
 	else
@@ -1159,18 +2267,11 @@ static int cputab_temp_fallback(Labels *data)
 static int cputab_volt_fallback(Labels *data)
 {
 	double val = 0.0;
-	char *command, *buff;
 
 	MSG_VERBOSE(_("Retrieving CPU voltage in fallback mode"));
-	setlocale(LC_ALL, "C");
-	asprintf(&command, "sensors | grep -i 'VCore' | awk -F '[+V]' '{ print $3 }'");
-	if(!popen_to_str(command, &buff))
-		val = atof(buff);
-	setlocale(LC_ALL, "");
-
-	if(val > 0)
+	if(!sensors_read(data->s_data, SENSOR_CPUVOLT, 0, &val) && val > 0)
 	{
-		iasprintf(&data->tab_cpu[VALUE][VOLTAGE], "%.3f V", val);
+		metric_set_double(data, MT_VOLTAGE, val);
 		return 0;
 	}
 	else
@@ -1183,44 +2284,46 @@ static int cputab_volt_fallback(Labels *data)
 /* Get CPU multipliers ("x current (min-max)" label) */
 static int cpu_multipliers_fallback(Labels *data)
 {
-	static bool no_range = false;
-	static double min_mult = 0, max_mult = 0;
+	CoreData *c_data = data->c_data;
+	const double bus_freq = metric_get(data, MT_BUSSPEED);
 
-	if(data->cpu_freq <= 0 || data->bus_freq <= 0)
+	if(metric_get(data, MT_CORESPEED) <= 0 || bus_freq <= 0)
 		return 1;
 
 #ifdef __linux__
-	static bool init = false;
 	char *min_freq_str, *max_freq_str;
 	char *cpuinfo_min_file, *cpuinfo_max_file;
 	double min_freq, max_freq;
 
 	MSG_VERBOSE(_("Calculating CPU multipliers in fallback mode"));
-	if(!init)
+	if(!c_data->mult_init)
 	{
 		/* Open files */
-		asprintf(&cpuinfo_min_file, "%s%i/cpufreq/cpuinfo_min_freq", SYS_CPU, opts->selected_core);
-		asprintf(&cpuinfo_max_file, "%s%i/cpufreq/cpuinfo_max_freq", SYS_CPU, opts->selected_core);
-		fopen_to_str(cpuinfo_min_file, &min_freq_str);
-		fopen_to_str(cpuinfo_max_file, &max_freq_str);
+		asprintf(&cpuinfo_min_file, "%s%i/cpufreq/cpuinfo_min_freq", SYS_CPU, data->opts->selected_core);
+		asprintf(&cpuinfo_max_file, "%s%i/cpufreq/cpuinfo_max_freq", SYS_CPU, data->opts->selected_core);
+		fopen_to_str(data->opts, cpuinfo_min_file, &min_freq_str);
+		fopen_to_str(data->opts, cpuinfo_max_file, &max_freq_str);
 
 		/* Convert to get min and max values */
 		min_freq = strtod(min_freq_str, NULL) / 1000;
 		max_freq = strtod(max_freq_str, NULL) / 1000;
-		min_mult = round(min_freq / data->bus_freq);
-		max_mult = round(max_freq / data->bus_freq);
-		init     = true;
+		c_data->min_mult  = round(min_freq / bus_freq);
+		c_data->max_mult  = round(max_freq / bus_freq);
+		c_data->mult_init = true;
 	}
 #endif /* __linux__ */
-	if(min_mult <= 0 || max_mult <= 0)
+	if(c_data->min_mult <= 0 || c_data->max_mult <= 0)
 	{
-		asprintf(&data->tab_cpu[VALUE][MULTIPLIER], "x %.2f", data->cpu_freq / data->bus_freq);
-		if(!no_range)
+		if(!c_data->mult_no_range)
 			MSG_WARNING(_("Cannot get minimum and maximum CPU multipliers (fallback mode)"));
-		no_range = true;
+		c_data->mult_no_range = true;
 	}
 	else
-		asprintf(&data->tab_cpu[VALUE][MULTIPLIER], "x%.1f (%.0f-%.0f)", data->cpu_freq / data->bus_freq, min_mult, max_mult);
+	{
+		metric_set_double(data, MT_MULTMIN, c_data->min_mult);
+		metric_set_double(data, MT_MULTMAX, c_data->max_mult);
+	}
+	metric_set_double(data, MT_MULTIPLIER, metric_get(data, MT_CORESPEED) / bus_freq);
 
 	return 0;
 }
@@ -1239,7 +2342,7 @@ static int motherboardtab_fallback(Labels *data)
 	for(i = 0; id[i] != NULL; i++)
 	{
 		asprintf(&file, "%s/%s", SYS_DMI, id[i]);
-		err += fopen_to_str(file, &buff);
+		err += fopen_to_str(data->opts, file, &buff);
 		iasprintf(&data->tab_motherboard[VALUE][i], buff);
 	}
 #endif /* __linux__ */
@@ -1275,14 +2378,14 @@ static int fallback_mode_dynamic(Labels *data)
 {
 	int err = 0;
 
-	if(data->tab_cpu[VALUE][TEMPERATURE] == NULL)
-		err += err_func(cputab_temp_fallback,     data);
+	if(!metric_valid(data, MT_TEMPERATURE))
+		err += ERR_FUNC(cputab_temp_fallback,     data);
 
-	if(data->tab_cpu[VALUE][VOLTAGE] == NULL)
-		err += err_func(cputab_volt_fallback,     data);
+	if(!metric_valid(data, MT_VOLTAGE))
+		err += ERR_FUNC(cputab_volt_fallback,     data);
 
-	if(data->tab_cpu[VALUE][MULTIPLIER] == NULL)
-		err += err_func(cpu_multipliers_fallback, data);
+	if(!metric_valid(data, MT_MULTIPLIER))
+		err += ERR_FUNC(cpu_multipliers_fallback, data);
 
 	return err;
 }
@@ -28,10 +28,127 @@
 #if HAS_LIBPCI
 # include "pci/pci.h"
 #endif
+#if defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+#define STARTUP_THREADS       4        /* Threads used by fill_labels() */
+#define STAT_LINE_SIZE        128      /* Initial buffer size by line of /proc/stat */
+#define TOPOLOGY_IDS          3        /* Identifiers of a logical CPU: socket, die and core */
+#define DEP(task)             (1U << (task))
+#define ERR_FUNC(func, data)  err_func(#func, func, data)
+#define STARTUP_TASK(has_mod, func, use_err_func, deps) \
+	{ #func, (has_mod) ? func : NULL, use_err_func, deps, false, 0, 0.0 }
+
+#define COLLECTORS_MAX        32       /* Max collectors called through err_func() */
+#define BACKOFF_FIRST         1000     /* Delay before first retry of a failed collector, in ms */
+#define BACKOFF_RETRIES       8        /* Retries of a failing collector (delay doubles each time) before the delay stops growing */
+
+#define BENCH_BLOCK_SLOW      256      /* Numbers claimed at once by a benchmark thread, in slow mode */
+#define BENCH_BLOCK_FAST      16384    /* Same in fast mode (a number costs sqrt(n) divisions instead of n) */
+#define SIEVE_SEGMENT_DEFAULT (32 * 1024) /* Size of a sieve segment when cache sizes are unknown, in bytes */
+#define SIEVE_SEGMENT_MIN     4096     /* Smallest sieve segment, in bytes (a multiple of 16) */
+#define SIEVE_SEGMENT_MAX     (4 << 20) /* Largest sieve segment, in bytes */
+#define SIEVE_PATTERNS        2        /* Pre-sieve patterns combined by the sieve kernel */
+#define SIEVE_PRESIEVED       8        /* Primes cleared by pre-sieve patterns (3 to 23) */
+
+#define REFRESH_SLOW          10000    /* Period of collectors running a benchmark, in ms */
+#define REFRESH_COST_RATIO    10       /* A collector uses at most 1/REFRESH_COST_RATIO of its period */
+#define REFRESH_TASK(has_mod, func, use_err_func, period, tolerance, cost, metrics) \
+	{ #func, (has_mod) ? func : NULL, use_err_func, period, tolerance, cost, metrics }
+
+typedef struct Collector
+{
+	int (*func)(Labels *);
+	enum EnHealth health;
+	unsigned failures;   /* Consecutive failures */
+	uint64_t errors;     /* All failures */
+	uint64_t retry;      /* Collector is skipped until this time (monotonic clock, in ns) */
+} Collector;
+
+enum EnStartupTasks
+{
+	ST_DMIDECODE, ST_LIBCPUID_STATIC, ST_LIBCPUID_CPUCLOCK, ST_MSR,
+	ST_SYSTEM_DYNAMIC, ST_BANDWIDTH, ST_DEVICES, ST_CPU_TOPOLOGY, ST_CPU_USAGE, ST_SYSTEM_STATIC,
+	ST_SENSORS, ST_GPU_TEMPERATURE, ST_BENCHMARK_STATUS, ST_FALLBACK_STATIC, ST_FALLBACK_DYNAMIC,
+	LASTSTARTUP
+};
+
+typedef struct
+{
+	const char *name;
+	int (*func)(Labels *);
+	bool use_err_func;
+	uint32_t deps;       /* Tasks which must be done before (DEP() mask) */
+	bool started;
+	int err;
+	double elapsed;      /* Wall time, in milliseconds */
+} StartupTask;
+
+enum EnRefreshTasks
+{
+	RT_LIBCPUID_CPUCLOCK, RT_MSR, RT_CPU_USAGE, RT_FALLBACK_DYNAMIC, RT_BANDWIDTH, RT_SYSTEM_DYNAMIC,
+	RT_GPU_TEMPERATURE, RT_BENCHMARK_STATUS,
+	LASTREFRESH
+};
+
+typedef struct
+{
+	const char *name;
+	int (*func)(Labels *);
+	bool use_err_func;
+	unsigned period;     /* Time between two runs, in ms (0 for --refresh value) */
+	unsigned tolerance;  /* A run can be advanced by this time (in ms), to share a wakeup */
+	double cost;         /* Initial estimate of run time, in ms */
+	uint64_t metrics;    /* Updated metrics (METRIC_BIT() mask) */
+} RefreshTask;
+
+/* Sieve state of a benchmark thread: a bit by odd number, 16 numbers by byte */
+typedef struct
+{
+	uint8_t  *segment;
+	uint8_t  *pattern[SIEVE_PATTERNS];  /* Odd multiples of small primes are cleared */
+	uint32_t pattern_size[SIEVE_PATTERNS]; /* A pattern repeats every (product of its primes) bytes */
+	uint32_t *base;                    /* Sieving primes (larger than pre-sieved ones) */
+	uint64_t base_count, base_limit;   /* Sieving primes are known up to base_limit */
+} SieveData;
+
+typedef struct
+{
+	Labels *data;
+	StartupTask *tasks;
+	uint32_t done;       /* Finished tasks (DEP() mask) */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+} StartupPool;
 
 
-/* Avoid to re-run a function if an error was occurred in previous call */
-static int err_func(int (*func)(Labels *), Labels *data);
+/* Milliseconds elapsed since 'start' (monotonic clock) */
+static double elapsed_ms(const struct timespec *start);
+
+/* Run startup collectors as soon as their dependencies are done */
+static void *startup_worker(void *p_pool);
+
+/* Current time of monotonic clock, in ns */
+static uint64_t refresh_now(void);
+
+/* Effective period of a collector, in ns (slow collectors are delayed) */
+static uint64_t refresh_period(Labels *data, unsigned task);
+
+/* Run a collector, and update its cost estimate */
+static int refresh_run(Labels *data, unsigned task);
+
+/* Add a collector to the deadline heap */
+static void refresh_heap_push(RefreshData *r, unsigned task);
+
+/* Remove the collector with the nearest deadline from the heap */
+static unsigned refresh_heap_pop(RefreshData *r);
+
+/* Set timer to given deadline (monotonic clock, in ns); 0 stops the timer */
+static void refresh_arm(RefreshData *r, uint64_t deadline);
+
+/* Call a collector unless it is waiting for a retry; update its health and count its cost */
+static int err_func(const char *name, int (*func)(Labels *), Labels *data);
 
 /* Static elements provided by libcpuid */
 static int call_libcpuid_static(Labels *data);
@@ -41,10 +158,6 @@ static int call_libcpuid_static(Labels *data);
 static int call_libcpuid_cpuclock(Labels *data);
 /* Required: HAS_LIBCPUID */
 
-/* MSRs values provided by libcpuid */
-static int call_libcpuid_msr(Labels *data);
-/* Required: HAS_LIBCPUID && root privileges */
-
 /* Elements provided by dmidecode (need root privileges) */
 static int call_dmidecode(Labels *data);
 /* Required: HAS_DMIDECODE && root privileges */
@@ -53,7 +166,42 @@ static int call_dmidecode(Labels *data);
 static int call_bandwidth(Labels *data);
 /* Required: HAS_BANDWIDTH */
 
-/* Calculate total CPU usage */
+/* Load CPU MSR kernel module (called once by process) */
+static void load_msr_driver_once(void);
+
+/* Load CPU MSR kernel module */
+static bool load_msr_driver(void);
+
+/* CPU MSR values, read from a pool of files kept open */
+static int call_msr(Labels *data);
+/* Required: root privileges (or CPUX_MSR_PATH) */
+
+/* Read an identifier in topology directory of a logical CPU */
+static int topology_read_id(const Options *options, unsigned cpu, const char *file, int32_t *id);
+
+/* Order logical CPUs by socket, die and core */
+static int topology_compare(const void *a, const void *b);
+
+/* Build CPU topology (sockets -> dies -> cores -> threads) */
+static int cpu_topology(Labels *data);
+/* Required: none */
+
+/* Allocate counters and open statistics source for CPU usage */
+static int usage_init(UsageData *u_data, const Options *options);
+
+/* Parse an unsigned integer, and move pointer after it */
+static inline uint64_t parse_u64(const char **p);
+
+/* Fill counters from "cpu" lines of /proc/stat; return false if buffer ends before last line */
+static bool parse_proc_stat(const char *p, const char *end, uint64_t *ticks, unsigned core_count);
+
+/* Read CPU time counters in given buffer */
+static int usage_read(UsageData *u_data, uint64_t *ticks);
+
+/* Time of a usage sample, in nanoseconds since boot */
+static uint64_t usage_clock(void);
+
+/* Calculate CPU usage, for all logical CPUs */
 static int cpu_usage(Labels *data);
 /* Required: none */
 
@@ -61,18 +209,60 @@ static int cpu_usage(Labels *data);
 static int find_devices(Labels *data);
 /* Required: HAS_LIBPCI */
 
-/* Retrieve GPU temperature */
+/* Find hardware sensors (hwmon and thermal zones) */
+static int find_sensors(Labels *data);
+/* Required: none */
+
+/* Retrieve temperature of each GPU */
 static int gpu_temperature(Labels *data);
 /* Required: none */
 
+/* Read a value in /proc/sys/kernel (unlike uname(), it is also found in a capture) */
+static int proc_kernel_str(const Options *options, const char *name, char *buff, size_t size);
+/* Required: __linux__ */
+
+/* Get PRETTY_NAME value in os-release file */
+static int os_release_name(const Options *options, char *buff, size_t size);
+/* Required: __linux__ */
+
 /* Satic elements for System tab, OS specific */
 static int system_static(Labels *data);
 /* Required: none */
 
+#if HAS_LIBSTATGRAB
+/* Initialize libstatgrab (called once by process) */
+static void statgrab_init_once(void);
+/* Required: HAS_LIBSTATGRAB */
+#endif /* HAS_LIBSTATGRAB */
+
 /* Dynamic elements for System tab, provided by libprocps/libstatgrab */
 static int system_dynamic(Labels *data);
 /* Required: HAS_LIBPROCPS || HAS_LIBSTATGRAB */
 
+/* Current time of a clock, in ns */
+static uint64_t bench_clock(clockid_t clock);
+
+/* Test numbers from 'num' to 'end' by trial division */
+static uint64_t primes_block(BenchData *b_data, uint64_t num, uint64_t end, uint64_t *candidates);
+
+/* Allocate segment and build pre-sieve patterns of a thread */
+static int sieve_init(SieveData *sieve, uint32_t segment);
+
+/* Free sieve state of a thread */
+static void sieve_free(SieveData *sieve);
+
+/* Find sieving primes up to 'limit' (simple sieve of Eratosthenes) */
+static int sieve_base(SieveData *sieve, uint64_t limit);
+
+/* Pre-sieve kernel: AND two patterns into segment */
+static void sieve_presieve(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t size);
+
+/* Count primes from 'lo' to 'lo + 16 * segment' ('lo' is a multiple of 16) */
+static uint64_t sieve_block(SieveData *sieve, uint32_t segment, uint64_t lo);
+
+/* Run a benchmark in a thread, until deadline or stop flag */
+static void *bench_thread(void *p_slot);
+
 /* Report score of benchmarks */
 static int benchmark_status(Labels *data);
 /* Required: none */
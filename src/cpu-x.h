@@ -24,8 +24,11 @@
 #ifndef _CPUX_H_
 #define _CPUX_H_
 
+#include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <dirent.h>
+#include <locale.h>
 #include <pthread.h>
 #define HAVE_STDINT_H         /* Skip conflicts with <libcpuid/libcpuid_types.h> */
 
@@ -35,6 +38,14 @@
 #define PRGURL                "https://github.com/X0rg/CPU-X"
 #define PRGCPYR               "Copyright © 2014-2016 Xorg"
 
+#if defined(__clang__)
+# define CC "Clang"
+#elif defined(__GNUC__) || defined(__GNUG__)
+# define CC "GCC"
+#else
+# define CC "Unknown"
+#endif
+
 /* Colors definition */
 #define DEFAULT               "\x1b[0m"
 #define BOLD_RED              "\x1b[1;31m"
@@ -57,20 +68,48 @@
 #define OUT_DUMP              (1 << 2)
 #define OUT_DMIDECODE         (1 << 3)
 #define OUT_BANDWIDTH         (1 << 4)
+#define OUT_DAEMON            (1 << 5)
+#define OUT_EXPORTER          (1 << 6)
+#define OUT_CAPTURE           (1 << 7)
+#define FMT_TEXT              0        /* Formats of --dump */
+#define FMT_NDJSON            1
+#define FMT_CSV               2
+#define REFRESH_MIN           50       /* Shortest time between two refreshes, in ms */
+#define REFRESH_TASKS_MAX     16       /* Max collectors known by refresh scheduler */
+#define METRIC_BIT(id)        (1ULL << (id))
+#define METRIC_BENCH          (1ULL << 63) /* Not a metric: benchmark status labels */
+#define STREAM_MIN_INTERVAL   10       /* Shortest time between two --dump records, in ms */
 
 /* Arrays definition */
 #define NAME                  0
 #define VALUE                 1
 #define MAXSTR                60       /* Max string */
 #define CACHEFIELDS           3        /* Nb of fields by cache frame */
-#define RAMFIELDS             2        /* Nb of fields by bank */
-#define GPUFIELDS             3        /* Nb of fields by GPU frame */
+#define RAMFIELDS             LASTMEMORY   /* Nb of fields by bank */
+#define GPUFIELDS             LASTGRAPHICS /* Nb of fields by GPU frame */
 #define BENCHFIELDS           2        /* Nb of fields by bench frame */
+#define CACHE_LINE_SIZE       64       /* Benchmark counters of each thread are in their own cache line */
+#define PCI_ORDER(domain, bus, dev, func) \
+	(((uint64_t) (domain) << 16) | ((bus) << 8) | ((dev) << 3) | (func)) /* Sort key of a PCI device */
 
 /* Linux-specific paths definition */
 #define SYS_DMI               "/sys/devices/virtual/dmi/id"
 #define SYS_CPU               "/sys/devices/system/cpu/cpu"
+#define SYS_CPU_POSSIBLE      "/sys/devices/system/cpu/possible"
 #define SYS_DRM               "/sys/class/drm/card"
+#define OS_RELEASE            "/etc/os-release"
+#define OS_RELEASE_DEFAULT    "/usr/lib/os-release"
+#define SYS_HWMON             "/sys/class/hwmon"
+#define SYS_THERMAL           "/sys/class/thermal"
+#define DEV_MSR               "/dev/cpu/%u/msr"
+#define SYS_PCI               "/sys/bus/pci/devices"
+#define CAPTURE_CPUID         "/cpuid.raw"  /* Raw CPUID leaves in a capture (libcpuid format) */
+
+/* Thermal status flags of CPU MSR */
+#define MSR_THERMAL_THROTTLE  (1 << 0)  /* Core is throttled */
+#define MSR_THERMAL_PROCHOT   (1 << 2)  /* PROCHOT# is asserted */
+#define MSR_THERMAL_CRITICAL  (1 << 4)  /* Critical temperature reached */
+#define MSR_THERMAL_POWER_LIMIT (1 << 10) /* Power limit reached */
 
 
 enum EnTabNumber
@@ -86,8 +125,8 @@ enum EnObjects
 	FRAMMOTHERBOARD, FRAMBIOS, FRAMCHIPSET,
 	FRAMBANKS,
 	FRAMOPERATINGSYSTEM, FRAMMEMORY,
-	FRAMGPU1, FRAMGPU2, FRAMGPU3, FRAMGPU4,
-	FRAMPRIMESLOW, FRAMPRIMEFAST, FRAMPARAM,
+	FRAMCARD,
+	FRAMPRIMESLOW, FRAMPRIMEFAST, FRAMSIEVE, FRAMPARAM,
 	FRAMABOUT, FRAMLICENSE,
 	LASTOBJ
 };
@@ -119,8 +158,7 @@ enum EnTabMotherboard
 
 enum EnTabMemory
 {
-	BANK0_0, BANK0_1, BANK1_0, BANK1_1, BANK2_0, BANK2_1, BANK3_0, BANK3_1,
-	BANK4_0, BANK4_1, BANK5_0, BANK5_1, BANK6_0, BANK6_1, BANK7_0, BANK7_1,
+	BANKREFERENCE, BANKTYPE,
 	LASTMEMORY
 };
 
@@ -139,10 +177,7 @@ enum EnTabSystemExtra
 
 enum EnTabGraphics
 {
-	GPU1VENDOR, GPU1MODEL, GPU1TEMPERATURE,
-	GPU2VENDOR, GPU2MODEL, GPU2TEMPERATURE,
-	GPU3VENDOR, GPU3MODEL, GPU3TEMPERATURE,
-	GPU4VENDOR, GPU4MODEL, GPU4TEMPERATURE,
+	GPUVENDOR, GPUMODEL, GPUTEMPERATURE,
 	LASTGRAPHICS
 };
 
@@ -150,10 +185,18 @@ enum EnTabBench
 {
 	PRIMESLOWSCORE, PRIMESLOWRUN,
 	PRIMEFASTSCORE, PRIMEFASTRUN,
+	SIEVESCORE,     SIEVERUN,
 	PARAMDURATION,  PARAMTHREADS,
 	LASTBENCH
 };
 
+enum EnBenchMode
+{
+	BENCH_PRIMESLOW,               /* Trial division, up to n */
+	BENCH_PRIMEFAST,               /* Trial division, up to sqrt(n) */
+	BENCH_SIEVE                    /* Segmented sieve of Eratosthenes */
+};
+
 enum EnTabAbout
 {
 	DESCRIPTION,
@@ -162,6 +205,49 @@ enum EnTabAbout
 	LASTABOUT
 };
 
+enum EnMetrics
+{
+	MT_CORESPEED, MT_MULTIPLIER, MT_MULTMIN, MT_MULTMAX, MT_BUSSPEED, MT_USAGE, MT_COREUSAGE, MT_VOLTAGE, MT_TEMPERATURE,
+	MT_L1SPEED, MT_L2SPEED, MT_L3SPEED,
+	MT_UPTIME, MT_MEMUSED, MT_MEMBUFFERS, MT_MEMCACHED, MT_MEMFREE, MT_SWAPUSED, MT_MEMTOTAL, MT_SWAPTOTAL,
+	MT_GPU1TEMPERATURE,
+	LASTMETRIC
+};
+
+enum EnMetricTypes
+{
+	TYPE_INT, TYPE_DOUBLE
+};
+
+enum EnMetricUnits
+{
+	UNIT_NONE, UNIT_MHZ, UNIT_VOLT, UNIT_CELSIUS, UNIT_PERCENT, UNIT_MBPS, UNIT_MB, UNIT_SECOND,
+	LASTUNIT
+};
+
+enum EnCpuStat
+{
+	STAT_USER, STAT_NICE, STAT_SYSTEM, STAT_IDLE, STAT_IOWAIT, STAT_IRQ, STAT_SOFTIRQ, STAT_STEAL, STAT_GUEST, STAT_GUESTNICE,
+	LASTSTAT
+};
+
+enum EnSensors
+{
+	SENSOR_CPUTEMP, SENSOR_CPUVOLT, SENSOR_GPUTEMP
+};
+
+enum EnHealth
+{
+	HEALTH_OK,                     /* Last call succeeded */
+	HEALTH_DEGRADED,               /* Last calls failed: retried after a delay */
+	HEALTH_DISABLED                /* Too many consecutive failures: retried after the longest delay */
+};
+
+enum EnMsrVendor
+{
+	MSR_UNKNOWN, MSR_INTEL, MSR_AMD
+};
+
 typedef struct
 {
 	int8_t  cpu_vendor_id;
@@ -172,67 +258,207 @@ typedef struct
 {
 	uint8_t  test_count;
 	uint32_t l1_size, l2_size, l3_size;
-	uint32_t speed[LASTCACHES / GPUFIELDS];
+	uint32_t l1d_size;      /* L1 data cache, in KB (l1_size is instruction cache) */
+	uint32_t speed[LASTCACHES / CACHEFIELDS];
 	char     **test_name;
 } BandwidthData;
 
 typedef struct
 {
-	uint32_t mem_usage[SWAP - USED + 1];
-	uint32_t mem_total;
-	uint32_t swap_total;
-} MemoryData;
+	/* Struct of arrays, indexed by EnMetrics */
+	bool     valid[LASTMETRIC];
+	int64_t  ival[LASTMETRIC];          /* Value of TYPE_INT metrics */
+	double   dval[LASTMETRIC];          /* Value of TYPE_DOUBLE metrics */
+	uint64_t stamp[LASTMETRIC];         /* Time of last update (monotonic clock, in ns) */
+	uint64_t fmt_stamp[LASTMETRIC];     /* Stamp of formatted value */
+	char     text[LASTMETRIC][MAXSTR];  /* Formatted values, used as labels */
+} MetricStore;
+
+typedef struct
+{
+	int      fd;                 /* Statistics file, kept open between calls */
+	char     *buff;
+	size_t   buff_size;
+	uint16_t core_count;         /* Logical CPUs (row 0 is the total, row N + 1 is CPU N) */
+	uint8_t  current;            /* Last sample in 'ticks' */
+	long     hz;                 /* Counter ticks by second */
+	uint64_t stamp[2];           /* Time of samples, in ns since boot */
+	uint64_t *ticks[2];          /* Double-buffered counters, LASTSTAT by row */
+	double   *percent;           /* Time spent in each state in percent, LASTSTAT by row */
+	double   *rate;              /* Time spent in each state in seconds by second, LASTSTAT by row */
+	double   *usage;             /* Usage in percent, by row */
+} UsageData;
+
+typedef struct
+{
+	enum EnMsrVendor vendor;
+	uint16_t core_count;         /* Logical CPUs */
+	int      *fd;                /* MSR file of each CPU, kept open between samples */
+	uint64_t *aperf, *mperf;     /* Previous APERF/MPERF counters, by CPU */
+	double   *voltage;           /* Core voltage in V, by CPU */
+	double   *temperature;       /* Core temperature in °C, by CPU */
+	double   *multiplier;        /* Current multiplier, by CPU */
+	double   *eff_multiplier;    /* Average multiplier while not halted, by CPU */
+	uint16_t *thermal;           /* MSR_THERMAL_* flags, by CPU */
+	double   min_mult, max_mult; /* Package multiplier range */
+	double   tjmax;              /* Package maximum junction temperature */
+} MsrData;
+
+typedef struct
+{
+	bool     init;
+	uint16_t core_count;         /* Logical CPUs */
+	unsigned fd_count;
+	int      *fds;               /* Sensor files, kept open between reads */
+	int      *core_temp;         /* Temperature file of each CPU (may be shared), -1 if none */
+	int      cpu_volt;           /* CPU core voltage file, -1 if none */
+	uint32_t gpu_count;          /* Display controllers, in PCI address order (like graphics tab) */
+	int      *gpu_temp;          /* Temperature file of each GPU, -1 if none */
+	const struct Options *opts;  /* Options of context (root directory of sensor files) */
+} SensorsData;
+
+typedef struct
+{
+	int32_t  socket, die, core;  /* Indexes in topology, -1 if CPU is offline */
+} CpuTopology;
 
 typedef struct
 {
-	bool     run, fast_mode;
+	uint32_t socket_count;       /* Physical packages */
+	uint32_t die_count;          /* Dies, in all packages */
+	uint32_t core_count;         /* Physical cores, in all dies */
+	uint32_t thread_count;       /* Logical CPUs (highest CPU number + 1) */
+	CpuTopology *cpus;           /* Sockets -> dies -> cores -> threads, by logical CPU */
+} TopologyData;
+
+typedef struct
+{
+	bool     writer;             /* Snapshot is owned by this instance (daemon mode) */
+	size_t   size;
+	void     *map;               /* Shared memory mapping, NULL if not attached */
+} SnapshotData;
+
+typedef struct
+{
+	int      fd;                              /* Timer, -1 if scheduler is not started */
+	uint64_t subscribed;                      /* Metrics shown by interface (METRIC_BIT() mask) */
+	unsigned heap_size;
+	uint8_t  heap[REFRESH_TASKS_MAX];         /* Scheduled collectors, ordered by deadline */
+	uint64_t deadline[REFRESH_TASKS_MAX];     /* Next run (monotonic clock, in ns) */
+	double   cost[REFRESH_TASKS_MAX];         /* Average run time, in ms */
+} RefreshData;
+
+typedef struct
+{
+	void     *writer;            /* Recording state, NULL if not recording */
+	void     *reader;            /* Replay state, NULL if not replaying */
+} RecordData;
+
+typedef struct
+{
+	void     *b_data;            /* Benchmark run by this thread */
+	uint64_t primes;             /* Prime numbers found by this thread */
+	uint64_t candidates;         /* Numbers tested by this thread */
+	uint64_t wall, cpu;          /* Time spent by this thread (monotonic clock and CPU time), in ns */
+} __attribute__((aligned(CACHE_LINE_SIZE))) BenchThread;
+
+typedef struct
+{
+	bool     run;                /* Stop flag of threads (atomic) */
+	bool     started;            /* Start barrier is open */
+	enum EnBenchMode mode;       /* Frame of running benchmark: PRIMESLOWSCORE + mode * BENCHFIELDS */
 	unsigned duration, threads;
-	uint32_t primes, start, elapsed;
-	uint64_t num;
-	pthread_t first_thread;
-	pthread_mutex_t mutex_num, mutex_primes;
+	uint32_t elapsed;            /* Elapsed time in seconds */
+	uint32_t segment;            /* Size of a sieve segment, in bytes */
+	uint64_t primes;
+	uint64_t start, deadline, end; /* Monotonic clock, in ns */
+	uint64_t num;                /* Next number not claimed by a thread */
+	unsigned active;             /* Threads still running */
+	bool     done;               /* Counters are merged, threads do not use slots anymore (atomic) */
+	unsigned slot_count;         /* Threads of last benchmark ('threads' can change after it) */
+	BenchThread *slots;          /* Counters of each thread (one cache line by thread) */
+	pthread_mutex_t slots_lock;  /* Held while slots are read, allocated or freed */
+	pthread_mutex_t gate_lock;   /* Start barrier (threads begin together) */
+	pthread_cond_t  gate;
 } BenchData;
 
+typedef struct Options
+{
+	int          use_network;
+	int          use_daemon;
+	unsigned int output_type;
+	unsigned int selected_core;
+	unsigned int refr_time;          /* In ms */
+	unsigned int bw_test;
+	unsigned int interval;
+	unsigned int dump_format;
+	char         *exporter;
+	char         *record;
+	char         *replay;
+	char         *sysroot;            /* Root directory of system files (NULL for "/") */
+	char         *capture;
+	char         *from_capture;
+	double       replay_speed;
+	double       replay_seek;
+	bool         verbose;
+	bool         color;
+	bool         update;
+	bool         use_wget;
+	bool         use_cache;
+	bool         refresh_cache;
+	bool         self_stats;
+} Options;
+
+typedef struct
+{
+	pthread_mutex_t  mutex;              /* Collectors of a context run concurrently (startup pool, GUI worker) */
+	unsigned         collector_count;
+	unsigned         stat_count;
+	struct Collector *collectors;        /* Health of collectors called through err_func(), allocated on first call */
+	struct SelfStat  *stats;             /* Cost of collectors, allocated on first call */
+	bool             bw_started;         /* First run of bandwidth has been waited for */
+	bool             mult_init;          /* Fallback multipliers have been computed */
+	bool             mult_no_range;      /* Missing fallback multipliers have been reported */
+	bool             bus_derived;        /* Bus speed is computed from multiplier (no source has measured it) */
+	double           min_mult, max_mult; /* Fallback multipliers */
+} CoreData;
+
 typedef struct
 {
 	char *objects[LASTOBJ];
 	char *tab_cpu[2][LASTCPU];
 	char *tab_caches[2][LASTCACHES];
 	char *tab_motherboard[2][LASTMOTHERBOARD];
-	char *tab_memory[2][LASTMEMORY];
+	char **tab_memory[2];              /* RAMFIELDS labels by bank, see labels_resize() */
 	char *tab_system[2][LASTSYSTEM];
-	char *tab_graphics[2][LASTGRAPHICS];
+	char **tab_graphics[2];            /* GPUFIELDS labels by GPU, see labels_resize() */
 	char *tab_bench[2][LASTBENCH];
 	char *tab_about[LASTABOUT];
+	char *tab_stat[LASTSTAT];
 
-	int      cpu_freq;
-	uint8_t  cpu_count, gpu_count, dimms_count;
-	double   bus_freq;
+	uint32_t cpu_count, gpu_count, dimms_count;
+	double   *gpu_temperature;         /* Temperature of each GPU in °C (0 if unknown), see labels_resize() */
 
 	LibcpuidData  *l_data;
+	TopologyData  *t_data;
 	BandwidthData *w_data;
-	MemoryData    *m_data;
+	UsageData     *u_data;
+	MsrData       *m_data;
+	SensorsData   *s_data;
+	SnapshotData  *snapshot;
+	RecordData    *r_data;
+	RefreshData   *refresh;
 	BenchData     *b_data;
+	MetricStore   *metrics;
+	CoreData      *c_data;
+	Options       *opts;               /* Options of this context (see opts for the whole process) */
 } Labels;
 
-typedef struct
-{
-	int          use_network;
-	unsigned int output_type;
-	unsigned int selected_core;
-	unsigned int refr_time;
-	unsigned int bw_test;
-	bool         verbose;
-	bool         color;
-	bool         update;
-	bool         use_wget;
-} Options;
-
 extern Options *opts;
 extern char    *binary_name, *new_version;
 
 
-/***************************** Defined in main.c *****************************/
+/***************************** Defined in util.c *****************************/
 
 /* Add a newline for given string (used by MSG_XXX macros) */
 char *msg_newline(char *color, char *str);
@@ -249,36 +475,223 @@ char *msg_error(char *color, char *file, int line, char *str);
 	   iasprintf(&buff, "foo %s %s", NULL, "bar") will allocate "foo bar" */
 int iasprintf(char **str, const char *fmt, ...);
 
-/* Check if a command exists */
-bool command_exists(char *in);
+/* Open a file and put its content in buffer ('options' gives root directory, NULL for "/") */
+int fopen_to_str(const Options *options, char *file, char **buffer);
 
-/* Open a file and put its content in buffer */
-int fopen_to_str(char *file, char **buffer);
+/* Prefix an absolute path with root directory of 'options' (see --sysroot), using 'buff' if needed */
+const char *sysroot_path(const Options *options, const char *path, char *buff, size_t size);
 
-/* Open a pipe and put its content in buffer */
-int popen_to_str(char *command, char **buffer);
+/* open() in root directory of 'options'; file is added to capture if 'options' records one (see --capture) */
+int sysroot_open(const Options *options, const char *path, int flags);
+
+/* fopen() in root directory */
+FILE *sysroot_fopen(const Options *options, const char *path, const char *mode);
+
+/* opendir() in root directory */
+DIR *sysroot_opendir(const Options *options, const char *path);
+
+/* access() in root directory */
+int sysroot_access(const Options *options, const char *path, int mode);
+
+/* Number of configured logical CPUs (read in root directory if there is one, like sysconf() does) */
+long sysroot_cpu_count(const Options *options);
+
+/* "C" locale for machine-readable output (decimal separator is always a dot), see uselocale() */
+locale_t c_locale(void);
 
 /* Free memory after display labels */
 void labels_free(Labels *data);
 
+/* Set the number of devices in the memory (banks) or graphics (GPUs) tab;
+ * new devices have empty values, and the table is freed when 'count' is 0 */
+int labels_resize(Labels *data, enum EnTabNumber page, uint32_t count);
+
+/* Add a device in the memory (banks) or graphics (GPUs) tab, and return its number (-1 on error) */
+int labels_add_device(Labels *data, enum EnTabNumber page);
+
 
 /***************************** External headers *****************************/
 
+/* Check if a command exists */
+bool command_exists(char *in);
+
+/* Open a pipe and put its content in buffer */
+int popen_to_str(char *command, char **buffer);
+
+/* Run a command and wait for it; its output is discarded */
+int run_command(char *command);
+
 /* Fill labels by calling core functions */
 int fill_labels(Labels *data);
 
 /* Refresh some labels */
 int do_refresh(Labels *data, enum EnTabNumber page);
 
+/* Fill static labels from the on-disk cache */
+int cache_load(Labels *data);
+
+/* Write static labels in the on-disk cache */
+int cache_save(Labels *data);
+
+/* Serialize static labels (the caller frees the buffer) */
+char *cache_serialize(Labels *data, size_t *size);
+
+/* Fill static labels from a buffer made by cache_serialize() */
+int cache_unserialize(Labels *data, const char *buff, size_t size);
+
+/* Store an integer value for a metric */
+void metric_set_int(Labels *data, enum EnMetrics id, int64_t value);
+
+/* Store a floating-point value for a metric */
+void metric_set_double(Labels *data, enum EnMetrics id, double value);
+
+/* Get the value of a metric, whatever its type (0 if not available) */
+double metric_get(Labels *data, enum EnMetrics id);
+
+/* Check if a metric has been set */
+bool metric_valid(Labels *data, enum EnMetrics id);
+
+/* Short name of a metric, used by exporters */
+const char *metric_name(enum EnMetrics id);
+
+/* Unit symbol of a metric */
+const char *metric_unit(enum EnMetrics id);
+
+/* Unit of a metric */
+enum EnMetricUnits metric_unit_type(enum EnMetrics id);
+
+/* Type of a metric value */
+enum EnMetricTypes metric_value_type(enum EnMetrics id);
+
+/* Short name of a CPU state (see /proc/stat), used by exporters */
+const char *stat_name(enum EnCpuStat id);
+
+/* Format labels of metrics shown in given page (all pages if page < 0) */
+void metrics_format(Labels *data, int page);
+
+/* Metrics shown in given page, as a METRIC_BIT() mask (all pages if page < 0) */
+uint64_t metrics_page_mask(int page);
+
+/* Detach labels owned by the metric store (before freeing labels) */
+void metrics_unbind(Labels *data);
+
+/* Open MSR files of all logical CPUs ('path' is a format with core number) */
+int msr_open(MsrData *m_data, const char *path, const Options *options);
+
+/* Read registers of all logical CPUs */
+int msr_sample(MsrData *m_data);
+
+/* Close MSR files and free memory */
+void msr_close(MsrData *m_data);
+
+/* Find hardware sensors (in root directory of 'options'), and open their input files */
+int sensors_init(SensorsData *s_data, const Options *options);
+
+/* Read a sensor value; 'index' is a logical CPU for SENSOR_CPUTEMP, a GPU for SENSOR_GPUTEMP */
+int sensors_read(SensorsData *s_data, enum EnSensors sensor, unsigned index, double *value);
+
+/* Close sensor files and free memory */
+void sensors_close(SensorsData *s_data);
+
+/* Attach to the snapshot of a running daemon (read-only) */
+int snapshot_attach(Labels *data);
+
+/* Copy values published by daemon */
+int snapshot_read(Labels *data);
+
+/* Detach from daemon snapshot */
+void snapshot_detach(Labels *data);
+
+/* Run collectors and publish their values in shared memory, until a signal is received */
+int start_daemon(Labels *data);
+
+/* Serve an OpenMetrics page with all live values, until a signal is received */
+int start_exporter(Labels *data);
+
+/* Start recording all samples produced by collectors in a file */
+int record_open(Labels *data, const char *path);
+
+/* Add values updated since previous call to the recording */
+void record_sample(Labels *data);
+
+/* Write pending samples, and close recording or replay */
+void record_close(Labels *data);
+
+/* Open a recording, and show its values instead of collecting them */
+int replay_open(Labels *data, const char *path);
+
+/* Show values recorded at current replay time */
+int replay_read(Labels *data);
+
+/* Open an archive ("-" for standard output), and remember system files read by collectors from now */
+int capture_start(const char *path);
+
+/* Remember a system file or directory read by a collector */
+void capture_add(const char *path);
+
+/* Write remembered files in archive, with those read by libraries, and close it */
+int capture_write(void);
+
+/* Extract an archive made by --capture ("-" for standard input), and read system files in it */
+int capture_open(const char *path);
+
+/* Remove extracted archive */
+void capture_close(void);
+
+/* Create the timer of the refresh scheduler; its file descriptor is readable when collectors are due */
+int refresh_start(Labels *data);
+
+/* Select metrics shown by interface: only collectors which update them are scheduled */
+void refresh_subscribe(Labels *data, uint64_t metrics);
+
+/* Run due collectors (call it when timer is readable); return updated metrics */
+uint64_t refresh_dispatch(Labels *data);
+
+/* Name of a refresh collector, NULL if it is not available in this build or 'task' is out of range */
+const char *refresh_task_name(unsigned task);
+
+/* Run a single refresh collector (index from 0 to refresh_task_count() - 1) */
+int refresh_task_run(Labels *data, unsigned task);
+
+/* Number of refresh collectors */
+unsigned refresh_task_count(void);
+
+/* Delete the timer of the refresh scheduler */
+void refresh_stop(Labels *data);
+
+/* Run collectors which update given metrics (METRIC_BIT() mask), without formatting labels */
+int refresh_metrics(Labels *data, uint64_t mask);
+
+/* Close statistics file of CPU usage and free counters */
+void usage_close(UsageData *u_data);
+
+/* Count a collector call, its latency (in ms) and its health after the call */
+void selfstats_add(Labels *data, const char *name, double elapsed, bool failed, enum EnHealth health);
+
+/* Format cost of each collector and of whole process (string must be freed) */
+char *selfstats_format(Labels *data);
+
+/* Keep stdout for records; messages printed after this call go to stderr */
+int stream_open(void);
+
+/* Print a record with all values every 'interval' milliseconds, until a signal is received */
+int start_stream(Labels *data);
+
 /* Call Dmidecode through CPU-X but do nothing else */
 int run_dmidecode(void);
 
 /* Call Bandwidth through CPU-X but do nothing else */
 int run_bandwidth(void);
 
-/* Perform a multithreaded benchmark (compute prime numbers) */
+/* Perform a multithreaded benchmark (compute prime numbers, by trial division or with a sieve) */
 void start_benchmarks(Labels *data);
 
+/* Ask threads of running benchmark to stop */
+void stop_benchmarks(Labels *data);
+
+/* Check if all benchmark threads are finished (parameters can be changed) */
+bool benchmarks_idle(Labels *data);
+
 /* Start CPU-X in GTK mode */
 void start_gui_gtk(int *argc, char **argv[], Labels *data);
 
@@ -0,0 +1,347 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE cpux-bench.c
+*/
+
+/* Micro-benchmark of collectors: latency, allocations and system calls of each one
+   Build it with 'make cpux-bench' */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <libintl.h>
+#include "cpu-x.h"
+
+#define BENCH_ITERATIONS      1000     /* Default number of calls by target */
+#define BENCH_BUDGET          10       /* Default max time spent on a target, in seconds */
+
+enum EnTargetTypes
+{
+	TARGET_FILL,                       /* fill_labels(), run once: it starts collectors */
+	TARGET_TASK,                       /* A refresh collector */
+	TARGET_PAGE                        /* do_refresh() for a page */
+};
+
+typedef struct
+{
+	char               name[MAXSTR];
+	enum EnTargetTypes type;
+	int                index;
+} BenchTarget;
+
+typedef struct
+{
+	int      fd;
+	bool     tracepoint;               /* All system calls, or only reads and writes (/proc/self/io) */
+	uint64_t self;                     /* System calls made by a measure */
+} SyscallCounter;
+
+static uint64_t alloc_count = 0;
+static FILE *out = NULL;
+static const struct { enum EnTabNumber page; const char *name; } pages[] =
+{
+	{ NO_CPU,      "cpu"      },
+	{ NO_CACHES,   "caches"   },
+	{ NO_SYSTEM,   "system"   },
+	{ NO_GRAPHICS, "graphics" },
+	{ NO_BENCH,    "bench"    }
+};
+
+
+/************************* Allocation counter *************************/
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+/* Interposed allocators: allocations made inside libc (asprintf, fopen...) are counted too */
+void *malloc(size_t size)
+{
+	__atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	__atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	__atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
+	return __libc_realloc(ptr, size);
+}
+#endif /* __GLIBC__ */
+
+
+/************************* System calls counter *************************/
+
+/* Current value of counter */
+static uint64_t syscalls_read(SyscallCounter *counter)
+{
+	char buff[MAXSTR * 4], *ptr;
+	ssize_t len;
+	uint64_t value = 0, syscr = 0, syscw = 0;
+
+	if(counter->fd < 0)
+		return 0;
+
+	if(counter->tracepoint)
+		return (read(counter->fd, &value, sizeof(value)) == sizeof(value)) ? value : 0;
+
+	if((len = pread(counter->fd, buff, sizeof(buff) - 1, 0)) <= 0)
+		return 0;
+	buff[len] = '\0';
+	if((ptr = strstr(buff, "syscr:")) != NULL)
+		syscr = strtoull(ptr + 6, NULL, 10);
+	if((ptr = strstr(buff, "syscw:")) != NULL)
+		syscw = strtoull(ptr + 6, NULL, 10);
+
+	return syscr + syscw;
+}
+
+/* Count system calls of this process with raw_syscalls:sys_enter tracepoint, or only reads and writes if it is not allowed */
+static void syscalls_open(SyscallCounter *counter)
+{
+	int i;
+	char *buff = NULL;
+	struct perf_event_attr attr = { .type = PERF_TYPE_TRACEPOINT, .size = sizeof(attr), .inherit = 1 };
+	const char *paths[] =
+	{
+		"/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+		"/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id",
+		NULL
+	};
+
+	counter->fd = -1;
+	for(i = 0; paths[i] != NULL && counter->fd < 0; i++)
+	{
+		if(access(paths[i], R_OK) || fopen_to_str(NULL, (char *) paths[i], &buff))
+			continue;
+		attr.config = strtoull(buff, NULL, 10);
+		counter->fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+		free(buff);
+		buff = NULL;
+	}
+	free(buff);
+
+	counter->tracepoint = (counter->fd >= 0);
+	if(!counter->tracepoint)
+		counter->fd = open("/proc/self/io", O_RDONLY | O_CLOEXEC);
+
+	/* Calibrate: reading the counter is a system call too */
+	counter->self = syscalls_read(counter);
+	counter->self = syscalls_read(counter) - counter->self;
+}
+
+
+/************************* Benchmark *************************/
+
+/* Compare two latencies (qsort) */
+static int cmp_latency(const void *a, const void *b)
+{
+	const double x = *(const double *) a, y = *(const double *) b;
+
+	return (x > y) - (x < y);
+}
+
+/* Call a target until 'iterations' calls are done or 'budget' seconds are elapsed, and print its costs */
+static void bench_target(Labels *data, const BenchTarget *target, unsigned iterations, unsigned budget, SyscallCounter *counter)
+{
+	unsigned n;
+	double total = 0;
+	double *latency = malloc(iterations * sizeof(double));
+	uint64_t allocs, syscalls;
+	struct timespec start, end;
+
+	allocs   = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+	syscalls = syscalls_read(counter);
+	for(n = 0; n < iterations && total < budget * 1e6; n++)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		switch(target->type)
+		{
+			case TARGET_FILL: fill_labels(data);                        break;
+			case TARGET_TASK: refresh_task_run(data, target->index);    break;
+			case TARGET_PAGE: do_refresh(data, target->index);          break;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		latency[n] = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+		total     += latency[n];
+	}
+	syscalls = syscalls_read(counter) - syscalls - counter->self;
+	allocs   = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED) - allocs;
+
+	qsort(latency, n, sizeof(double), cmp_latency);
+	fprintf(out, "%-28s %8u %11.2f %11.2f %11.2f %12.1f %14.1f\n", target->name, n, total / n,
+	       latency[(n - 1) / 2], latency[(n * 99 + 99) / 100 - 1], (double) allocs / n, (double) syscalls / n);
+	fflush(out);
+	free(latency);
+}
+
+/* Target is selected in command line (all targets if none is given) */
+static bool target_selected(const char *name, int argc, char *argv[])
+{
+	int i;
+
+	for(i = optind; i < argc && strcmp(argv[i], name); i++);
+
+	return (optind == argc || i < argc);
+}
+
+/* Print help */
+static void usage(const char *prog)
+{
+	printf(_("Usage: %s [OPTIONS] [TARGETS]\n\n"), prog);
+	printf(_("Run each collector and each do_refresh() page, and print their latency (in µs),\n"
+	         "allocations and system calls by call. TARGETS are names printed in first column.\n\n"));
+	printf(_("  -n, --iterations N  Number of calls by target (default: %u)\n"), BENCH_ITERATIONS);
+	printf(_("  -b, --budget S      Max time spent on a target, in seconds (default: %u)\n"), BENCH_BUDGET);
+	printf(_("  -r, --root DIR      Read /sys, /proc and /dev in another root directory, e.g. a fixture\n"
+	         "                      in data/sysroot (default: CPUX_SYSROOT)\n"));
+	printf(_("  -h, --help          Print help and exit\n"));
+}
+
+int main(int argc, char *argv[])
+{
+	int c;
+	unsigned i, iterations = BENCH_ITERATIONS, budget = BENCH_BUDGET;
+	char *root = getenv("CPUX_SYSROOT");
+	BenchTarget target;
+	SyscallCounter counter;
+	const struct option longopts[] =
+	{
+		{ "iterations", required_argument, 0, 'n' },
+		{ "budget",     required_argument, 0, 'b' },
+		{ "root",       required_argument, 0, 'r' },
+		{ "help",       no_argument,       0, 'h' },
+		{ 0,            0,                 0, 0   }
+	};
+
+	binary_name = argv[0];
+	Labels *data = &(Labels) {
+	                .tab_cpu    = {{ NULL }}, .tab_caches     = {{ NULL }}, .tab_motherboard = {{ NULL }},
+	                .tab_memory = { NULL },  .tab_system     = {{ NULL }}, .tab_graphics    = { NULL },
+	                .cpu_count  = 0,          .gpu_count      = 0,          .dimms_count     = 0 };
+	data->l_data   = &(LibcpuidData)  { .cpu_vendor_id = -1, .cpu_model = -1, .cpu_ext_model = -1, .cpu_ext_family = -1 };
+	data->t_data   = &(TopologyData)  { .socket_count = 0, .die_count = 0, .core_count = 0, .thread_count = 0, .cpus = NULL };
+	data->w_data   = &(BandwidthData) { .l1_size = 0, .test_count = 0, .test_name = NULL, .speed = { 0 } };
+	data->u_data   = &(UsageData)     { .fd = -1, .buff = NULL, .core_count = 0, .current = 0, .hz = 0, .stamp = { 0 },
+	                                    .ticks = { NULL }, .percent = NULL, .rate = NULL, .usage = NULL };
+	data->m_data   = &(MsrData)       { .vendor = MSR_UNKNOWN, .core_count = 0, .fd = NULL };
+	data->s_data   = &(SensorsData)   { .init = false, .core_count = 0, .fd_count = 0, .fds = NULL, .core_temp = NULL,
+	                                    .cpu_volt = -1, .gpu_count = 0, .gpu_temp = NULL };
+	data->snapshot = &(SnapshotData)  { .writer = false, .size = 0, .map = NULL };
+	data->r_data   = &(RecordData)    { .writer = NULL, .reader = NULL };
+	data->refresh  = &(RefreshData)   { .fd = -1, .subscribed = 0, .heap_size = 0 };
+	data->b_data   = &(BenchData)     { .run = false, .duration = 1, .threads = 1, .primes = 0,
+	                                    .slots_lock = PTHREAD_MUTEX_INITIALIZER };
+	data->metrics  = &(MetricStore)   { .valid = { false }, .stamp = { 0 }, .fmt_stamp = { 0 } };
+	data->c_data   = &(CoreData)      { .mutex = PTHREAD_MUTEX_INITIALIZER, .collector_count = 0, .stat_count = 0,
+	                                    .collectors = NULL, .stats = NULL, .bw_started = false, .mult_init = false };
+
+	/* Nothing is shared with other instances: results only depend on hardware (or on fake root) */
+	opts = &(Options) { .output_type = OUT_DUMP, .selected_core = 0,     .refr_time   = 1000,
+	                    .bw_test     = 0,        .verbose       = false, .color       = isatty(STDERR_FILENO),
+	                    .update      = false,    .use_network   = 0,     .use_wget    = false,
+	                    .use_daemon  = 0,        .exporter      = NULL,  .interval    = 0,
+	                    .dump_format = FMT_TEXT, .record        = NULL,  .replay      = NULL,
+	                    .replay_speed = 1.0,     .replay_seek   = 0,     .use_cache   = false,
+	                    .refresh_cache = false,  .self_stats    = false, .sysroot = NULL,
+	                    .capture       = NULL,   .from_capture  = NULL };
+	data->opts = opts;
+
+	while((c = getopt_long(argc, argv, "n:b:r:h", longopts, NULL)) != -1)
+	{
+		switch(c)
+		{
+			case 'n':
+				if(atoi(optarg) > 0)
+					iterations = atoi(optarg);
+				break;
+			case 'b':
+				if(atoi(optarg) > 0)
+					budget = atoi(optarg);
+				break;
+			case 'r':
+				root = optarg;
+				break;
+			case 'h':
+				usage(argv[0]);
+				return EXIT_SUCCESS;
+			default:
+				usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	/* Keep stdout for results; messages of collectors go to stderr */
+	fflush(stdout);
+	if((c = dup(STDOUT_FILENO)) < 0 || (out = fdopen(c, "w")) == NULL)
+		return EXIT_FAILURE;
+	dup2(STDERR_FILENO, STDOUT_FILENO);
+
+	/* Counter is opened before root directory is set: tracing files are not in fake root */
+	syscalls_open(&counter);
+	if(root != NULL && root[0] != '\0')
+		opts->sysroot = root;
+
+	fprintf(out, _("System calls: %s\n\n"), counter.tracepoint ? _("all (raw_syscalls:sys_enter tracepoint)") :
+	       (counter.fd >= 0) ? _("reads and writes only (/proc/self/io)") : _("unavailable"));
+	fprintf(out, "%-28s %8s %11s %11s %11s %12s %14s\n", _("Target"), _("Calls"), _("Mean (µs)"), _("p50 (µs)"),
+	       _("p99 (µs)"), _("Allocs/call"), _("Syscalls/call"));
+
+	/* Collectors need a first fill_labels() */
+	target = (BenchTarget) { .name = "fill_labels", .type = TARGET_FILL, .index = 0 };
+	bench_target(data, &target, 1, budget, &counter);
+
+	for(i = 0; i < refresh_task_count(); i++)
+	{
+		if(refresh_task_name(i) == NULL || !target_selected(refresh_task_name(i), argc, argv))
+			continue;
+		target = (BenchTarget) { .type = TARGET_TASK, .index = i };
+		snprintf(target.name, sizeof(target.name), "%s", refresh_task_name(i));
+		bench_target(data, &target, iterations, budget, &counter);
+	}
+
+	for(i = 0; i < sizeof(pages) / sizeof(pages[0]); i++)
+	{
+		target = (BenchTarget) { .type = TARGET_PAGE, .index = pages[i].page };
+		snprintf(target.name, sizeof(target.name), "do_refresh:%s", pages[i].name);
+		if(target_selected(target.name, argc, argv))
+			bench_target(data, &target, iterations, budget, &counter);
+	}
+
+	labels_free(data);
+	fclose(out);
+
+	return EXIT_SUCCESS;
+}
@@ -57,6 +57,7 @@
 #include <strings.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <limits.h>
 
 #include "version.h"
 #include "config.h"
@@ -79,9 +80,11 @@ static const char *bad_index = "<BAD INDEX>";
 #define SYS_ENTRY_FILE SYS_FIRMWARE_DIR "/smbios_entry_point"
 #define SYS_TABLE_FILE SYS_FIRMWARE_DIR "/DMI"
 
-/* Options are global */
-struct opt opt;
-char **dmidata[16];
+/* Options are global to each thread: CPU-X contexts can call dmidecode concurrently */
+__thread struct opt opt;
+__thread char **dmidata[16];
+__thread Labels *dmilabels;
+__thread const char *dmisysroot;
 
 /*
  * Type-independant Stuff
@@ -302,7 +305,7 @@ static void dmi_bios_runtime_size(u32 code)
 
 static char *dmi_bios_runtime_size_str(u32 code)
 {
-	static char size[24];
+	static __thread char size[24];
 
 	if (code & 0x000003FF)
 		sprintf(size, " %u bytes", code);
@@ -1155,7 +1158,7 @@ static void dmi_processor_frequency(const u8 *p)
 static char *dmi_processor_frequency_str(const u8 *p)
 {
 	u16 code = WORD(p);
-	static char freq[10];
+	static __thread char freq[10];
 
 	if (code)
 		sprintf(freq, "%u MHz", code);
@@ -2305,7 +2308,7 @@ static void dmi_memory_device_size(u16 code)
 
 static char *dmi_memory_device_size_str(u16 code)
 {
-	static char size[8];
+	static __thread char size[8];
 
 	if (code == 0)
 		strcpy(size, "Empty");
@@ -3283,7 +3286,6 @@ static const char *dmi_management_controller_host_type(u8 code)
 static void dmi_decode(const struct dmi_header *h, u16 ver)
 {
 	const u8 *data = h->data;
-	static int bank = BANK0_0;
 
 	/*
 	 * Note: DMI types 37 and 42 are untested
@@ -3763,25 +3765,30 @@ static void dmi_decode(const struct dmi_header *h, u16 ver)
 			break;
 
 		case 17: /* 7.18 Memory Device */
-			if((opt.flags & FLAG_CPU_X) && bank <= BANK7_0)
+			if(opt.flags & FLAG_CPU_X)
 			{
+				int bank = labels_add_device(dmilabels, NO_MEMORY);
+				char **dimm;
+
+				if(bank < 0)
+					break;
+				dimm = &dmilabels->tab_memory[VALUE][bank * RAMFIELDS];
 				if(strstr(dmi_string(h, data[0x17]), "Empty") != NULL)
 				{
-					iasprintf(dmidata[bank],   "- - - - - -");
-					iasprintf(dmidata[++bank], "- - - - - -");
+					iasprintf(&dimm[BANKREFERENCE], "- - - - - -");
+					iasprintf(&dimm[BANKTYPE],      "- - - - - -");
 				}
 				else
 				{
-					iasprintf(dmidata[bank], "%s %s",
+					iasprintf(&dimm[BANKREFERENCE], "%s %s",
 					          dmi_string(h, data[0x17]),
 					          dmi_string(h, data[0x1A]));
-					iasprintf(dmidata[++bank], "%s @ %uMHz (%s %s)",
+					iasprintf(&dimm[BANKTYPE], "%s @ %uMHz (%s %s)",
 					          dmi_memory_device_size_str(WORD(data + 0x0C)),
 					          (WORD(data + 0x15)),
 					          dmi_memory_device_form_factor(data[0x0E]),
 					          dmi_memory_device_type(data[0x12]));
 				}
-				bank++;
 			}
 			else
 			{
@@ -4872,8 +4879,10 @@ int dmidecode(void)
 	off_t fp;
 	size_t size;
 	int efi;
-	u8 *buf;
+	u8 *buf = NULL;
 	char *argv[] = { "dmidecode (built-in with CPU-X)", NULL };
+	const char *sysroot = (dmisysroot != NULL) ? dmisysroot : "";
+	char sys_entry_file[PATH_MAX], sys_table_file[PATH_MAX];
 
 	if (sizeof(u8) != 1 || sizeof(u16) != 2 || sizeof(u32) != 4 || '\0' != 0)
 	{
@@ -4883,6 +4892,8 @@ int dmidecode(void)
 
 	/* Set default option values */
 	opt.devmem = DEFAULT_MEM_DEV;
+	snprintf(sys_entry_file, sizeof(sys_entry_file), "%s%s", sysroot, SYS_ENTRY_FILE);
+	snprintf(sys_table_file, sizeof(sys_table_file), "%s%s", sysroot, SYS_TABLE_FILE);
 #if 0
 	opt.flags = 0;
 
@@ -4944,23 +4955,23 @@ int dmidecode(void)
 	 */
 	size = 0x20;
 	if (!(opt.flags & FLAG_NO_SYSFS)
-	 && (buf = read_file(&size, SYS_ENTRY_FILE)) != NULL)
+	 && (buf = read_file(&size, sys_entry_file)) != NULL)
 	{
 		if (!(opt.flags & FLAG_QUIET))
 			printf("Getting SMBIOS data from sysfs.\n");
 		if (size >= 24 && memcmp(buf, "_SM3_", 5) == 0)
 		{
-			if (smbios3_decode(buf, SYS_TABLE_FILE, FLAG_NO_FILE_OFFSET))
+			if (smbios3_decode(buf, sys_table_file, FLAG_NO_FILE_OFFSET))
 				found++;
 		}
 		else if (size >= 31 && memcmp(buf, "_SM_", 4) == 0)
 		{
-			if (smbios_decode(buf, SYS_TABLE_FILE, FLAG_NO_FILE_OFFSET))
+			if (smbios_decode(buf, sys_table_file, FLAG_NO_FILE_OFFSET))
 				found++;
 		}
 		else if (size >= 15 && memcmp(buf, "_DMI_", 5) == 0)
 		{
-			if (legacy_decode(buf, SYS_TABLE_FILE, FLAG_NO_FILE_OFFSET))
+			if (legacy_decode(buf, sys_table_file, FLAG_NO_FILE_OFFSET))
 				found++;
 		}
 
@@ -4970,6 +4981,13 @@ int dmidecode(void)
 			printf("Failed to get SMBIOS data from sysfs.\n");
 	}
 
+	/* CPU-X: EFI and memory of running system do not belong to root directory given by --sysroot */
+	if (sysroot[0] != '\0')
+	{
+		ret = 1;
+		goto done;
+	}
+
 	/* Next try EFI (ia64, Intel-based Mac) */
 	efi = address_from_efi(&fp);
 	switch (efi)
@@ -37,7 +37,7 @@ enum DMI_VENDORS
 	VENDOR_ACER,
 };
 
-static enum DMI_VENDORS dmi_vendor = VENDOR_UNKNOWN;
+static __thread enum DMI_VENDORS dmi_vendor = VENDOR_UNKNOWN;
 
 /*
  * Remember the system vendor for later use. We only actually store the
@@ -75,7 +75,7 @@ static void dmi_print_hp_net_iface_rec(u8 id, u8 bus, u8 dev, const u8 *mac)
 	 * using 0xFF marker is not future proof. 256 NICs is a lot, but
 	 * 640K ought to be enough for anybody(said no one, ever).
 	 * */
-	static u8 nic_ctr;
+	static __thread u8 nic_ctr;
 
 	if (id == 0xFF)
 		id = ++nic_ctr;
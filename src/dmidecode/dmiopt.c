@@ -31,8 +31,8 @@
 #include "dmiopt.h"
 
 
-/* Options are global */
-struct opt opt;
+/* Options are global to each thread */
+__thread struct opt opt;
 
 
 /*
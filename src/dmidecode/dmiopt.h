@@ -39,7 +39,7 @@ struct opt
 	const struct string_keyword *string;
 	char *dumpfile;
 };
-extern struct opt opt;
+extern __thread struct opt opt;
 
 #define FLAG_VERSION            (1 << 0)
 #define FLAG_HELP               (1 << 1)
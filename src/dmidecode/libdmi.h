@@ -30,7 +30,9 @@
 #define PROC_BUS 1
 #define LASTPROC 2
 
-extern char **dmidata[16];
+extern __thread char **dmidata[16];
+extern __thread Labels *dmilabels; /* Memory devices are added in these labels */
+extern __thread const char *dmisysroot; /* Root directory of DMI tables (see --sysroot), NULL for "/" */
 
 int dmidecode(void);
 
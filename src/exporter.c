@@ -0,0 +1,403 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE exporter.c
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <math.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <libintl.h>
+#include "exporter.h"
+#include "cpu-x.h"
+
+static volatile sig_atomic_t running = 1;
+
+
+/************************* Public functions *************************/
+
+/* Serve an OpenMetrics page with all live values, until a signal is received */
+int start_exporter(Labels *data)
+{
+	int fd, client;
+	struct sigaction sa = { .sa_handler = exporter_stop };
+	ExpPage page = { .buff = NULL, .len = 0, .truncated = false };
+
+	/* Page is allocated once, and only grows if a scrape does not fit (e.g. more devices than expected) */
+	page.size = EXPORTER_BASE_SIZE + (data->u_data->core_count + 1) * EXPORTER_CPU_SIZE + data->gpu_count * EXPORTER_GPU_SIZE;
+	if((page.buff = malloc(page.size)) == NULL)
+	{
+		MSG_ERROR(_("failed to allocate memory for exporter"));
+		return 1;
+	}
+
+	if((fd = exp_listen(opts->exporter)) < 0)
+	{
+		MSG_ERROR(_("failed to listen on '%s'"), opts->exporter);
+		free(page.buff);
+		return 2;
+	}
+
+	/* No SA_RESTART: accept() must return when a signal is received */
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT,  &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	MSG_VERBOSE(_("Serving OpenMetrics page on '%s'"), opts->exporter);
+	while(running)
+	{
+		if((client = accept(fd, NULL, NULL)) < 0)
+		{
+			if(errno == EINTR || errno == ECONNABORTED)
+				continue;
+			MSG_ERROR(_("failed to accept a connection"));
+			break;
+		}
+		exp_serve(data, &page, client);
+		close(client);
+	}
+
+	close(fd);
+	if(strchr(opts->exporter, '/') != NULL)
+		unlink(opts->exporter);
+	free(page.buff);
+
+	return 0;
+}
+
+
+/************************* Private functions *************************/
+
+/* Append formatted text to page (never allocates) */
+static void exp_printf(ExpPage *page, const char *fmt, ...)
+{
+	int len;
+	va_list ap;
+
+	if(page->truncated)
+		return;
+
+	va_start(ap, fmt);
+	len = vsnprintf(page->buff + page->len, page->size - page->len, fmt, ap);
+	va_end(ap);
+
+	if(len < 0 || (size_t) len >= page->size - page->len)
+		page->truncated = true;
+	else
+		page->len += len;
+}
+
+/* Append a label value, escaped as required by OpenMetrics */
+static void exp_escape(ExpPage *page, const char *str)
+{
+	for(; str != NULL && *str != '\0' && !page->truncated; str++)
+	{
+		switch(*str)
+		{
+			case '\\': exp_printf(page, "\\\\"); break;
+			case '"':  exp_printf(page, "\\\""); break;
+			case '\n': exp_printf(page, "\\n");  break;
+			default:   exp_printf(page, "%c", *str);
+		}
+	}
+}
+
+/* Append metadata of a metric family */
+static void exp_family(ExpPage *page, const char *name, const char *unit, const char *help)
+{
+	const char *sep = (unit[0] != '\0') ? "_" : "";
+
+	exp_printf(page, "# TYPE " EXPORTER_PREFIX "%s%s%s gauge\n", name, sep, unit);
+	if(unit[0] != '\0')
+		exp_printf(page, "# UNIT " EXPORTER_PREFIX "%s%s%s %s\n", name, sep, unit, unit);
+	exp_printf(page, "# HELP " EXPORTER_PREFIX "%s%s%s %s\n", name, sep, unit, help);
+}
+
+/* Build the page, from numeric values of collectors */
+static void exp_render(Labels *data, ExpPage *page)
+{
+	unsigned id, r, s, i;
+	const UsageData *u_data = data->u_data;
+	const MsrData *m_data   = data->m_data;
+	static const ExpUnit units[LASTUNIT] =
+	{
+		[UNIT_NONE]    = { "",                 1.0       },
+		[UNIT_MHZ]     = { "hertz",            1e6       },
+		[UNIT_VOLT]    = { "volts",            1.0       },
+		[UNIT_CELSIUS] = { "celsius",          1.0       },
+		[UNIT_PERCENT] = { "ratio",            0.01      },
+		[UNIT_MBPS]    = { "bytes_per_second", 1e6       },
+		[UNIT_MB]      = { "bytes",            1048576.0 },
+		[UNIT_SECOND]  = { "seconds",          1.0       },
+	};
+	static const struct { uint16_t flag; const char *name; } thermal[] =
+	{
+		{ MSR_THERMAL_THROTTLE, "throttle" }, { MSR_THERMAL_PROCHOT, "prochot" },
+		{ MSR_THERMAL_CRITICAL, "critical" }, { MSR_THERMAL_POWER_LIMIT, "power_limit" },
+	};
+
+	/* Samples are parsed by scrapers: decimal separator does not follow locale */
+	const locale_t old_locale = uselocale(c_locale());
+
+	page->len       = 0;
+	page->truncated = false;
+
+	/* Hardware identity, as labels */
+	exp_printf(page, "# TYPE " EXPORTER_PREFIX "cpu info\n" EXPORTER_PREFIX "cpu_info{vendor=\"");
+	exp_escape(page, data->tab_cpu[VALUE][VENDOR]);
+	exp_printf(page, "\",model=\"");
+	exp_escape(page, data->tab_cpu[VALUE][SPECIFICATION]);
+	exp_printf(page, "\",codename=\"");
+	exp_escape(page, data->tab_cpu[VALUE][CODENAME]);
+	exp_printf(page, "\",package=\"");
+	exp_escape(page, data->tab_cpu[VALUE][PACKAGE]);
+	exp_printf(page, "\"} 1\n");
+
+	exp_printf(page, "# TYPE " EXPORTER_PREFIX "board info\n" EXPORTER_PREFIX "board_info{vendor=\"");
+	exp_escape(page, data->tab_motherboard[VALUE][MANUFACTURER]);
+	exp_printf(page, "\",model=\"");
+	exp_escape(page, data->tab_motherboard[VALUE][MBMODEL]);
+	exp_printf(page, "\",bios_version=\"");
+	exp_escape(page, data->tab_motherboard[VALUE][BIOSVERSION]);
+	exp_printf(page, "\",chipset=\"");
+	exp_escape(page, data->tab_motherboard[VALUE][CHIPMODEL]);
+	exp_printf(page, "\"} 1\n");
+
+	exp_printf(page, "# TYPE " EXPORTER_PREFIX "gpu info\n");
+	for(i = 0; i < data->gpu_count; i++)
+	{
+		exp_printf(page, EXPORTER_PREFIX "gpu_info{gpu=\"%u\",vendor=\"", i);
+		exp_escape(page, data->tab_graphics[VALUE][GPUVENDOR + i * GPUFIELDS]);
+		exp_printf(page, "\",model=\"");
+		exp_escape(page, data->tab_graphics[VALUE][GPUMODEL + i * GPUFIELDS]);
+		exp_printf(page, "\"} 1\n");
+	}
+
+	/* Metric store (usage of selected core is replaced by per-CPU series) */
+	for(id = 0; id < LASTMETRIC; id++)
+	{
+		const ExpUnit *unit = &units[metric_unit_type(id)];
+
+		if(id == MT_COREUSAGE || !metric_valid(data, id) || !isfinite(metric_get(data, id)))
+			continue;
+		exp_family(page, metric_name(id), unit->suffix, metric_name(id));
+		exp_printf(page, EXPORTER_PREFIX "%s%s%s %.10g\n", metric_name(id), unit->suffix[0] ? "_" : "", unit->suffix,
+		           metric_get(data, id) * unit->scale);
+	}
+
+	/* Usage by logical CPU and by state */
+	if(u_data->usage != NULL)
+	{
+		exp_family(page, "cpu_core_usage", "ratio", "Usage of a logical CPU");
+		for(r = 1; r <= u_data->core_count; r++)
+			exp_printf(page, EXPORTER_PREFIX "cpu_core_usage_ratio{cpu=\"%u\"} %.6g\n", r - 1, u_data->usage[r] / 100);
+
+		exp_family(page, "cpu_state", "ratio", "Time spent by CPUs in each state");
+		for(r = 0; r <= u_data->core_count; r++)
+		{
+			for(s = 0; s < LASTSTAT; s++)
+			{
+				if(r == 0)
+					exp_printf(page, EXPORTER_PREFIX "cpu_state_ratio{cpu=\"all\",state=\"%s\"} %.6g\n",
+					           stat_name(s), u_data->percent[s] / 100);
+				else
+					exp_printf(page, EXPORTER_PREFIX "cpu_state_ratio{cpu=\"%u\",state=\"%s\"} %.6g\n",
+					           r - 1, stat_name(s), u_data->percent[r * LASTSTAT + s] / 100);
+			}
+		}
+	}
+
+	/* MSR values by logical CPU */
+	if(m_data->fd != NULL)
+	{
+		exp_family(page, "cpu_msr_voltage", "volts", "Core voltage read in MSR");
+		for(r = 0; r < m_data->core_count; r++)
+			if(m_data->fd[r] >= 0 && m_data->voltage[r] > 0)
+				exp_printf(page, EXPORTER_PREFIX "cpu_msr_voltage_volts{cpu=\"%u\"} %.4g\n", r, m_data->voltage[r]);
+
+		exp_family(page, "cpu_msr_temperature", "celsius", "Core temperature read in MSR");
+		for(r = 0; r < m_data->core_count; r++)
+			if(m_data->fd[r] >= 0 && m_data->temperature[r] > 0)
+				exp_printf(page, EXPORTER_PREFIX "cpu_msr_temperature_celsius{cpu=\"%u\"} %.4g\n", r, m_data->temperature[r]);
+
+		exp_family(page, "cpu_msr_multiplier", "", "Current core multiplier");
+		for(r = 0; r < m_data->core_count; r++)
+			if(m_data->fd[r] >= 0 && m_data->multiplier[r] > 0)
+				exp_printf(page, EXPORTER_PREFIX "cpu_msr_multiplier{cpu=\"%u\"} %.4g\n", r, m_data->multiplier[r]);
+
+		exp_family(page, "cpu_msr_effective_multiplier", "", "Average core multiplier while not halted (APERF/MPERF)");
+		for(r = 0; r < m_data->core_count; r++)
+			if(m_data->fd[r] >= 0 && m_data->eff_multiplier[r] > 0)
+				exp_printf(page, EXPORTER_PREFIX "cpu_msr_effective_multiplier{cpu=\"%u\"} %.4g\n", r, m_data->eff_multiplier[r]);
+
+		exp_family(page, "cpu_msr_thermal_status", "", "Thermal status flags read in MSR");
+		for(r = 0; m_data->vendor == MSR_INTEL && r < m_data->core_count; r++)
+			for(i = 0; m_data->fd[r] >= 0 && i < sizeof(thermal) / sizeof(thermal[0]); i++)
+				exp_printf(page, EXPORTER_PREFIX "cpu_msr_thermal_status{cpu=\"%u\",flag=\"%s\"} %i\n",
+				           r, thermal[i].name, !!(m_data->thermal[r] & thermal[i].flag));
+	}
+
+	/* Temperature by GPU (same numbers as in gpu_info) */
+	if(data->gpu_temperature != NULL)
+	{
+		exp_family(page, "gpu_temperature", "celsius", "Temperature of a GPU");
+		for(i = 0; i < data->gpu_count; i++)
+			if(data->gpu_temperature[i] > 0)
+				exp_printf(page, EXPORTER_PREFIX "gpu_temperature_celsius{gpu=\"%u\"} %.4g\n", i, data->gpu_temperature[i]);
+	}
+
+	exp_printf(page, "# EOF\n");
+	uselocale(old_locale);
+}
+
+/* Double the size of page, up to EXPORTER_MAX_SIZE */
+static bool exp_grow(ExpPage *page)
+{
+	char *buff;
+
+	if(page->size >= EXPORTER_MAX_SIZE || (buff = realloc(page->buff, page->size * 2)) == NULL)
+		return false;
+
+	MSG_VERBOSE(_("Growing exporter page to %zu bytes"), page->size * 2);
+	page->buff  = buff;
+	page->size *= 2;
+	return true;
+}
+
+/* Open listening socket: port, address:port or Unix socket path */
+static int exp_listen(const char *addr)
+{
+	int fd, one = 1;
+	char host[INET_ADDRSTRLEN];
+	const char *colon;
+	struct sockaddr_in in = { .sin_family = AF_INET };
+	struct sockaddr_un un = { .sun_family = AF_UNIX };
+
+	if(strchr(addr, '/') != NULL)
+	{
+		if(strlen(addr) >= sizeof(un.sun_path) || (fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+			return -1;
+		strcpy(un.sun_path, addr);
+		unlink(addr);
+		if(bind(fd, (struct sockaddr *) &un, sizeof(un)) || listen(fd, SOMAXCONN))
+		{
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	if((colon = strrchr(addr, ':')) != NULL)
+		snprintf(host, sizeof(host), "%.*s", (int) (colon - addr), addr);
+	else
+		snprintf(host, sizeof(host), "%s", EXPORTER_HOST);
+	in.sin_port = htons(atoi((colon != NULL) ? colon + 1 : addr));
+	if(in.sin_port == 0 || inet_pton(AF_INET, host, &in.sin_addr) != 1 ||
+	   (fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+		return -1;
+
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if(bind(fd, (struct sockaddr *) &in, sizeof(in)) || listen(fd, SOMAXCONN))
+	{
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* Answer to a scrape */
+static void exp_serve(Labels *data, ExpPage *page, int client)
+{
+	int hlen;
+	size_t len = 0, sent;
+	ssize_t n;
+	char request[EXPORTER_REQUEST], header[256];
+	const char *status = "200 OK", *type = EXPORTER_CONTENT_TYPE;
+	struct timeval tv = { .tv_sec = EXPORTER_TIMEOUT, .tv_usec = 0 };
+
+	setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	/* Only request line is used */
+	request[0] = '\0';
+	while(len < sizeof(request) - 1 && strstr(request, "\r\n\r\n") == NULL && strstr(request, "\n\n") == NULL &&
+	     (n = recv(client, request + len, sizeof(request) - 1 - len, 0)) > 0)
+	{
+		len += n;
+		request[len] = '\0';
+	}
+
+	if(strncmp(request, "GET ", 4))
+	{
+		status = "405 Method Not Allowed";
+		page->len = 0;
+	}
+	else if(strncmp(request + 4, "/ ", 2) && strncmp(request + 4, "/metrics ", 9) && strncmp(request + 4, "/metrics?", 9))
+	{
+		status = "404 Not Found";
+		page->len = 0;
+	}
+	else
+	{
+		/* Values are refreshed by scrapes, so CPU usage is averaged over scrape interval */
+		do_refresh(data, NO_CPU);
+		do_refresh(data, NO_SYSTEM);
+		do_refresh(data, NO_GRAPHICS);
+
+		/* A truncated page (without "# EOF") is never served: page grows until it fits */
+		for(exp_render(data, page); page->truncated && exp_grow(page); exp_render(data, page));
+		if(page->truncated)
+		{
+			MSG_ERROR(_("failed to allocate memory for exporter"));
+			status = "503 Service Unavailable";
+			page->len = 0;
+		}
+	}
+
+	hlen = snprintf(header, sizeof(header), "HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+	                status, type, page->len);
+	if(send(client, header, hlen, MSG_NOSIGNAL) != hlen)
+		return;
+
+	for(sent = 0; sent < page->len; sent += n)
+	{
+		if((n = send(client, page->buff + sent, page->len - sent, MSG_NOSIGNAL)) <= 0)
+			break;
+	}
+}
+
+/* Stop exporter loop (signal handler) */
+static void exporter_stop(int signum)
+{
+	(void) signum;
+	running = 0;
+}
@@ -0,0 +1,80 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE exporter.h
+*/
+
+#ifndef _EXPORTER_H_
+#define _EXPORTER_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "cpu-x.h"
+
+#define EXPORTER_PREFIX       "cpux_"
+#define EXPORTER_HOST         "127.0.0.1"    /* Only local scrapers, if no address is given */
+#define EXPORTER_BASE_SIZE    16384          /* Page size without per-CPU series */
+#define EXPORTER_CPU_SIZE     (128 * (LASTSTAT + 8)) /* Page size by logical CPU */
+#define EXPORTER_GPU_SIZE     512            /* Page size by GPU (labels and temperature) */
+#define EXPORTER_MAX_SIZE     (64 << 20)     /* Page is never grown over this size */
+#define EXPORTER_REQUEST      1024           /* Max read size of a HTTP request */
+#define EXPORTER_TIMEOUT      2              /* Timeout for client I/O, in seconds */
+#define EXPORTER_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+typedef struct
+{
+	char   *buff;       /* Allocated at startup, grown by exp_grow() */
+	size_t size, len;
+	bool   truncated;
+} ExpPage;
+
+typedef struct
+{
+	const char *suffix; /* OpenMetrics base unit */
+	double     scale;   /* Factor from CPU-X unit to base unit */
+} ExpUnit;
+
+
+/* Append formatted text to page (never allocates) */
+static void exp_printf(ExpPage *page, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/* Append a label value, escaped as required by OpenMetrics */
+static void exp_escape(ExpPage *page, const char *str);
+
+/* Append metadata of a metric family */
+static void exp_family(ExpPage *page, const char *name, const char *unit, const char *help);
+
+/* Build the page, from numeric values of collectors */
+static void exp_render(Labels *data, ExpPage *page);
+
+/* Double the size of page, up to EXPORTER_MAX_SIZE */
+static bool exp_grow(ExpPage *page);
+
+/* Open listening socket: port, address:port or Unix socket path */
+static int exp_listen(const char *addr);
+
+/* Answer to a scrape */
+static void exp_serve(Labels *data, ExpPage *page, int client);
+
+/* Stop exporter loop (signal handler) */
+static void exporter_stop(int signum);
+
+
+#endif /* _EXPORTER_H_ */
@@ -25,7 +25,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <unistd.h>
+#include <poll.h>
 #include <libintl.h>
+#include <sys/eventfd.h>
 #include "cpu-x.h"
 #include "gui_gtk.h"
 #include "gui_gtk_id.h"
@@ -34,6 +37,21 @@
 # include "gtk-resources.h"
 #endif
 
+/* Colors of CPU states in per-core usage graph (idle and guest time are not stacked) */
+static const struct StatColor { bool stacked; double red, green, blue; } stat_colors[LASTSTAT] =
+{
+	[STAT_USER]      = { true,  1.00, 0.75, 0.15 },
+	[STAT_NICE]      = { true,  0.20, 1.00, 0.25 },
+	[STAT_SYSTEM]    = { true,  1.00, 0.35, 0.15 },
+	[STAT_IDLE]      = { false, 0.00, 0.00, 0.00 },
+	[STAT_IOWAIT]    = { true,  0.25, 0.55, 1.00 },
+	[STAT_IRQ]       = { true,  0.75, 0.00, 0.65 },
+	[STAT_SOFTIRQ]   = { true,  1.00, 0.25, 0.90 },
+	[STAT_STEAL]     = { true,  0.80, 0.00, 0.00 },
+	[STAT_GUEST]     = { false, 0.00, 0.00, 0.00 },
+	[STAT_GUESTNICE] = { false, 0.00, 0.00, 0.00 },
+};
+
 
 /************************* Public function *************************/
 
@@ -42,7 +60,8 @@ void start_gui_gtk(int *argc, char **argv[], Labels *data)
 {
 	int i;
 	GtkLabels  glab;
-	GThrd      refr     = { &glab, data };
+	GThrd      refr     = { .glab = &glab, .data = data, .worker = NULL, .wakeup = -1, .stop = false,
+	                        .subscribed = 0, .pending = NULL, .frame = NULL };
 	GtkBuilder *builder = gtk_builder_new();
 	const char *ui_files[] = { "cpu-x-gtk-3.16.ui", "cpu-x-gtk-3.8.ui", NULL };
 
@@ -62,6 +81,11 @@ void start_gui_gtk(int *argc, char **argv[], Labels *data)
 		MSG_ERROR(_("failed to import UI in GtkBuilder"));
 		exit(EXIT_FAILURE);
 	}
+#if PORTABLE_BINARY
+	glab.ui_file = GRESOURCE_UI(ui_files[i]);
+#else
+	glab.ui_file = data_path(ui_files[i]);
+#endif /* PORTABLE_BINARY */
 
 	get_widgets(builder, &glab);
 	g_object_unref(G_OBJECT(builder));
@@ -77,8 +101,25 @@ void start_gui_gtk(int *argc, char **argv[], Labels *data)
 	if(PORTABLE_BINARY && new_version != NULL)
 		new_version_window(glab.mainwindow);
 
-	g_timeout_add_seconds(opts->refr_time, (gpointer)grefresh, &refr);
+	/* Collectors can block (MSR, external commands, bandwidth): they run in a worker */
+	if((refr.wakeup = eventfd(0, EFD_CLOEXEC)) < 0 || refresh_start(data) < 0)
+		MSG_ERROR(_("failed to start refresh worker"));
+	else
+		refr.worker = g_thread_new("refresh", (GThreadFunc) gworker, &refr);
+	change_page(GTK_NOTEBOOK(glab.notebook), NULL, gtk_notebook_get_current_page(GTK_NOTEBOOK(glab.notebook)), &refr);
 	gtk_main();
+
+	if(refr.worker != NULL)
+	{
+		__atomic_store_n(&refr.stop, true, __ATOMIC_RELEASE);
+		write(refr.wakeup, &(uint64_t) { 1 }, sizeof(uint64_t));
+		g_thread_join(refr.worker);
+	}
+	if(refr.wakeup >= 0)
+		close(refr.wakeup);
+	refresh_stop(data);
+	gframe_free(__atomic_exchange_n(&refr.pending, NULL, __ATOMIC_ACQ_REL));
+	gframe_free(refr.frame);
 }
 
 
@@ -130,49 +171,182 @@ static void new_version_window(GtkWidget *mainwindow)
 	gtk_widget_destroy(dialog);
 }
 
-/* Refresh dynamic values */
-static gboolean grefresh(GThrd *refr)
+/* Run collectors out of main loop, and send their values to it */
+static gpointer gworker(GThrd *refr)
+{
+	uint64_t val;
+	GFrame *frame;
+	Labels *data = refr->data;
+	struct pollfd fds[] =
+	{
+		{ .fd = data->refresh->fd, .events = POLLIN },
+		{ .fd = refr->wakeup,      .events = POLLIN }
+	};
+
+	while(!__atomic_load_n(&refr->stop, __ATOMIC_ACQUIRE))
+	{
+		if(poll(fds, sizeof(fds) / sizeof(fds[0]), -1) <= 0)
+			continue;
+		if((fds[1].revents & POLLIN) && read(refr->wakeup, &val, sizeof(val)) == sizeof(val))
+			refresh_subscribe(data, __atomic_load_n(&refr->subscribed, __ATOMIC_ACQUIRE));
+		if(!(fds[0].revents & POLLIN) || !(refresh_dispatch(data) & data->refresh->subscribed))
+			continue;
+
+		/* Single slot handoff: a frame not shown yet is replaced by the newer one */
+		frame = __atomic_exchange_n(&refr->pending, gframe_new(data), __ATOMIC_ACQ_REL);
+		if(frame == NULL)
+			g_idle_add((GSourceFunc) grefresh, refr);
+		else
+			gframe_free(frame);
+	}
+
+	return NULL;
+}
+
+/* Copy values shown by widgets (in worker) */
+static GFrame *gframe_new(Labels *data)
 {
 	int i;
-	enum EnTabNumber page;
-	Labels    *(data) = refr->data;
-	GtkLabels *(glab) = refr->glab;
+	const size_t percent_size = (data->u_data->core_count + 1) * LASTSTAT * sizeof(double);
+	GFrame *frame = g_new0(GFrame, 1);
+
+	for(i = 0; i < LASTCPU; i++)
+		frame->cpu[i] = g_strdup(data->tab_cpu[VALUE][i]);
+	for(i = 0; i < LASTCACHES; i++)
+		frame->caches[i] = g_strdup(data->tab_caches[VALUE][i]);
+	for(i = 0; i < LASTSYSTEM; i++)
+		frame->system[i] = g_strdup(data->tab_system[VALUE][i]);
+	frame->gpu_count = data->gpu_count;
+	frame->graphics  = g_new0(char *, data->gpu_count * GPUFIELDS);
+	for(i = 0; i < (int) (data->gpu_count * GPUFIELDS); i++)
+		frame->graphics[i] = g_strdup(data->tab_graphics[VALUE][i]);
+	for(i = 0; i < LASTBENCH; i++)
+		frame->bench[i] = g_strdup(data->tab_bench[VALUE][i]);
+	for(i = 0; i < LASTMETRIC; i++)
+		frame->metrics[i] = metric_get(data, i);
+
+	if(data->u_data->percent != NULL && data->u_data->core_count > 0)
+	{
+		frame->core_count = data->u_data->core_count;
+		frame->percent    = g_malloc(percent_size);
+		memcpy(frame->percent, data->u_data->percent, percent_size);
+	}
 
-	page = gtk_notebook_get_current_page(GTK_NOTEBOOK(glab->notebook));
-	do_refresh(data, page);
+	return frame;
+}
+
+/* Free a frame */
+static void gframe_free(GFrame *frame)
+{
+	int i;
 
-	switch(page)
+	if(frame == NULL)
+		return;
+
+	for(i = 0; i < LASTCPU; i++)
+		g_free(frame->cpu[i]);
+	for(i = 0; i < LASTCACHES; i++)
+		g_free(frame->caches[i]);
+	for(i = 0; i < LASTSYSTEM; i++)
+		g_free(frame->system[i]);
+	for(i = 0; i < (int) (frame->gpu_count * GPUFIELDS); i++)
+		g_free(frame->graphics[i]);
+	g_free(frame->graphics);
+	for(i = 0; i < LASTBENCH; i++)
+		g_free(frame->bench[i]);
+	g_free(frame->percent);
+	g_free(frame);
+}
+
+/* Update text of a widget only if it changed since previous frame */
+static void gupdate_text(GtkWidget *widget, const char *old, const char *new)
+{
+	if(new == NULL || !g_strcmp0(old, new))
+		return;
+
+	if(GTK_IS_PROGRESS_BAR(widget))
+		gtk_progress_bar_set_text(GTK_PROGRESS_BAR(widget), new);
+	else
+		gtk_label_set_text(GTK_LABEL(widget), new);
+}
+
+/* Refresh dynamic values (in main loop, when worker sent a frame) */
+static gboolean grefresh(GThrd *refr)
+{
+	int i;
+	const enum EnTabCpu cpu_labels[] = { VOLTAGE, TEMPERATURE, MULTIPLIER, CORESPEED, USAGE };
+	GtkLabels *(glab) = refr->glab;
+	GFrame    *old    = refr->frame;
+	GFrame    *new    = __atomic_exchange_n(&refr->pending, NULL, __ATOMIC_ACQ_REL);
+
+	if(new == NULL)
+		return G_SOURCE_REMOVE;
+
+	/* Only widgets whose value changed are redrawn */
+	for(i = 0; i < (int) (sizeof(cpu_labels) / sizeof(cpu_labels[0])); i++)
+		gupdate_text(glab->gtktab_cpu[VALUE][cpu_labels[i]], old ? old->cpu[cpu_labels[i]] : NULL, new->cpu[cpu_labels[i]]);
+	if(old == NULL || old->core_count != new->core_count || (new->percent != NULL &&
+	   (old->percent == NULL || memcmp(old->percent, new->percent, (new->core_count + 1) * LASTSTAT * sizeof(double)))))
+		gtk_widget_queue_draw(glab->coresusage);
+
+	for(i = L1SPEED; i < LASTCACHES; i += CACHEFIELDS)
+		gupdate_text(glab->gtktab_caches[VALUE][i], old ? old->caches[i] : NULL, new->caches[i]);
+
+	gupdate_text(glab->gtktab_system[VALUE][UPTIME], old ? old->system[UPTIME] : NULL, new->system[UPTIME]);
+	for(i = USED; i < LASTSYSTEM; i++)
+		gupdate_text(glab->gtktab_system[VALUE][i], old ? old->system[i] : NULL, new->system[i]);
+	if(old == NULL || memcmp(&old->metrics[MT_MEMUSED], &new->metrics[MT_MEMUSED], (MT_SWAPTOTAL - MT_MEMUSED + 1) * sizeof(double)))
 	{
-		case NO_CPU:
-			gtk_label_set_text(GTK_LABEL(glab->gtktab_cpu[VALUE][VOLTAGE]),      data->tab_cpu[VALUE][VOLTAGE]);
-			gtk_label_set_text(GTK_LABEL(glab->gtktab_cpu[VALUE][TEMPERATURE]),  data->tab_cpu[VALUE][TEMPERATURE]);
-			gtk_label_set_text(GTK_LABEL(glab->gtktab_cpu[VALUE][MULTIPLIER]),   data->tab_cpu[VALUE][MULTIPLIER]);
-			gtk_label_set_text(GTK_LABEL(glab->gtktab_cpu[VALUE][CORESPEED]),    data->tab_cpu[VALUE][CORESPEED]);
-			gtk_label_set_text(GTK_LABEL(glab->gtktab_cpu[VALUE][USAGE]),        data->tab_cpu[VALUE][USAGE]);
-			break;
-		case NO_CACHES:
-			for(i = L1SPEED; i < LASTCACHES; i += CACHEFIELDS)
-				gtk_label_set_text(GTK_LABEL(glab->gtktab_caches[VALUE][i]), data->tab_caches[VALUE][i]);
-			break;
-		case NO_SYSTEM:
-			gtk_label_set_text(GTK_LABEL(glab->gtktab_system[VALUE][UPTIME]),    data->tab_system[VALUE][UPTIME]);
-			for(i = USED; i < LASTSYSTEM; i++)
-				gtk_label_set_text(GTK_LABEL(glab->gtktab_system[VALUE][i]), data->tab_system[VALUE][i]);
-			break;
-		case NO_GRAPHICS:
-			for(i = 0; i < data->gpu_count; i += GPUFIELDS)
-				gtk_label_set_text(GTK_LABEL(glab->gtktab_graphics[VALUE][GPU1TEMPERATURE + i]), data->tab_graphics[VALUE][GPU1TEMPERATURE + i]);
-			break;
-		case NO_BENCH:
-			for(i = PRIMESLOWSCORE; i <= PRIMEFASTSCORE; i += BENCHFIELDS)
-				gtk_progress_bar_set_text(GTK_PROGRESS_BAR(glab->gtktab_bench[VALUE][i]), data->tab_bench[VALUE][i]);
-			change_benchsensitive(glab, data);
-			break;
-		default:
-			break;
+		for(i = BARUSED; i < LASTBAR; i++)
+			gtk_widget_queue_draw(glab->bar[i]);
 	}
 
-	return G_SOURCE_CONTINUE;
+	for(i = GPUTEMPERATURE; i < (int) (new->gpu_count * GPUFIELDS); i += GPUFIELDS)
+		gupdate_text(glab->gtktab_graphics[VALUE][i], old ? old->graphics[i] : NULL, new->graphics[i]);
+
+	for(i = PRIMESLOWSCORE; i < PARAMDURATION; i += BENCHFIELDS)
+		gupdate_text(glab->gtktab_bench[VALUE][i], old ? old->bench[i] : NULL, new->bench[i]);
+	if(gtk_notebook_get_current_page(GTK_NOTEBOOK(glab->notebook)) == NO_BENCH)
+		change_benchsensitive(glab, refr->data);
+
+	refr->frame = new;
+	gframe_free(old);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Event when notebook page is changed: collect only values shown in new page */
+static void change_page(GtkNotebook *notebook, GtkWidget *page, guint page_num, GThrd *refr)
+{
+	__atomic_store_n(&refr->subscribed, (page_num == NO_BENCH) ? METRIC_BENCH : metrics_page_mask(page_num), __ATOMIC_RELEASE);
+	if(refr->wakeup >= 0)
+		write(refr->wakeup, &(uint64_t) { 1 }, sizeof(uint64_t));
+}
+
+/* Show hidden diagnostics panel on Ctrl+Shift+D */
+static gboolean show_selfstats(GtkWidget *widget, GdkEventKey *event, GThrd *refr)
+{
+	char *report, *markup;
+	GtkWidget *dialog;
+
+	if((event->state & (GDK_CONTROL_MASK | GDK_SHIFT_MASK)) != (GDK_CONTROL_MASK | GDK_SHIFT_MASK) ||
+	   gdk_keyval_to_lower(event->keyval) != GDK_KEY_d || (report = selfstats_format(refr->data)) == NULL)
+		return FALSE;
+
+	dialog = gtk_message_dialog_new(GTK_WINDOW(refr->glab->mainwindow),
+		GTK_DIALOG_DESTROY_WITH_PARENT,
+		GTK_MESSAGE_INFO,
+		GTK_BUTTONS_CLOSE,
+		_("%s diagnostics"), PRGNAME);
+	markup = g_markup_escape_text(report, -1);
+	gtk_message_dialog_format_secondary_markup(GTK_MESSAGE_DIALOG(dialog), "<tt>%s</tt>", markup);
+	g_free(markup);
+	free(report);
+
+	gtk_dialog_run(GTK_DIALOG(dialog));
+	gtk_widget_destroy(dialog);
+
+	return TRUE;
 }
 
 /* Event in CPU tab when Core number is changed */
@@ -196,16 +370,22 @@ static void change_activetest(GtkComboBox *box, Labels *data)
 /* Events in Bench tab when a benchmark start/stop */
 static void start_benchmark_bg(GtkSwitch *gswitch, GdkEvent *event, GThrd *refr)
 {
+	enum EnBenchMode mode;
 	Labels *data = refr->data;
 
 	if(!data->b_data->run)
 	{
+		/* Mode is used by threads of a stopping benchmark: start_benchmarks() refuses to start */
 		change_benchsensitive(refr->glab, data);
-		data->b_data->fast_mode = !strcmp(gtk_widget_get_name(GTK_WIDGET(gswitch)), objectbench[PRIMEFASTRUN]);
+		for(mode = BENCH_PRIMESLOW; benchmarks_idle(data) && PRIMESLOWRUN + mode * BENCHFIELDS < PARAMDURATION; mode++)
+		{
+			if(!strcmp(gtk_widget_get_name(GTK_WIDGET(gswitch)), objectbench[PRIMESLOWRUN + mode * BENCHFIELDS]))
+				data->b_data->mode = mode;
+		}
 		start_benchmarks(data);
 	}
 	else
-		data->b_data->run = false;
+		stop_benchmarks(data);
 }
 
 /* Events in Bench tab when Duration/Threads SpinButtons are changed */
@@ -216,7 +396,13 @@ static void change_benchparam(GtkSpinButton *spinbutton, Labels *data)
 	if(!g_strcmp0(gtk_widget_get_name     (GTK_WIDGET(spinbutton)), objectbench[PARAMDURATION]))
 		data->b_data->duration = val;
 	else if(!g_strcmp0(gtk_widget_get_name(GTK_WIDGET(spinbutton)), objectbench[PARAMTHREADS]))
-		data->b_data->threads = val;
+	{
+		/* Threads of a stopping benchmark still use their slots */
+		if(benchmarks_idle(data))
+			data->b_data->threads = val;
+		else
+			gtk_spin_button_set_value(spinbutton, data->b_data->threads);
+	}
 
 	gtk_spin_button_update(spinbutton);
 }
@@ -224,10 +410,10 @@ static void change_benchparam(GtkSpinButton *spinbutton, Labels *data)
 /* Set/Unset widgets sensitive when a benchmark start/stop */
 static void change_benchsensitive(GtkLabels *glab, Labels *data)
 {
+	int i;
 	static bool skip = false;
-	const enum EnTabBench indP = data->b_data->fast_mode ? PRIMEFASTSCORE : PRIMESLOWSCORE;
-	const enum EnTabBench indS = data->b_data->fast_mode ? PRIMESLOWRUN   : PRIMEFASTRUN;
-	const enum EnTabBench indA = data->b_data->fast_mode ? PRIMEFASTRUN   : PRIMESLOWRUN;
+	const enum EnTabBench indP = PRIMESLOWSCORE + data->b_data->mode * BENCHFIELDS;
+	const enum EnTabBench indA = indP + 1;
 
 	if(data->b_data->run)
 	{
@@ -238,7 +424,11 @@ static void change_benchsensitive(GtkLabels *glab, Labels *data)
 #endif /* GTK_CHECK_VERSION(3, 15, 0) || PORTABLE_BINARY */
 		gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(glab->gtktab_bench[VALUE][indP]),
 			(double) data->b_data->elapsed / (data->b_data->duration * 60));
-		gtk_widget_set_sensitive(glab->gtktab_bench[VALUE][indS],         false);
+		for(i = PRIMESLOWRUN; i < PARAMDURATION; i += BENCHFIELDS)
+		{
+			if(i != indA)
+				gtk_widget_set_sensitive(glab->gtktab_bench[VALUE][i], false);
+		}
 		gtk_widget_set_sensitive(glab->gtktab_bench[VALUE][PARAMTHREADS], false);
 	}
 	else if(!data->b_data->run && !skip)
@@ -249,12 +439,13 @@ static void change_benchsensitive(GtkLabels *glab, Labels *data)
 			gtk_switch_set_state(GTK_SWITCH(glab->gtktab_bench[VALUE][indA]),  false);
 #endif /* GTK_CHECK_VERSION(3, 15, 0) || PORTABLE_BINARY */
 		gtk_switch_set_active(GTK_SWITCH(glab->gtktab_bench[VALUE][indA]), false);
-		gtk_widget_set_sensitive(glab->gtktab_bench[VALUE][indS],          true);
+		for(i = PRIMESLOWRUN; i < PARAMDURATION; i += BENCHFIELDS)
+			gtk_widget_set_sensitive(glab->gtktab_bench[VALUE][i],         true);
 		gtk_widget_set_sensitive(glab->gtktab_bench[VALUE][PARAMTHREADS],  true);
 	}
 }
 
-/* Get label ID ('type' must be "lab" or "val") */
+/* Get label ID ('type' must be "lab", "val" or "fram") */
 static char *get_id(const char *objectstr, char *type)
 {
 	static char *buff;
@@ -295,6 +486,7 @@ static void get_widgets(GtkBuilder *builder, GtkLabels *glab)
 	glab->notebook    = GTK_WIDGET(gtk_builder_get_object(builder, "header_notebook"));
 	glab->logocpu     = GTK_WIDGET(gtk_builder_get_object(builder, "proc_logocpu"));
 	glab->activecore  = GTK_WIDGET(gtk_builder_get_object(builder, "trg_activecore"));
+	glab->coresusage  = gtk_drawing_area_new();
 	glab->activetest  = GTK_WIDGET(gtk_builder_get_object(builder, "test_activetest"));
 	glab->logoprg     = GTK_WIDGET(gtk_builder_get_object(builder, "about_logoprg"));
 	glab->butcol      = GTK_WIDGET(gtk_builder_get_object(builder, "colorbutton"));
@@ -304,6 +496,11 @@ static void get_widgets(GtkBuilder *builder, GtkLabels *glab)
 	for(i = TABCPU; i < LASTOBJ; i++)
 		glab->gtktrad[i] = GTK_WIDGET(gtk_builder_get_object(builder, trad[i]));
 
+	/* Per-core usage graph, below frames in CPU tab */
+	gtk_widget_set_size_request(glab->coresusage, -1, CORESUSAGE_HEIGHT);
+	gtk_box_pack_end(GTK_BOX(gtk_builder_get_object(builder, "cpu_box")), glab->coresusage, FALSE, FALSE, 0);
+	gtk_widget_show(glab->coresusage);
+
 	/* Tab CPU */
 	for(i = VENDOR; i < LASTCPU; i++)
 	{
@@ -325,12 +522,7 @@ static void get_widgets(GtkBuilder *builder, GtkLabels *glab)
 		glab->gtktab_motherboard[VALUE][i] = GTK_WIDGET(gtk_builder_get_object(builder, get_id(objectmb[i], "val")));
 	}
 
-	/* Tab RAM */
-	for(i = BANK0_0; i < LASTMEMORY; i++)
-	{
-		glab->gtktab_memory[NAME][i]  = GTK_WIDGET(gtk_builder_get_object(builder, get_id(objectram[i], "lab")));
-		glab->gtktab_memory[VALUE][i] = GTK_WIDGET(gtk_builder_get_object(builder, get_id(objectram[i], "val")));
-	}
+	/* Tab RAM (widgets of banks are added by set_labels()) */
 	glab->gridbanks = GTK_WIDGET(gtk_builder_get_object(builder, "banks_grid"));
 
 	/* Tab System */
@@ -345,12 +537,7 @@ static void get_widgets(GtkBuilder *builder, GtkLabels *glab)
 		gtk_widget_set_name(GTK_WIDGET(glab->bar[i]), g_strdup_printf("%i", i));
 	}
 
-	/* Tab Graphics */
-	for(i = GPU1VENDOR; i < LASTGRAPHICS; i++)
-	{
-		glab->gtktab_graphics[NAME][i]  = GTK_WIDGET(gtk_builder_get_object(builder, get_id(objectgpu[i], "lab")));
-		glab->gtktab_graphics[VALUE][i] = GTK_WIDGET(gtk_builder_get_object(builder, get_id(objectgpu[i], "val")));
-	}
+	/* Tab Graphics (frames of cards are added by set_labels()) */
 	glab->gridcards = GTK_WIDGET(gtk_builder_get_object(builder, "graphics_box"));
 
 	/* Tab Bench */
@@ -439,10 +626,67 @@ static void set_logos(GtkLabels *glab, Labels *data)
 		gtk_image_set_from_pixbuf(GTK_IMAGE(glab->logocpu), unknown_pixbuf);
 }
 
+/* Build a copy of some widgets of UI file (for devices, which are only known at runtime) */
+static GtkBuilder *copy_widgets(GtkLabels *glab, gchar **ids)
+{
+	GtkBuilder *builder = gtk_builder_new();
+
+#if PORTABLE_BINARY
+	gtk_builder_add_objects_from_resource(builder, glab->ui_file, ids, NULL);
+#else
+	gtk_builder_add_objects_from_file(builder, glab->ui_file, ids, NULL);
+#endif /* PORTABLE_BINARY */
+
+	return builder;
+}
+
+/* Add widgets of a bank in Memory tab, copied from bank 0 */
+static void add_bank(GtkLabels *glab, unsigned bank)
+{
+	int i;
+	gchar *ids[LASTMEMORY * 2 + 1] = { NULL };
+	GtkBuilder *builder;
+
+	for(i = BANKREFERENCE; i < LASTMEMORY; i++)
+	{
+		ids[i * 2]     = get_id(objectram[i], "lab");
+		ids[i * 2 + 1] = get_id(objectram[i], "fram");
+	}
+	builder = copy_widgets(glab, ids);
+
+	/* Each field is a row: name on the left, value on the right */
+	for(i = BANKREFERENCE; i < LASTMEMORY; i++)
+	{
+		glab->gtktab_memory[NAME][bank * RAMFIELDS + i]  = GTK_WIDGET(gtk_builder_get_object(builder, ids[i * 2]));
+		glab->gtktab_memory[VALUE][bank * RAMFIELDS + i] = GTK_WIDGET(gtk_builder_get_object(builder, get_id(objectram[i], "val")));
+		gtk_grid_attach(GTK_GRID(glab->gridbanks), glab->gtktab_memory[NAME][bank * RAMFIELDS + i], 0, bank * RAMFIELDS + i, 1, 1);
+		gtk_grid_attach(GTK_GRID(glab->gridbanks), GTK_WIDGET(gtk_builder_get_object(builder, ids[i * 2 + 1])), 1, bank * RAMFIELDS + i, 1, 1);
+	}
+	g_object_unref(G_OBJECT(builder));
+}
+
+/* Add frame of a card in Graphics tab, copied from card 0 */
+static void add_card(GtkLabels *glab, unsigned card)
+{
+	int i;
+	gchar *ids[] = { (gchar *) objectcard, NULL };
+	GtkBuilder *builder = copy_widgets(glab, ids);
+
+	glab->gtkcards[card] = GTK_WIDGET(gtk_builder_get_object(builder, trad[FRAMCARD]));
+	for(i = GPUVENDOR; i < LASTGRAPHICS; i++)
+	{
+		glab->gtktab_graphics[NAME][card * GPUFIELDS + i]  = GTK_WIDGET(gtk_builder_get_object(builder, get_id(objectgpu[i], "lab")));
+		glab->gtktab_graphics[VALUE][card * GPUFIELDS + i] = GTK_WIDGET(gtk_builder_get_object(builder, get_id(objectgpu[i], "val")));
+	}
+	gtk_grid_attach(GTK_GRID(glab->gridcards), GTK_WIDGET(gtk_builder_get_object(builder, objectcard)), 0, card, 1, 1);
+	g_object_unref(G_OBJECT(builder));
+}
+
 /* Filling all labels */
 static void set_labels(GtkLabels *glab, Labels *data)
 {
 	int i;
+	gchar *title;
 	const gint width1 = gtk_widget_get_allocated_width(glab->gtktab_system[VALUE][COMPILER]);
 	const gint width2 = width1 - gtk_widget_get_allocated_width(glab->gtktab_system[VALUE][USED]) - 6;
 	GtkRequisition requisition;
@@ -463,6 +707,7 @@ static void set_labels(GtkLabels *glab, Labels *data)
 	for(i = 0; i < data->cpu_count; i++)
 		gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(glab->activecore), g_strdup_printf(_("Core #%i"), i));
 	gtk_combo_box_set_active(GTK_COMBO_BOX(glab->activecore), opts->selected_core);
+	set_coresusage_legend(glab, data);
 
 	/* Tab Caches */
 	for(i = L1SIZE; i < LASTCACHES; i++)
@@ -481,14 +726,18 @@ static void set_labels(GtkLabels *glab, Labels *data)
 		gtk_label_set_text(GTK_LABEL(glab->gtktab_motherboard[VALUE][i]), data->tab_motherboard[VALUE][i]);
 	}
 
-	/* Tab RAM */
-	for(i = BANK0_0; i < data->dimms_count; i++)
+	/* Tab RAM: bank 0 in UI file is only a template */
+	for(i = LASTMEMORY - 1; i >= BANKREFERENCE; i--)
+		gtk_grid_remove_row(GTK_GRID(glab->gridbanks), i);
+	glab->gtktab_memory[NAME]  = g_new(GtkWidget *, data->dimms_count * RAMFIELDS);
+	glab->gtktab_memory[VALUE] = g_new(GtkWidget *, data->dimms_count * RAMFIELDS);
+	for(i = 0; i < (int) data->dimms_count; i++)
+		add_bank(glab, i);
+	for(i = 0; i < (int) (data->dimms_count * RAMFIELDS); i++)
 	{
 		gtk_label_set_text(GTK_LABEL(glab->gtktab_memory[NAME][i]),  data->tab_memory[NAME][i]);
 		gtk_label_set_text(GTK_LABEL(glab->gtktab_memory[VALUE][i]), data->tab_memory[VALUE][i]);
 	}
-	for(i = BANK7_1; i >= data->dimms_count; i--)
-		gtk_grid_remove_row(GTK_GRID(glab->gridbanks), i);
 
 	/* Tab System */
 	for(i = KERNEL; i < LASTSYSTEM; i++)
@@ -502,19 +751,28 @@ static void set_labels(GtkLabels *glab, Labels *data)
 		gtk_widget_set_size_request(glab->bar[i], width2, requisition.height);
 	}
 
-	/* Tab Graphics */
-	for(i = GPU1VENDOR; i < LASTGRAPHICS; i++)
+	/* Tab Graphics: card 0 in UI file is only a template */
+	gtk_grid_remove_row(GTK_GRID(glab->gridcards), 0);
+	glab->gtkcards              = g_new(GtkWidget *, data->gpu_count);
+	glab->gtktab_graphics[NAME]  = g_new(GtkWidget *, data->gpu_count * GPUFIELDS);
+	glab->gtktab_graphics[VALUE] = g_new(GtkWidget *, data->gpu_count * GPUFIELDS);
+	for(i = 0; i < (int) data->gpu_count; i++)
+	{
+		add_card(glab, i);
+		title = g_strdup_printf(data->objects[FRAMCARD], i);
+		gtk_label_set_text(GTK_LABEL(glab->gtkcards[i]), title);
+		g_free(title);
+	}
+	for(i = 0; i < (int) (data->gpu_count * GPUFIELDS); i++)
 	{
 		gtk_label_set_text(GTK_LABEL(glab->gtktab_graphics[NAME][i]),  data->tab_graphics[NAME][i]);
 		gtk_label_set_text(GTK_LABEL(glab->gtktab_graphics[VALUE][i]), data->tab_graphics[VALUE][i]);
 	}
-	for(i = LASTGRAPHICS; i >= data->gpu_count; i -= GPUFIELDS)
-		gtk_grid_remove_row(GTK_GRID(glab->gridcards), i / GPUFIELDS);
 
 	/* Tab Bench */
 	for(i = PRIMESLOWSCORE; i < LASTBENCH; i++)
 		gtk_label_set_text(GTK_LABEL(glab->gtktab_bench[NAME][i]), data->tab_bench[NAME][i]);
-	for(i = PRIMESLOWSCORE; i <= PRIMEFASTSCORE; i += BENCHFIELDS)
+	for(i = PRIMESLOWSCORE; i < PARAMDURATION; i += BENCHFIELDS)
 	{
 		gtk_progress_bar_set_text(GTK_PROGRESS_BAR(glab->gtktab_bench[VALUE][i]), data->tab_bench[VALUE][i]);
 		gtk_widget_set_size_request(glab->gtktab_bench[VALUE][i], width1, -1);
@@ -537,11 +795,15 @@ static void set_signals(GtkLabels *glab, Labels *data, GThrd *refr)
 
 	g_signal_connect(glab->mainwindow,  "destroy", G_CALLBACK(gtk_main_quit),     NULL);
 	g_signal_connect(glab->closebutton, "clicked", G_CALLBACK(gtk_main_quit),     NULL);
+	g_signal_connect(glab->notebook,    "switch-page", G_CALLBACK(change_page),   refr);
+	g_signal_connect(glab->mainwindow,  "key-press-event", G_CALLBACK(show_selfstats), refr);
 	g_signal_connect(glab->activecore,  "changed", G_CALLBACK(change_activecore), data);
+	g_signal_connect(glab->coresusage,  "draw",    G_CALLBACK(draw_coresusage),   refr);
 	g_signal_connect(glab->activetest,  "changed", G_CALLBACK(change_activetest), data);
 
 	g_signal_connect(glab->gtktab_bench[VALUE][PRIMESLOWRUN],  "button-press-event", G_CALLBACK(start_benchmark_bg), refr);
 	g_signal_connect(glab->gtktab_bench[VALUE][PRIMEFASTRUN],  "button-press-event", G_CALLBACK(start_benchmark_bg), refr);
+	g_signal_connect(glab->gtktab_bench[VALUE][SIEVERUN],      "button-press-event", G_CALLBACK(start_benchmark_bg), refr);
 	g_signal_connect(glab->gtktab_bench[VALUE][PARAMDURATION], "value-changed",      G_CALLBACK(change_benchparam),  data);
 	g_signal_connect(glab->gtktab_bench[VALUE][PARAMTHREADS],  "value-changed",      G_CALLBACK(change_benchparam),  data);
 
@@ -562,9 +824,12 @@ void fill_frame(GtkWidget *widget, cairo_t *cr, GThrd *refr)
 	cairo_pattern_t *pat;
 	PangoLayout *reflayout, *newlayout;
 
-	Labels *(data)    = refr->data;
+	GFrame *(frame)   = refr->frame;
 	GtkLabels *(glab) = refr->glab;
 
+	if(frame == NULL)
+		return;
+
 	widget_name = gtk_widget_get_name(widget);
 	width       = gtk_widget_get_allocated_width(widget);
 	height      = gtk_widget_get_allocated_height(widget);
@@ -572,17 +837,17 @@ void fill_frame(GtkWidget *widget, cairo_t *cr, GThrd *refr)
 	reflayout   = gtk_label_get_layout(GTK_LABEL(glab->gtktab_system[VALUE][page + USED]));
 	newlayout   = pango_layout_copy(reflayout);
 
-	if((page == BARSWAP && data->m_data->swap_total == 0) || (page != BARSWAP && data->m_data->mem_total == 0))
+	if((page == BARSWAP && frame->metrics[MT_SWAPTOTAL] <= 0) || (page != BARSWAP && frame->metrics[MT_MEMTOTAL] <= 0))
 		return;
 
 	for(i = BARUSED; (i <= page) && (page != BARSWAP); i++) /* Get value to start */
 	{
 		before += percent;
-		percent = (double) data->m_data->mem_usage[i] / data->m_data->mem_total * 100;
+		percent = frame->metrics[MT_MEMUSED + i] / frame->metrics[MT_MEMTOTAL] * 100;
 	}
 
 	if(page == BARSWAP)
-		percent = (double) data->m_data->mem_usage[BARSWAP] / data->m_data->swap_total * 100;
+		percent = frame->metrics[MT_SWAPUSED] / frame->metrics[MT_SWAPTOTAL] * 100;
 
 	pat = cairo_pattern_create_linear(before / 100 * width, 0, percent / 100 * width, height);
 
@@ -622,3 +887,59 @@ void fill_frame(GtkWidget *widget, cairo_t *cr, GThrd *refr)
 	cairo_fill(cr);
 	g_object_unref(newlayout);
 }
+
+/* Draw usage of each logical CPU in CPU tab */
+static gboolean draw_coresusage(GtkWidget *widget, cairo_t *cr, GThrd *refr)
+{
+	unsigned i, j;
+	double bar_width, bar_height, bottom;
+	const guint width  = gtk_widget_get_allocated_width(widget);
+	const guint height = gtk_widget_get_allocated_height(widget);
+	GFrame *frame      = refr->frame;
+
+	if(frame == NULL || frame->percent == NULL)
+		return FALSE;
+
+	/* One stacked bar by logical CPU, selected core is underlined */
+	bar_width = (double) width / frame->core_count;
+	for(i = 0; i < frame->core_count; i++)
+	{
+		bottom = height - CORESUSAGE_MARK;
+		for(j = 0; j < LASTSTAT; j++)
+		{
+			if(stat_colors[j].stacked)
+			{
+				bar_height = (height - CORESUSAGE_MARK) * frame->percent[(i + 1) * LASTSTAT + j] / 100;
+				bottom    -= bar_height;
+				cairo_set_source_rgb(cr, stat_colors[j].red, stat_colors[j].green, stat_colors[j].blue);
+				cairo_rectangle(cr, i * bar_width, bottom, MAX(bar_width - 1, 1), bar_height);
+				cairo_fill(cr);
+			}
+		}
+		if(i == opts->selected_core)
+		{
+			cairo_set_source_rgb(cr, 0.00, 0.00, 0.81);
+			cairo_rectangle(cr, i * bar_width, height - CORESUSAGE_MARK, MAX(bar_width - 1, 1), CORESUSAGE_MARK);
+			cairo_fill(cr);
+		}
+	}
+
+	return FALSE;
+}
+
+/* Show colors used for each CPU state in per-core usage graph */
+static void set_coresusage_legend(GtkLabels *glab, Labels *data)
+{
+	int i;
+	GString *legend = g_string_new(NULL);
+
+	for(i = 0; i < LASTSTAT; i++)
+	{
+		if(stat_colors[i].stacked)
+			g_string_append_printf(legend, "%s<span foreground=\"#%02X%02X%02X\">\u25A0</span> %s", legend->len ? "\n" : "",
+			                       (int) (stat_colors[i].red * 255), (int) (stat_colors[i].green * 255),
+			                       (int) (stat_colors[i].blue * 255), data->tab_stat[i]);
+	}
+	gtk_widget_set_tooltip_markup(glab->coresusage, legend->str);
+	g_string_free(legend, TRUE);
+}
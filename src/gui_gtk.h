@@ -32,6 +32,8 @@
 #define GRESOURCE_UI(file)    g_strconcat("/cpu-x/ui/",    file, NULL)
 #define GRESOURCE_CSS(file)   g_strconcat("/cpu-x/css/",   file, NULL)
 #define GRESOURCE_LOGOS(file) g_strconcat("/cpu-x/logos/", file, NULL)
+#define CORESUSAGE_HEIGHT     48       /* Height of per-core usage graph in CPU tab */
+#define CORESUSAGE_MARK       3        /* Height of selected core mark, under its bar */
 
 typedef struct
 {
@@ -41,11 +43,13 @@ typedef struct
 	GtkWidget *labprgver;
 	GtkWidget *closebutton;
 	GtkWidget *gtktrad[LASTOBJ];
+	gchar     *ui_file;                    /* UI file (resource path in portable binary), device widgets are copied from it */
 
 	/* Tab CPU */
 	GtkWidget *logocpu;
 	GtkWidget *gtktab_cpu[2][LASTCPU];
 	GtkWidget *activecore;
+	GtkWidget *coresusage;
 
 	/* Tab Caches */
 	GtkWidget *gtktab_caches[2][LASTCACHES];
@@ -56,7 +60,7 @@ typedef struct
 
 	/* Tab RAM */
 	GtkWidget *gridbanks;
-	GtkWidget *gtktab_memory[2][LASTMEMORY];
+	GtkWidget **gtktab_memory[2];          /* RAMFIELDS widgets by bank */
 
 	/* Tab System */
 	GtkWidget *bar[LASTBAR];
@@ -64,7 +68,8 @@ typedef struct
 
 	/* Tab Graphics */
 	GtkWidget *gridcards;
-	GtkWidget *gtktab_graphics[2][LASTGRAPHICS];
+	GtkWidget **gtktab_graphics[2];        /* GPUFIELDS widgets by card */
+	GtkWidget **gtkcards;                  /* Frame label of each card */
 
 	/* Tab Bench */
 	GtkWidget *gtktab_bench[2][LASTBENCH];
@@ -76,10 +81,29 @@ typedef struct
 
 } GtkLabels; /* Useful GtkWidgets */
 
+typedef struct
+{
+	char     *cpu[LASTCPU];
+	char     *caches[LASTCACHES];
+	char     *system[LASTSYSTEM];
+	char     **graphics;                   /* GPUFIELDS values by card */
+	unsigned gpu_count;
+	char     *bench[LASTBENCH];
+	double   metrics[LASTMETRIC];
+	unsigned core_count;
+	double   *percent;                     /* Copy of per-core usage (UsageData) */
+} GFrame; /* Values collected by worker, shown by main loop */
+
 typedef struct
 {
 	GtkLabels *glab;
-	Labels *data;
+	Labels    *data;
+	GThread   *worker;
+	int       wakeup;                      /* eventfd: wakes worker up when subscription changes or on exit */
+	bool      stop;
+	uint64_t  subscribed;                  /* Metrics shown by current page (written by main loop) */
+	GFrame    *pending;                    /* Last frame sent by worker, not shown yet */
+	GFrame    *frame;                      /* Frame shown by widgets (main loop only) */
 } GThrd; /* Used to refresh GUI */
 
 
@@ -94,9 +118,27 @@ static void warning_window(GtkWidget *mainwindow);
 /* In portable version, inform when a new version is available and ask for update */
 static void new_version_window(GtkWidget *mainwindow);
 
-/* Refresh dynamic values */
+/* Run collectors out of main loop, and send their values to it */
+static gpointer gworker(GThrd *refr);
+
+/* Copy values shown by widgets (in worker) */
+static GFrame *gframe_new(Labels *data);
+
+/* Free a frame */
+static void gframe_free(GFrame *frame);
+
+/* Update text of a widget only if it changed since previous frame */
+static void gupdate_text(GtkWidget *widget, const char *old, const char *new);
+
+/* Refresh dynamic values (in main loop, when worker sent a frame) */
 static gboolean grefresh(GThrd *refr);
 
+/* Event when notebook page is changed: collect only values shown in new page */
+static void change_page(GtkNotebook *notebook, GtkWidget *page, guint page_num, GThrd *refr);
+
+/* Show hidden diagnostics panel on Ctrl+Shift+D */
+static gboolean show_selfstats(GtkWidget *widget, GdkEventKey *event, GThrd *refr);
+
 /* Event in CPU tab when Core number is changed */
 static void change_activecore(GtkComboBox *box, Labels *data);
 
@@ -112,7 +154,7 @@ static void change_benchparam(GtkSpinButton *spinbutton, Labels *data);
 /* Set/Unset widgets sensitive when a benchmark start/stop */
 static void change_benchsensitive(GtkLabels *glab, Labels *data);
 
-/* Get label ID ('type' must be "lab" or "val") */
+/* Get label ID ('type' must be "lab", "val" or "fram") */
 static char *get_id(const char *objectstr, char *type);
 
 /* Search file location in standard paths */
@@ -130,6 +172,15 @@ static void change_color(GtkWidget *button, GtkLabels *glab);
 /* Set CPU vendor logo and program logo */
 static void set_logos(GtkLabels *glab, Labels *data);
 
+/* Build a copy of some widgets of UI file (for devices, which are only known at runtime) */
+static GtkBuilder *copy_widgets(GtkLabels *glab, gchar **ids);
+
+/* Add widgets of a bank in Memory tab, copied from bank 0 */
+static void add_bank(GtkLabels *glab, unsigned bank);
+
+/* Add frame of a card in Graphics tab, copied from card 0 */
+static void add_card(GtkLabels *glab, unsigned card);
+
 /* Filling all labels */
 static void set_labels(GtkLabels *glab, Labels *data);
 
@@ -139,5 +190,11 @@ static void set_signals(GtkLabels *glab, Labels *data, GThrd *refr);
 /* Draw bars in Memory tab */
 void fill_frame(GtkWidget *widget, cairo_t *cr, GThrd *refr);
 
+/* Draw usage of each logical CPU in CPU tab */
+static gboolean draw_coresusage(GtkWidget *widget, cairo_t *cr, GThrd *refr);
+
+/* Show colors used for each CPU state in per-core usage graph */
+static void set_coresusage_legend(GtkLabels *glab, Labels *data);
+
 
 #endif /* _GUI_GTK_H_ */
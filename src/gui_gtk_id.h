@@ -34,8 +34,8 @@ static const char *trad[LASTOBJ] =
 	"motherboard_lab", "bios_lab", "chip_lab",
 	"banks_lab",
 	"os_lab", "mem_lab",
-	"card0_lab", "card1_lab", "card2_lab", "card3_lab",
-	"primeslow_lab", "primefast_lab", "param_lab",
+	"card0_lab",
+	"primeslow_lab", "primefast_lab", "sieve_lab", "param_lab",
 	"about_lab", "license_lab"
 };
 
@@ -64,11 +64,10 @@ static const char *objectmb[LASTMOTHERBOARD] =
 	"chip_vend", "chip_name"
 };
 
-/* Tab RAM */
+/* Tab RAM (widgets of bank 0, copied for other banks) */
 static const char *objectram[LASTMEMORY] =
 {
-	"banks_bank0_0", "banks_bank0_1", "banks_bank1_0", "banks_bank1_1", "banks_bank2_0", "banks_bank2_1", "banks_bank3_0", "banks_bank3_1",
-	"banks_bank4_0", "banks_bank4_1", "banks_bank5_0", "banks_bank5_1", "banks_bank6_0", "banks_bank6_1", "banks_bank7_0", "banks_bank7_1"
+	"banks_bank0_0", "banks_bank0_1"
 };
 
 /* Tab System */
@@ -83,20 +82,19 @@ static const char *objectsys_bar[LASTBAR] =
 	"mem_barused", "mem_barbuff", "mem_barcache", "mem_barfree", "mem_barswap"
 };
 
-/* Tab Graphics */
+/* Tab Graphics (widgets of card 0, copied for other cards) */
 static const char *objectgpu[LASTGRAPHICS] =
 {
-	"card0_vend", "card0_mod", "card0_drv",
-	"card1_vend", "card1_mod", "card1_drv",
-	"card2_vend", "card2_mod", "card2_drv",
-	"card3_vend", "card3_mod", "card3_drv"
+	"card0_vend", "card0_mod", "card0_drv"
 };
+static const char *objectcard = "card0_fram";
 
 /* Tab Bench */
 static const char *objectbench[LASTBENCH] =
 {
 	"primeslow_score", "primeslow_run",
 	"primefast_score", "primefast_run",
+	"sieve_score",     "sieve_run",
 	"param_duration",  "param_threads"
 };
 
@@ -0,0 +1,365 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE libcpux.c
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+#include "cpu-x.h"
+#include "libcpux.h"
+
+struct cpux
+{
+	pthread_mutex_t mutex;                      /* Serializes refreshes and reads */
+	Labels        labels;
+	Options       opts;
+	LibcpuidData  l_data;
+	TopologyData  t_data;
+	BandwidthData w_data;
+	UsageData     u_data;
+	MsrData       m_data;
+	SensorsData   s_data;
+	SnapshotData  snapshot;
+	RecordData    r_data;
+	RefreshData   refresh;
+	BenchData     b_data;
+	MetricStore   metrics;
+	CoreData      c_data;
+};
+
+struct cpux_snapshot
+{
+	uint64_t stamp;
+	unsigned core_count;
+	bool     valid[CPUX_LASTMETRIC];
+	int64_t  ival[CPUX_LASTMETRIC];
+	double   dval[CPUX_LASTMETRIC];
+	double   usage[];                           /* By logical CPU */
+};
+
+/* Public metric numbers are stable, internal ones are not */
+static const enum EnMetrics metric_id[CPUX_LASTMETRIC] =
+{
+	[CPUX_CORESPEED]  = MT_CORESPEED,  [CPUX_MULTIPLIER] = MT_MULTIPLIER, [CPUX_MULTMIN]     = MT_MULTMIN,
+	[CPUX_MULTMAX]    = MT_MULTMAX,    [CPUX_BUSSPEED]   = MT_BUSSPEED,   [CPUX_USAGE]       = MT_USAGE,
+	[CPUX_COREUSAGE]  = MT_COREUSAGE,  [CPUX_VOLTAGE]    = MT_VOLTAGE,    [CPUX_TEMPERATURE] = MT_TEMPERATURE,
+	[CPUX_L1SPEED]    = MT_L1SPEED,    [CPUX_L2SPEED]    = MT_L2SPEED,    [CPUX_L3SPEED]     = MT_L3SPEED,
+	[CPUX_UPTIME]     = MT_UPTIME,     [CPUX_MEMUSED]    = MT_MEMUSED,    [CPUX_MEMBUFFERS]  = MT_MEMBUFFERS,
+	[CPUX_MEMCACHED]  = MT_MEMCACHED,  [CPUX_MEMFREE]    = MT_MEMFREE,    [CPUX_SWAPUSED]    = MT_SWAPUSED,
+	[CPUX_MEMTOTAL]   = MT_MEMTOTAL,   [CPUX_SWAPTOTAL]  = MT_SWAPTOTAL,  [CPUX_GPU1TEMPERATURE] = MT_GPU1TEMPERATURE,
+};
+
+/* Location of static values in Labels */
+static const size_t info_offset[CPUX_LASTINFO] =
+{
+	[CPUX_CPU_VENDOR]         = offsetof(Labels, tab_cpu[VALUE][VENDOR]),
+	[CPUX_CPU_CODENAME]       = offsetof(Labels, tab_cpu[VALUE][CODENAME]),
+	[CPUX_CPU_PACKAGE]        = offsetof(Labels, tab_cpu[VALUE][PACKAGE]),
+	[CPUX_CPU_TECHNOLOGY]     = offsetof(Labels, tab_cpu[VALUE][TECHNOLOGY]),
+	[CPUX_CPU_SPECIFICATION]  = offsetof(Labels, tab_cpu[VALUE][SPECIFICATION]),
+	[CPUX_CPU_INSTRUCTIONS]   = offsetof(Labels, tab_cpu[VALUE][INSTRUCTIONS]),
+	[CPUX_BOARD_MANUFACTURER] = offsetof(Labels, tab_motherboard[VALUE][MANUFACTURER]),
+	[CPUX_BOARD_MODEL]        = offsetof(Labels, tab_motherboard[VALUE][MBMODEL]),
+	[CPUX_BIOS_BRAND]         = offsetof(Labels, tab_motherboard[VALUE][BRAND]),
+	[CPUX_BIOS_VERSION]       = offsetof(Labels, tab_motherboard[VALUE][BIOSVERSION]),
+	[CPUX_BIOS_DATE]          = offsetof(Labels, tab_motherboard[VALUE][DATE]),
+	[CPUX_CHIPSET]            = offsetof(Labels, tab_motherboard[VALUE][CHIPMODEL]),
+	[CPUX_OS_KERNEL]          = offsetof(Labels, tab_system[VALUE][KERNEL]),
+	[CPUX_OS_DISTRIBUTION]    = offsetof(Labels, tab_system[VALUE][DISTRIBUTION]),
+	[CPUX_OS_HOSTNAME]        = offsetof(Labels, tab_system[VALUE][HOSTNAME]),
+};
+
+
+/************************* Public functions *************************/
+
+/* Create a context, and collect static values (it can take some time, and more as root) */
+cpux_t *cpux_new(void)
+{
+	cpux_t *ctx;
+	Labels *data;
+
+	if((ctx = calloc(1, sizeof(cpux_t))) == NULL)
+		return NULL;
+
+	/* Contexts start with options of the process (quiet defaults when CPU-X is used as a library) */
+	pthread_mutex_init(&ctx->mutex, NULL);
+	pthread_mutex_init(&ctx->c_data.mutex, NULL);
+	ctx->opts     = *opts;
+	ctx->l_data   = (LibcpuidData) { .cpu_vendor_id = -1, .cpu_model = -1, .cpu_ext_model = -1, .cpu_ext_family = -1 };
+	ctx->u_data   = (UsageData)    { .fd = -1, .buff = NULL, .core_count = 0, .current = 0, .hz = 0, .stamp = { 0 },
+	                                 .ticks = { NULL }, .percent = NULL, .rate = NULL, .usage = NULL };
+	ctx->m_data   = (MsrData)      { .vendor = MSR_UNKNOWN, .core_count = 0, .fd = NULL };
+	ctx->s_data   = (SensorsData)  { .init = false, .core_count = 0, .fd_count = 0, .fds = NULL, .core_temp = NULL,
+	                                 .cpu_volt = -1, .gpu_count = 0, .gpu_temp = NULL };
+	ctx->refresh  = (RefreshData)  { .fd = -1, .subscribed = 0, .heap_size = 0 };
+	ctx->b_data   = (BenchData)    { .run = false, .duration = 1, .threads = 1, .primes = 0,
+	                                 .slots_lock = PTHREAD_MUTEX_INITIALIZER };
+
+	data           = &ctx->labels;
+	data->l_data   = &ctx->l_data;
+	data->t_data   = &ctx->t_data;
+	data->w_data   = &ctx->w_data;
+	data->u_data   = &ctx->u_data;
+	data->m_data   = &ctx->m_data;
+	data->s_data   = &ctx->s_data;
+	data->snapshot = &ctx->snapshot;
+	data->r_data   = &ctx->r_data;
+	data->refresh  = &ctx->refresh;
+	data->b_data   = &ctx->b_data;
+	data->metrics  = &ctx->metrics;
+	data->c_data   = &ctx->c_data;
+	data->opts     = &ctx->opts;
+
+	fill_labels(data);
+
+	return ctx;
+}
+
+/* Free a context */
+void cpux_free(cpux_t *ctx)
+{
+	int i;
+
+	if(ctx == NULL)
+		return;
+
+	labels_free(&ctx->labels);
+	labels_resize(&ctx->labels, NO_MEMORY,   0);
+	labels_resize(&ctx->labels, NO_GRAPHICS, 0);
+	usage_close(&ctx->u_data);
+	for(i = 0; i < ctx->w_data.test_count; i++)
+		free(ctx->w_data.test_name[i]);
+	free(ctx->w_data.test_name);
+	free(ctx->c_data.collectors);
+	free(ctx->c_data.stats);
+	pthread_mutex_destroy(&ctx->c_data.mutex);
+	pthread_mutex_destroy(&ctx->mutex);
+	free(ctx);
+}
+
+/* Select the logical CPU used by per-core metrics (CPUX_COREUSAGE, CPUX_TEMPERATURE...) */
+int cpux_set_core(cpux_t *ctx, unsigned core)
+{
+	int err = 0;
+
+	pthread_mutex_lock(&ctx->mutex);
+	if(core < ctx->labels.cpu_count || core < ctx->u_data.core_count)
+		ctx->opts.selected_core = core;
+	else
+		err = 1;
+	pthread_mutex_unlock(&ctx->mutex);
+
+	return err;
+}
+
+/* Collect dynamic values again (cache speeds are only measured by cpux_new()) */
+int cpux_refresh(cpux_t *ctx)
+{
+	int err;
+	const uint64_t mask = (METRIC_BIT(LASTMETRIC) - 1) & ~(METRIC_BIT(MT_L1SPEED) | METRIC_BIT(MT_L2SPEED) | METRIC_BIT(MT_L3SPEED));
+
+	pthread_mutex_lock(&ctx->mutex);
+	err = refresh_metrics(&ctx->labels, mask);
+	pthread_mutex_unlock(&ctx->mutex);
+
+	return err;
+}
+
+/* Short name of a metric (e.g. "cpu_core_speed"), NULL if 'metric' is unknown */
+const char *cpux_metric_name(enum CpuxMetric metric)
+{
+	return (metric < CPUX_LASTMETRIC) ? metric_name(metric_id[metric]) : NULL;
+}
+
+/* Unit symbol of a metric (e.g. "MHz"), NULL if 'metric' is unknown */
+const char *cpux_metric_unit(enum CpuxMetric metric)
+{
+	return (metric < CPUX_LASTMETRIC) ? metric_unit(metric_id[metric]) : NULL;
+}
+
+/* Value of an integer metric; return 0 if it is available */
+int cpux_get_int(cpux_t *ctx, enum CpuxMetric metric, int64_t *value)
+{
+	int err = 1;
+
+	if(metric >= CPUX_LASTMETRIC || metric_value_type(metric_id[metric]) != TYPE_INT)
+		return 1;
+
+	pthread_mutex_lock(&ctx->mutex);
+	if(metric_valid(&ctx->labels, metric_id[metric]))
+	{
+		*value = ctx->metrics.ival[metric_id[metric]];
+		err    = 0;
+	}
+	pthread_mutex_unlock(&ctx->mutex);
+
+	return err;
+}
+
+/* Value of a metric as a floating-point number (integer metrics are converted); return 0 if it is available */
+int cpux_get_double(cpux_t *ctx, enum CpuxMetric metric, double *value)
+{
+	int err = 1;
+
+	if(metric >= CPUX_LASTMETRIC)
+		return 1;
+
+	pthread_mutex_lock(&ctx->mutex);
+	if(metric_valid(&ctx->labels, metric_id[metric]))
+	{
+		*value = metric_get(&ctx->labels, metric_id[metric]);
+		err    = 0;
+	}
+	pthread_mutex_unlock(&ctx->mutex);
+
+	return err;
+}
+
+/* Copy a static value in 'buff' (empty string if unknown); return 0 if it is available */
+int cpux_get_info(cpux_t *ctx, enum CpuxInfo info, char *buff, size_t size)
+{
+	const char *str;
+
+	if(size == 0)
+		return 1;
+	buff[0] = '\0';
+	if(info >= CPUX_LASTINFO)
+		return 1;
+
+	pthread_mutex_lock(&ctx->mutex);
+	str = *(char **) ((char *) &ctx->labels + info_offset[info]);
+	if(str != NULL)
+	{
+		strncpy(buff, str, size - 1);
+		buff[size - 1] = '\0';
+	}
+	pthread_mutex_unlock(&ctx->mutex);
+
+	return (buff[0] == '\0');
+}
+
+/* Number of logical CPUs */
+unsigned cpux_cpu_count(cpux_t *ctx)
+{
+	unsigned count;
+
+	/* Without CPU topology, CPU count is known by CPU usage counters */
+	pthread_mutex_lock(&ctx->mutex);
+	count = (ctx->labels.cpu_count > 0) ? ctx->labels.cpu_count : ctx->u_data.core_count;
+	pthread_mutex_unlock(&ctx->mutex);
+
+	return count;
+}
+
+/* Usage of a logical CPU, in percent; return 0 if it is available */
+int cpux_get_core_usage(cpux_t *ctx, unsigned core, double *value)
+{
+	int err = 1;
+
+	pthread_mutex_lock(&ctx->mutex);
+	if(ctx->u_data.usage != NULL && core < ctx->u_data.core_count)
+	{
+		*value = ctx->u_data.usage[core + 1];
+		err    = 0;
+	}
+	pthread_mutex_unlock(&ctx->mutex);
+
+	return err;
+}
+
+/* Copy all dynamic values, so they can be read while the context is refreshed again */
+cpux_snapshot_t *cpux_snapshot(cpux_t *ctx)
+{
+	unsigned i, count;
+	struct timespec now;
+	cpux_snapshot_t *snap;
+
+	pthread_mutex_lock(&ctx->mutex);
+	count = (ctx->u_data.usage != NULL) ? ctx->u_data.core_count : 0;
+	if((snap = malloc(sizeof(cpux_snapshot_t) + count * sizeof(double))) != NULL)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		snap->stamp      = (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+		snap->core_count = count;
+		for(i = 0; i < CPUX_LASTMETRIC; i++)
+		{
+			snap->valid[i] = ctx->metrics.valid[metric_id[i]];
+			snap->ival[i]  = ctx->metrics.ival[metric_id[i]];
+			snap->dval[i]  = metric_get(&ctx->labels, metric_id[i]);
+		}
+		if(count > 0)
+			memcpy(snap->usage, ctx->u_data.usage + 1, count * sizeof(double));
+	}
+	pthread_mutex_unlock(&ctx->mutex);
+
+	return snap;
+}
+
+/* Free a snapshot */
+void cpux_snapshot_free(cpux_snapshot_t *snap)
+{
+	free(snap);
+}
+
+/* Time of a snapshot (monotonic clock, in ns) */
+uint64_t cpux_snapshot_time(const cpux_snapshot_t *snap)
+{
+	return snap->stamp;
+}
+
+/* Value of an integer metric in a snapshot; return 0 if it is available */
+int cpux_snapshot_int(const cpux_snapshot_t *snap, enum CpuxMetric metric, int64_t *value)
+{
+	if(metric >= CPUX_LASTMETRIC || !snap->valid[metric] || metric_value_type(metric_id[metric]) != TYPE_INT)
+		return 1;
+
+	*value = snap->ival[metric];
+	return 0;
+}
+
+/* Value of a metric in a snapshot, as a floating-point number; return 0 if it is available */
+int cpux_snapshot_double(const cpux_snapshot_t *snap, enum CpuxMetric metric, double *value)
+{
+	if(metric >= CPUX_LASTMETRIC || !snap->valid[metric])
+		return 1;
+
+	*value = snap->dval[metric];
+	return 0;
+}
+
+/* Number of logical CPUs in a snapshot */
+unsigned cpux_snapshot_cpu_count(const cpux_snapshot_t *snap)
+{
+	return snap->core_count;
+}
+
+/* Usage of a logical CPU in a snapshot, in percent; return 0 if it is available */
+int cpux_snapshot_core_usage(const cpux_snapshot_t *snap, unsigned core, double *value)
+{
+	if(core >= snap->core_count)
+		return 1;
+
+	*value = snap->usage[core];
+	return 0;
+}
@@ -0,0 +1,121 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE libcpux.h
+*/
+
+/* Public interface of libcpux: CPU-X collectors, without user interface.
+ * Each context has its own state; a context can be used by several threads,
+ * and several contexts can be used at the same time.
+ * Values are only added at the end of enums, so numbers stay stable. */
+
+#ifndef _LIBCPUX_H_
+#define _LIBCPUX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CPUX_API_VERSION      1
+
+typedef struct cpux cpux_t;                    /* Context */
+typedef struct cpux_snapshot cpux_snapshot_t;  /* Copy of values at a given time */
+
+enum CpuxMetric
+{
+	CPUX_CORESPEED, CPUX_MULTIPLIER, CPUX_MULTMIN, CPUX_MULTMAX, CPUX_BUSSPEED, CPUX_USAGE, CPUX_COREUSAGE, CPUX_VOLTAGE,
+	CPUX_TEMPERATURE, CPUX_L1SPEED, CPUX_L2SPEED, CPUX_L3SPEED,
+	CPUX_UPTIME, CPUX_MEMUSED, CPUX_MEMBUFFERS, CPUX_MEMCACHED, CPUX_MEMFREE, CPUX_SWAPUSED, CPUX_MEMTOTAL, CPUX_SWAPTOTAL,
+	CPUX_GPU1TEMPERATURE,
+	CPUX_LASTMETRIC
+};
+
+enum CpuxInfo
+{
+	CPUX_CPU_VENDOR, CPUX_CPU_CODENAME, CPUX_CPU_PACKAGE, CPUX_CPU_TECHNOLOGY, CPUX_CPU_SPECIFICATION, CPUX_CPU_INSTRUCTIONS,
+	CPUX_BOARD_MANUFACTURER, CPUX_BOARD_MODEL, CPUX_BIOS_BRAND, CPUX_BIOS_VERSION, CPUX_BIOS_DATE, CPUX_CHIPSET,
+	CPUX_OS_KERNEL, CPUX_OS_DISTRIBUTION, CPUX_OS_HOSTNAME,
+	CPUX_LASTINFO
+};
+
+
+/* Create a context, and collect static values (it can take some time, and more as root) */
+cpux_t *cpux_new(void);
+
+/* Free a context */
+void cpux_free(cpux_t *ctx);
+
+/* Select the logical CPU used by per-core metrics (CPUX_COREUSAGE, CPUX_TEMPERATURE...) */
+int cpux_set_core(cpux_t *ctx, unsigned core);
+
+/* Collect dynamic values again (cache speeds are only measured by cpux_new()) */
+int cpux_refresh(cpux_t *ctx);
+
+/* Short name of a metric (e.g. "cpu_core_speed"), NULL if 'metric' is unknown */
+const char *cpux_metric_name(enum CpuxMetric metric);
+
+/* Unit symbol of a metric (e.g. "MHz"), NULL if 'metric' is unknown */
+const char *cpux_metric_unit(enum CpuxMetric metric);
+
+/* Value of an integer metric; return 0 if it is available */
+int cpux_get_int(cpux_t *ctx, enum CpuxMetric metric, int64_t *value);
+
+/* Value of a metric as a floating-point number (integer metrics are converted); return 0 if it is available */
+int cpux_get_double(cpux_t *ctx, enum CpuxMetric metric, double *value);
+
+/* Copy a static value in 'buff' (empty string if unknown); return 0 if it is available */
+int cpux_get_info(cpux_t *ctx, enum CpuxInfo info, char *buff, size_t size);
+
+/* Number of logical CPUs */
+unsigned cpux_cpu_count(cpux_t *ctx);
+
+/* Usage of a logical CPU, in percent; return 0 if it is available */
+int cpux_get_core_usage(cpux_t *ctx, unsigned core, double *value);
+
+/* Copy all dynamic values, so they can be read while the context is refreshed again */
+cpux_snapshot_t *cpux_snapshot(cpux_t *ctx);
+
+/* Free a snapshot */
+void cpux_snapshot_free(cpux_snapshot_t *snap);
+
+/* Time of a snapshot (monotonic clock, in ns) */
+uint64_t cpux_snapshot_time(const cpux_snapshot_t *snap);
+
+/* Value of an integer metric in a snapshot; return 0 if it is available */
+int cpux_snapshot_int(const cpux_snapshot_t *snap, enum CpuxMetric metric, int64_t *value);
+
+/* Value of a metric in a snapshot, as a floating-point number; return 0 if it is available */
+int cpux_snapshot_double(const cpux_snapshot_t *snap, enum CpuxMetric metric, double *value);
+
+/* Number of logical CPUs in a snapshot */
+unsigned cpux_snapshot_cpu_count(const cpux_snapshot_t *snap);
+
+/* Usage of a logical CPU in a snapshot, in percent; return 0 if it is available */
+int cpux_snapshot_core_usage(const cpux_snapshot_t *snap, unsigned core, double *value);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _LIBCPUX_H_ */
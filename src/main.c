@@ -43,14 +43,6 @@
 # endif
 #endif
 
-#if defined(__clang__)
-# define CC "Clang"
-#elif defined(__GNUC__) || defined(__GNUG__)
-# define CC "GCC"
-#else
-# define CC "Unknown"
-#endif
-
 #if (defined (__DragonFly__) || defined (__FreeBSD__) || defined (__NetBSD__) || defined (__OpenBSD__)) && defined (__LP64__)
 # define OS "bsd64"
 #elif (defined (__DragonFly__) || defined (__FreeBSD__) || defined (__NetBSD__) || defined (__OpenBSD__)) && !defined (__LP64__)
@@ -62,10 +54,6 @@
 #endif
 
 
-char *binary_name, *new_version = NULL;
-Options *opts;
-
-
 /************************* Arrays management functions *************************/
 
 /* Set labels name */
@@ -97,6 +85,16 @@ static void labels_setname(Labels *data)
 	asprintf(&data->tab_cpu[NAME][MULTIPLIER],      _("Multiplier"));
 	asprintf(&data->tab_cpu[NAME][BUSSPEED],        _("Bus Speed"));
 	asprintf(&data->tab_cpu[NAME][USAGE],           _("Usage"));
+	asprintf(&data->tab_stat[STAT_USER],            _("User"));
+	asprintf(&data->tab_stat[STAT_NICE],            _("Nice"));
+	asprintf(&data->tab_stat[STAT_SYSTEM],          _("System"));
+	asprintf(&data->tab_stat[STAT_IDLE],            _("Idle"));
+	asprintf(&data->tab_stat[STAT_IOWAIT],          _("I/O wait"));
+	asprintf(&data->tab_stat[STAT_IRQ],             _("IRQ"));
+	asprintf(&data->tab_stat[STAT_SOFTIRQ],         _("Soft IRQ"));
+	asprintf(&data->tab_stat[STAT_STEAL],           _("Steal"));
+	asprintf(&data->tab_stat[STAT_GUEST],           _("Guest"));
+	asprintf(&data->tab_stat[STAT_GUESTNICE],       _("Guest nice"));
 
 	asprintf(&data->objects[FRAMCACHE],             _("Cache")); // Frame label
 	asprintf(&data->tab_cpu[NAME][LEVEL1D],         _("L1 Data"));
@@ -140,11 +138,6 @@ static void labels_setname(Labels *data)
 	/* Memory tab */
 	asprintf(&data->objects[TABMEMORY], _("Memory")); // Tab label
 	asprintf(&data->objects[FRAMBANKS], _("Banks")); // Frame label
-	for(i = BANK0_0; i < LASTMEMORY; i += RAMFIELDS)
-	{
-		asprintf(&data->tab_memory[NAME][BANK0_0 + i], _("Bank %i Ref."), i / RAMFIELDS);
-		asprintf(&data->tab_memory[NAME][BANK0_1 + i], _("Bank %i Type"), i / RAMFIELDS);
-	}
 
 	/* System tab */
 	asprintf(&data->objects[TABSYSTEM],                   _("System")); // Tab label
@@ -164,19 +157,13 @@ static void labels_setname(Labels *data)
 
 	/* Graphics tab */
 	asprintf(&data->objects[TABGRAPHICS], _("Graphics")); // Tab label
-	for(i = GPU1VENDOR; i < LASTGRAPHICS; i += GPUFIELDS)
-	{
-		j = i / GPUFIELDS;
-		asprintf(&data->objects[FRAMGPU1 + j],                   _("Card %i"), j); // Frame label
-		asprintf(&data->tab_graphics[NAME][GPU1VENDOR      + i], _("Vendor"));
-		asprintf(&data->tab_graphics[NAME][GPU1MODEL       + i], _("Model"));
-		asprintf(&data->tab_graphics[NAME][GPU1TEMPERATURE + i], _("Temperature"));
-	}
+	data->objects[FRAMCARD] = strdup(_("Card %i")); // Frame label, formatted with card number
 
 	/* Bench tab */
 	asprintf(&data->objects[TABBENCH],              _("Bench")); // Tab label
 	asprintf(&data->objects[FRAMPRIMESLOW],         _("Prime numbers (slow)")); // Frame label
 	asprintf(&data->objects[FRAMPRIMEFAST],         _("Prime numbers (fast)")); // Frame label
+	asprintf(&data->objects[FRAMSIEVE],             _("Prime numbers (sieve)")); // Frame label
 	for(i = PRIMESLOWSCORE; i < PARAMDURATION; i += BENCHFIELDS)
 	{
 		asprintf(&data->tab_bench[NAME][PRIMESLOWSCORE  + i], _("Score"));
@@ -210,21 +197,21 @@ static void labels_setname(Labels *data)
 /* Replace null pointers by character '\0' */
 static int remove_null_ptr(Labels *data)
 {
-	int i, j, ret = 0;
+	unsigned i;
+	int j, ret = 0;
 	const struct Arrays { char **array; const int last; } a[] =
 	{
-		{ data->tab_cpu[VALUE],         LASTCPU         },
-		{ data->tab_caches[VALUE],      LASTCACHES      },
-		{ data->tab_motherboard[VALUE], LASTMOTHERBOARD },
-		{ data->tab_memory[VALUE],      LASTMEMORY      },
-		{ data->tab_system[VALUE],      LASTSYSTEM      },
-		{ data->tab_graphics[VALUE],    LASTGRAPHICS    },
-		{ data->tab_bench[VALUE],       LASTBENCH       },
-		{ NULL,                         0               }
+		{ data->tab_cpu[VALUE],         LASTCPU                       },
+		{ data->tab_caches[VALUE],      LASTCACHES                    },
+		{ data->tab_motherboard[VALUE], LASTMOTHERBOARD               },
+		{ data->tab_memory[VALUE],      data->dimms_count * RAMFIELDS },
+		{ data->tab_system[VALUE],      LASTSYSTEM                    },
+		{ data->tab_graphics[VALUE],    data->gpu_count * GPUFIELDS   },
+		{ data->tab_bench[VALUE],       LASTBENCH                     }
 	};
 
 	MSG_VERBOSE(_("Replacing undefined labels by an empty string"));
-	for(i = 0; a[i].array != NULL; i++)
+	for(i = 0; i < sizeof(a) / sizeof(a[0]); i++)
 	{
 		for(j = 0; j < a[i].last; j++)
 		{
@@ -236,56 +223,138 @@ static int remove_null_ptr(Labels *data)
 	return ret;
 }
 
+/* Dump CPU time breakdown, for all logical CPUs */
+static void dump_usage(Labels *data)
+{
+	int i, j, len;
+	char name[MAXSTR], line[LASTSTAT * MAXSTR];
+	const char *col   = opts->color ? BOLD_BLUE : "";
+	UsageData *u_data = data->u_data;
+
+	MSG_STDOUT("\n\t%s***** %s *****%s", col, data->tab_cpu[NAME][USAGE], DEFAULT);
+	for(i = 0; i <= u_data->core_count; i++)
+	{
+		/* Row 0 is the total */
+		if(i == 0)
+			snprintf(name, sizeof(name), _("Total"));
+		else
+			snprintf(name, sizeof(name), _("Core #%i"), i - 1);
+
+		for(j = len = 0; j < LASTSTAT; j++)
+			len += snprintf(line + len, sizeof(line) - len, "%s%s %.2f %%", j ? ", " : "",
+			                data->tab_stat[j], u_data->percent[i * LASTSTAT + j]);
+		MSG_STDOUT("%16s: %6.2f %% (%s)", name, u_data->usage[i], line);
+	}
+
+	/* CPU time consumed by second, for the whole system */
+	for(j = len = 0; j < LASTSTAT; j++)
+		len += snprintf(line + len, sizeof(line) - len, "%s%s %.2f s/s", j ? ", " : "",
+		                data->tab_stat[j], u_data->rate[j]);
+	MSG_STDOUT("%16s: %s", _("Rate"), line);
+}
+
+/* Dump cost of collectors (in stderr when records are streamed) */
+static void dump_selfstats(Labels *data)
+{
+	char *report;
+	const char *col = opts->color ? BOLD_BLUE : "";
+
+	if((report = selfstats_format(data)) == NULL)
+		return;
+
+	MSG_STDOUT("  %s>>>>>>>>>> %s <<<<<<<<<<%s", col, _("Self statistics"), DEFAULT);
+	fputs(report, stdout);
+	free(report);
+}
+
+/* Dump CPU topology, by socket */
+static void dump_topology(Labels *data)
+{
+	uint32_t s, i, threads;
+	int32_t die_min, die_max, core_min, core_max;
+	char name[MAXSTR], line[MAXSTR];
+	const char *col = opts->color ? BOLD_BLUE : "";
+	TopologyData *t = data->t_data;
+
+	MSG_STDOUT("\n\t%s***** %s *****%s", col, _("Topology"), DEFAULT);
+	for(s = 0; s < t->socket_count; s++)
+	{
+		/* Dies and cores are numbered by socket, so they are contiguous */
+		die_min = core_min = INT32_MAX;
+		die_max = core_max = -1;
+		for(i = threads = 0; i < t->thread_count; i++)
+		{
+			if(t->cpus[i].socket != (int32_t) s)
+				continue;
+			die_min  = (t->cpus[i].die  < die_min)  ? t->cpus[i].die  : die_min;
+			die_max  = (t->cpus[i].die  > die_max)  ? t->cpus[i].die  : die_max;
+			core_min = (t->cpus[i].core < core_min) ? t->cpus[i].core : core_min;
+			core_max = (t->cpus[i].core > core_max) ? t->cpus[i].core : core_max;
+			threads++;
+		}
+		snprintf(name, sizeof(name), _("Socket %u"), s);
+		snprintf(line, sizeof(line), _("%i dies, %i cores, %u threads"), die_max - die_min + 1, core_max - core_min + 1, threads);
+		MSG_STDOUT("%16s: %s", name, line);
+	}
+}
+
 /* Dump all data in stdout */
 static void dump_data(Labels *data)
 {
-	int i, j, k = 0;
+	unsigned i;
+	int j, k;
+	char title[MAXSTR];
 	const char *col = opts->color ? BOLD_BLUE : "";
 	const struct Arrays { char **array_name, **array_value; int last; } a[] =
 	{
-		{ data->tab_cpu[NAME],         data->tab_cpu[VALUE],         LASTCPU                     },
-		{ data->tab_caches[NAME],      data->tab_caches[VALUE],      LASTCACHES                  },
-		{ data->tab_motherboard[NAME], data->tab_motherboard[VALUE], LASTMOTHERBOARD             },
-		{ data->tab_memory[NAME],      data->tab_memory[VALUE],      data->dimms_count           },
-		{ data->tab_system[NAME],      data->tab_system[VALUE],      LASTSYSTEM                  },
-		{ data->tab_graphics[NAME],    data->tab_graphics[VALUE],    data->gpu_count * GPUFIELDS },
-		{ NULL,                        NULL,                         0                           }
+		{ data->tab_cpu[NAME],         data->tab_cpu[VALUE],         LASTCPU                       },
+		{ data->tab_caches[NAME],      data->tab_caches[VALUE],      LASTCACHES                    },
+		{ data->tab_motherboard[NAME], data->tab_motherboard[VALUE], LASTMOTHERBOARD               },
+		{ data->tab_memory[NAME],      data->tab_memory[VALUE],      data->dimms_count * RAMFIELDS },
+		{ data->tab_system[NAME],      data->tab_system[VALUE],      LASTSYSTEM                    },
+		{ data->tab_graphics[NAME],    data->tab_graphics[VALUE],    data->gpu_count * GPUFIELDS   }
 	};
 	const struct Frames { int tab_nb, lab_nb, frame_nb; } f[] =
 	{
-		{ NO_CPU,         VENDOR,       FRAMPROCESSOR       },
-		{ NO_CPU,         CORESPEED,    FRAMCLOCKS          },
-		{ NO_CPU,         LEVEL1D,      FRAMCACHE           },
-		{ NO_CPU,         SOCKETS,      -1                  },
-		{ NO_CACHES,      L1SIZE,       FRAML1CACHE         },
-		{ NO_CACHES,      L2SIZE,       FRAML2CACHE         },
-		{ NO_CACHES,      L3SIZE,       FRAML3CACHE         },
-		{ NO_MOTHERBOARD, MANUFACTURER, FRAMMOTHERBOARD     },
-		{ NO_MOTHERBOARD, BRAND,        FRAMBIOS            },
-		{ NO_MOTHERBOARD, CHIPVENDOR,   FRAMCHIPSET         },
-		{ NO_MEMORY,      BANK0_0,      FRAMBANKS           },
-		{ NO_SYSTEM,      KERNEL,       FRAMOPERATINGSYSTEM },
-		{ NO_SYSTEM,      USED,         FRAMMEMORY          },
-		{ NO_GRAPHICS,    GPU1VENDOR,   FRAMGPU1            },
-		{ NO_GRAPHICS,    GPU2VENDOR,   FRAMGPU2            },
-		{ NO_GRAPHICS,    GPU3VENDOR,   FRAMGPU3            },
-		{ NO_GRAPHICS,    GPU4VENDOR,   FRAMGPU4            }
+		{ NO_CPU,         VENDOR,        FRAMPROCESSOR       },
+		{ NO_CPU,         CORESPEED,     FRAMCLOCKS          },
+		{ NO_CPU,         LEVEL1D,       FRAMCACHE           },
+		{ NO_CPU,         SOCKETS,       -1                  },
+		{ NO_CACHES,      L1SIZE,        FRAML1CACHE         },
+		{ NO_CACHES,      L2SIZE,        FRAML2CACHE         },
+		{ NO_CACHES,      L3SIZE,        FRAML3CACHE         },
+		{ NO_MOTHERBOARD, MANUFACTURER,  FRAMMOTHERBOARD     },
+		{ NO_MOTHERBOARD, BRAND,         FRAMBIOS            },
+		{ NO_MOTHERBOARD, CHIPVENDOR,    FRAMCHIPSET         },
+		{ NO_MEMORY,      BANKREFERENCE, FRAMBANKS           },
+		{ NO_SYSTEM,      KERNEL,        FRAMOPERATINGSYSTEM },
+		{ NO_SYSTEM,      USED,          FRAMMEMORY          }
 	};
 
 	MSG_VERBOSE(_("Dumping data..."));
-	for(i = 0; a[i].array_name != NULL; i++)
+	for(i = 0; i < sizeof(a) / sizeof(a[0]); i++)
 	{
 		MSG_STDOUT("  %s>>>>>>>>>> %s <<<<<<<<<<%s", col, data->objects[i], DEFAULT);
 		for(j = 0; j < a[i].last; j++)
 		{
-			if(f[k].tab_nb == i && f[k].lab_nb == j)
+			/* There is one frame by graphic card */
+			if(i == NO_GRAPHICS && j % GPUFIELDS == GPUVENDOR)
+			{
+				snprintf(title, sizeof(title), data->objects[FRAMCARD], j / GPUFIELDS);
+				MSG_STDOUT("\n\t%s***** %s *****%s", col, title, DEFAULT);
+			}
+			for(k = 0; k < (int) (sizeof(f) / sizeof(f[0])); k++)
 			{
-				MSG_STDOUT("\n\t%s***** %s *****%s", col, (f[k].frame_nb >= 0) ?
-				                                 data->objects[f[k].frame_nb] : "*", DEFAULT);
-				k++;
+				if(f[k].tab_nb == (int) i && f[k].lab_nb == j)
+					MSG_STDOUT("\n\t%s***** %s *****%s", col, (f[k].frame_nb >= 0) ?
+					                                 data->objects[f[k].frame_nb] : "*", DEFAULT);
 			}
 			MSG_STDOUT("%16s: %s", a[i].array_name[j], a[i].array_value[j]);
 		}
+		if(i == NO_CPU && data->t_data->cpus != NULL)
+			dump_topology(data);
+		if(i == NO_CPU && data->u_data->usage != NULL)
+			dump_usage(data);
 		MSG_STDOUT("\n");
 	}
 
@@ -438,11 +507,25 @@ static const struct AvailableOpts
 	{ HAS_GTK,         'g', "gtk",       no_argument,       N_("Start graphical user interface (GUI) (default)")           },
 	{ HAS_NCURSES,     'n', "ncurses",   no_argument,       N_("Start text-based user interface (TUI)")                    },
 	{ true,            'd', "dump",      no_argument,       N_("Dump all data on standard output and exit")                },
+	{ true,            'i', "interval",  required_argument, N_("Print a record every interval with --dump (e.g. 200ms, 2s)") },
+	{ true,            'f', "format",    required_argument, N_("Set format of --dump: text (default), ndjson or csv")        },
+	{ true,            'w', "record",    required_argument, N_("Record all values in a file, to show them later with --replay") },
+	{ true,            'p', "replay",    required_argument, N_("Show values from a recording instead of collecting them") },
+	{ true,            's', "speed",     required_argument, N_("Set replay speed (e.g. 10 is ten times faster)")           },
+	{ true,            'k', "seek",      required_argument, N_("Start replay after given time in recording (in seconds)") },
+	{ true,            'a', "capture",   required_argument, N_("Write all system files read by collectors in a tar archive (\"-\" for standard output), after other output if any") },
+	{ true,            'A', "from-capture", required_argument, N_("Read system files in an archive made by --capture (\"-\" for standard input)") },
+	{ true,            'y', "sysroot",   required_argument, N_("Read /sys, /proc and /dev in another root directory (also set by CPUX_SYSROOT)") },
+	{ true,            'S', "daemon",    no_argument,       N_("Collect data and share it with other instances (no display)") },
+	{ true,            'E', "exporter",  required_argument, N_("Serve metrics in OpenMetrics format on port, address:port or socket path") },
 	{ true,            'c', "core",      required_argument, N_("Select CPU core to monitor (integer)")                     },
-	{ true,            'r', "refresh",   required_argument, N_("Set custom time between two refreshes (in seconds)")       },
+	{ true,            'r', "refresh",   required_argument, N_("Set custom time between two refreshes (e.g. 500ms, 2s)")   },
 	{ HAS_BANDWIDTH,   't', "cachetest", required_argument, N_("Set custom bandwidth test for CPU caches speed (integer)") },
 	{ HAS_DMIDECODE,   'D', "dmidecode", no_argument,       N_("Run embedded command dmidecode and exit")                  },
 	{ HAS_BANDWIDTH,   'B', "bandwidth", no_argument,       N_("Run embedded command bandwidth and exit")                  },
+	{ true,            'C', "no-cache",  no_argument,       N_("Do not use cache for static data")                         },
+	{ true,            'X', "self-stats", no_argument,      N_("Print cost of each collector and of CPU-X after --dump")   },
+	{ true,            'R', "refresh-cache", no_argument,   N_("Ignore cached static data and update cache")               },
 	{ true,            'o', "nocolor",   no_argument,       N_("Disable colored output")                                   },
 	{ true,            'v', "verbose",   no_argument,       N_("Verbose output")                                           },
 	{ PORTABLE_BINARY, 'u', "update",    no_argument,       N_("Update portable version if a new version is available")    },
@@ -462,7 +545,7 @@ static void help(void)
 	for(i = 0; o[i].long_opt != NULL; i++)
 	{
 		if(o[i].has_mod)
-			MSG_STDOUT("  -%c, --%-10s %s", o[i].short_opt, o[i].long_opt, _(o[i].description));
+			MSG_STDOUT("  -%c, --%-14s %s", o[i].short_opt, o[i].long_opt, _(o[i].description));
 	}
 }
 
@@ -514,6 +597,8 @@ static void version(void)
 static void menu(int argc, char *argv[])
 {
 	int i, j = 0, c, tmp_arg = -1;
+	double tmp_dbl;
+	char *endptr;
 	char *shortopts = { "" };
 	struct option longopts[sizeof(o)/sizeof(o[0]) - 1];
 
@@ -527,14 +612,6 @@ static void menu(int argc, char *argv[])
 		j++;
 	}
 
-	/* Set the default mode */
-	if(HAS_GTK && (getenv("DISPLAY") != NULL || getenv("WAYLAND_DISPLAY") != NULL))
-		opts->output_type = OUT_GTK;
-	else if(HAS_NCURSES)
-		opts->output_type = OUT_NCURSES;
-	else
-		opts->output_type = OUT_DUMP;
-
 	/* Parse options */
 	while((c = getopt_long(argc, argv, shortopts, longopts, NULL)) != -1)
 	{
@@ -549,15 +626,74 @@ static void menu(int argc, char *argv[])
 			case 'd':
 				opts->output_type = OUT_DUMP;
 				break;
+			case 'i':
+				tmp_dbl = strtod(optarg, &endptr);
+				if(!strcmp(endptr, "ms"))
+					tmp_dbl /= 1000.0;
+				else if(*endptr != '\0' && strcmp(endptr, "s"))
+					tmp_dbl = -1;
+				if(tmp_dbl * 1000.0 >= STREAM_MIN_INTERVAL)
+					opts->interval = tmp_dbl * 1000.0;
+				else
+					MSG_WARNING(_("Ignoring invalid interval '%s'"), optarg);
+				break;
+			case 'f':
+				if(!strcmp(optarg, "text"))
+					opts->dump_format = FMT_TEXT;
+				else if(!strcmp(optarg, "ndjson"))
+					opts->dump_format = FMT_NDJSON;
+				else if(!strcmp(optarg, "csv"))
+					opts->dump_format = FMT_CSV;
+				else
+					MSG_WARNING(_("Ignoring unknown format '%s'"), optarg);
+				break;
+			case 'w':
+				opts->record = optarg;
+				break;
+			case 'p':
+				opts->replay = optarg;
+				break;
+			case 's':
+				tmp_dbl = atof(optarg);
+				if(tmp_dbl > 0)
+					opts->replay_speed = tmp_dbl;
+				break;
+			case 'k':
+				tmp_dbl = atof(optarg);
+				if(tmp_dbl >= 0)
+					opts->replay_seek = tmp_dbl;
+				break;
+			case 'a':
+				opts->capture = optarg;
+				break;
+			case 'A':
+				opts->from_capture = optarg;
+				break;
+			case 'y':
+				opts->sysroot = optarg;
+				break;
+			case 'S':
+				opts->output_type = OUT_DAEMON;
+				break;
+			case 'E':
+				opts->output_type = OUT_EXPORTER;
+				opts->exporter    = optarg;
+				break;
 			case 'c':
 				tmp_arg = atoi(optarg);
 				if(tmp_arg >= 0)
 					opts->selected_core = tmp_arg;
 				break;
 			case 'r':
-				tmp_arg = atoi(optarg);
-				if(tmp_arg >= 1)
-					opts->refr_time = tmp_arg;
+				tmp_dbl = strtod(optarg, &endptr);
+				if(!strcmp(endptr, "ms"))
+					tmp_dbl /= 1000.0;
+				else if(*endptr != '\0' && strcmp(endptr, "s"))
+					tmp_dbl = -1;
+				if(tmp_dbl * 1000.0 >= REFRESH_MIN)
+					opts->refr_time = tmp_dbl * 1000.0;
+				else
+					MSG_WARNING(_("Ignoring invalid refresh time '%s'"), optarg);
 				break;
 			case 't':
 				tmp_arg = atoi(optarg);
@@ -572,6 +708,16 @@ static void menu(int argc, char *argv[])
 				opts->output_type = OUT_BANDWIDTH;
 				if(HAS_BANDWIDTH)
 					exit(run_bandwidth());
+				break;
+			case 'C':
+				opts->use_cache = false;
+				break;
+			case 'X':
+				opts->self_stats = true;
+				break;
+			case 'R':
+				opts->refresh_cache = true;
+				break;
 			case 'o':
 				opts->color = false;
 				break;
@@ -593,6 +739,23 @@ static void menu(int argc, char *argv[])
 				exit(EXIT_FAILURE);
 		}
 	}
+
+	/* Set the default mode (a capture alone has no display) */
+	if(opts->output_type == 0 && opts->capture != NULL)
+		opts->output_type = OUT_CAPTURE;
+	else if(opts->output_type == 0 && HAS_GTK && (getenv("DISPLAY") != NULL || getenv("WAYLAND_DISPLAY") != NULL))
+		opts->output_type = OUT_GTK;
+	else if(opts->output_type == 0 && HAS_NCURSES)
+		opts->output_type = OUT_NCURSES;
+	else if(opts->output_type == 0)
+		opts->output_type = OUT_DUMP;
+
+	/* Standard output cannot hold both the archive and another output */
+	if(opts->capture != NULL && !strcmp(opts->capture, "-") && opts->output_type != OUT_CAPTURE)
+	{
+		MSG_ERROR(_("a capture on standard output cannot be combined with another output"));
+		exit(EXIT_FAILURE);
+	}
 }
 
 
@@ -686,21 +849,46 @@ int main(int argc, char *argv[])
 	binary_name = argv[0];
 	Labels *data = &(Labels) {
 	                .tab_cpu    = {{ NULL }}, .tab_caches     = {{ NULL }}, .tab_motherboard = {{ NULL }},
-	                .tab_memory = {{ NULL }}, .tab_system     = {{ NULL }}, .tab_graphics    = {{ NULL }},
-	                .cpu_freq   = 0,          .bus_freq       = 0.0,
+	                .tab_memory = { NULL },  .tab_system     = {{ NULL }}, .tab_graphics    = { NULL },
 	                .cpu_count  = 0,          .gpu_count      = 0,          .dimms_count     = 0 };
 
 	data->l_data = &(LibcpuidData) { .cpu_vendor_id = -1, .cpu_model = -1, .cpu_ext_model = -1, .cpu_ext_family = -1 };
 
+	data->t_data = &(TopologyData) { .socket_count = 0, .die_count = 0, .core_count = 0, .thread_count = 0, .cpus = NULL };
+
 	data->w_data = &(BandwidthData) { .l1_size = 0, .test_count = 0, .test_name = NULL, .speed = { 0 } };
 
-	data->m_data = &(MemoryData) { .mem_total = 0, .swap_total = 0 };
+	data->u_data = &(UsageData) { .fd = -1, .buff = NULL, .core_count = 0, .current = 0, .hz = 0, .stamp = { 0 },
+	                              .ticks = { NULL }, .percent = NULL, .rate = NULL, .usage = NULL };
+
+	data->m_data = &(MsrData) { .vendor = MSR_UNKNOWN, .core_count = 0, .fd = NULL };
+
+	data->s_data = &(SensorsData) { .init = false, .core_count = 0, .fd_count = 0, .fds = NULL, .core_temp = NULL,
+	                                .cpu_volt = -1, .gpu_count = 0, .gpu_temp = NULL };
+
+	data->snapshot = &(SnapshotData) { .writer = false, .size = 0, .map = NULL };
+
+	data->r_data = &(RecordData) { .writer = NULL, .reader = NULL };
+	data->refresh = &(RefreshData) { .fd = -1, .subscribed = 0, .heap_size = 0 };
+
+	data->b_data = &(BenchData) { .run = false, .duration = 1, .threads = 1, .primes = 0,
+	                              .slots_lock = PTHREAD_MUTEX_INITIALIZER };
+
+	data->metrics = &(MetricStore) { .valid = { false }, .stamp = { 0 }, .fmt_stamp = { 0 } };
 
-	data->b_data = &(BenchData) { .run = false, .duration = 1, .threads = 1, .primes = 0 };
+	data->c_data = &(CoreData) { .mutex = PTHREAD_MUTEX_INITIALIZER, .collector_count = 0, .stat_count = 0,
+	                             .collectors = NULL, .stats = NULL, .bw_started = false, .mult_init = false };
 
-	opts = &(Options) { .output_type = 0,     .selected_core  = 0,          .refr_time       = 1,
+	opts = &(Options) { .output_type = 0,     .selected_core  = 0,          .refr_time       = 1000,
 	                    .bw_test     = 0,     .verbose        = false,      .color           = true,
-	                    .update      = false, .use_network    = 1,          .use_wget        = false };
+	                    .update      = false, .use_network    = 1,          .use_wget        = false,
+	                    .use_daemon  = 1,     .exporter       = NULL,
+	                    .interval    = 0,     .dump_format    = FMT_TEXT,
+	                    .record      = NULL,  .replay         = NULL,       .replay_speed    = 1.0,
+	                    .replay_seek = 0,     .sysroot        = NULL,       .capture         = NULL,
+	                    .from_capture = NULL,
+	                    .use_cache   = true,  .refresh_cache  = false, .self_stats = false };
+	data->opts = opts;
 
 	set_locales();
 	signal(SIGSEGV, sighandler);
@@ -708,17 +896,51 @@ int main(int argc, char *argv[])
 
 	if(getenv("CPUX_NETWORK"))
 		opts->use_network = atoi(getenv("CPUX_NETWORK"));
+	if(getenv("CPUX_DAEMON"))
+		opts->use_daemon = atoi(getenv("CPUX_DAEMON"));
+	if(getenv("CPUX_SYSROOT"))
+		opts->sysroot = getenv("CPUX_SYSROOT");
 
 	menu(argc, argv);
+	if(opts->sysroot != NULL && opts->sysroot[0] == '\0')
+		opts->sysroot = NULL;
+	if(opts->from_capture != NULL && capture_open(opts->from_capture))
+		return EXIT_FAILURE;
+	if(opts->capture != NULL && capture_start(opts->capture))
+	{
+		capture_close();
+		return EXIT_FAILURE;
+	}
+	/* Values read in another root directory are not those of this system: they are neither shared nor cached;
+	 * a capture needs collectors to read all files */
+	if(opts->sysroot != NULL || opts->capture != NULL)
+	{
+		opts->use_daemon = 0;
+		opts->use_cache  = false;
+	}
+	/* Text format cannot be streamed: an interval implies NDJSON */
+	if(opts->output_type == OUT_DUMP && opts->interval > 0 && opts->dump_format == FMT_TEXT)
+		opts->dump_format = FMT_NDJSON;
+	if(opts->output_type == OUT_DUMP && opts->dump_format != FMT_TEXT && stream_open())
+		return EXIT_FAILURE;
 	if(getuid())
 	{
 		MSG_WARNING(_("Root privileges are required to work properly"));
 		MSG_WARNING(_("Some informations will not be retrievable"));
 	}
+	/* Values of a recording or of a running daemon are used instead of collecting them again */
+	if(opts->replay != NULL && replay_open(data, opts->replay))
+		return EXIT_FAILURE;
+	else if(opts->replay == NULL && opts->output_type != OUT_DAEMON && opts->use_daemon > 0)
+		snapshot_attach(data);
 	labels_setname (data);
 	fill_labels    (data);
 	remove_null_ptr(data);
-	check_new_version();
+	if(opts->record != NULL && opts->replay == NULL && record_open(data, opts->record))
+		return EXIT_FAILURE;
+	/* New version is only shown by portable binary, which can update itself */
+	if(PORTABLE_BINARY && opts->use_network > 0)
+		check_new_version();
 
 
 	/* Show data */
@@ -733,234 +955,30 @@ int main(int argc, char *argv[])
 				start_tui_ncurses(data);
 			break;
 		case OUT_DUMP:
-			dump_data(data);
+			if(opts->dump_format == FMT_TEXT)
+				dump_data(data);
+			else if(start_stream(data))
+				return EXIT_FAILURE;
+			if(opts->self_stats)
+				dump_selfstats(data);
+			break;
+		case OUT_DAEMON:
+			if(start_daemon(data))
+				return EXIT_FAILURE;
+			break;
+		case OUT_EXPORTER:
+			if(start_exporter(data))
+				return EXIT_FAILURE;
 			break;
 	}
+	/* Archive is written once the output has read all its files */
+	if(opts->capture != NULL && capture_write())
+		return EXIT_FAILURE;
+	record_close(data);
+	capture_close();
 
 	if(PORTABLE_BINARY && opts->update)
 		update_prg();
 
 	return EXIT_SUCCESS;
 }
-
-
-/************************* Public functions *************************/
-
-/* Add a newline for given string (used by MSG_XXX macros) */
-char *msg_newline(char *color, char *str)
-{
-	static char *buff;
-
-	asprintf(&buff, "%s%s%s\n", opts->color ? color : DEFAULT, str, DEFAULT);
-
-	return buff;
-}
-
-/* Add a newline and more informations for given string (used by MSG_ERROR macro) */
-char *msg_error(char *color, char *file, int line, char *str)
-{
-	static char *buff;
-
-	if(errno)
-		asprintf(&buff, "%s%s:%s:%i: %s (%s)%s\n", opts->color ? color : DEFAULT, PRGNAME, file, line, str, strerror(errno), DEFAULT);
-	else
-		asprintf(&buff, "%s%s:%s:%i: %s%s\n", opts->color ? color : DEFAULT, PRGNAME, file, line, str, DEFAULT);
-
-	errno = 0;
-	return buff;
-}
-
-/* The improved asprintf:
- * - allocate an empty string if input string is null
- * - only call asprintf if there is no format in input string
- * - print "valid" args if input string is formatted, or skip them until next arg
-     E.g.: iasprintf(&buff, "%i nm", 32) will allocate "32 nm" string
-           iasprintf(&buff, "%i nm", 0) will allocate an empty string
-	   iasprintf(&buff, "foo %s %s", NULL, "bar") will allocate "foo bar" */
-int iasprintf(char **str, const char *fmt, ...)
-{
-	bool is_format = false, print = true;
-	int arg_int, i, ret = 0;
-	unsigned int arg_uint;
-	double arg_double;
-	char *arg_string, *tmp_fmt = NULL;
-	va_list aptr;
-
-	/* Allocate an empty string */
-	*str    = malloc(1 * sizeof(char));
-	*str[0] = '\0';
-
-	/* Exit if input is null or without format */
-	if(fmt == NULL)
-		return 0;
-	else if(strchr(fmt, '%') == NULL)
-		return asprintf(str, "%s", fmt);
-
-	/* Read format, character by character */
-	va_start(aptr, fmt);
-	for(i = 0; fmt[i] != '\0'; i++)
-	{
-		is_format = fmt[i] == '%' || is_format;
-		if(is_format)
-		{
-			print = true;
-
-			/* Construct the new temporary format */
-			if(fmt[i] == '%')
-				asprintf(&tmp_fmt, "%%s%%");
-			else
-				asprintf(&tmp_fmt, "%s%c", tmp_fmt, fmt[i]);
-
-			/* Extract arg */
-			switch(fmt[i])
-			{
-				case '%':
-					break;
-				case '.':
-				case '0' ... '9':
-				case 'l':
-				case 'L':
-					break;
-				case 'x':
-				case 'X':
-				case 'd':
-				case 'i':
-					is_format = false;
-					arg_int = va_arg(aptr, int);
-					if(arg_int > 0)
-						ret = asprintf(str, tmp_fmt, *str, arg_int);
-					else
-						print = false;
-					break;
-				case 'u':
-					is_format = false;
-					arg_uint = va_arg(aptr, unsigned int);
-					if(arg_uint > 0)
-						ret = asprintf(str, tmp_fmt, *str, arg_uint);
-					else
-						print = false;
-					break;
-				case 'f':
-					is_format = false;
-					arg_double = va_arg(aptr, double);
-					if(arg_double > 0.0)
-						ret = asprintf(str, tmp_fmt, *str,  arg_double);
-					else
-						print = false;
-					break;
-				case 's':
-					is_format = false;
-					arg_string = va_arg(aptr, char *);
-					if(arg_string != NULL)
-						ret = asprintf(str, tmp_fmt, *str, arg_string);
-					else
-						print = false;
-					break;
-				default:
-					is_format = false;
-					asprintf(&tmp_fmt, "unknown format for iasprintf() '%%%c' (need to be implemented)", fmt[i]);
-					MSG_ERROR(tmp_fmt);
-					break;
-			}
-		}
-		else if(print)
-			ret = asprintf(str, "%s%c", *str, fmt[i]);
-	}
-	va_end(aptr);
-
-	if(tmp_fmt != NULL)
-		free(tmp_fmt);
-
-	return ret;
-}
-
-/* Check if a command exists */
-bool command_exists(char *in)
-{
-	bool ret;
-	char *cmd;
-
-	asprintf(&cmd, "which %s >/dev/null 2>&1", in);
-	ret = system(cmd);
-	free(cmd);
-
-	return !ret;
-}
-
-/* Open a file and put its content in buffer */
-int fopen_to_str(char *file, char **buffer)
-{
-	FILE *f = NULL;
-
-	if((*buffer = malloc(MAXSTR * sizeof(char))) == NULL)
-		goto error;
-
-	if((f = fopen(file, "r")) == NULL)
-		goto error;
-
-	if(fgets(*buffer, MAXSTR, f) == NULL)
-		goto error;
-
-	(*buffer)[strlen(*buffer) - 1] = '\0';
-	return fclose(f);
-
-error:
-	MSG_ERROR(_("an error occurred while opening file '%s'"), file);
-	return (f == NULL) ? 1 : 2 + fclose(f);
-}
-
-/* Open a pipe and put its content in buffer */
-int popen_to_str(char *command, char **buffer)
-{
-	char *test_command;
-	FILE *p = NULL;
-
-	if((*buffer = malloc(MAXSTR * sizeof(char))) == NULL)
-		goto error;
-
-	asprintf(&test_command, "%s", command);
-	if(!command_exists(strtok(test_command, " ")))
-		return -1;
-
-	if((p = popen(command, "r")) == NULL)
-		goto error;
-
-	if(fgets(*buffer, MAXSTR, p) == NULL)
-		goto error;
-
-	(*buffer)[strlen(*buffer) - 1] = '\0';
-	return pclose(p);
-
-error:
-	MSG_ERROR(_("an error occurred while running command '%s'"), command);
-	return (p == NULL) ? 1 : 2 + pclose(p);
-}
-
-/* Free memory after display labels */
-void labels_free(Labels *data)
-{
-	int i, j;
-	const struct Arrays { char **array_name, **array_value; const int last; } a[] =
-	{
-		{ data->tab_cpu[NAME],         data->tab_cpu[VALUE],         LASTCPU         },
-		{ data->tab_caches[NAME],      data->tab_caches[VALUE],      LASTCACHES      },
-		{ data->tab_motherboard[NAME], data->tab_motherboard[VALUE], LASTMOTHERBOARD },
-		{ data->tab_memory[NAME],      data->tab_memory[VALUE],      LASTMEMORY      },
-		{ data->tab_system[NAME],      data->tab_system[VALUE],      LASTSYSTEM      },
-		{ data->tab_graphics[NAME],    data->tab_graphics[VALUE],    LASTGRAPHICS    },
-		{ data->tab_bench[NAME],       data->tab_bench[VALUE],       LASTBENCH       },
-		{ NULL,                        NULL,                         0               }
-	};
-
-	MSG_VERBOSE(_("Freeing memory"));
-	for(i = 0; a[i].array_name != NULL; i++)
-	{
-		for(j = 0; j < a[i].last; j++)
-		{
-			free(a[i].array_name[j]);
-			free(a[i].array_value[j]);
-			a[i].array_name[j] = NULL;
-			a[i].array_value[j] = NULL;
-		}
-	}
-}
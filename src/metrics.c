@@ -0,0 +1,275 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE metrics.c
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <time.h>
+#include <libintl.h>
+#include "metrics.h"
+#include "cpu-x.h"
+
+static const MetricInfo info[LASTMETRIC] =
+{
+	/*     Page          Label             Ref                  Type          Unit           Name                   Format              Formatter */
+	METRIC(NO_CPU,       CORESPEED,        MT_CORESPEED,        TYPE_INT,     UNIT_MHZ,      "cpu_core_speed",      "%" PRIi64 " MHz",  NULL),
+	METRIC(NO_CPU,       MULTIPLIER,       MT_MULTMAX,          TYPE_DOUBLE,  UNIT_NONE,     "cpu_multiplier",      NULL,               format_multiplier),
+	METRIC(NO_CPU,       NOLABEL,          MT_MULTMIN,          TYPE_DOUBLE,  UNIT_NONE,     "cpu_multiplier_min",  NULL,               NULL),
+	METRIC(NO_CPU,       NOLABEL,          MT_MULTMAX,          TYPE_DOUBLE,  UNIT_NONE,     "cpu_multiplier_max",  NULL,               NULL),
+	METRIC(NO_CPU,       BUSSPEED,         MT_BUSSPEED,         TYPE_DOUBLE,  UNIT_MHZ,      "cpu_bus_speed",       "%.2f MHz",         NULL),
+	METRIC(NO_CPU,       USAGE,            MT_COREUSAGE,        TYPE_DOUBLE,  UNIT_PERCENT,  "cpu_usage",           NULL,               format_usage),
+	METRIC(NO_CPU,       NOLABEL,          MT_COREUSAGE,        TYPE_DOUBLE,  UNIT_PERCENT,  "cpu_core_usage",      NULL,               NULL),
+	METRIC(NO_CPU,       VOLTAGE,          MT_VOLTAGE,          TYPE_DOUBLE,  UNIT_VOLT,     "cpu_voltage",         "%.3f V",           NULL),
+	METRIC(NO_CPU,       TEMPERATURE,      MT_TEMPERATURE,      TYPE_DOUBLE,  UNIT_CELSIUS,  "cpu_temperature",     "%.2f°C",           NULL),
+	METRIC(NO_CACHES,    L1SPEED,          MT_L1SPEED,          TYPE_DOUBLE,  UNIT_MBPS,     "cache_l1_speed",      "%.2f MB/s",        NULL),
+	METRIC(NO_CACHES,    L2SPEED,          MT_L2SPEED,          TYPE_DOUBLE,  UNIT_MBPS,     "cache_l2_speed",      "%.2f MB/s",        NULL),
+	METRIC(NO_CACHES,    L3SPEED,          MT_L3SPEED,          TYPE_DOUBLE,  UNIT_MBPS,     "cache_l3_speed",      "%.2f MB/s",        NULL),
+	METRIC(NO_SYSTEM,    UPTIME,           MT_UPTIME,           TYPE_INT,     UNIT_SECOND,   "system_uptime",       NULL,               format_uptime),
+	METRIC(NO_SYSTEM,    USED,             MT_MEMTOTAL,         TYPE_INT,     UNIT_MB,       "memory_used",         NULL,               format_memory),
+	METRIC(NO_SYSTEM,    BUFFERS,          MT_MEMTOTAL,         TYPE_INT,     UNIT_MB,       "memory_buffers",      NULL,               format_memory),
+	METRIC(NO_SYSTEM,    CACHED,           MT_MEMTOTAL,         TYPE_INT,     UNIT_MB,       "memory_cached",       NULL,               format_memory),
+	METRIC(NO_SYSTEM,    FREE,             MT_MEMTOTAL,         TYPE_INT,     UNIT_MB,       "memory_free",         NULL,               format_memory),
+	METRIC(NO_SYSTEM,    SWAP,             MT_SWAPTOTAL,        TYPE_INT,     UNIT_MB,       "swap_used",           NULL,               format_memory),
+	METRIC(NO_SYSTEM,    NOLABEL,          MT_MEMTOTAL,         TYPE_INT,     UNIT_MB,       "memory_total",        NULL,               NULL),
+	METRIC(NO_SYSTEM,    NOLABEL,          MT_SWAPTOTAL,        TYPE_INT,     UNIT_MB,       "swap_total",          NULL,               NULL),
+	METRIC(NO_GRAPHICS,  NOLABEL,          MT_GPU1TEMPERATURE,  TYPE_DOUBLE,  UNIT_CELSIUS,  "gpu1_temperature",    NULL,               NULL), /* Labels by GPU: see gpu_temperature() */
+};
+
+
+/************************* Public functions *************************/
+
+/* Store an integer value for a metric */
+void metric_set_int(Labels *data, enum EnMetrics id, int64_t value)
+{
+	MetricStore *m = data->metrics;
+
+	if(info[id].type == TYPE_DOUBLE)
+		m->dval[id] = (double) value;
+	else
+		m->ival[id] = value;
+	m->stamp[id] = metric_now();
+	m->valid[id] = true;
+}
+
+/* Store a floating-point value for a metric */
+void metric_set_double(Labels *data, enum EnMetrics id, double value)
+{
+	MetricStore *m = data->metrics;
+
+	if(info[id].type == TYPE_INT)
+		m->ival[id] = (int64_t) value;
+	else
+		m->dval[id] = value;
+	m->stamp[id] = metric_now();
+	m->valid[id] = true;
+}
+
+/* Get the value of a metric, whatever its type (0 if not available) */
+double metric_get(Labels *data, enum EnMetrics id)
+{
+	MetricStore *m = data->metrics;
+
+	if(!m->valid[id])
+		return 0.0;
+
+	return (info[id].type == TYPE_INT) ? (double) m->ival[id] : m->dval[id];
+}
+
+/* Check if a metric has been set */
+bool metric_valid(Labels *data, enum EnMetrics id)
+{
+	return data->metrics->valid[id];
+}
+
+/* Short name of a metric, used by exporters */
+const char *metric_name(enum EnMetrics id)
+{
+	return info[id].name;
+}
+
+/* Unit symbol of a metric */
+const char *metric_unit(enum EnMetrics id)
+{
+	static const char *units[LASTUNIT] = { "", "MHz", "V", "°C", "%", "MB/s", "MB", "s" };
+
+	return units[info[id].unit];
+}
+
+/* Unit of a metric */
+enum EnMetricUnits metric_unit_type(enum EnMetrics id)
+{
+	return info[id].unit;
+}
+
+/* Type of a metric value */
+enum EnMetricTypes metric_value_type(enum EnMetrics id)
+{
+	return info[id].type;
+}
+
+/* Short name of a CPU state (see /proc/stat), used by exporters */
+const char *stat_name(enum EnCpuStat id)
+{
+	static const char *states[LASTSTAT] =
+	{
+		"user", "nice", "system", "idle", "iowait", "irq", "softirq", "steal", "guest", "guest_nice"
+	};
+
+	return states[id];
+}
+
+/* Format labels of metrics shown in given page (all pages if page < 0) */
+void metrics_format(Labels *data, int page)
+{
+	int id;
+	uint64_t stamp;
+	char **label;
+	MetricStore *m = data->metrics;
+
+	for(id = 0; id < LASTMETRIC; id++)
+	{
+		if(!m->valid[id] || info[id].label == NOLABEL || (page >= 0 && info[id].page != (enum EnTabNumber) page))
+			continue;
+
+		/* Label is up to date if no value changed since last call */
+		stamp = (m->stamp[id] > m->stamp[info[id].ref]) ? m->stamp[id] : m->stamp[info[id].ref];
+		if(stamp == m->fmt_stamp[id])
+			continue;
+
+		if(info[id].format != NULL)
+			info[id].format(data, id, m->text[id], MAXSTR);
+		else if(info[id].type == TYPE_INT)
+			snprintf(m->text[id], MAXSTR, info[id].fmt, m->ival[id]);
+		else
+			snprintf(m->text[id], MAXSTR, info[id].fmt, m->dval[id]);
+		m->fmt_stamp[id] = stamp;
+
+		/* Label points to the store, so next updates are allocation-free */
+		label = metric_label(data, id);
+		if(label != NULL && *label != m->text[id])
+		{
+			free(*label);
+			*label = m->text[id];
+		}
+	}
+}
+
+/* Metrics shown in given page, as a METRIC_BIT() mask (all pages if page < 0) */
+uint64_t metrics_page_mask(int page)
+{
+	int id;
+	uint64_t mask = 0;
+
+	for(id = 0; id < LASTMETRIC; id++)
+	{
+		if(page < 0 || (int) info[id].page == page)
+			mask |= METRIC_BIT(id);
+	}
+
+	return mask;
+}
+
+/* Detach labels owned by the metric store (before freeing labels) */
+void metrics_unbind(Labels *data)
+{
+	int id;
+	char **label;
+	MetricStore *m = data->metrics;
+
+	for(id = 0; id < LASTMETRIC; id++)
+	{
+		if(info[id].label == NOLABEL)
+			continue;
+
+		label = metric_label(data, id);
+		if(label != NULL && *label == m->text[id])
+			*label = NULL;
+		m->fmt_stamp[id] = 0;
+	}
+}
+
+
+/************************* Private functions *************************/
+
+/* Current time of monotonic clock, in nanoseconds */
+static uint64_t metric_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/* Get the label bound to a metric */
+static char **metric_label(Labels *data, enum EnMetrics id)
+{
+	switch(info[id].page)
+	{
+		case NO_CPU:      return &data->tab_cpu[VALUE][info[id].label];
+		case NO_CACHES:   return &data->tab_caches[VALUE][info[id].label];
+		case NO_SYSTEM:   return &data->tab_system[VALUE][info[id].label];
+		default:          return NULL;
+	}
+}
+
+/* Format CPU multiplier, with range if known */
+static void format_multiplier(Labels *data, enum EnMetrics id, char *buff, size_t size)
+{
+	MetricStore *m = data->metrics;
+
+	if(m->valid[MT_MULTMIN] && m->valid[MT_MULTMAX])
+		snprintf(buff, size, "x%.1f (%.0f-%.0f)", m->dval[id], m->dval[MT_MULTMIN], m->dval[MT_MULTMAX]);
+	else
+		snprintf(buff, size, "x %.2f", m->dval[id]);
+}
+
+/* Format total CPU usage, followed by usage of selected core */
+static void format_usage(Labels *data, enum EnMetrics id, char *buff, size_t size)
+{
+	MetricStore *m = data->metrics;
+
+	if(m->valid[MT_COREUSAGE])
+		snprintf(buff, size, _("%6.2f %% (core #%u: %.2f %%)"), m->dval[id], data->opts->selected_core, m->dval[MT_COREUSAGE]);
+	else
+		snprintf(buff, size, "%6.2f %%", m->dval[id]);
+}
+
+/* Format memory usage, compared to total */
+static void format_memory(Labels *data, enum EnMetrics id, char *buff, size_t size)
+{
+	MetricStore *m = data->metrics;
+
+	snprintf(buff, size, "%5" PRIi64 " MB / %5" PRIi64 " MB", m->ival[id], m->ival[info[id].ref]);
+}
+
+/* Format system uptime */
+static void format_uptime(Labels *data, enum EnMetrics id, char *buff, size_t size)
+{
+	MetricStore *m = data->metrics;
+	time_t uptime_s = (time_t) m->ival[id];
+	struct tm tm;
+
+	gmtime_r(&uptime_s, &tm);
+	snprintf(buff, size, _("%i days, %i hours, %i minutes, %i seconds"),
+	         tm.tm_yday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
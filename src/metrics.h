@@ -0,0 +1,68 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE metrics.h
+*/
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <stddef.h>
+#include "cpu-x.h"
+
+#define NOLABEL               -1       /* Metric is not shown in a label */
+#define METRIC(page, label, ref, type, unit, name, fmt, format) \
+	{ page, label, ref, type, unit, name, fmt, format }
+
+typedef void (*MetricFormat)(Labels *data, enum EnMetrics id, char *buff, size_t size);
+
+typedef struct
+{
+	enum EnTabNumber   page;     /* Tab where metric is shown */
+	int                label;    /* Index of label in tab, or NOLABEL */
+	enum EnMetrics     ref;      /* Other metric used by formatter (itself if none) */
+	enum EnMetricTypes type;
+	enum EnMetricUnits unit;
+	const char         *name;
+	const char         *fmt;     /* Format for the value, if 'format' is NULL */
+	MetricFormat       format;
+} MetricInfo;
+
+
+/* Current time of monotonic clock, in nanoseconds */
+static uint64_t metric_now(void);
+
+/* Get the label bound to a metric */
+static char **metric_label(Labels *data, enum EnMetrics id);
+
+/* Format CPU multiplier, with range if known */
+static void format_multiplier(Labels *data, enum EnMetrics id, char *buff, size_t size);
+
+/* Format total CPU usage, followed by usage of selected core */
+static void format_usage(Labels *data, enum EnMetrics id, char *buff, size_t size);
+
+/* Format memory usage, compared to total */
+static void format_memory(Labels *data, enum EnMetrics id, char *buff, size_t size);
+
+/* Format system uptime */
+static void format_uptime(Labels *data, enum EnMetrics id, char *buff, size_t size);
+
+
+#endif /* _METRICS_H_ */
@@ -0,0 +1,240 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE msr.c
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <libintl.h>
+#include "msr.h"
+#include "cpu-x.h"
+
+#if defined (__i386__) || defined (__x86_64__)
+# include <cpuid.h>
+#endif
+
+
+/************************* Public functions *************************/
+
+/* Open MSR files of all logical CPUs ('path' is a format with core number) */
+int msr_open(MsrData *m_data, const char *path, const Options *options)
+{
+	unsigned i, opened = 0;
+	long count;
+	char *file;
+
+	count = sysroot_cpu_count(options);
+
+	m_data->vendor         = msr_vendor();
+	m_data->core_count     = count;
+	m_data->fd             = malloc(count * sizeof(int));
+	m_data->aperf          = calloc(count, sizeof(uint64_t));
+	m_data->mperf          = calloc(count, sizeof(uint64_t));
+	m_data->voltage        = calloc(count, sizeof(double));
+	m_data->temperature    = calloc(count, sizeof(double));
+	m_data->multiplier     = calloc(count, sizeof(double));
+	m_data->eff_multiplier = calloc(count, sizeof(double));
+	m_data->thermal        = calloc(count, sizeof(uint16_t));
+	if(m_data->fd == NULL || m_data->aperf == NULL || m_data->mperf == NULL || m_data->voltage == NULL ||
+	   m_data->temperature == NULL || m_data->multiplier == NULL || m_data->eff_multiplier == NULL || m_data->thermal == NULL)
+	{
+		MSG_ERROR(_("failed to allocate memory for CPU MSR"));
+		msr_close(m_data);
+		return 1;
+	}
+
+	if(m_data->vendor == MSR_UNKNOWN)
+	{
+		MSG_WARNING(_("CPU MSR are not supported for this CPU"));
+		msr_close(m_data);
+		return 2;
+	}
+
+	/* Files stay open: next samples do not need to open them again */
+	for(i = 0; i < m_data->core_count; i++)
+	{
+		asprintf(&file, path, i);
+		m_data->fd[i] = sysroot_open(options, file, O_RDONLY | O_CLOEXEC);
+		opened       += (m_data->fd[i] >= 0);
+		free(file);
+	}
+	errno = 0;
+
+	if(!opened)
+	{
+		msr_close(m_data);
+		return 3;
+	}
+
+	msr_read_package(m_data);
+	return 0;
+}
+
+/* Read registers of all logical CPUs */
+int msr_sample(MsrData *m_data)
+{
+	unsigned i;
+
+	if(m_data->fd == NULL)
+		return 1;
+
+	/* Files are kept open, so a sample only costs a few pread() by core */
+	for(i = 0; i < m_data->core_count; i++)
+		msr_sample_core(m_data, i);
+
+	return 0;
+}
+
+/* Close MSR files and free memory */
+void msr_close(MsrData *m_data)
+{
+	unsigned i;
+
+	for(i = 0; m_data->fd != NULL && i < m_data->core_count; i++)
+	{
+		if(m_data->fd[i] >= 0)
+			close(m_data->fd[i]);
+	}
+
+	free(m_data->fd);
+	free(m_data->aperf);
+	free(m_data->mperf);
+	free(m_data->voltage);
+	free(m_data->temperature);
+	free(m_data->multiplier);
+	free(m_data->eff_multiplier);
+	free(m_data->thermal);
+	*m_data = (MsrData) { .vendor = MSR_UNKNOWN, .core_count = 0, .fd = NULL };
+}
+
+
+/************************* Private functions *************************/
+
+/* Identify CPU vendor with CPUID instruction */
+static enum EnMsrVendor msr_vendor(void)
+{
+#if defined (__i386__) || defined (__x86_64__)
+	unsigned eax, ebx, ecx, edx, family;
+
+	if(!__get_cpuid(0, &eax, &ebx, &ecx, &edx))
+		return MSR_UNKNOWN;
+
+	if(ebx == 0x756e6547) /* "GenuineIntel" */
+		return MSR_INTEL;
+
+	if(ebx == 0x68747541 || ebx == 0x6f677948) /* "AuthenticAMD" or "HygonGenuine" */
+	{
+		/* Registers used here exist since Zen (family 17h) */
+		__get_cpuid(1, &eax, &ebx, &ecx, &edx);
+		family = (eax >> 8) & 0xF;
+		if(family == 0xF)
+			family += (eax >> 20) & 0xFF;
+		return (family >= 0x17) ? MSR_AMD : MSR_UNKNOWN;
+	}
+#endif /* __i386__ || __x86_64__ */
+
+	return MSR_UNKNOWN;
+}
+
+/* Read a register on a core; return 0 if it can't be read */
+static uint64_t msr_read(MsrData *m_data, unsigned core, uint32_t reg)
+{
+	uint64_t val;
+
+	/* Register address is the offset in MSR file */
+	if(m_data->fd[core] < 0 || pread(m_data->fd[core], &val, sizeof(val), reg) != sizeof(val))
+		return 0;
+
+	return val;
+}
+
+/* Read package values, which do not change at runtime */
+static void msr_read_package(MsrData *m_data)
+{
+	uint64_t val;
+
+	switch(m_data->vendor)
+	{
+		case MSR_INTEL:
+			val              = msr_read(m_data, 0, MSR_TEMPERATURE_TARGET);
+			m_data->tjmax    = ((val >> 16) & 0xFF) ? (val >> 16) & 0xFF : 100;
+			val              = msr_read(m_data, 0, MSR_PLATFORM_INFO);
+			m_data->max_mult = (val >> 8)  & 0xFF;
+			m_data->min_mult = (val >> 40) & 0xFF;
+			break;
+		case MSR_AMD:
+			val              = msr_read(m_data, 0, MSR_PSTATE_LIMIT);
+			m_data->max_mult = amd_pstate_multiplier(msr_read(m_data, 0, MSR_PSTATE_DEF0));
+			m_data->min_mult = amd_pstate_multiplier(msr_read(m_data, 0, MSR_PSTATE_DEF0 + ((val >> 4) & 0x7)));
+			break;
+		default:
+			break;
+	}
+}
+
+/* Multiplier from an AMD P-state (100 MHz reference clock) */
+static double amd_pstate_multiplier(uint64_t pstate)
+{
+	const unsigned fid = pstate & 0xFF, did = (pstate >> 8) & 0x3F;
+
+	/* CoreCOF = FID / DID * 200 MHz */
+	return did ? (double) fid / did * 2 : 0.0;
+}
+
+/* Read all sampled registers of a core, and decode them */
+static void msr_sample_core(MsrData *m_data, unsigned core)
+{
+	uint64_t aperf, mperf, perf, therm, vid;
+
+	aperf = msr_read(m_data, core, IA32_APERF);
+	mperf = msr_read(m_data, core, IA32_MPERF);
+
+	switch(m_data->vendor)
+	{
+		case MSR_INTEL:
+			perf  = msr_read(m_data, core, IA32_PERF_STATUS);
+			therm = msr_read(m_data, core, IA32_THERM_STATUS);
+			m_data->multiplier[core]  = (perf >> 8) & 0xFF;
+			m_data->voltage[core]     = (double) ((perf >> 32) & 0xFFFF) / (1 << 13);
+			m_data->temperature[core] = (therm & (1ULL << 31)) ? m_data->tjmax - ((therm >> 16) & 0x7F) : 0.0;
+			m_data->thermal[core]     = therm & (MSR_THERMAL_THROTTLE | MSR_THERMAL_PROCHOT | MSR_THERMAL_CRITICAL | MSR_THERMAL_POWER_LIMIT);
+			break;
+		case MSR_AMD:
+			perf = msr_read(m_data, core, MSR_HW_PSTATE_STATUS);
+			vid  = (perf >> 14) & 0xFF;
+			m_data->multiplier[core]  = amd_pstate_multiplier(perf);
+			m_data->voltage[core]     = vid ? 1.55 - vid * 0.00625 : 0.0;
+			break;
+		default:
+			break;
+	}
+
+	/* APERF/MPERF ratio gives the average frequency while core was not halted */
+	if(mperf > m_data->mperf[core] && m_data->mperf[core] > 0)
+		m_data->eff_multiplier[core] = m_data->max_mult * (aperf - m_data->aperf[core]) / (mperf - m_data->mperf[core]);
+	m_data->aperf[core] = aperf;
+	m_data->mperf[core] = mperf;
+}
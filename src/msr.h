@@ -0,0 +1,59 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE msr.h
+*/
+
+#ifndef _MSR_H_
+#define _MSR_H_
+
+#include "cpu-x.h"
+
+/* Architectural and Intel registers */
+#define IA32_MPERF            0xE7
+#define IA32_APERF            0xE8
+#define MSR_PLATFORM_INFO     0xCE
+#define IA32_PERF_STATUS      0x198
+#define IA32_THERM_STATUS     0x19C
+#define MSR_TEMPERATURE_TARGET 0x1A2
+
+/* AMD registers (family 17h and later) */
+#define MSR_PSTATE_LIMIT      0xC0010061
+#define MSR_PSTATE_DEF0       0xC0010064
+#define MSR_HW_PSTATE_STATUS  0xC0010293
+
+
+/* Identify CPU vendor with CPUID instruction */
+static enum EnMsrVendor msr_vendor(void);
+
+/* Read a register on a core; return 0 if it can't be read */
+static uint64_t msr_read(MsrData *m_data, unsigned core, uint32_t reg);
+
+/* Read package values, which do not change at runtime */
+static void msr_read_package(MsrData *m_data);
+
+/* Multiplier from an AMD P-state (100 MHz reference clock) */
+static double amd_pstate_multiplier(uint64_t pstate);
+
+/* Read all sampled registers of a core, and decode them */
+static void msr_sample_core(MsrData *m_data, unsigned core);
+
+
+#endif /* _MSR_H_ */
@@ -0,0 +1,666 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE record.c
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <libintl.h>
+#include "record.h"
+#include "cpu-x.h"
+
+
+/************************* Public functions *************************/
+
+/* Start recording all samples produced by collectors in a file */
+int record_open(Labels *data, const char *path)
+{
+	int fd;
+	unsigned s, row;
+	size_t static_size = 0;
+	char *static_buff;
+	RecWriter *w;
+	RecHeader header = { .magic = RECORD_MAGIC, .version = RECORD_VERSION, .metric_count = LASTMETRIC };
+	static const uint32_t scales[LASTUNIT] =
+	{
+		[UNIT_NONE] = 100, [UNIT_MHZ] = 100, [UNIT_VOLT] = 10000, [UNIT_CELSIUS] = 100,
+		[UNIT_PERCENT] = 100, [UNIT_MBPS] = 100, [UNIT_MB] = 1, [UNIT_SECOND] = 1
+	};
+
+	if((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644)) < 0)
+	{
+		MSG_ERROR(_("failed to create recording %s"), path);
+		return 1;
+	}
+
+	header.core_count   = data->u_data->core_count;
+	header.series_count = RECORD_SERIES(header.core_count);
+	header.start        = record_now();
+	w = calloc(1, sizeof(RecWriter));
+	if(w != NULL)
+	{
+		w->series  = calloc(header.series_count, sizeof(RecSeries));
+		w->state   = calloc(header.series_count, sizeof(RecState));
+		w->present = calloc(header.series_count, sizeof(bool));
+		w->value   = calloc(header.series_count, sizeof(int64_t));
+	}
+	if(w == NULL || w->series == NULL || w->state == NULL || w->present == NULL || w->value == NULL)
+	{
+		MSG_ERROR(_("failed to allocate memory for recording"));
+		close(fd);
+		return 2;
+	}
+
+	/* Values are stored as fixed-point integers, with the resolution shown in labels */
+	for(s = 0; s < header.series_count; s++)
+	{
+		if(s < LASTMETRIC)
+		{
+			snprintf(w->series[s].name, RECORD_NAME, "%s", metric_name(s));
+			w->series[s].scale = (metric_value_type(s) == TYPE_INT) ? 1 : scales[metric_unit_type(s)];
+			w->series[s].codec = (metric_value_type(s) == TYPE_INT) ? CODEC_DOD : CODEC_DELTA;
+		}
+		else if(s < RECORD_STATES(header.core_count))
+		{
+			snprintf(w->series[s].name, RECORD_NAME, "cpu%u_usage", s - LASTMETRIC);
+			w->series[s].scale = scales[UNIT_PERCENT];
+			w->series[s].codec = CODEC_DELTA;
+		}
+		else
+		{
+			/* Same rows as UsageData: total, then each logical CPU */
+			row = (s - RECORD_STATES(header.core_count)) / LASTSTAT;
+			if(row == 0)
+				snprintf(w->series[s].name, RECORD_NAME, "cpu_%s", stat_name((s - RECORD_STATES(header.core_count)) % LASTSTAT));
+			else
+				snprintf(w->series[s].name, RECORD_NAME, "cpu%u_%s", row - 1, stat_name((s - RECORD_STATES(header.core_count)) % LASTSTAT));
+			w->series[s].scale = RECORD_STATE_SCALE;
+			w->series[s].codec = CODEC_DELTA;
+		}
+	}
+
+	/* Static labels are embedded, so a recording can be shown on another machine */
+	static_buff = cache_serialize(data, &static_size);
+	header.static_size = static_size;
+	header.header_size = sizeof(RecHeader) + header.series_count * sizeof(RecSeries) + static_size;
+	if(write(fd, &header, sizeof(RecHeader)) != sizeof(RecHeader) ||
+	   write(fd, w->series, header.series_count * sizeof(RecSeries)) != (ssize_t) (header.series_count * sizeof(RecSeries)) ||
+	   (static_size > 0 && write(fd, static_buff, static_size) != (ssize_t) static_size))
+	{
+		MSG_ERROR(_("failed to write recording %s"), path);
+		free(static_buff);
+		close(fd);
+		return 3;
+	}
+	free(static_buff);
+
+	w->fd           = fd;
+	w->core_count   = header.core_count;
+	w->series_count = header.series_count;
+	data->r_data->writer = w;
+
+	MSG_VERBOSE(_("Recording values in %s"), path);
+	record_sample(data);
+
+	return 0;
+}
+
+/* Add values updated since previous call to the recording */
+void record_sample(Labels *data)
+{
+	unsigned id, r, s;
+	bool usage;
+	int64_t now = record_now();
+	RecWriter *w = data->r_data->writer;
+	const MetricStore *m    = data->metrics;
+	const UsageData *u_data = data->u_data;
+
+	if(w == NULL)
+		return;
+
+	/* Interfaces refresh pages one by one: close refreshes make one tick */
+	if(w->pending && now - w->tick_time >= RECORD_COALESCE)
+		record_tick(w);
+	if(!w->pending)
+	{
+		w->pending   = true;
+		w->tick_time = now;
+	}
+
+	/* Usage of all CPUs is computed when usage of selected CPU is updated */
+	usage = m->valid[MT_COREUSAGE] && m->stamp[MT_COREUSAGE] != w->stamp[MT_COREUSAGE];
+	for(id = 0; id < LASTMETRIC; id++)
+	{
+		if(!m->valid[id] || m->stamp[id] == w->stamp[id])
+			continue;
+		w->present[id] = true;
+		w->value[id]   = llround(metric_get(data, id) * w->series[id].scale);
+		w->stamp[id]   = m->stamp[id];
+	}
+
+	for(r = 0; usage && u_data->usage != NULL && r < w->core_count && r < u_data->core_count; r++)
+	{
+		w->present[LASTMETRIC + r] = true;
+		w->value[LASTMETRIC + r]   = llround(u_data->usage[r + 1] * w->series[LASTMETRIC + r].scale);
+	}
+
+	/* Time in each state is only written when it changes */
+	for(r = 0; usage && u_data->percent != NULL && r <= w->core_count && r <= u_data->core_count; r++)
+	{
+		for(s = RECORD_STATES(w->core_count) + r * LASTSTAT, id = 0; id < LASTSTAT; s++, id++)
+		{
+			w->value[s]   = llround(u_data->percent[r * LASTSTAT + id] * RECORD_STATE_SCALE);
+			w->present[s] = !w->state[s].known || w->state[s].value != w->value[s];
+		}
+	}
+}
+
+/* Write pending samples, and close recording or replay */
+void record_close(Labels *data)
+{
+	RecWriter *w = data->r_data->writer;
+	RecReader *r = data->r_data->reader;
+	UsageData *u_data = data->u_data;
+
+	if(w != NULL)
+	{
+		if(w->pending)
+			record_tick(w);
+		record_flush(w);
+		close(w->fd);
+		free(w->series);
+		free(w->state);
+		free(w->present);
+		free(w->value);
+		free(w->buff);
+		free(w);
+		data->r_data->writer = NULL;
+	}
+
+	if(r != NULL)
+	{
+		/* Usage arrays were allocated for replay (no counters) */
+		if(u_data->ticks[0] == NULL)
+		{
+			free(u_data->usage);
+			free(u_data->percent);
+			free(u_data->rate);
+			u_data->usage   = NULL;
+			u_data->percent = NULL;
+			u_data->rate    = NULL;
+		}
+		munmap((void *) r->map, r->size);
+		free(r->series);
+		free(r->offset);
+		free(r->first);
+		free(r->last);
+		free(r->state);
+		free(r);
+		data->r_data->reader = NULL;
+	}
+}
+
+/* Open a recording, and show its values instead of collecting them */
+int replay_open(Labels *data, const char *path)
+{
+	int fd;
+	unsigned rows;
+	struct stat st;
+	RecReader *r;
+	UsageData *u_data = data->u_data;
+
+	if((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+	{
+		MSG_ERROR(_("failed to open recording %s"), path);
+		return 1;
+	}
+
+	if((r = calloc(1, sizeof(RecReader))) == NULL || fstat(fd, &st) || st.st_size < (off_t) sizeof(RecHeader) ||
+	   (r->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+	{
+		MSG_ERROR(_("failed to open recording %s"), path);
+		free(r);
+		close(fd);
+		return 2;
+	}
+	close(fd);
+	r->size = st.st_size;
+	memcpy(&r->header, r->map, sizeof(RecHeader));
+	data->r_data->reader = r;
+
+	/* Series are matched by index with metrics of this version */
+	if(memcmp(r->header.magic, RECORD_MAGIC, sizeof(r->header.magic)) || r->header.version != RECORD_VERSION ||
+	   r->header.metric_count != LASTMETRIC || r->header.series_count != RECORD_SERIES(r->header.core_count) ||
+	   r->header.header_size != sizeof(RecHeader) + r->header.series_count * sizeof(RecSeries) + r->header.static_size ||
+	   r->header.header_size > r->size)
+	{
+		MSG_ERROR(_("%s is not a recording made by this version of %s"), path, PRGNAME);
+		record_close(data);
+		return 3;
+	}
+
+	r->series = malloc(r->header.series_count * sizeof(RecSeries));
+	r->state  = calloc(r->header.series_count, sizeof(RecState));
+	if(r->series == NULL || r->state == NULL || replay_index(r))
+	{
+		MSG_ERROR(_("failed to read recording %s"), path);
+		record_close(data);
+		return 4;
+	}
+	memcpy(r->series, r->map + sizeof(RecHeader), r->header.series_count * sizeof(RecSeries));
+
+	if(r->header.static_size > 0 &&
+	   cache_unserialize(data, (const char *) r->map + sizeof(RecHeader) + r->header.series_count * sizeof(RecSeries),
+	                     r->header.static_size))
+		MSG_WARNING(_("Static data in recording %s is corrupted"), path);
+
+	/* Usage arrays have no counters, like for a daemon snapshot */
+	rows = r->header.core_count + 1;
+	u_data->core_count = r->header.core_count;
+	u_data->usage      = calloc(rows, sizeof(double));
+	u_data->percent    = calloc(rows * LASTSTAT, sizeof(double));
+	u_data->rate       = calloc(rows * LASTSTAT, sizeof(double));
+	if(u_data->usage == NULL || u_data->percent == NULL || u_data->rate == NULL)
+	{
+		MSG_ERROR(_("failed to allocate memory for CPU usage"));
+		record_close(data);
+		return 5;
+	}
+
+	r->chunk = r->chunk_count;
+	r->speed = data->opts->replay_speed;
+	r->start = r->first[0] + llround(data->opts->replay_seek * 1000.0);
+	clock_gettime(CLOCK_MONOTONIC, &r->origin);
+	MSG_VERBOSE(_("Replaying %s: %.0f seconds in %u chunks, at speed %g"), path,
+	            (r->last[r->chunk_count - 1] - r->first[0]) / 1000.0, r->chunk_count, r->speed);
+
+	return 0;
+}
+
+/* Show values recorded at current replay time */
+int replay_read(Labels *data)
+{
+	unsigned id, c, row, s;
+	double val;
+	int64_t time;
+	struct timespec now;
+	RecReader *r = data->r_data->reader;
+	UsageData *u_data = data->u_data;
+	MetricStore *m = data->metrics;
+
+	if(r == NULL)
+		return 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	time = r->start + llround(((now.tv_sec - r->origin.tv_sec) * 1e3 + (now.tv_nsec - r->origin.tv_nsec) / 1e6) * r->speed);
+	if(replay_seek(r, time))
+	{
+		MSG_ERROR(_("recording is corrupted"));
+		return 2;
+	}
+
+	for(id = 0; id < LASTMETRIC; id++)
+	{
+		if(r->state[id].known)
+			metric_set_double(data, id, (double) r->state[id].value / r->series[id].scale);
+		else
+			m->valid[id] = false;
+	}
+
+	for(c = 0; c < r->header.core_count; c++)
+	{
+		id = LASTMETRIC + c;
+		u_data->usage[c + 1] = r->state[id].known ? (double) r->state[id].value / r->series[id].scale : 0.0;
+	}
+	u_data->usage[0] = metric_get(data, MT_USAGE);
+
+	/* Rate is the share of a row, for the CPUs in that row (all of them in total row) */
+	for(row = 0; row <= r->header.core_count; row++)
+	{
+		for(s = 0; s < LASTSTAT; s++)
+		{
+			id  = RECORD_STATES(r->header.core_count) + row * LASTSTAT + s;
+			val = r->state[id].known ? (double) r->state[id].value / r->series[id].scale : 0.0;
+			u_data->percent[row * LASTSTAT + s] = val;
+			u_data->rate[row * LASTSTAT + s]    = val / 100 * ((row == 0) ? r->header.core_count : 1);
+		}
+	}
+	if(data->opts->selected_core < r->header.core_count && r->state[LASTMETRIC + data->opts->selected_core].known)
+		metric_set_double(data, MT_COREUSAGE, u_data->usage[data->opts->selected_core + 1]);
+
+	return 0;
+}
+
+
+/************************* Private functions *************************/
+
+/* Append bits to a chunk */
+static void bits_put(RecWriter *w, uint64_t value, unsigned nbits)
+{
+	while(nbits-- > 0)
+	{
+		if((value >> nbits) & 1)
+			w->buff[w->bit >> 3] |= 0x80 >> (w->bit & 7);
+		w->bit++;
+	}
+}
+
+/* Read bits from a chunk; return 1 after end of chunk */
+static int bits_get(RecReader *r, uint64_t *value, unsigned nbits)
+{
+	if(r->bit + nbits > r->bit_end)
+		return 1;
+
+	*value = 0;
+	while(nbits-- > 0)
+	{
+		*value = (*value << 1) | ((r->map[r->bit >> 3] >> (7 - (r->bit & 7))) & 1);
+		r->bit++;
+	}
+
+	return 0;
+}
+
+/* Encode a signed value: small values use less bits */
+static void encode_int(RecWriter *w, int64_t value)
+{
+	const uint64_t zz = ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+
+	if(zz == 0)
+		bits_put(w, 0x0, 1);
+	else if(zz < (1 << 7))
+		bits_put(w, (0x2ULL << 7) | zz, 2 + 7);
+	else if(zz < (1 << 12))
+		bits_put(w, (0x6ULL << 12) | zz, 3 + 12);
+	else if(zz < (1 << 20))
+		bits_put(w, (0xEULL << 20) | zz, 4 + 20);
+	else
+	{
+		bits_put(w, 0xF, 4);
+		bits_put(w, zz, 64);
+	}
+}
+
+/* Decode a value written by encode_int() */
+static int decode_int(RecReader *r, int64_t *value)
+{
+	int err = 0;
+	unsigned prefix = 0;
+	uint64_t bit = 1, zz = 0;
+	static const unsigned nbits[] = { 0, 7, 12, 20, 64 };
+
+	while(prefix < 4 && !(err = bits_get(r, &bit, 1)) && bit)
+		prefix++;
+	if(!err && prefix > 0)
+		err = bits_get(r, &zz, nbits[prefix]);
+	*value = (int64_t) (zz >> 1) ^ -(int64_t) (zz & 1);
+
+	return err;
+}
+
+/* Current time of realtime clock, in ms */
+static int64_t record_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	return (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/* Write chunk being encoded, and start a new one */
+static int record_flush(RecWriter *w)
+{
+	int err;
+	const size_t len = (w->bit + 7) / 8;
+	struct iovec iov[2] = { { &w->chunk, sizeof(RecChunk) }, { w->buff, len } };
+
+	if(w->chunk.ticks == 0)
+		return 0;
+
+	/* Chunks are appended with one call: a reader never sees a partial header */
+	w->chunk.magic = RECORD_CHUNK_MAGIC;
+	w->chunk.size  = sizeof(RecChunk) + len;
+	err = (writev(w->fd, iov, 2) != (ssize_t) w->chunk.size);
+	w->chunk.ticks = 0;
+	if(err)
+		MSG_ERROR(_("failed to write recording"));
+
+	return err;
+}
+
+/* Encode the tick being filled */
+static void record_tick(RecWriter *w)
+{
+	unsigned s;
+	bool keyframe;
+	int64_t delta;
+	uint8_t *tmp;
+	const size_t need = (RECORD_TICK_BITS(w->series_count) + 7) / 8;
+	RecState *st;
+
+	/* A chunk covers a bounded time, so a crash only loses the last one */
+	if(w->chunk.ticks >= RECORD_CHUNK_TICKS || (w->chunk.ticks > 0 && w->tick_time - w->chunk.first >= RECORD_CHUNK_SPAN))
+		record_flush(w);
+
+	keyframe = (w->chunk.ticks == 0);
+	if(keyframe)
+		w->bit = 0;
+	if(w->bit / 8 + need > w->buff_size)
+	{
+		if((tmp = realloc(w->buff, w->buff_size + need * 64)) == NULL)
+		{
+			MSG_ERROR(_("failed to allocate memory for recording"));
+			return;
+		}
+		memset(tmp + w->buff_size, 0, need * 64);
+		w->buff       = tmp;
+		w->buff_size += need * 64;
+	}
+
+	if(keyframe)
+	{
+		memset(w->buff, 0, w->buff_size);
+		w->chunk.first = w->tick_time;
+		w->time        = w->tick_time;
+		w->delta       = 0;
+	}
+	else
+	{
+		/* Timestamps: difference of differences is 0 with a regular refresh */
+		delta = w->tick_time - w->time;
+		encode_int(w, delta - w->delta);
+		w->delta = delta;
+		w->time  = w->tick_time;
+	}
+
+	/* Each value is preceded by a presence bit; first tick of a chunk contains all known values */
+	for(s = 0; s < w->series_count; s++)
+	{
+		st = &w->state[s];
+		if(!w->present[s] && !(keyframe && st->known))
+		{
+			bits_put(w, 0, 1);
+			continue;
+		}
+		bits_put(w, 1, 1);
+		if(!w->present[s])
+			w->value[s] = st->value;
+
+		if(keyframe)
+		{
+			encode_int(w, w->value[s]);
+			st->delta = 0;
+		}
+		else if(w->series[s].codec == CODEC_DELTA)
+			encode_int(w, w->value[s] - st->value);
+		else
+		{
+			delta = w->value[s] - st->value;
+			encode_int(w, delta - st->delta);
+			st->delta = delta;
+		}
+		st->value     = w->value[s];
+		st->known     = true;
+		w->present[s] = false;
+	}
+
+	w->chunk.last = w->tick_time;
+	w->chunk.ticks++;
+	w->pending = false;
+}
+
+/* Scan chunks to build the time index */
+static int replay_index(RecReader *r)
+{
+	size_t off, alloc = 0;
+	RecChunk chunk;
+
+	/* A truncated last chunk (writer killed) is ignored */
+	for(off = r->header.header_size; off + sizeof(RecChunk) <= r->size; off += chunk.size)
+	{
+		memcpy(&chunk, r->map + off, sizeof(RecChunk));
+		if(chunk.magic != RECORD_CHUNK_MAGIC || chunk.size < sizeof(RecChunk) || off + chunk.size > r->size ||
+		   chunk.ticks == 0)
+			break;
+
+		if(r->chunk_count == alloc)
+		{
+			alloc = alloc ? alloc * 2 : 64;
+			if((r->offset = realloc(r->offset, alloc * sizeof(size_t)))  == NULL ||
+			   (r->first  = realloc(r->first,  alloc * sizeof(int64_t))) == NULL ||
+			   (r->last   = realloc(r->last,   alloc * sizeof(int64_t))) == NULL)
+				return 1;
+		}
+		r->offset[r->chunk_count] = off;
+		r->first[r->chunk_count]  = chunk.first;
+		r->last[r->chunk_count]   = chunk.last;
+		r->chunk_count++;
+	}
+
+	if(r->chunk_count == 0)
+	{
+		MSG_ERROR(_("recording does not contain any value"));
+		return 2;
+	}
+
+	return 0;
+}
+
+/* Decode next tick of current chunk, if its time is not after 'limit'
+   Return 1 if tick was not decoded, -1 if chunk is corrupted */
+static int replay_tick(RecReader *r, int64_t limit)
+{
+	unsigned s;
+	bool keyframe = (r->tick == 0);
+	int64_t value, delta = 0;
+	uint64_t bit = r->bit, present;
+	RecChunk chunk;
+	RecState *st;
+
+	memcpy(&chunk, r->map + r->offset[r->chunk], sizeof(RecChunk));
+	if(r->tick >= chunk.ticks)
+		return 1;
+
+	if(!keyframe)
+	{
+		if(decode_int(r, &delta))
+			return -1;
+		if(r->time + r->delta + delta > limit)
+		{
+			r->bit = bit;
+			return 1;
+		}
+		r->delta += delta;
+		r->time  += r->delta;
+	}
+
+	for(s = 0; s < r->header.series_count; s++)
+	{
+		st = &r->state[s];
+		if(bits_get(r, &present, 1))
+			return -1;
+		if(!present)
+			continue;
+		if(decode_int(r, &value))
+			return -1;
+
+		if(keyframe)
+		{
+			st->value = value;
+			st->delta = 0;
+		}
+		else if(r->series[s].codec == CODEC_DELTA)
+			st->value += value;
+		else
+		{
+			st->delta += value;
+			st->value += st->delta;
+		}
+		st->known = true;
+	}
+	r->tick++;
+
+	return 0;
+}
+
+/* Move decoder to the last tick before 'time' */
+static int replay_seek(RecReader *r, int64_t time)
+{
+	int err;
+	unsigned s, lo = 0, hi = r->chunk_count - 1, mid;
+	RecChunk chunk;
+
+	/* Time index: last chunk starting before 'time' (or first chunk) */
+	while(lo < hi)
+	{
+		mid = (lo + hi + 1) / 2;
+		if(r->first[mid] <= time)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	/* Chunks are decoded from their start; forward moves continue from current tick */
+	if(lo != r->chunk || (r->tick > 0 && r->time > time))
+	{
+		memcpy(&chunk, r->map + r->offset[lo], sizeof(RecChunk));
+		r->chunk   = lo;
+		r->tick    = 0;
+		r->bit     = (r->offset[lo] + sizeof(RecChunk)) * 8;
+		r->bit_end = (r->offset[lo] + chunk.size) * 8;
+		r->time    = chunk.first;
+		r->delta   = 0;
+		for(s = 0; s < r->header.series_count; s++)
+			r->state[s] = (RecState) { .known = false, .value = 0, .delta = 0 };
+	}
+
+	while(!(err = replay_tick(r, time)));
+
+	return (err < 0);
+}
@@ -0,0 +1,163 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE record.h
+*/
+
+#ifndef _RECORD_H_
+#define _RECORD_H_
+
+#include <stddef.h>
+#include <time.h>
+#include "cpu-x.h"
+
+#define RECORD_MAGIC          "CPUXREC"
+#define RECORD_VERSION        2
+#define RECORD_CHUNK_MAGIC    0x4b4e4843     /* "CHNK" */
+#define RECORD_CHUNK_TICKS    3600           /* Max ticks by chunk */
+#define RECORD_CHUNK_SPAN     60000          /* Max time covered by a chunk, in ms (data lost on crash) */
+#define RECORD_COALESCE       250            /* Samples closer than this (in ms) belong to the same tick */
+#define RECORD_NAME           32
+#define RECORD_STATES(core_count) (LASTMETRIC + (core_count)) /* Metrics, then usage of each logical CPU */
+#define RECORD_SERIES(core_count) (RECORD_STATES(core_count) + ((core_count) + 1) * LASTSTAT) /* Then time in each state by row */
+#define RECORD_STATE_SCALE    10             /* Resolution of time in each state (0.1 %): idle CPUs cost one bit */
+
+/* Worst case size of an encoded tick, in bits */
+#define RECORD_TICK_BITS(series_count) (68 + (series_count) * (1 + 68))
+
+enum EnRecordCodecs
+{
+	CODEC_DELTA,                         /* Gauges: difference with previous value */
+	CODEC_DOD                            /* Counters: difference of differences */
+};
+
+/* File layout: header, series table, static labels (cache format), then chunks */
+typedef struct
+{
+	char     magic[8];
+	uint32_t version;
+	uint32_t header_size;                /* Size of header, series table and static labels */
+	uint32_t metric_count;               /* LASTMETRIC of the writer */
+	uint32_t core_count;
+	uint32_t series_count;
+	uint32_t static_size;
+	int64_t  start;                      /* Creation time (realtime clock, in ms) */
+} RecHeader;
+
+typedef struct
+{
+	char     name[RECORD_NAME];
+	uint32_t scale;                      /* Stored value is round(value * scale) */
+	uint32_t codec;
+} RecSeries;
+
+/* A chunk can be decoded alone: its first tick contains all known values */
+typedef struct
+{
+	uint32_t magic;
+	uint32_t size;                       /* Size of chunk, including this header */
+	uint32_t ticks;
+	uint32_t reserved;
+	int64_t  first, last;                /* Time of first and last ticks (realtime clock, in ms) */
+} RecChunk;
+
+/* Encoder or decoder state of a series */
+typedef struct
+{
+	bool     known;
+	int64_t  value, delta;
+} RecState;
+
+typedef struct
+{
+	int       fd;
+	unsigned  core_count, series_count;
+	RecSeries *series;
+	RecState  *state;
+	uint8_t   *buff;                     /* Chunk being encoded */
+	size_t    buff_size;
+	uint64_t  bit;                       /* Position in 'buff', in bits */
+	RecChunk  chunk;
+	int64_t   time, delta;               /* Time of previous tick, and difference with the one before */
+
+	/* Tick being filled */
+	bool      pending;
+	int64_t   tick_time;
+	bool      *present;
+	int64_t   *value;
+	uint64_t  stamp[LASTMETRIC];         /* Last recorded update of each metric */
+} RecWriter;
+
+typedef struct
+{
+	const uint8_t *map;
+	size_t    size;
+	RecHeader header;
+	RecSeries *series;
+	unsigned  chunk_count;
+	size_t    *offset;                   /* Time index: offset, first and last tick of each chunk */
+	int64_t   *first, *last;
+
+	/* Decoder position */
+	unsigned  chunk, tick;
+	uint64_t  bit, bit_end;
+	int64_t   time, delta;
+	RecState  *state;
+
+	/* Replay clock */
+	struct timespec origin;
+	int64_t   start;                     /* Recorded time shown at 'origin' */
+	double    speed;
+} RecReader;
+
+
+/* Append bits to a chunk */
+static void bits_put(RecWriter *w, uint64_t value, unsigned nbits);
+
+/* Read bits from a chunk; return 1 after end of chunk */
+static int bits_get(RecReader *r, uint64_t *value, unsigned nbits);
+
+/* Encode a signed value: small values use less bits */
+static void encode_int(RecWriter *w, int64_t value);
+
+/* Decode a value written by encode_int() */
+static int decode_int(RecReader *r, int64_t *value);
+
+/* Current time of realtime clock, in ms */
+static int64_t record_now(void);
+
+/* Write chunk being encoded, and start a new one */
+static int record_flush(RecWriter *w);
+
+/* Encode the tick being filled */
+static void record_tick(RecWriter *w);
+
+/* Scan chunks to build the time index */
+static int replay_index(RecReader *r);
+
+/* Decode next tick of current chunk, if its time is not after 'limit'
+   Return 1 if tick was not decoded, -1 if chunk is corrupted */
+static int replay_tick(RecReader *r, int64_t limit);
+
+/* Move decoder to the last tick before 'time' */
+static int replay_seek(RecReader *r, int64_t time);
+
+
+#endif /* _RECORD_H_ */
@@ -0,0 +1,179 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE selfstats.c
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <libintl.h>
+#include "selfstats.h"
+#include "cpu-x.h"
+
+
+/************************* Public functions *************************/
+
+/* Count a collector call, its latency (in ms) and its health after the call */
+void selfstats_add(Labels *data, const char *name, double elapsed, bool failed, enum EnHealth health)
+{
+	unsigned i;
+	SelfStat *stat;
+	CoreData *c_data = data->c_data;
+
+	pthread_mutex_lock(&c_data->mutex);
+	if(c_data->stats == NULL && (c_data->stats = calloc(SELFSTATS_MAX, sizeof(SelfStat))) == NULL)
+	{
+		pthread_mutex_unlock(&c_data->mutex);
+		return;
+	}
+
+	/* Names are string literals: compare pointers first */
+	for(i = 0; i < c_data->stat_count && c_data->stats[i].name != name && strcmp(c_data->stats[i].name, name); i++);
+	if(i == c_data->stat_count)
+	{
+		if(c_data->stat_count == SELFSTATS_MAX)
+		{
+			pthread_mutex_unlock(&c_data->mutex);
+			return;
+		}
+		c_data->stats[c_data->stat_count++].name = name;
+	}
+
+	stat = &c_data->stats[i];
+	stat->calls++;
+	stat->failures += failed;
+	stat->health    = health;
+	stat->total    += elapsed;
+	if(elapsed > stat->max)
+		stat->max = elapsed;
+	stat->hist[hist_index(elapsed > 0 ? elapsed * 1000.0 : 0)]++;
+	pthread_mutex_unlock(&c_data->mutex);
+}
+
+/* Format cost of each collector and of whole process (string must be freed) */
+char *selfstats_format(Labels *data)
+{
+	unsigned i;
+	const SelfStat *stats;
+	size_t size;
+	const char *health[] = { [HEALTH_OK] = _("ok"), [HEALTH_DEGRADED] = _("degraded"), [HEALTH_DISABLED] = _("disabled") };
+	double wall, user, sys;
+	char *buff = NULL;
+	FILE *report;
+	struct rusage usage;
+
+	if((report = open_memstream(&buff, &size)) == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&data->c_data->mutex);
+	stats = data->c_data->stats;
+	fprintf(report, "%-24s %-8s %7s %5s %9s %9s %9s %9s %9s %10s\n", _("Collector"), _("State"), _("Calls"), _("Fail"),
+	        _("Mean"), "p50", "p90", "p99", _("Max"), _("Total"));
+	for(i = 0; i < data->c_data->stat_count; i++)
+		fprintf(report, "%-24s %-8s %7lu %5lu %9.3f %9.3f %9.3f %9.3f %9.3f %10.1f\n", stats[i].name, health[stats[i].health],
+		        (unsigned long) stats[i].calls, (unsigned long) stats[i].failures,
+		        stats[i].total / stats[i].calls, hist_percentile(&stats[i], 50), hist_percentile(&stats[i], 90),
+		        hist_percentile(&stats[i], 99), stats[i].max, stats[i].total);
+	fprintf(report, _("(latencies in ms)\n"));
+	pthread_mutex_unlock(&data->c_data->mutex);
+
+	/* Whole process: collectors, interface and benchmarks */
+	wall = process_uptime();
+	if(!getrusage(RUSAGE_SELF, &usage))
+	{
+		user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+		sys  = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+		fprintf(report, _("Process: %.2f s user, %.2f s system (%.2f %% of one CPU over %.1f s), max RSS %.1f MiB\n"),
+		        user, sys, (wall > 0) ? (user + sys) / wall * 100 : 0, wall, usage.ru_maxrss / 1024.0);
+	}
+	fclose(report);
+
+	return buff;
+}
+
+
+/************************* Private functions *************************/
+
+/* Time elapsed since process started, in seconds (0 if unknown) */
+static double process_uptime(void)
+{
+	char line[MAXSTR * 4], *ptr;
+	unsigned long long start_ticks;
+	FILE *file;
+	struct timespec now;
+
+	if((file = fopen("/proc/self/stat", "r")) == NULL)
+		return 0;
+	ptr = fgets(line, sizeof(line), file);
+	fclose(file);
+
+	/* Field 22 is start time, in clock ticks after boot; process name (field 2) can contain spaces */
+	if(ptr == NULL || (ptr = strrchr(line, ')')) == NULL ||
+	   sscanf(ptr + 2, "%*c %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %llu", &start_ticks) != 1)
+		return 0;
+
+	clock_gettime(CLOCK_BOOTTIME, &now);
+	return fmax(now.tv_sec + now.tv_nsec / 1e9 - (double) start_ticks / sysconf(_SC_CLK_TCK), 0);
+}
+
+/* Histogram bucket of a latency (in µs) */
+static unsigned hist_index(uint64_t us)
+{
+	unsigned msb;
+
+	if(us < SELFSTATS_SUB)
+		return us;
+	if(us >> (SELFSTATS_MAX_MSB + 1))
+		us = (1ULL << (SELFSTATS_MAX_MSB + 1)) - 1;
+
+	msb = 63 - __builtin_clzll(us);
+	return (msb - SELFSTATS_SUB_BITS + 1) * SELFSTATS_SUB + ((us >> (msb - SELFSTATS_SUB_BITS)) & (SELFSTATS_SUB - 1));
+}
+
+/* Highest latency (in µs) counted in a histogram bucket */
+static uint64_t hist_value(unsigned index)
+{
+	unsigned shift;
+
+	if(index < 2 * SELFSTATS_SUB)
+		return index;
+
+	shift = index / SELFSTATS_SUB - 1;
+	return ((uint64_t) (SELFSTATS_SUB + index % SELFSTATS_SUB) << shift) + (1ULL << shift) - 1;
+}
+
+/* Latency (in ms) under which 'percent' % of calls completed */
+static double hist_percentile(const SelfStat *stat, double percent)
+{
+	unsigned i;
+	uint64_t count = 0;
+	const uint64_t rank = ceil(stat->calls * percent / 100);
+
+	for(i = 0; i < SELFSTATS_BUCKETS && count < rank; i++)
+		count += stat->hist[i];
+
+	return (i > 0) ? fmin(hist_value(i - 1) / 1000.0, stat->max) : 0;
+}
@@ -0,0 +1,59 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE selfstats.h
+*/
+
+#ifndef _SELFSTATS_H_
+#define _SELFSTATS_H_
+
+#include <stdint.h>
+#include "cpu-x.h"
+
+#define SELFSTATS_MAX         32             /* Max collectors in report */
+#define SELFSTATS_SUB_BITS    3              /* Precision of histogram: 2^SELFSTATS_SUB_BITS buckets by power of two */
+#define SELFSTATS_SUB         (1 << SELFSTATS_SUB_BITS)
+#define SELFSTATS_MAX_MSB     35             /* Longer latencies (about 19 hours, in µs) are clamped */
+#define SELFSTATS_BUCKETS     ((SELFSTATS_MAX_MSB - SELFSTATS_SUB_BITS + 2) * SELFSTATS_SUB)
+
+typedef struct SelfStat
+{
+	const char *name;
+	uint64_t   calls, failures;
+	enum EnHealth health;                    /* Health after last call */
+	double     total, max;                   /* In ms */
+	uint32_t   hist[SELFSTATS_BUCKETS];      /* Latencies in µs: exact below 2*SELFSTATS_SUB, then log-linear */
+} SelfStat;
+
+
+/* Time elapsed since process started, in seconds (0 if unknown) */
+static double process_uptime(void);
+
+/* Histogram bucket of a latency (in µs) */
+static unsigned hist_index(uint64_t us);
+
+/* Highest latency (in µs) counted in a histogram bucket */
+static uint64_t hist_value(unsigned index);
+
+/* Latency (in ms) under which 'percent' % of calls completed */
+static double hist_percentile(const SelfStat *stat, double percent);
+
+
+#endif /* _SELFSTATS_H_ */
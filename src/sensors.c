@@ -0,0 +1,393 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE sensors.c
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <libintl.h>
+#include "sensors.h"
+#include "cpu-x.h"
+
+
+/************************* Public functions *************************/
+
+/* Find hardware sensors (in root directory of 'options'), and open their input files */
+int sensors_init(SensorsData *s_data, const Options *options)
+{
+	unsigned i;
+	long count;
+	char dir[PATH_MAX];
+	DIR *dp;
+	struct dirent *entry;
+	SensorList list = { .input = NULL, .count = 0 };
+
+	count = sysroot_cpu_count(options);
+
+	s_data->opts       = options;
+	s_data->core_count = count;
+	s_data->core_temp  = malloc(count * sizeof(int));
+	if(s_data->core_temp == NULL)
+	{
+		MSG_ERROR(_("failed to allocate memory for sensors"));
+		return 1;
+	}
+	for(i = 0; i < s_data->core_count; i++)
+		s_data->core_temp[i] = -1;
+
+	MSG_VERBOSE(_("Finding hardware sensors"));
+	if((dp = sysroot_opendir(s_data->opts, SYS_HWMON)) != NULL)
+	{
+		while((entry = readdir(dp)) != NULL)
+		{
+			if(entry->d_name[0] == '.')
+				continue;
+			snprintf(dir, sizeof(dir), "%s/%s", SYS_HWMON, entry->d_name);
+			sensor_scan_chip(s_data, &list, dir);
+		}
+		closedir(dp);
+	}
+	sensor_scan_thermal(s_data, &list);
+	sensor_map_cores(s_data, &list);
+	sensor_scan_gpus(s_data);
+	free(list.input);
+	s_data->init = true;
+
+	return (s_data->fd_count == 0);
+}
+
+/* Read a sensor value; 'index' is a logical CPU for SENSOR_CPUTEMP, a GPU for SENSOR_GPUTEMP */
+int sensors_read(SensorsData *s_data, enum EnSensors sensor, unsigned index, double *value)
+{
+	int fd = -1;
+
+	switch(sensor)
+	{
+		case SENSOR_CPUTEMP:
+			fd = (index < s_data->core_count) ? s_data->core_temp[index] : -1;
+			break;
+		case SENSOR_CPUVOLT:
+			fd = s_data->cpu_volt;
+			break;
+		case SENSOR_GPUTEMP:
+			fd = (index < s_data->gpu_count) ? s_data->gpu_temp[index] : -1;
+			break;
+	}
+
+	return !sensor_value(fd, value);
+}
+
+/* Close sensor files and free memory */
+void sensors_close(SensorsData *s_data)
+{
+	unsigned i;
+
+	for(i = 0; i < s_data->fd_count; i++)
+		close(s_data->fds[i]);
+
+	free(s_data->fds);
+	free(s_data->core_temp);
+	free(s_data->gpu_temp);
+	*s_data = (SensorsData) { .init = false, .core_count = 0, .fd_count = 0, .fds = NULL, .core_temp = NULL,
+	                          .cpu_volt = -1, .gpu_count = 0, .gpu_temp = NULL };
+}
+
+
+/************************* Private functions *************************/
+
+/* Read a small sysfs file in 'buff', without trailing newline */
+static bool sensor_read_str(SensorsData *s_data, const char *path, char *buff, size_t size)
+{
+	int fd;
+	ssize_t len;
+
+	if((fd = sysroot_open(s_data->opts, path, O_RDONLY | O_CLOEXEC)) < 0)
+		return false;
+	len = read(fd, buff, size - 1);
+	close(fd);
+	if(len <= 0)
+		return false;
+
+	buff[len] = '\0';
+	buff[strcspn(buff, "\n")] = '\0';
+	return true;
+}
+
+/* Open a sensor input file, and keep it in the pool */
+static int sensor_open(SensorsData *s_data, const char *path)
+{
+	int fd, *tmp;
+
+	if((fd = sysroot_open(s_data->opts, path, O_RDONLY | O_CLOEXEC)) < 0)
+		return -1;
+
+	tmp = realloc(s_data->fds, (s_data->fd_count + 1) * sizeof(int));
+	if(tmp == NULL)
+	{
+		close(fd);
+		return -1;
+	}
+	s_data->fds = tmp;
+	s_data->fds[s_data->fd_count++] = fd;
+
+	return fd;
+}
+
+/* Add a CPU temperature input */
+static void sensor_add_cpu(SensorsData *s_data, SensorList *list, const char *path, int package, int core)
+{
+	int fd;
+	SensorInput *tmp;
+
+	if((fd = sensor_open(s_data, path)) < 0)
+		return;
+
+	tmp = realloc(list->input, (list->count + 1) * sizeof(SensorInput));
+	if(tmp == NULL)
+		return;
+	list->input = tmp;
+	list->input[list->count++] = (SensorInput) { .fd = fd, .package = package, .core = core };
+}
+
+/* Find inputs of a hwmon chip */
+static void sensor_scan_chip(SensorsData *s_data, SensorList *list, const char *dir)
+{
+	int id, package = NOPACKAGE, k10_level = 0;
+	unsigned i, num, first = list->count;
+	char path[PATH_MAX], k10_path[PATH_MAX], name[SENSOR_STR], label[SENSOR_STR], type[5], suffix[6];
+	enum EnChips chip;
+	DIR *dp;
+	struct dirent *entry;
+	const ChipName chips[] =
+	{
+		{ "coretemp", CHIP_CORETEMP }, /* Intel */
+		{ "k10temp",  CHIP_K10TEMP  }, /* AMD */
+		{ "zenpower", CHIP_K10TEMP  },
+		{ NULL,       CHIP_OTHER    }
+	};
+
+	snprintf(path, sizeof(path), "%s/name", dir);
+	if(!sensor_read_str(s_data, path, name, sizeof(name)))
+		return;
+	for(i = 0; chips[i].name != NULL && strcmp(chips[i].name, name); i++);
+	chip = chips[i].chip;
+	snprintf(k10_path, sizeof(k10_path), "%s/temp1_input", dir);
+
+	if((dp = sysroot_opendir(s_data->opts, dir)) == NULL)
+		return;
+	while((entry = readdir(dp)) != NULL)
+	{
+		/* Inputs are identified by their label (e.g. "temp2_label" contains "Core 0") */
+		if(sscanf(entry->d_name, "%4[a-z]%u_%5s", type, &num, suffix) != 3 || strcmp(suffix, "label"))
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+		if(!sensor_read_str(s_data, path, label, sizeof(label)))
+			continue;
+		snprintf(path, sizeof(path), "%s/%s%u_input", dir, type, num);
+
+		if(!strcmp(type, "in") && !strcasecmp(label, "Vcore") && s_data->cpu_volt < 0)
+			s_data->cpu_volt = sensor_open(s_data, path);
+		else if(!strcmp(type, "temp") && chip == CHIP_CORETEMP)
+		{
+			if(sscanf(label, "Package id %i", &id) == 1)
+			{
+				package = id;
+				sensor_add_cpu(s_data, list, path, NOPACKAGE, NOCORE);
+			}
+			else if(sscanf(label, "Core %i", &id) == 1)
+				sensor_add_cpu(s_data, list, path, NOPACKAGE, id);
+		}
+		else if(!strcmp(type, "temp") && chip == CHIP_K10TEMP)
+		{
+			/* Tctl can have an offset, Tdie is the real temperature */
+			if(!strcmp(label, "Tdie") || (!strcmp(label, "Tctl") && k10_level < 1))
+			{
+				k10_level = !strcmp(label, "Tdie") ? 2 : 1;
+				strcpy(k10_path, path);
+			}
+		}
+	}
+	closedir(dp);
+
+	switch(chip)
+	{
+		case CHIP_CORETEMP:
+			/* Package is known after all labels are read */
+			for(i = first; i < list->count; i++)
+				list->input[i].package = package;
+			break;
+		case CHIP_K10TEMP:
+			sensor_add_cpu(s_data, list, k10_path, NOPACKAGE, NOCORE);
+			break;
+		default:
+			break;
+	}
+}
+
+/* Find CPU temperatures in thermal zones (if hwmon does not provide them) */
+static void sensor_scan_thermal(SensorsData *s_data, SensorList *list)
+{
+	char path[PATH_MAX], type[SENSOR_STR];
+	DIR *dp;
+	struct dirent *entry;
+
+	if(list->count > 0 || (dp = sysroot_opendir(s_data->opts, SYS_THERMAL)) == NULL)
+		return;
+
+	while((entry = readdir(dp)) != NULL)
+	{
+		if(strncmp(entry->d_name, "thermal_zone", 12))
+			continue;
+		snprintf(path, sizeof(path), "%s/%s/type", SYS_THERMAL, entry->d_name);
+		if(!sensor_read_str(s_data, path, type, sizeof(type)))
+			continue;
+
+		if(!strcmp(type, "x86_pkg_temp") || !strcmp(type, "cpu-thermal") || !strcmp(type, "cpu_thermal"))
+		{
+			snprintf(path, sizeof(path), "%s/%s/temp", SYS_THERMAL, entry->d_name);
+			sensor_add_cpu(s_data, list, path, NOPACKAGE, NOCORE);
+		}
+	}
+	closedir(dp);
+}
+
+/* Bind a temperature input to each logical CPU */
+static void sensor_map_cores(SensorsData *s_data, SensorList *list)
+{
+	int package, core, score, best;
+	unsigned cpu, i;
+	char path[PATH_MAX], buff[SENSOR_STR];
+
+	for(cpu = 0; cpu < s_data->core_count; cpu++)
+	{
+		snprintf(path, sizeof(path), "%s%u/topology/physical_package_id", SYS_CPU, cpu);
+		package = sensor_read_str(s_data, path, buff, sizeof(buff)) ? atoi(buff) : NOPACKAGE;
+		snprintf(path, sizeof(path), "%s%u/topology/core_id", SYS_CPU, cpu);
+		core    = sensor_read_str(s_data, path, buff, sizeof(buff)) ? atoi(buff) : NOCORE;
+
+		/* Prefer core sensor, then sensor of its package, then any package sensor */
+		for(i = 0, best = 0; i < list->count; i++)
+		{
+			const SensorInput *in = &list->input[i];
+			const bool same_package = (in->package == NOPACKAGE || in->package == package);
+
+			if(in->core != NOCORE)
+				score = (same_package && in->core == core) ? 3 : 0;
+			else
+				score = (in->package == package) ? 2 : (in->package == NOPACKAGE) ? 1 : 0;
+
+			if(score > best)
+			{
+				best = score;
+				s_data->core_temp[cpu] = in->fd;
+			}
+		}
+	}
+}
+
+/* Compare two GPUs by PCI address (used by qsort) */
+static int sensor_cmp_gpu(const void *a, const void *b)
+{
+	const SensorGpu *ga = a, *gb = b;
+
+	return (ga->order > gb->order) - (ga->order < gb->order);
+}
+
+/* Find temperature input of each display controller */
+static void sensor_scan_gpus(SensorsData *s_data)
+{
+	unsigned i, count = 0, domain, bus, dev, func;
+	char path[PATH_MAX], buff[SENSOR_STR];
+	DIR *dp;
+	struct dirent *entry;
+	SensorGpu *gpus = NULL, *tmp;
+
+	if((dp = sysroot_opendir(s_data->opts, SYS_PCI)) == NULL)
+		return;
+	while((entry = readdir(dp)) != NULL)
+	{
+		if(sscanf(entry->d_name, "%x:%x:%x.%x", &domain, &bus, &dev, &func) != 4)
+			continue;
+		snprintf(path, sizeof(path), "%s/%s/class", SYS_PCI, entry->d_name);
+		if(!sensor_read_str(s_data, path, buff, sizeof(buff)) || (strtoul(buff, NULL, 16) >> 16) != PCI_BASE_DISPLAY)
+			continue;
+		if((tmp = realloc(gpus, (count + 1) * sizeof(SensorGpu))) == NULL)
+			break;
+		gpus = tmp;
+		gpus[count].order = PCI_ORDER(domain, bus, dev, func);
+		gpus[count].domain = domain;
+		gpus[count].bus    = bus;
+		gpus[count].dev    = dev;
+		gpus[count].func   = func;
+		count++;
+	}
+	closedir(dp);
+
+	/* GPUs are in same order as in graphics tab */
+	if(count == 0 || (s_data->gpu_temp = malloc(count * sizeof(int))) == NULL)
+	{
+		free(gpus);
+		return;
+	}
+	qsort(gpus, count, sizeof(SensorGpu), sensor_cmp_gpu);
+	s_data->gpu_count = count;
+
+	for(i = 0; i < count; i++)
+	{
+		/* First input of hwmon chip is the GPU die (not labelled by all drivers) */
+		s_data->gpu_temp[i] = -1;
+		/* Device directory is named after its address (see sysfs-bus-pci) */
+		snprintf(path, sizeof(path), "%s/%04x:%02x:%02x.%x/hwmon", SYS_PCI, gpus[i].domain, gpus[i].bus, gpus[i].dev, gpus[i].func);
+		if((dp = sysroot_opendir(s_data->opts, path)) == NULL)
+			continue;
+		while(s_data->gpu_temp[i] < 0 && (entry = readdir(dp)) != NULL)
+		{
+			if(strncmp(entry->d_name, "hwmon", 5))
+				continue;
+			snprintf(path, sizeof(path), "%s/%04x:%02x:%02x.%x/hwmon/%s/temp1_input", SYS_PCI,
+			         gpus[i].domain, gpus[i].bus, gpus[i].dev, gpus[i].func, entry->d_name);
+			s_data->gpu_temp[i] = sensor_open(s_data, path);
+		}
+		closedir(dp);
+	}
+	free(gpus);
+}
+
+/* Read a sensor value (sysfs values are in milli-units) */
+static bool sensor_value(int fd, double *value)
+{
+	char buff[SENSOR_STR];
+	ssize_t len;
+
+	/* File stays open: rewinding with pread() gives a new value */
+	if(fd < 0 || (len = pread(fd, buff, sizeof(buff) - 1, 0)) <= 0)
+		return false;
+
+	buff[len] = '\0';
+	*value    = strtol(buff, NULL, 10) / 1000.0;
+	return true;
+}
@@ -0,0 +1,94 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE sensors.h
+*/
+
+#ifndef _SENSORS_H_
+#define _SENSORS_H_
+
+#include <stdbool.h>
+#include "cpu-x.h"
+
+#define SENSOR_STR            32       /* Max length of a sysfs value */
+#define NOPACKAGE             -1       /* Sensor is not bound to a CPU package */
+#define NOCORE                -1       /* Sensor gives the package temperature */
+#define PCI_BASE_DISPLAY      0x03     /* PCI base class of display controllers */
+
+enum EnChips
+{
+	CHIP_OTHER, CHIP_CORETEMP, CHIP_K10TEMP
+};
+
+typedef struct
+{
+	const char     *name;
+	enum EnChips   chip;
+} ChipName;
+
+typedef struct
+{
+	int fd;
+	int package;   /* Physical package ID, or NOPACKAGE */
+	int core;      /* Core ID in package, or NOCORE */
+} SensorInput;
+
+typedef struct
+{
+	SensorInput *input;
+	unsigned    count;
+} SensorList;
+
+typedef struct
+{
+	uint64_t order;            /* PCI_ORDER() of device */
+	unsigned domain, bus, dev, func;
+} SensorGpu;
+
+
+/* Read a small sysfs file in 'buff', without trailing newline */
+static bool sensor_read_str(SensorsData *s_data, const char *path, char *buff, size_t size);
+
+/* Open a sensor input file, and keep it in the pool */
+static int sensor_open(SensorsData *s_data, const char *path);
+
+/* Add a CPU temperature input */
+static void sensor_add_cpu(SensorsData *s_data, SensorList *list, const char *path, int package, int core);
+
+/* Find inputs of a hwmon chip */
+static void sensor_scan_chip(SensorsData *s_data, SensorList *list, const char *dir);
+
+/* Find CPU temperatures in thermal zones (if hwmon does not provide them) */
+static void sensor_scan_thermal(SensorsData *s_data, SensorList *list);
+
+/* Bind a temperature input to each logical CPU */
+static void sensor_map_cores(SensorsData *s_data, SensorList *list);
+
+/* Compare two GPUs by PCI address (used by qsort) */
+static int sensor_cmp_gpu(const void *a, const void *b);
+
+/* Find temperature input of each display controller */
+static void sensor_scan_gpus(SensorsData *s_data);
+
+/* Read a sensor value (sysfs values are in milli-units) */
+static bool sensor_value(int fd, double *value);
+
+
+#endif /* _SENSORS_H_ */
@@ -0,0 +1,376 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE snapshot.c
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <libintl.h>
+#include "snapshot.h"
+#include "cpu-x.h"
+
+static volatile sig_atomic_t running = 1;
+
+
+/************************* Public functions *************************/
+
+/* Attach to the snapshot of a running daemon (read-only) */
+int snapshot_attach(Labels *data)
+{
+	int fd;
+	struct stat st;
+	Snapshot *snap;
+	SnapshotData *p_data = data->snapshot;
+
+	if((fd = shm_open(SNAPSHOT_NAME, O_RDONLY, 0)) < 0)
+		return 1;
+
+	if(fstat(fd, &st))
+	{
+		close(fd);
+		return 2;
+	}
+
+	/* Values written by another user could be forged: only the current user or root can own the snapshot */
+	if((st.st_uid != getuid() && st.st_uid != 0) || (st.st_mode & (S_IWGRP | S_IWOTH)))
+	{
+		MSG_WARNING(_("Ignoring shared memory object '%s' (owner %u, mode %04o)"), SNAPSHOT_NAME,
+		            (unsigned) st.st_uid, (unsigned) (st.st_mode & 07777));
+		close(fd);
+		return 4;
+	}
+
+	if((size_t) st.st_size < sizeof(Snapshot) ||
+	   (snap = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+	{
+		close(fd);
+		return 2;
+	}
+	close(fd);
+
+	/* Snapshot from another version or from a dead daemon is ignored */
+	if(snap->magic != SNAPSHOT_MAGIC || snap->version != SNAPSHOT_VERSION || snap->size != (uint32_t) st.st_size ||
+	   snap->metric_count != LASTMETRIC || snap->stat_count != LASTSTAT ||
+	   snap->size != snapshot_size(snap->core_count) || !snapshot_alive(snap))
+	{
+		munmap(snap, st.st_size);
+		return 3;
+	}
+
+	MSG_VERBOSE(_("Using values published by daemon (PID %i)"), snap->pid);
+	p_data->map    = snap;
+	p_data->size   = st.st_size;
+	p_data->writer = false;
+
+	return 0;
+}
+
+/* Copy values published by daemon */
+int snapshot_read(Labels *data)
+{
+	unsigned i, id, r, rows;
+	uint32_t seq;
+	double core[SNAPSHOT_CORE_VALUES];
+	const double *row;
+	const enum EnMetrics core_metrics[SNAPSHOT_CORE_VALUES] = { MT_TEMPERATURE, MT_VOLTAGE, MT_MULTIPLIER };
+	const Snapshot *snap = data->snapshot->map;
+	MetricStore *m       = data->metrics;
+	UsageData *u_data    = data->u_data;
+
+	if(snap == NULL || data->snapshot->writer)
+		return 1;
+
+	/* Collectors are used again if daemon stops */
+	if(!snapshot_alive(snap))
+	{
+		MSG_WARNING(_("Daemon is not running anymore, values will be collected by %s"), PRGNAME);
+		snapshot_detach(data);
+		return 2;
+	}
+
+	/* Counters are only needed by collectors, so values can be copied in place */
+	rows = snap->core_count + 1;
+	if(u_data->usage == NULL)
+	{
+		u_data->core_count = snap->core_count;
+		u_data->usage      = calloc(rows, sizeof(double));
+		u_data->percent    = calloc(rows * LASTSTAT, sizeof(double));
+		u_data->rate       = calloc(rows * LASTSTAT, sizeof(double));
+		if(u_data->usage == NULL || u_data->percent == NULL || u_data->rate == NULL)
+		{
+			MSG_ERROR(_("failed to allocate memory for CPU usage"));
+			return 3;
+		}
+	}
+
+	/* Seqlock: retry if writer changed values during the copy; writer never waits */
+	for(i = 0; i < SNAPSHOT_RETRIES; i++)
+	{
+		seq = __atomic_load_n(&snap->seq, __ATOMIC_ACQUIRE);
+		if(seq & 1)
+		{
+			sched_yield();
+			continue;
+		}
+
+		for(id = 0; id < LASTMETRIC; id++)
+			m->valid[id] = snap->valid[id];
+		memcpy(m->ival,  snap->ival,   sizeof(m->ival));
+		memcpy(m->dval,  snap->dval,   sizeof(m->dval));
+		memcpy(m->stamp, snap->mstamp, sizeof(m->stamp));
+		for(r = 0; r < rows; r++)
+		{
+			row = &snap->rows[r * SNAPSHOT_ROW];
+			u_data->usage[r] = row[0];
+			memcpy(&u_data->percent[r * LASTSTAT], &row[1],            LASTSTAT * sizeof(double));
+			memcpy(&u_data->rate[r * LASTSTAT],    &row[1 + LASTSTAT], LASTSTAT * sizeof(double));
+		}
+		if(data->opts->selected_core < snap->core_count)
+			memcpy(core, &snap->rows[(data->opts->selected_core + 1) * SNAPSHOT_ROW + SNAPSHOT_CORE], sizeof(core));
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&snap->seq, __ATOMIC_RELAXED) == seq)
+			break;
+	}
+
+	if(i == SNAPSHOT_RETRIES)
+		return 4;
+
+	/* Values of core selected by this instance, not the ones of core selected by daemon */
+	if(data->opts->selected_core < snap->core_count)
+	{
+		metric_set_double(data, MT_COREUSAGE, u_data->usage[data->opts->selected_core + 1]);
+		for(id = 0; id < SNAPSHOT_CORE_VALUES; id++)
+		{
+			if(core[id] > 0)
+				metric_set_double(data, core_metrics[id], core[id]);
+			else
+				m->valid[core_metrics[id]] = false;
+		}
+	}
+	else
+	{
+		for(id = 0; id < SNAPSHOT_CORE_VALUES; id++)
+			m->valid[core_metrics[id]] = false;
+	}
+
+	return 0;
+}
+
+/* Detach from daemon snapshot */
+void snapshot_detach(Labels *data)
+{
+	SnapshotData *p_data = data->snapshot;
+	UsageData *u_data    = data->u_data;
+
+	/* Usage arrays of a reader have no counters: collectors must start again from scratch */
+	if(p_data->map != NULL && !p_data->writer && u_data->ticks[0] == NULL)
+	{
+		free(u_data->usage);
+		free(u_data->percent);
+		free(u_data->rate);
+		*u_data = (UsageData) { .fd = -1, .buff = NULL, .core_count = 0, .current = 0, .hz = 0, .stamp = { 0 },
+		                        .ticks = { NULL }, .percent = NULL, .rate = NULL, .usage = NULL };
+	}
+
+	if(p_data->map != NULL)
+		munmap(p_data->map, p_data->size);
+	p_data->map  = NULL;
+	p_data->size = 0;
+}
+
+/* Run collectors and publish their values in shared memory, until a signal is received */
+int start_daemon(Labels *data)
+{
+	const enum EnTabNumber pages[] = { NO_CPU, NO_SYSTEM, NO_GRAPHICS };
+	unsigned i;
+	Snapshot *snap;
+	struct timespec delay = { .tv_sec = data->opts->refr_time / 1000, .tv_nsec = (data->opts->refr_time % 1000) * 1000000L };
+
+	if((snap = snapshot_create(data)) == NULL)
+		return 1;
+
+	signal(SIGINT,  daemon_stop);
+	signal(SIGTERM, daemon_stop);
+	signal(SIGHUP,  daemon_stop);
+
+	MSG_VERBOSE(_("Publishing values in shared memory object '%s' every %u ms"), SNAPSHOT_NAME, data->opts->refr_time);
+	snapshot_write(data, snap);
+	while(running)
+	{
+		/* Collection cost does not depend on the number of readers */
+		nanosleep(&delay, NULL);
+		for(i = 0; running && i < sizeof(pages) / sizeof(pages[0]); i++)
+			do_refresh(data, pages[i]);
+		snapshot_write(data, snap);
+	}
+
+	MSG_VERBOSE(_("Removing shared memory object '%s'"), SNAPSHOT_NAME);
+	shm_unlink(SNAPSHOT_NAME);
+	snapshot_detach(data);
+
+	return 0;
+}
+
+
+/************************* Private functions *************************/
+
+/* Size of a snapshot for given logical CPU count */
+static size_t snapshot_size(unsigned core_count)
+{
+	return sizeof(Snapshot) + (core_count + 1) * SNAPSHOT_ROW * sizeof(double);
+}
+
+/* Check if the daemon which owns a snapshot is still running */
+static bool snapshot_alive(const Snapshot *snap)
+{
+	/* EPERM: process exists, but belongs to another user */
+	return snap->pid > 0 && (!kill(snap->pid, 0) || errno == EPERM);
+}
+
+/* Create shared memory object, replacing a stale one */
+static Snapshot *snapshot_create(Labels *data)
+{
+	int fd;
+	const unsigned core_count = data->u_data->core_count;
+	const size_t size = snapshot_size(core_count);
+	Snapshot *snap;
+
+	if(!snapshot_attach(data))
+	{
+		MSG_ERROR(_("a daemon is already running (PID %i)"), ((Snapshot *) data->snapshot->map)->pid);
+		snapshot_detach(data);
+		return NULL;
+	}
+	shm_unlink(SNAPSHOT_NAME);
+
+	if((fd = shm_open(SNAPSHOT_NAME, O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) < 0)
+	{
+		MSG_ERROR(_("failed to create shared memory object '%s'"), SNAPSHOT_NAME);
+		return NULL;
+	}
+
+	/* Readers only need read access, whatever the umask is */
+	fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if(ftruncate(fd, size) || (snap = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+	{
+		MSG_ERROR(_("failed to create shared memory object '%s'"), SNAPSHOT_NAME);
+		close(fd);
+		shm_unlink(SNAPSHOT_NAME);
+		return NULL;
+	}
+	close(fd);
+
+	/* Header is written once; new segment is filled with zeros */
+	snap->magic        = SNAPSHOT_MAGIC;
+	snap->size         = size;
+	snap->metric_count = LASTMETRIC;
+	snap->stat_count   = LASTSTAT;
+	snap->pid          = getpid();
+	snap->refr_time    = data->opts->refr_time;
+	snap->core_count   = core_count;
+	__atomic_store_n(&snap->version, SNAPSHOT_VERSION, __ATOMIC_RELEASE);
+
+	data->snapshot->map    = snap;
+	data->snapshot->size   = size;
+	data->snapshot->writer = true;
+
+	return snap;
+}
+
+/* Values of a CPU which depend on the core (temperature, voltage, multiplier) */
+static void snapshot_core_values(Labels *data, unsigned cpu, double *values)
+{
+	double val;
+	const MsrData *m_data = data->m_data;
+
+	values[0] = values[1] = values[2] = 0.0;
+
+	/* MSR are sampled on every CPU, not only on the one selected by daemon */
+	if(cpu < m_data->core_count && m_data->fd != NULL && m_data->fd[cpu] >= 0)
+	{
+		values[0] = m_data->temperature[cpu];
+		values[1] = m_data->voltage[cpu];
+		values[2] = (m_data->eff_multiplier[cpu] > 0) ? m_data->eff_multiplier[cpu] : m_data->multiplier[cpu];
+	}
+
+	/* Fallback sensors: temperature is by CPU, voltage is for the whole package */
+	if(values[0] <= 0 && data->s_data->init && !sensors_read(data->s_data, SENSOR_CPUTEMP, cpu, &val) && val > 0)
+		values[0] = val;
+	if(values[1] <= 0 && data->s_data->init && !sensors_read(data->s_data, SENSOR_CPUVOLT, 0, &val) && val > 0)
+		values[1] = val;
+
+	/* Fallback multiplier is computed from the CPU clock, not from a selected core */
+	if(values[2] <= 0 && (m_data->fd == NULL || cpu >= m_data->core_count || m_data->fd[cpu] < 0))
+		values[2] = metric_get(data, MT_MULTIPLIER);
+}
+
+/* Publish current values (called by daemon only) */
+static void snapshot_write(Labels *data, Snapshot *snap)
+{
+	unsigned id, r;
+	uint32_t seq = snap->seq;
+	struct timespec now;
+	double *row;
+	const MetricStore *m    = data->metrics;
+	const UsageData *u_data = data->u_data;
+
+	__atomic_store_n(&snap->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	for(id = 0; id < LASTMETRIC; id++)
+		snap->valid[id] = m->valid[id];
+	memcpy(snap->ival,   m->ival,  sizeof(snap->ival));
+	memcpy(snap->dval,   m->dval,  sizeof(snap->dval));
+	memcpy(snap->mstamp, m->stamp, sizeof(snap->mstamp));
+	for(r = 0; r <= snap->core_count; r++)
+	{
+		row = &snap->rows[r * SNAPSHOT_ROW];
+		if(u_data->usage != NULL)
+		{
+			row[0] = u_data->usage[r];
+			memcpy(&row[1],            &u_data->percent[r * LASTSTAT], LASTSTAT * sizeof(double));
+			memcpy(&row[1 + LASTSTAT], &u_data->rate[r * LASTSTAT],    LASTSTAT * sizeof(double));
+		}
+		if(r > 0)
+			snapshot_core_values(data, r - 1, &row[SNAPSHOT_CORE]);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	snap->stamp = (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+
+	__atomic_store_n(&snap->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* Stop daemon loop (signal handler) */
+static void daemon_stop(int signum)
+{
+	(void) signum;
+	running = 0;
+}
@@ -0,0 +1,82 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE snapshot.h
+*/
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <stddef.h>
+#include "cpu-x.h"
+
+#define SNAPSHOT_NAME         "/cpu-x"       /* POSIX shared memory object */
+#define SNAPSHOT_MAGIC        0x58555043     /* "CPUX" */
+#define SNAPSHOT_VERSION      3
+#define SNAPSHOT_RETRIES      1000           /* Reader attempts while writer updates snapshot */
+#define SNAPSHOT_CORE         (1 + 2 * LASTSTAT) /* Usage, percent by state, rate by state, then values below */
+#define SNAPSHOT_CORE_VALUES  3                  /* Temperature, voltage and multiplier of CPU (0 if unknown) */
+#define SNAPSHOT_ROW          (SNAPSHOT_CORE + SNAPSHOT_CORE_VALUES)
+
+/* Layout of shared memory; readers must check 'version' and 'size' */
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;                  /* Size of the whole segment */
+	uint32_t metric_count;          /* LASTMETRIC of the writer */
+	uint32_t stat_count;            /* LASTSTAT of the writer */
+	int32_t  pid;                   /* Daemon PID */
+	uint32_t seq;                   /* Sequence counter, odd while values are written */
+	uint32_t refr_time;             /* Time between two updates, in ms */
+	uint64_t stamp;                 /* Time of last update (monotonic clock, in ns) */
+
+	/* Metric store, indexed by EnMetrics */
+	uint8_t  valid[LASTMETRIC];
+	int64_t  ival[LASTMETRIC];
+	double   dval[LASTMETRIC];
+	uint64_t mstamp[LASTMETRIC];
+
+	/* CPU usage: row 0 is the total, row N + 1 is CPU N */
+	uint32_t core_count;
+	double   rows[];                /* (core_count + 1) rows of SNAPSHOT_ROW values */
+} Snapshot;
+
+
+/* Size of a snapshot for given logical CPU count */
+static size_t snapshot_size(unsigned core_count);
+
+/* Check if the daemon which owns a snapshot is still running */
+static bool snapshot_alive(const Snapshot *snap);
+
+/* Create shared memory object, replacing a stale one */
+static Snapshot *snapshot_create(Labels *data);
+
+/* Values of a CPU which depend on the core (temperature, voltage, multiplier) */
+static void snapshot_core_values(Labels *data, unsigned cpu, double *values);
+
+/* Publish current values (called by daemon only) */
+static void snapshot_write(Labels *data, Snapshot *snap);
+
+/* Stop daemon loop (signal handler) */
+static void daemon_stop(int signum);
+
+
+#endif /* _SNAPSHOT_H_ */
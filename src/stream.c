@@ -0,0 +1,298 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE stream.c
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <math.h>
+#include <libintl.h>
+#include "stream.h"
+#include "cpu-x.h"
+
+static volatile sig_atomic_t running = 1;
+static FILE *out = NULL;
+
+
+/************************* Public functions *************************/
+
+/* Keep stdout for records; messages printed after this call go to stderr */
+int stream_open(void)
+{
+	int fd;
+
+	fflush(stdout);
+	if((fd = dup(STDOUT_FILENO)) < 0 || (out = fdopen(fd, "w")) == NULL)
+	{
+		MSG_ERROR(_("failed to open output stream"));
+		return 1;
+	}
+	dup2(STDERR_FILENO, STDOUT_FILENO);
+	setvbuf(out, NULL, _IOFBF, STREAM_BUFFER);
+
+	return 0;
+}
+
+/* Print a record with all values every 'interval' milliseconds, until a signal is received */
+int start_stream(Labels *data)
+{
+	unsigned i, core_count;
+	uint64_t seq;
+	struct timespec next, now;
+	const enum EnTabNumber pages[] = { NO_CPU, NO_SYSTEM, NO_GRAPHICS, NO_BENCH };
+
+	if(out == NULL && stream_open())
+		return 1;
+
+	signal(SIGINT,  stream_stop);
+	signal(SIGTERM, stream_stop);
+	signal(SIGPIPE, SIG_IGN);
+
+	/* Fields are fixed at start, even if a collector fails later */
+	core_count = data->u_data->core_count;
+	stream_static(data);
+	if(opts->dump_format == FMT_CSV)
+		stream_header(core_count);
+
+	MSG_VERBOSE(_("Streaming values every %u ms"), opts->interval);
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for(seq = 0; running; seq++)
+	{
+		stream_record(data, seq, core_count);
+		if(fflush(out) == EOF || opts->interval == 0)
+			break;
+
+		/* Deadlines are absolute, so refresh time does not shift records; late ticks are skipped */
+		stream_add_ms(&next, opts->interval);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if(now.tv_sec > next.tv_sec || (now.tv_sec == next.tv_sec && now.tv_nsec > next.tv_nsec))
+			next = now;
+		while(running && clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR);
+
+		for(i = 0; running && i < sizeof(pages) / sizeof(pages[0]); i++)
+			do_refresh(data, pages[i]);
+	}
+
+	fclose(out);
+	out = NULL;
+
+	return 0;
+}
+
+
+/************************* Private functions *************************/
+
+/* Print labels of static tabs once: a record in JSON, comment lines in CSV */
+static void stream_static(Labels *data)
+{
+	unsigned i;
+	int j;
+	const bool json = (opts->dump_format != FMT_CSV);
+	const struct Arrays { enum EnObjects object; char **array_name, **array_value; int last; } a[] =
+	{
+		{ TABCPU,         data->tab_cpu[NAME],         data->tab_cpu[VALUE],         LASTCPU                       },
+		{ TABCACHES,      data->tab_caches[NAME],      data->tab_caches[VALUE],      LASTCACHES                    },
+		{ TABMOTHERBOARD, data->tab_motherboard[NAME], data->tab_motherboard[VALUE], LASTMOTHERBOARD               },
+		{ TABMEMORY,      data->tab_memory[NAME],      data->tab_memory[VALUE],      data->dimms_count * RAMFIELDS },
+		{ TABSYSTEM,      data->tab_system[NAME],      data->tab_system[VALUE],      LASTSYSTEM                    },
+		{ TABGRAPHICS,    data->tab_graphics[NAME],    data->tab_graphics[VALUE],    data->gpu_count * GPUFIELDS   }
+	};
+
+	/* Names can be repeated in a tab (one bank or GPU after the other): pairs keep them all, in order */
+	if(json)
+		fputs("{\"static\":{", out);
+	for(i = 0; i < sizeof(a) / sizeof(a[0]); i++)
+	{
+		if(json)
+		{
+			fputs(i ? ",\"" : "\"", out);
+			stream_string(data->objects[a[i].object], json);
+			fputs("\":[", out);
+		}
+		for(j = 0; a[i].array_name != NULL && a[i].array_value != NULL && j < a[i].last; j++)
+		{
+			fputs(json ? (j ? ",[\"" : "[\"") : "# ", out);
+			if(!json)
+			{
+				stream_string(data->objects[a[i].object], json);
+				fputs(": ", out);
+			}
+			stream_string(a[i].array_name[j], json);
+			fputs(json ? "\",\"" : ": ", out);
+			stream_string(a[i].array_value[j], json);
+			fputs(json ? "\"]" : "\n", out);
+		}
+		if(json)
+			fputc(']', out);
+	}
+	if(json)
+		fputs("}}\n", out);
+}
+
+/* Print names of fields (CSV only) */
+static void stream_header(unsigned core_count)
+{
+	unsigned id, r;
+
+	fputs("seq,time", out);
+	for(id = 0; id < LASTMETRIC; id++)
+	{
+		fputc(',', out);
+		stream_name(id);
+	}
+	for(r = 0; r < core_count; r++)
+		fprintf(out, ",cpu%u_usage_percent", r);
+	for(r = 0; r <= core_count; r++)
+	{
+		for(id = 0; id < LASTSTAT; id++)
+		{
+			if(r == 0)
+				fprintf(out, ",cpu_%s_percent", stat_name(id));
+			else
+				fprintf(out, ",cpu%u_%s_percent", r - 1, stat_name(id));
+		}
+	}
+	fputc('\n', out);
+}
+
+/* Print one record with all values */
+static void stream_record(Labels *data, uint64_t seq, unsigned core_count)
+{
+	unsigned id, r;
+	bool known;
+	const bool json = (opts->dump_format != FMT_CSV);
+	const UsageData *u_data = data->u_data;
+	struct timespec now;
+	/* Values are parsed by other programs: decimal separator does not follow locale */
+	const locale_t old_locale = uselocale(c_locale());
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	if(json)
+		fprintf(out, "{\"seq\":%" PRIu64 ",\"time\":%lld.%03ld", seq, (long long) now.tv_sec, now.tv_nsec / 1000000);
+	else
+		fprintf(out, "%" PRIu64 ",%lld.%03ld", seq, (long long) now.tv_sec, now.tv_nsec / 1000000);
+
+	for(id = 0; id < LASTMETRIC; id++)
+	{
+		if(json)
+		{
+			fputs(",\"", out);
+			stream_name(id);
+			fputs("\":", out);
+		}
+		else
+			fputc(',', out);
+
+		stream_value(metric_valid(data, id), metric_get(data, id), "%.10g", json);
+	}
+
+	for(r = 0; r < core_count; r++)
+	{
+		if(json)
+			fprintf(out, ",\"cpu%u_usage_percent\":", r);
+		else
+			fputc(',', out);
+
+		known = (u_data->usage != NULL && r < u_data->core_count);
+		stream_value(known, known ? u_data->usage[r + 1] : 0.0, "%.4g", json);
+	}
+
+	/* Time in each state: total, then each logical CPU */
+	for(r = 0; r <= core_count; r++)
+	{
+		for(id = 0; id < LASTSTAT; id++)
+		{
+			if(json && r == 0)
+				fprintf(out, ",\"cpu_%s_percent\":", stat_name(id));
+			else if(json)
+				fprintf(out, ",\"cpu%u_%s_percent\":", r - 1, stat_name(id));
+			else
+				fputc(',', out);
+
+			known = (u_data->percent != NULL && r <= u_data->core_count);
+			stream_value(known, known ? u_data->percent[r * LASTSTAT + id] : 0.0, "%.4g", json);
+		}
+	}
+
+	fputs(json ? "}\n" : "\n", out);
+	uselocale(old_locale);
+}
+
+/* Print a value; missing and non-finite values are null in JSON, and empty in CSV */
+static void stream_value(bool valid, double value, const char *fmt, bool json)
+{
+	if(valid && isfinite(value))
+		fprintf(out, fmt, value);
+	else if(json)
+		fputs("null", out);
+}
+
+/* Print a label, escaped for a JSON string; in CSV comments, line breaks are replaced by spaces */
+static void stream_string(const char *str, bool json)
+{
+	for(; str != NULL && *str != '\0'; str++)
+	{
+		if(json && (*str == '"' || *str == '\\'))
+			fprintf(out, "\\%c", *str);
+		else if((unsigned char) *str < 0x20 && json)
+			fprintf(out, "\\u%04x", *str);
+		else if((unsigned char) *str < 0x20)
+			fputc(' ', out);
+		else
+			fputc(*str, out);
+	}
+}
+
+/* Print a field name, with its unit suffix */
+static void stream_name(enum EnMetrics id)
+{
+	static const char *suffix[LASTUNIT] =
+	{
+		"", "_mhz", "_volts", "_celsius", "_percent", "_mbps", "_mb", "_seconds"
+	};
+
+	fprintf(out, "%s%s", metric_name(id), suffix[metric_unit_type(id)]);
+}
+
+/* Add milliseconds to a time */
+static void stream_add_ms(struct timespec *ts, unsigned ms)
+{
+	ts->tv_sec  += ms / 1000;
+	ts->tv_nsec += (ms % 1000) * 1000000L;
+	if(ts->tv_nsec >= 1000000000L)
+	{
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+/* Stop stream loop (signal handler) */
+static void stream_stop(int signum)
+{
+	(void) signum;
+	running = 0;
+}
@@ -0,0 +1,59 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE stream.h
+*/
+
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+#include <stdio.h>
+#include <time.h>
+#include "cpu-x.h"
+
+#define STREAM_BUFFER         65536          /* Size of output buffer, flushed once by record */
+
+
+/* Print labels of static tabs once: a record in JSON, comment lines in CSV */
+static void stream_static(Labels *data);
+
+/* Print names of fields (CSV only) */
+static void stream_header(unsigned core_count);
+
+/* Print one record with all values */
+static void stream_record(Labels *data, uint64_t seq, unsigned core_count);
+
+/* Print a value; missing and non-finite values are null in JSON, and empty in CSV */
+static void stream_value(bool valid, double value, const char *fmt, bool json);
+
+/* Print a label, escaped for a JSON string; in CSV comments, line breaks are replaced by spaces */
+static void stream_string(const char *str, bool json);
+
+/* Print a field name, with its unit suffix */
+static void stream_name(enum EnMetrics id);
+
+/* Add milliseconds to a time */
+static void stream_add_ms(struct timespec *ts, unsigned ms);
+
+/* Stop stream loop (signal handler) */
+static void stream_stop(int signum);
+
+
+#endif /* _STREAM_H_ */
@@ -24,6 +24,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <poll.h>
 #include <ncurses.h>
 #include <math.h>
 #include <libintl.h>
@@ -31,6 +32,7 @@
 #include "tui_ncurses.h"
 
 static int  page = NO_CPU;
+static unsigned first_device = 0; /* First bank or card shown in Memory and Graphics tabs */
 static void (*func_ptr[])(WINDOW*, const SizeInfo, Labels*) =
 {
 	ntab_cpu,
@@ -68,6 +70,11 @@ void start_tui_ncurses(Labels *data)
 	const SizeInfo info = { .height = LINE_COUNT, .width = 70, .start = 1, .tb = 2, .tm = 26, .te = 48 };
 	NThrd refr = { .data = data, .info = info };
 	WINDOW *win;
+	struct pollfd fds[] =
+	{
+		{ .fd = STDIN_FILENO,        .events = POLLIN },
+		{ .fd = refresh_start(data), .events = POLLIN }
+	};
 
 	MSG_VERBOSE(_("Starting NCurses TUI..."));
 	setenv("TERMINFO", "/lib/terminfo", 0);
@@ -99,12 +106,20 @@ void start_tui_ncurses(Labels *data)
 	refresh();
 	main_win(win, info, data);
 	ntab_cpu(win, info, data);
-	timeout(opts->refr_time * 1000);
+	nsubscribe(data);
+	timeout(0);
 	printw(_("Press 'h' to see help.\n"));
 
 	while(ch != 'q')
 	{
-		ch = getch();
+		/* Sleep until a key is pressed or collectors are due */
+		if((ch = getch()) == ERR)
+		{
+			if(poll(fds, sizeof(fds) / sizeof(fds[0]), -1) > 0 && (fds[1].revents & POLLIN))
+				nrefresh(&refr);
+			continue;
+		}
+
 		switch(ch)
 		{
 			case KEY_LEFT:
@@ -112,8 +127,10 @@ void start_tui_ncurses(Labels *data)
 				if(page > NO_CPU)
 				{
 					page--;
+					first_device = 0;
 					main_win(win, info, data);
 					(*func_ptr[page])(win, info, data);
+					nsubscribe(data);
 				}
 				break;
 			case KEY_RIGHT:
@@ -121,8 +138,10 @@ void start_tui_ncurses(Labels *data)
 				if(page < NO_ABOUT)
 				{
 					page++;
+					first_device = 0;
 					main_win(win, info, data);
 					(*func_ptr[page])(win, info, data);
+					nsubscribe(data);
 				}
 				break;
 			case KEY_DOWN:
@@ -141,16 +160,23 @@ void start_tui_ncurses(Labels *data)
 					data->b_data->duration--;
 					print_paramduration(win, info, data);
 				}
+				else if((page == NO_MEMORY   && first_device + BANKS_SHOWN < data->dimms_count) ||
+				        (page == NO_GRAPHICS && first_device + CARDS_SHOWN < data->gpu_count))
+				{
+					first_device++;
+					main_win(win, info, data);
+					(*func_ptr[page])(win, info, data);
+				}
 				break;
 			case KEY_NPAGE:
-				if(page == NO_BENCH && data->b_data->threads > 1 && !data->b_data->run)
+				if(page == NO_BENCH && data->b_data->threads > 1 && benchmarks_idle(data))
 				{
 					data->b_data->threads--;
 					print_paramthreads(win, info, data);
 				}
 				break;
 			case KEY_UP:
-				if(page == NO_CPU && (int) opts->selected_core < data->cpu_count - 1)
+				if(page == NO_CPU && opts->selected_core + 1 < data->cpu_count)
 				{
 					opts->selected_core++;
 					print_activecore(win);
@@ -165,9 +191,15 @@ void start_tui_ncurses(Labels *data)
 					data->b_data->duration++;
 					print_paramduration(win, info, data);
 				}
+				else if((page == NO_MEMORY || page == NO_GRAPHICS) && first_device > 0)
+				{
+					first_device--;
+					main_win(win, info, data);
+					(*func_ptr[page])(win, info, data);
+				}
 				break;
 			case KEY_PPAGE:
-				if(page == NO_BENCH && data->b_data->threads < data->cpu_count && !data->b_data->run)
+				if(page == NO_BENCH && data->b_data->threads < data->cpu_count && benchmarks_idle(data))
 				{
 					data->b_data->threads++;
 					print_paramthreads(win, info, data);
@@ -176,20 +208,42 @@ void start_tui_ncurses(Labels *data)
 			case 'f':
 				if(page == NO_BENCH && !data->b_data->run)
 				{
-					data->b_data->fast_mode = true;
+					/* Mode is used by threads of a stopping benchmark */
+					if(benchmarks_idle(data))
+						data->b_data->mode = BENCH_PRIMEFAST;
 					start_benchmarks(data);
 				}
 				else if(page == NO_BENCH && data->b_data->run)
-					data->b_data->run = false;
+					stop_benchmarks(data);
 				break;
 			case 's':
 				if(page == NO_BENCH && !data->b_data->run)
 				{
-					data->b_data->fast_mode = false;
+					if(benchmarks_idle(data))
+						data->b_data->mode = BENCH_PRIMESLOW;
+					start_benchmarks(data);
+				}
+				else if(page == NO_BENCH && data->b_data->run)
+					stop_benchmarks(data);
+				break;
+			case 'e':
+				if(page == NO_BENCH && !data->b_data->run)
+				{
+					if(benchmarks_idle(data))
+						data->b_data->mode = BENCH_SIEVE;
 					start_benchmarks(data);
 				}
 				else if(page == NO_BENCH && data->b_data->run)
-					data->b_data->run = false;
+					stop_benchmarks(data);
+				break;
+			case 'D':
+				/* Hidden diagnostics panel */
+				erase();
+				print_selfstats(data);
+				erase();
+				refresh();
+				main_win(win, info, data);
+				(*func_ptr[page])(win, info, data);
 				break;
 			case 'h':
 				erase();
@@ -199,11 +253,6 @@ void start_tui_ncurses(Labels *data)
 				main_win(win, info, data);
 				(*func_ptr[page])(win, info, data);
 				break;
-			case ERR:
-				/* Refresh dynamic labels */
-				if(page == NO_CPU || page == NO_CACHES || page == NO_SYSTEM || page == NO_GRAPHICS || page == NO_BENCH)
-					nrefresh(&refr);
-				break;
 			case KEY_RESIZE:
 				/* Resize window */
 				erase();
@@ -312,7 +361,9 @@ static void nrefresh(NThrd *refr)
 	Labels *(data) = refr->data;
 	SizeInfo info  = refr->info;
 
-	do_refresh(data, page);
+	/* Nothing to draw when no shown value was updated */
+	if(!(refresh_dispatch(data) & data->refresh->subscribed))
+		return;
 
 	switch(page)
 	{
@@ -338,9 +389,10 @@ static void nrefresh(NThrd *refr)
 			break;
 		case NO_GRAPHICS:
 			line = LINE_3;
-			for(i = 0; i < data->gpu_count; i += GPUFIELDS)
+			for(i = first_device; i < (int) data->gpu_count && i < (int) (first_device + CARDS_SHOWN); i++)
 			{
-				mvwprintw2c(win, line, info.tb, "%13s: %s", data->tab_graphics[NAME][GPU1TEMPERATURE + i], data->tab_graphics[VALUE][GPU1TEMPERATURE + i]);
+				mvwprintw2c(win, line, info.tb, "%13s: %s", data->tab_graphics[NAME][i * GPUFIELDS + GPUTEMPERATURE],
+				            data->tab_graphics[VALUE][i * GPUFIELDS + GPUTEMPERATURE]);
 				line += GPUFIELDS + 2;
 			}
 			break;
@@ -349,6 +401,8 @@ static void nrefresh(NThrd *refr)
 			mvwprintw2c(win, LINE_2, info.tb, "%13s: %s", data->tab_bench[NAME][PRIMESLOWRUN],   data->tab_bench[VALUE][PRIMESLOWRUN]);
 			mvwprintw2c(win, LINE_5, info.tb, "%13s: %s", data->tab_bench[NAME][PRIMEFASTSCORE], data->tab_bench[VALUE][PRIMEFASTSCORE]);
 			mvwprintw2c(win, LINE_6, info.tb, "%13s: %s", data->tab_bench[NAME][PRIMEFASTRUN],   data->tab_bench[VALUE][PRIMEFASTRUN]);
+			mvwprintw2c(win, LINE_9, info.tb, "%13s: %s", data->tab_bench[NAME][SIEVESCORE],     data->tab_bench[VALUE][SIEVESCORE]);
+			mvwprintw2c(win, LINE_10, info.tb, "%13s: %s", data->tab_bench[NAME][SIEVERUN],      data->tab_bench[VALUE][SIEVERUN]);
 			break;
 		default:
 			break;
@@ -357,6 +411,12 @@ static void nrefresh(NThrd *refr)
 	wrefresh(win);
 }
 
+/* Collect only values shown in current page */
+static void nsubscribe(Labels *data)
+{
+	refresh_subscribe(data, (page == NO_BENCH) ? METRIC_BENCH : metrics_page_mask(page));
+}
+
 /* Print how to use this TUI */
 static void print_help()
 {
@@ -380,6 +440,10 @@ static void print_help()
 	printw(_("\tPress 'down' key to switch to previous test.\n"));
 	printw(_("\tPress 'up' key' to switch to next test.\n"));
 
+	printw(_("\nMemory and Graphics tabs:\n"));
+	printw(_("\tPress 'down' key to scroll to next devices.\n"));
+	printw(_("\tPress 'up' key to scroll to previous devices.\n"));
+
 	printw(_("\nBench tab:\n"));
 	printw(_("\tPress 'down' key to decrement benchmark duration.\n"));
 	printw(_("\tPress 'up' key to increment benchmark duration.\n"));
@@ -387,13 +451,30 @@ static void print_help()
 	printw(_("\tPress 'previous page' key to increment number of threads to use.\n"));
 	printw(_("\tPress 's' key to start/stop prime numbers (slow) benchmark.\n"));
 	printw(_("\tPress 'f' key to start/stop prime numbers (fast) benchmark.\n"));
+	printw(_("\tPress 'e' key to start/stop prime numbers (sieve) benchmark.\n"));
 
 	printw(_("\nPress any key to exit this help.\n"));
 
 	refresh();
 	getch();
 	nodelay(stdscr, TRUE);
-	timeout(opts->refr_time * 1000);
+}
+
+/* Print cost of each collector and of CPU-X */
+static void print_selfstats(Labels *data)
+{
+	char *report;
+
+	nodelay(stdscr, FALSE);
+	printw(_("%s diagnostics\n\n"), PRGNAME);
+	if((report = selfstats_format(data)) != NULL)
+		printw("%s", report);
+	free(report);
+	printw(_("\nPress any key to exit this panel.\n"));
+
+	refresh();
+	getch();
+	nodelay(stdscr, TRUE);
 }
 
 /* Ask for update when a new version is available (portable version only) */
@@ -584,12 +665,13 @@ static void ntab_motherboard(WINDOW *win, const SizeInfo info, Labels *data)
 /* Memory tab */
 static void ntab_memory(WINDOW *win, const SizeInfo info, Labels *data)
 {
-	int i, line;
+	unsigned i, line, last;
 
-	/* Banks frame */
-	frame(win, LINE_0, info.start, LINE_0 + data->dimms_count + 1, info.width - 1, data->objects[FRAMBANKS]);
+	/* Banks frame (other banks are shown by scrolling) */
+	last = (first_device + BANKS_SHOWN < data->dimms_count) ? first_device + BANKS_SHOWN : data->dimms_count;
+	frame(win, LINE_0, info.start, LINE_0 + (last - first_device) * RAMFIELDS + 1, info.width - 1, data->objects[FRAMBANKS]);
 	line = LINE_1;
-	for(i = BANK0_0; i < data->dimms_count; i++)
+	for(i = first_device * RAMFIELDS; i < last * RAMFIELDS; i++)
 		mvwprintw2c(win, line++, info.tb, "%13s: %s", data->tab_memory[NAME][i], data->tab_memory[VALUE][i]);
 
 	wrefresh(win);
@@ -626,13 +708,13 @@ static void draw_bar(WINDOW *win, const SizeInfo info, Labels *data, int bar)
 	const int val = 39, start = 46, end = info.width - 3, size = end - start;
 	double percent;
 
-	if((bar == SWAP && data->m_data->swap_total == 0) || (bar != SWAP && data->m_data->mem_total == 0))
+	if((bar == SWAP && metric_get(data, MT_SWAPTOTAL) <= 0) || (bar != SWAP && metric_get(data, MT_MEMTOTAL) <= 0))
 		return;
 
 	line      = bar - USED + LINE_8;
 	color     = YELLOW_BAR_COLOR + bar - USED;
 	before    = (bar == USED) ? 0 : before;
-	percent   = (double) data->m_data->mem_usage[bar - USED] / ((bar == SWAP) ? data->m_data->swap_total : data->m_data->mem_total);
+	percent   = metric_get(data, MT_MEMUSED + bar - USED) / metric_get(data, (bar == SWAP) ? MT_SWAPTOTAL : MT_MEMTOTAL);
 	bar_count = (int) roundf(percent * (size - 1));
 	if(0.0 < percent && bar_count < 1)
 	{
@@ -664,18 +746,21 @@ static void draw_bar(WINDOW *win, const SizeInfo info, Labels *data, int bar)
 /* Graphics tab */
 static void ntab_graphics(WINDOW *win, const SizeInfo info, Labels *data)
 {
-	int i, line, start = LINE_0, end = LINE_4;
+	unsigned i, line, last, start = LINE_0, end = LINE_4;
+	char title[MAXSTR];
 
-	/* Card frames */
+	/* Card frames (other cards are shown by scrolling) */
 	line = LINE_1;
-	for(i = GPU1VENDOR; i < data->gpu_count * GPUFIELDS; i++)
+	last = (first_device + CARDS_SHOWN < data->gpu_count) ? first_device + CARDS_SHOWN : data->gpu_count;
+	for(i = first_device * GPUFIELDS; i < last * GPUFIELDS; i++)
 	{
-		if(i % GPUFIELDS == 0)
+		if(i % GPUFIELDS == GPUVENDOR)
 		{
-			frame(win, start, info.start, end, info.width - 1, data->objects[FRAMGPU1 + i / GPUFIELDS]);
+			snprintf(title, sizeof(title), data->objects[FRAMCARD], i / GPUFIELDS);
+			frame(win, start, info.start, end, info.width - 1, title);
 			start = end + 1;
-			end += 5;
-			if(i > 0)
+			end += GPUFIELDS + 2;
+			if(i > first_device * GPUFIELDS)
 				line += 2;
 		}
 		mvwprintw2c(win, line++, 2, "%13s: %s", data->tab_graphics[NAME][i], data->tab_graphics[VALUE][i]);
@@ -688,7 +773,7 @@ static void ntab_graphics(WINDOW *win, const SizeInfo info, Labels *data)
 static void print_paramduration(WINDOW *win, const SizeInfo info, Labels *data)
 {
 	iasprintf(&data->tab_bench[VALUE][PARAMDURATION], _("%u mins"), data->b_data->duration);
-	mvwprintw2c(win, LINE_9, info.tb, "%13s: %s", data->tab_bench[NAME][PARAMDURATION], data->tab_bench[VALUE][PARAMDURATION]);
+	mvwprintw2c(win, LINE_13, info.tb, "%13s: %s", data->tab_bench[NAME][PARAMDURATION], data->tab_bench[VALUE][PARAMDURATION]);
 	wrefresh(win);
 }
 
@@ -696,7 +781,7 @@ static void print_paramduration(WINDOW *win, const SizeInfo info, Labels *data)
 static void print_paramthreads(WINDOW *win, const SizeInfo info, Labels *data)
 {
 	iasprintf(&data->tab_bench[VALUE][PARAMTHREADS], "%u", data->b_data->threads);
-	mvwprintw2c(win, LINE_9, info.tm, "%13s: %s", data->tab_bench[NAME][PARAMTHREADS],  data->tab_bench[VALUE][PARAMTHREADS]);
+	mvwprintw2c(win, LINE_13, info.tm, "%13s: %s", data->tab_bench[NAME][PARAMTHREADS],  data->tab_bench[VALUE][PARAMTHREADS]);
 	wrefresh(win);
 }
 
@@ -714,11 +799,17 @@ static void ntab_bench(WINDOW *win, const SizeInfo info, Labels *data)
 	/* Prime numbers (fast) frame */
 	frame(win, LINE_4, info.start , LINE_7, info.width - 1, data->objects[FRAMPRIMEFAST]);
 	line = LINE_5;
-	for(i = PRIMEFASTSCORE; i < PARAMDURATION; i++)
+	for(i = PRIMEFASTSCORE; i < SIEVESCORE; i++)
+		mvwprintw2c(win, line++, info.tb, "%13s: %s", data->tab_bench[NAME][i], data->tab_bench[VALUE][i]);
+
+	/* Prime numbers (sieve) frame */
+	frame(win, LINE_8, info.start , LINE_11, info.width - 1, data->objects[FRAMSIEVE]);
+	line = LINE_9;
+	for(i = SIEVESCORE; i < PARAMDURATION; i++)
 		mvwprintw2c(win, line++, info.tb, "%13s: %s", data->tab_bench[NAME][i], data->tab_bench[VALUE][i]);
 
 	/* Parameters frame */
-	frame(win, LINE_8, info.start , LINE_10, info.width - 1, data->objects[FRAMPARAM]);
+	frame(win, LINE_12, info.start , LINE_14, info.width - 1, data->objects[FRAMPARAM]);
 	print_paramduration(win, info, data);
 	print_paramthreads (win, info, data);
 
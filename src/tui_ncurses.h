@@ -56,6 +56,9 @@ enum EnLines
 	LINE_COUNT
 };
 
+#define BANKS_SHOWN           ((LINE_18 - LINE_0 - 1) / RAMFIELDS)  /* Banks which fit in Memory tab */
+#define CARDS_SHOWN           ((LINE_18 - LINE_0 + 1) / (GPUFIELDS + 2)) /* Cards which fit in Graphics tab */
+
 enum EnColors
 {
 	DEFAULT_COLOR = 1,
@@ -104,9 +107,15 @@ static int mvwprintw2c(WINDOW *win, int y, int x, const char *fmt, ...);
 /* Refresh dynamic values */
 static void nrefresh(NThrd *refr);
 
+/* Collect only values shown in current page */
+static void nsubscribe(Labels *data);
+
 /* Print how to use this TUI */
 static void print_help(void);
 
+/* Print cost of each collector and of CPU-X */
+static void print_selfstats(Labels *data);
+
 /* Ask for update when a new version is available (portable version only) */
 static void print_new_version(void);
 
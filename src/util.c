@@ -0,0 +1,444 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE util.c
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <dirent.h>
+#include <libintl.h>
+#include "cpu-x.h"
+
+
+/* Options of the process, replaced by main(); library users keep these read-only defaults (quiet, no colors) */
+static Options default_opts = { .output_type  = 0,     .selected_core = 0,        .refr_time     = 1000,
+                                .bw_test      = 0,     .verbose       = false,    .color         = false,
+                                .update       = false, .use_network   = 0,        .use_wget      = false,
+                                .use_daemon   = 0,     .exporter      = NULL,     .interval      = 0,
+                                .dump_format  = FMT_TEXT, .record     = NULL,     .replay        = NULL,
+                                .replay_speed = 1.0,   .replay_seek   = 0,        .use_cache     = false,
+                                .refresh_cache = false, .self_stats   = false,    .sysroot       = NULL,
+                                .capture      = NULL,  .from_capture  = NULL };
+
+char *binary_name = NULL, *new_version = NULL;
+Options *opts = &default_opts;
+
+/* Locale of machine-readable output, created on first use by c_locale() */
+static locale_t locale_c = (locale_t) 0;
+static pthread_once_t locale_c_once = PTHREAD_ONCE_INIT;
+
+
+/************************* Public functions *************************/
+
+/* Add a newline for given string (used by MSG_XXX macros) */
+char *msg_newline(char *color, char *str)
+{
+	static __thread char *buff; /* Collectors can run concurrently */
+
+	asprintf(&buff, "%s%s%s\n", opts->color ? color : DEFAULT, str, DEFAULT);
+
+	return buff;
+}
+
+/* Add a newline and more informations for given string (used by MSG_ERROR macro) */
+char *msg_error(char *color, char *file, int line, char *str)
+{
+	static __thread char *buff; /* Collectors can run concurrently */
+
+	if(errno)
+		asprintf(&buff, "%s%s:%s:%i: %s (%s)%s\n", opts->color ? color : DEFAULT, PRGNAME, file, line, str, strerror(errno), DEFAULT);
+	else
+		asprintf(&buff, "%s%s:%s:%i: %s%s\n", opts->color ? color : DEFAULT, PRGNAME, file, line, str, DEFAULT);
+
+	errno = 0;
+	return buff;
+}
+
+/* The improved asprintf:
+ * - allocate an empty string if input string is null
+ * - only call asprintf if there is no format in input string
+ * - print "valid" args if input string is formatted, or skip them until next arg
+     E.g.: iasprintf(&buff, "%i nm", 32) will allocate "32 nm" string
+           iasprintf(&buff, "%i nm", 0) will allocate an empty string
+	   iasprintf(&buff, "foo %s %s", NULL, "bar") will allocate "foo bar" */
+int iasprintf(char **str, const char *fmt, ...)
+{
+	bool is_format = false, print = true;
+	int arg_int, i, ret = 0;
+	unsigned int arg_uint;
+	double arg_double;
+	char *arg_string, *tmp_fmt = NULL;
+	va_list aptr;
+
+	/* Allocate an empty string */
+	*str    = malloc(1 * sizeof(char));
+	*str[0] = '\0';
+
+	/* Exit if input is null or without format */
+	if(fmt == NULL)
+		return 0;
+	else if(strchr(fmt, '%') == NULL)
+		return asprintf(str, "%s", fmt);
+
+	/* Read format, character by character */
+	va_start(aptr, fmt);
+	for(i = 0; fmt[i] != '\0'; i++)
+	{
+		is_format = fmt[i] == '%' || is_format;
+		if(is_format)
+		{
+			print = true;
+
+			/* Construct the new temporary format */
+			if(fmt[i] == '%')
+				asprintf(&tmp_fmt, "%%s%%");
+			else
+				asprintf(&tmp_fmt, "%s%c", tmp_fmt, fmt[i]);
+
+			/* Extract arg */
+			switch(fmt[i])
+			{
+				case '%':
+					break;
+				case '.':
+				case '0' ... '9':
+				case 'l':
+				case 'L':
+					break;
+				case 'x':
+				case 'X':
+				case 'd':
+				case 'i':
+					is_format = false;
+					arg_int = va_arg(aptr, int);
+					if(arg_int > 0)
+						ret = asprintf(str, tmp_fmt, *str, arg_int);
+					else
+						print = false;
+					break;
+				case 'u':
+					is_format = false;
+					arg_uint = va_arg(aptr, unsigned int);
+					if(arg_uint > 0)
+						ret = asprintf(str, tmp_fmt, *str, arg_uint);
+					else
+						print = false;
+					break;
+				case 'f':
+					is_format = false;
+					arg_double = va_arg(aptr, double);
+					if(arg_double > 0.0)
+						ret = asprintf(str, tmp_fmt, *str,  arg_double);
+					else
+						print = false;
+					break;
+				case 's':
+					is_format = false;
+					arg_string = va_arg(aptr, char *);
+					if(arg_string != NULL)
+						ret = asprintf(str, tmp_fmt, *str, arg_string);
+					else
+						print = false;
+					break;
+				default:
+					is_format = false;
+					asprintf(&tmp_fmt, "unknown format for iasprintf() '%%%c' (need to be implemented)", fmt[i]);
+					MSG_ERROR(tmp_fmt);
+					break;
+			}
+		}
+		else if(print)
+			ret = asprintf(str, "%s%c", *str, fmt[i]);
+	}
+	va_end(aptr);
+
+	if(tmp_fmt != NULL)
+		free(tmp_fmt);
+
+	return ret;
+}
+
+/* Open a file and put its content in buffer ('options' gives root directory, NULL for "/") */
+int fopen_to_str(const Options *options, char *file, char **buffer)
+{
+	FILE *f = NULL;
+
+	if((*buffer = malloc(MAXSTR * sizeof(char))) == NULL)
+		goto error;
+	(*buffer)[0] = '\0';
+
+	if((f = sysroot_fopen(options, file, "r")) == NULL)
+		goto error;
+
+	if(fgets(*buffer, MAXSTR, f) == NULL)
+		goto error;
+
+	(*buffer)[strlen(*buffer) - 1] = '\0';
+	return fclose(f);
+
+error:
+	MSG_ERROR(_("an error occurred while opening file '%s'"), file);
+	return (f == NULL) ? 1 : 2 + fclose(f);
+}
+
+/* Prefix an absolute path with root directory of 'options' (see --sysroot), using 'buff' if needed */
+const char *sysroot_path(const Options *options, const char *path, char *buff, size_t size)
+{
+	if(options == NULL || options->sysroot == NULL || path[0] != '/')
+		return path;
+
+	snprintf(buff, size, "%s%s", options->sysroot, path);
+	return buff;
+}
+
+/* open() in root directory of 'options'; file is added to capture if 'options' records one (see --capture) */
+int sysroot_open(const Options *options, const char *path, int flags)
+{
+	int fd;
+	char buff[PATH_MAX];
+
+	if((fd = open(sysroot_path(options, path, buff, sizeof(buff)), flags)) >= 0 && options != NULL && options->capture != NULL)
+		capture_add(path);
+
+	return fd;
+}
+
+/* fopen() in root directory */
+FILE *sysroot_fopen(const Options *options, const char *path, const char *mode)
+{
+	FILE *f;
+	char buff[PATH_MAX];
+
+	if((f = fopen(sysroot_path(options, path, buff, sizeof(buff)), mode)) != NULL && options != NULL && options->capture != NULL)
+		capture_add(path);
+
+	return f;
+}
+
+/* opendir() in root directory */
+DIR *sysroot_opendir(const Options *options, const char *path)
+{
+	DIR *dp;
+	char buff[PATH_MAX];
+
+	if((dp = opendir(sysroot_path(options, path, buff, sizeof(buff)))) != NULL && options != NULL && options->capture != NULL)
+		capture_add(path);
+
+	return dp;
+}
+
+/* access() in root directory */
+int sysroot_access(const Options *options, const char *path, int mode)
+{
+	int ret;
+	char buff[PATH_MAX];
+
+	if(!(ret = access(sysroot_path(options, path, buff, sizeof(buff)), mode)) && options != NULL && options->capture != NULL)
+		capture_add(path);
+
+	return ret;
+}
+
+/* Number of configured logical CPUs (read in root directory if there is one, like sysconf() does) */
+long sysroot_cpu_count(const Options *options)
+{
+	long count = 0, last;
+	char *buff, *p;
+
+	if(options == NULL || options->sysroot == NULL)
+		count = sysconf(_SC_NPROCESSORS_CONF);
+	/* File contains ranges, e.g. "0-3,8-11" */
+	else if(!fopen_to_str(options, SYS_CPU_POSSIBLE, &buff))
+	{
+		for(p = buff; *p != '\0'; p++)
+		{
+			last = strtol(p, &p, 10);
+			if(*p == '-')
+				last = strtol(p + 1, &p, 10);
+			if(last >= count)
+				count = last + 1;
+			if(*p == '\0')
+				break;
+		}
+		free(buff);
+	}
+	else
+		free(buff);
+
+	return (count < 1) ? 1 : count;
+}
+
+/* Create "C" locale (called once by process) */
+static void c_locale_init(void)
+{
+	locale_c = newlocale(LC_ALL_MASK, "C", (locale_t) 0);
+}
+
+/* "C" locale for machine-readable output (decimal separator is always a dot), see uselocale() */
+locale_t c_locale(void)
+{
+	pthread_once(&locale_c_once, c_locale_init);
+	return (locale_c != (locale_t) 0) ? locale_c : LC_GLOBAL_LOCALE;
+}
+
+/* Free memory after display labels */
+void labels_free(Labels *data)
+{
+	unsigned i;
+	int j;
+	const struct Arrays { char **array_name, **array_value; const int last; } a[] =
+	{
+		{ data->tab_cpu[NAME],         data->tab_cpu[VALUE],         LASTCPU                       },
+		{ data->tab_caches[NAME],      data->tab_caches[VALUE],      LASTCACHES                    },
+		{ data->tab_motherboard[NAME], data->tab_motherboard[VALUE], LASTMOTHERBOARD               },
+		{ data->tab_memory[NAME],      data->tab_memory[VALUE],      data->dimms_count * RAMFIELDS },
+		{ data->tab_system[NAME],      data->tab_system[VALUE],      LASTSYSTEM                    },
+		{ data->tab_graphics[NAME],    data->tab_graphics[VALUE],    data->gpu_count * GPUFIELDS   },
+		{ data->tab_bench[NAME],       data->tab_bench[VALUE],       LASTBENCH                     }
+	};
+
+	MSG_VERBOSE(_("Freeing memory"));
+	metrics_unbind(data);
+	msr_close(data->m_data);
+	sensors_close(data->s_data);
+	snapshot_detach(data);
+	record_close(data);
+	refresh_stop(data);
+	/* Tables of devices are kept (with empty values): the GUI still refreshes them */
+	for(i = 0; i < sizeof(a) / sizeof(a[0]); i++)
+	{
+		for(j = 0; j < a[i].last; j++)
+		{
+			free(a[i].array_name[j]);
+			free(a[i].array_value[j]);
+			a[i].array_name[j] = NULL;
+			a[i].array_value[j] = NULL;
+		}
+	}
+	free(data->t_data->cpus);
+	data->t_data->cpus = NULL;
+	/* Counters are still used by running benchmark threads */
+	__atomic_store_n(&data->b_data->run, false, __ATOMIC_RELEASE);
+	pthread_mutex_lock(&data->b_data->slots_lock);
+	if(data->b_data->slots != NULL && __atomic_load_n(&data->b_data->done, __ATOMIC_ACQUIRE))
+	{
+		pthread_mutex_destroy(&data->b_data->gate_lock);
+		pthread_cond_destroy(&data->b_data->gate);
+		free(data->b_data->slots);
+		data->b_data->slots      = NULL;
+		data->b_data->slot_count = 0;
+	}
+	pthread_mutex_unlock(&data->b_data->slots_lock);
+}
+
+/* Set the number of devices in the memory (banks) or graphics (GPUs) tab */
+int labels_resize(Labels *data, enum EnTabNumber page, uint32_t count)
+{
+	uint32_t i, *old_count, fields;
+	char ***tab, **name, **value;
+	double *temp;
+
+	switch(page)
+	{
+		case NO_MEMORY:   tab = data->tab_memory;   old_count = &data->dimms_count; fields = RAMFIELDS; break;
+		case NO_GRAPHICS: tab = data->tab_graphics; old_count = &data->gpu_count;   fields = GPUFIELDS; break;
+		default:          return 1;
+	}
+
+	/* Remove devices: arrays are only freed when they are empty */
+	if(count <= *old_count)
+	{
+		for(i = count * fields; i < *old_count * fields; i++)
+		{
+			free(tab[NAME][i]);
+			free(tab[VALUE][i]);
+		}
+		if(count == 0)
+		{
+			free(tab[NAME]);
+			free(tab[VALUE]);
+			tab[NAME] = tab[VALUE] = NULL;
+			if(page == NO_GRAPHICS)
+			{
+				free(data->gpu_temperature);
+				data->gpu_temperature = NULL;
+			}
+		}
+		*old_count = count;
+		return 0;
+	}
+
+	/* Add devices */
+	if((name = realloc(tab[NAME], count * fields * sizeof(char *))) != NULL)
+		tab[NAME] = name;
+	if(name == NULL || (value = realloc(tab[VALUE], count * fields * sizeof(char *))) == NULL)
+	{
+		MSG_ERROR(_("failed to allocate memory for %u devices"), count);
+		return 2;
+	}
+	tab[VALUE] = value;
+	memset(&name[*old_count * fields],  0, (count - *old_count) * fields * sizeof(char *));
+	memset(&value[*old_count * fields], 0, (count - *old_count) * fields * sizeof(char *));
+	if(page == NO_GRAPHICS)
+	{
+		if((temp = realloc(data->gpu_temperature, count * sizeof(double))) == NULL)
+		{
+			MSG_ERROR(_("failed to allocate memory for %u devices"), count);
+			return 2;
+		}
+		data->gpu_temperature = temp;
+		memset(&temp[*old_count], 0, (count - *old_count) * sizeof(double));
+	}
+
+	for(i = *old_count; i < count; i++)
+	{
+		if(page == NO_MEMORY)
+		{
+			asprintf(&name[i * RAMFIELDS + BANKREFERENCE], _("Bank %i Ref."), (int) i);
+			asprintf(&name[i * RAMFIELDS + BANKTYPE],      _("Bank %i Type"), (int) i);
+		}
+		else
+		{
+			asprintf(&name[i * GPUFIELDS + GPUVENDOR],      _("Vendor"));
+			asprintf(&name[i * GPUFIELDS + GPUMODEL],       _("Model"));
+			asprintf(&name[i * GPUFIELDS + GPUTEMPERATURE], _("Temperature"));
+		}
+	}
+	*old_count = count;
+
+	return 0;
+}
+
+/* Add a device in the memory (banks) or graphics (GPUs) tab */
+int labels_add_device(Labels *data, enum EnTabNumber page)
+{
+	const uint32_t count = (page == NO_MEMORY) ? data->dimms_count : data->gpu_count;
+
+	return labels_resize(data, page, count + 1) ? -1 : (int) count;
+}
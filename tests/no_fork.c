@@ -0,0 +1,123 @@
+/****************************************************************************
+*    Copyright © 2014-2016 Xorg
+*
+*    This program is free software: you can redistribute it and/or modify
+*    it under the terms of the GNU General Public License as published by
+*    the Free Software Foundation, either version 3 of the License, or
+*    (at your option) any later version.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU General Public License for more details.
+*
+*    You should have received a copy of the GNU General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+****************************************************************************/
+
+/*
+* PROJECT CPU-X
+* FILE tests/no_fork.c
+*/
+
+/* Run a command under ptrace, and fail if it (or one of its threads) creates a child process.
+ * Threads are allowed: a new task is a thread if it belongs to the thread group of the command. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define SKIP                  77       /* Test is skipped (ptrace is not allowed), see SKIP_RETURN_CODE */
+
+
+/* Thread group of a task (0 if unknown) */
+static pid_t task_tgid(pid_t tid)
+{
+	pid_t tgid = 0;
+	char path[64], line[128];
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "/proc/%d/status", tid);
+	if((fp = fopen(path, "r")) == NULL)
+		return 0;
+	while(fgets(line, sizeof(line), fp) != NULL)
+	{
+		if(sscanf(line, "Tgid: %d", &tgid) == 1)
+			break;
+	}
+	fclose(fp);
+
+	return tgid;
+}
+
+int main(int argc, char *argv[])
+{
+	int status, event, sig, children = 0, ret = EXIT_FAILURE;
+	pid_t pid, tid;
+	unsigned long msg;
+	const long options = PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL;
+
+	if(argc < 2)
+	{
+		fprintf(stderr, "Usage: %s COMMAND [ARGS...]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if((pid = fork()) == 0)
+	{
+		if(ptrace(PTRACE_TRACEME, 0, NULL, NULL))
+			_exit(SKIP);
+		raise(SIGSTOP);
+		execvp(argv[1], &argv[1]);
+		perror(argv[1]);
+		_exit(127);
+	}
+	if(pid < 0 || waitpid(pid, &status, 0) != pid)
+		return EXIT_FAILURE;
+	if(!WIFSTOPPED(status))
+		return (WIFEXITED(status) && WEXITSTATUS(status) == SKIP) ? SKIP : EXIT_FAILURE;
+	if(ptrace(PTRACE_SETOPTIONS, pid, NULL, (void *) options))
+	{
+		perror("ptrace");
+		kill(pid, SIGKILL);
+		return SKIP;
+	}
+	ptrace(PTRACE_CONT, pid, NULL, NULL);
+
+	/* New tasks are traced too; they start with a SIGSTOP */
+	while((tid = waitpid(-1, &status, __WALL)) > 0)
+	{
+		if(WIFEXITED(status) || WIFSIGNALED(status))
+		{
+			if(tid == pid)
+				ret = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+			continue;
+		}
+
+		sig   = WSTOPSIG(status);
+		event = status >> 16;
+		if(event == PTRACE_EVENT_FORK || event == PTRACE_EVENT_VFORK ||
+		   (event == PTRACE_EVENT_CLONE && !ptrace(PTRACE_GETEVENTMSG, tid, NULL, &msg) && task_tgid(msg) != pid))
+		{
+			ptrace(PTRACE_GETEVENTMSG, tid, NULL, &msg);
+			fprintf(stderr, "Task %d of %s created child process %lu\n", tid, argv[1], msg);
+			children++;
+		}
+		if(event != 0 || sig == SIGSTOP || sig == SIGTRAP)
+			sig = 0;
+		ptrace(PTRACE_CONT, tid, NULL, (void *) (long) sig);
+	}
+
+	if(ret != EXIT_SUCCESS)
+		fprintf(stderr, "%s exited with status %i\n", argv[1], ret);
+	printf("%i child process(es) created by %s\n", children, argv[1]);
+
+	return (children == 0 && ret == EXIT_SUCCESS) ? EXIT_SUCCESS : EXIT_FAILURE;
+}